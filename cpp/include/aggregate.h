@@ -0,0 +1,285 @@
+#ifndef AGGREGATE_H
+#define AGGREGATE_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <unordered_map>
+#include <stdexcept>
+
+using namespace std;
+
+#include <record.h>
+#include <filter.h>
+#include <chunk.h>
+
+namespace rbf
+{
+
+    /// extra decimals of averages, beyond those of the summed values
+    constexpr unsigned int AVERAGE_DECIMALS = 4;
+
+    /// estimated memory used by a group, on top of its key and aggregate states
+    constexpr size_t GROUP_OVERHEAD = 64;
+
+    /// number of spill files used once the memory limit of an **Aggregator** is reached
+    constexpr size_t SPILL_PARTITIONS = 16;
+
+    /*!
+     * @enum Aggregate
+     * @brief Aggregate functions of an **Aggregator**
+     */
+    enum class Aggregate
+    {
+        COUNT,              ///< number of lines, or of non-blank values when a field is given
+        SUM,                ///< exact sum of the values
+        MIN,                ///< lowest value
+        MAX,                ///< highest value
+        AVG,                ///< average of the values, with **AVERAGE_DECIMALS** more decimals
+    };
+
+    /*!
+     * @struct AggregateState
+     * @brief Running state of an aggregate for a group. It's trivially copyable, so partial tables are
+     * merged and spilled as raw bytes.
+     */
+    struct AggregateState
+    {
+        int64_t count {0};                  ///< number of values
+        int64_t sum {0};                    ///< sum mantissa
+        unsigned int scale {0};             ///< sum scale, the largest one of the values
+        Decimal min;                        ///< lowest value, when count > 0
+        Decimal max;                        ///< highest value, when count > 0
+
+        /*!
+         * @details add a value
+         * @return false if the sum overflows
+         */
+        bool add(const Decimal& value);
+
+        /*!
+         * @details add the values of another state
+         * @return false if the sum overflows
+         */
+        bool merge(const AggregateState& other);
+
+        /*!
+         * @return the value of an aggregate function, 0 when null (see **is_null()**)
+         */
+        Decimal result(Aggregate function) const;
+
+        /*!
+         * @return true for the sum, minimum, maximum and average of a state without any value
+         */
+        inline bool is_null(Aggregate function) const { return count == 0 && function != Aggregate::COUNT; }
+    };
+
+    /*!
+     * @struct GroupResult
+     * @brief Aggregated values of a group
+     */
+    struct GroupResult
+    {
+        vector<string> keys;                ///< value of each key field, blank-stripped
+        vector<Decimal> values;             ///< value of each aggregate, in the order they were added
+        vector<bool> nulls;                 ///< true for an aggregate without any value, e.g. when all are blank
+    };
+
+    /*!
+     * @class Aggregator
+     * @brief A streaming hash aggregation over the lines of a record
+     * @details Lines are grouped by the raw bytes of key fields: keys are never converted, fixed-width fields
+     * being compared byte for byte. Aggregates are computed on numeric fields (INTEGER, DECIMAL, PACKED, ZONED),
+     * decoded straight from the line, and blank values are ignored.
+     *
+     * **run()** splits the input file into chunks aggregated by several threads into partial tables, which are
+     * merged into a single table. When this table outgrows the memory limit, its groups are spilled into
+     * **SPILL_PARTITIONS** temporary files according to their key hash, and each partition is merged on its own
+     * when results are read. A partition which still outgrows the limit is split the same way, using other
+     * bits of the hash.
+     *
+     * **Example**
+     *
+     * @code
+     * Aggregator sums(*layout["PAYM"]);
+     * sums.group_by("ACCOUNT").add(Aggregate::COUNT).add(Aggregate::SUM, "AMOUNT");
+     * sums.run("payments.txt", [](string s) { return s.substr(0,4); });
+     *
+     * sums.for_each_group([](const GroupResult& group) {
+     *     cout << group.keys[0] << ": " << group.values[1].mantissa << endl;
+     * });
+     * @endcode
+     */
+    class Aggregator
+    {
+        private:
+            // a key field or an aggregated field, located in the line
+            struct Column
+            {
+                string name;
+                size_t offset;
+                size_t length;
+                const FieldType *type;
+            };
+
+            // groups by key, each with a state per aggregate
+            using Table = unordered_map<string, vector<AggregateState>>;
+
+            // a spill file, removed once closed
+            using SpillFile = unique_ptr<FILE, int (*)(FILE *)>;
+
+            const Record& _record;              // record whose lines are aggregated
+            vector<Column> _keys;               // key fields
+            vector<Aggregate> _functions;       // aggregate functions
+            vector<Column> _columns;            // aggregated fields, with a 0 length for COUNT of lines
+            const Filter *_filter {nullptr};    // lines aggregated, if not all of them
+            size_t _key_length {0};             // sum of the key field lengths
+            size_t _record_length {0};          // 0 for line-based files
+            char _delimiter {'\n'};
+            size_t _memory_limit {0};           // 0 for no limit
+            Table _table;                       // groups not spilled yet
+            vector<SpillFile> _spills;          // partitions, once the memory limit is reached
+
+            // a field of the record
+            Column column(size_t handle) const;
+
+            // aggregate a line into a table, building its key into a reused string. Return false if it's filtered out.
+            bool update(Table& table, const char *line, size_t len, string& key) const;
+
+            // merge the states of a group into a table
+            void merge(Table& table, const string& key, const AggregateState *states) const;
+
+            // serialize a group: key followed by its states
+            void append(string& out, const string& key, const vector<AggregateState>& states) const;
+
+            // merge serialized groups into a table
+            void load(Table& table, const char *p, size_t size) const;
+
+            // true if a table outgrows the memory limit
+            bool full(const Table& table) const;
+
+            // spill the table once it's too large
+            void check_memory();
+
+            // partition of a group, from other bits of its key hash at each depth
+            size_t partition(const string& key, size_t depth) const;
+
+            // write a table into partitions of a depth, created if needed, and clear it
+            void spill(Table& table, vector<SpillFile>& files, size_t depth) const;
+
+            // call a function with the groups of a partition, spilled again while they don't fit in memory
+            void read(FILE *fp, size_t depth, function <void (const GroupResult&)>& f) const;
+
+            // result of a group
+            GroupResult result(const string& key, const vector<AggregateState>& states) const;
+
+        public:
+            Aggregator() = delete;
+            Aggregator(const Aggregator& other) = delete;
+            Aggregator& operator=(const Aggregator& other) = delete;
+
+            /*!
+             * @brief Aggregator constructor
+             * @param[in] rec record whose lines are aggregated (usually from a **Layout**). It must outlive the aggregator.
+             */
+            explicit Aggregator(const Record& rec): _record{rec} {}
+
+            /*!
+             * @details add a key field. Groups are made of lines whose key fields have the same raw bytes.
+             * @param[in] handle field handle as returned by **Record::handle()**
+             * @throw runtime_error if some lines were already aggregated
+             */
+            Aggregator& group_by(size_t handle);
+            inline Aggregator& group_by(const string& field_name) { return group_by(_record.handle(field_name)); }
+
+            /*!
+             * @details add an aggregate on a numeric field
+             * @param[in] function aggregate function
+             * @param[in] handle field handle as returned by **Record::handle()**
+             * @throw runtime_error if the field is not numeric, or if some lines were already aggregated
+             */
+            Aggregator& add(Aggregate function, size_t handle);
+            inline Aggregator& add(Aggregate function, const string& field_name) { return add(function, _record.handle(field_name)); }
+
+            /*!
+             * @details add a count of lines
+             * @throw runtime_error if the function is not **Aggregate::COUNT**
+             */
+            Aggregator& add(Aggregate function);
+
+            /*!
+             * @details only aggregate lines matching a filter, checked from their raw bytes
+             * @param[in] filter filter on the aggregated record, which must outlive the aggregator
+             * @throw runtime_error if the filter is on another record
+             */
+            void setFilter(const Filter& filter);
+
+            /*!
+             * @details read fixed-length records (without any delimiter) instead of lines
+             * @param[in] length record length in bytes, 0 to read lines
+             */
+            inline void setRecordLength(size_t length) { _record_length = length; }
+
+            /*!
+             * @details change the input line delimiter
+             */
+            inline void setDelimiter(char delimiter) { _delimiter = delimiter; }
+
+            /*!
+             * @details limit the memory used by groups. Once it's reached, groups are spilled into temporary files.
+             * @param[in] bytes estimated memory of all groups, 0 for no limit
+             */
+            inline void setMemoryLimit(size_t bytes) { _memory_limit = bytes; }
+
+            /*!
+             * @return number of groups held in memory
+             */
+            inline size_t size() const { return _table.size(); }
+
+            /*!
+             * @return true if groups were spilled into temporary files
+             */
+            inline bool spilled() const { return !_spills.empty(); }
+
+            /*!
+             * @details aggregate a line of the record, e.g. one read by a **Reader**
+             * @param[in] line raw line
+             * @param[in] len line length
+             * @throw runtime_error if an aggregated field can't be decoded, or if a sum overflows
+             */
+            void update(const char *line, size_t len);
+            inline void update(const string& line) { update(line.data(), line.length()); }
+
+            /*!
+             * @details aggregate all lines of the record in a file, in parallel
+             * @param[in] input_file record-based file, read through a **MappedFile**
+             * @param[in] mapper function returning the record name of a line. It's called by several threads.
+             * @param[in] nb_threads number of threads, 0 for the number of cores
+             * @return number of lines aggregated
+             * @throw runtime_error on any I/O error, if an aggregated field can't be decoded, or if a sum overflows
+             */
+            size_t run(const string& input_file, function <string (string)> mapper, size_t nb_threads = 0);
+
+            /*!
+             * @details call a function with the result of each group, in no particular order. Spilled groups are
+             * read back one partition at a time, and partitions larger than the memory limit are split again.
+             * @param[in] f function called with each **const GroupResult&**
+             */
+            void for_each_group(function <void (const GroupResult&)> f);
+
+            /*!
+             * @return the results of all groups, sorted by key
+             */
+            vector<GroupResult> results();
+
+            /*!
+             * @details remove all groups, keeping key fields and aggregates
+             */
+            void clear();
+    };
+
+}
+
+#endif // AGGREGATE_H
@@ -0,0 +1,96 @@
+#ifndef ARROW_H
+#define ARROW_H
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <stdexcept>
+
+using namespace std;
+
+#include <exporter.h>
+
+namespace rbf
+{
+
+    /// default number of rows of an Arrow record batch
+    constexpr size_t ARROW_BATCH_SIZE = 1 << 16;
+
+    /*!
+     * @class ArrowExporter
+     * @brief Export a record-based file in the Arrow IPC format, one stream per record
+     * @details Each record gets its own output file, holding a schema made of the exported fields, followed by
+     * record batches. Column types are derived from the field **DataType**:
+     *
+     * * STRING and VOID fields are **utf8**: trimmed values are appended to the data buffer, next to their offsets
+     * * INTEGER fields are **int64**
+     * * DECIMAL fields are **float64**
+     * * PACKED and ZONED fields are **decimal128**, scaled by the field type **decimals**
+     * * DATE fields are **date32** (days since 1970-01-01)
+     *
+     * Blank numbers and dates are null. With a code page, text values are converted from ISO-8859-1 to UTF-8.
+     * Without one, bytes which are not UTF-8 are read as ISO-8859-1 too, so **utf8** columns are always valid
+     * (see **append_utf8()**).
+     *
+     * Both IPC formats are written: the streaming format (an end-of-stream marker closes the batches), and the
+     * file format, which adds a footer locating the batches. The IPC metadata (flatbuffers) is encoded in-tree,
+     * so no Arrow library is needed. The input file is read through a **MappedFile**, by a single thread.
+     *
+     * **Example**
+     *
+     * @code
+     * ArrowExporter arrow(layout);
+     * arrow.setColumns("CONT", {});
+     * // writes /tmp/world_COUN.arrows
+     * arrow.run("world_data.txt", "/tmp/world_", [](string s) { return s.substr(0,4); });
+     * @endcode
+     */
+    class ArrowExporter: public Exporter
+    {
+        private:
+            size_t _batch_size {ARROW_BATCH_SIZE};
+            bool _file_format {false};
+
+        public:
+            /*!
+             * @brief ArrowExporter constructor
+             * @param[in] layout layout of the input file
+             */
+            explicit ArrowExporter(Layout& layout): Exporter(layout) {}
+
+            /*!
+             * @details change the maximum number of rows of a record batch, **ARROW_BATCH_SIZE** by default
+             */
+            inline void setBatchSize(size_t rows) {
+                if (rows == 0)
+                    throw invalid_argument("batch size can't be 0");
+                _batch_size = rows;
+            }
+
+            /*!
+             * @details write the IPC file format (**.arrow** files) instead of the streaming format
+             * (**.arrows** files, the default)
+             */
+            inline void setFileFormat(bool file_format) { _file_format = file_format; }
+
+            /*!
+             * @return the encapsulated schema message of a record, as found at the beginning of its stream
+             * @throw runtime_error if the record is not found
+             */
+            string schema(const string& record_name);
+
+            /*!
+             * @details export a whole file. The output of a record is only created when one of its lines is found.
+             * @param[in] input_file file of the layout
+             * @param[in] output_prefix prefix of output files, followed by the record name and **.arrows** (or
+             * **.arrow** for the file format)
+             * @param[in] mapper function returning the record name of a line
+             * @return number of lines exported, skipped ones excluded
+             * @throw runtime_error on any I/O or conversion error, or if a line record is not found
+             */
+            size_t run(const string& input_file, const string& output_prefix, function <string (string)> mapper);
+    };
+
+}
+
+#endif // ARROW_H
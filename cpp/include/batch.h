@@ -0,0 +1,188 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <record.h>
+
+using namespace std;
+
+namespace rbf
+{
+
+    /// default number of lines of a **RecordBatch**
+    constexpr size_t BATCH_SIZE = 1024;
+
+    /*!
+     * @class Selection
+     * @brief A bitmap of the lines of a batch: bit i is set when line i is selected
+     * @details Lines are grouped by 64, one word per group, so predicates can skip whole groups
+     * once none of their lines is selected anymore.
+     */
+    class Selection
+    {
+        private:
+            vector<uint64_t> _words;
+            size_t _size {0};
+
+        public:
+            /*!
+             * @brief Selection constructor
+             * @param[in] size number of lines, all selected
+             */
+            explicit Selection(size_t size = 0) { select_all(size); }
+
+            /*!
+             * @details select all lines
+             * @param[in] size number of lines
+             */
+            void select_all(size_t size);
+
+            /*!
+             * @return number of lines, selected or not
+             */
+            inline size_t size() const { return _size; }
+
+            /*!
+             * @return number of 64-line groups
+             */
+            inline size_t nb_words() const { return _words.size(); }
+
+            /*!
+             * @return bits of a 64-line group
+             */
+            inline uint64_t word(size_t i) const { return _words[i]; }
+            inline uint64_t& word(size_t i) { return _words[i]; }
+
+            /*!
+             * @return true if a line is selected
+             */
+            inline bool test(size_t i) const { return (_words[i / 64] >> (i % 64)) & 1; }
+
+            /*!
+             * @details unselect a line
+             */
+            inline void clear(size_t i) { _words[i / 64] &= ~(uint64_t{1} << (i % 64)); }
+
+            /*!
+             * @return number of selected lines
+             */
+            size_t count() const;
+
+            /*!
+             * @return true if no line is selected
+             */
+            bool none() const;
+
+            /*!
+             * @details call a function with the index of each selected line, in increasing order
+             */
+            template <typename Function>
+                void for_each(Function f) const
+                {
+                    for (size_t w = 0; w < _words.size(); w++)
+                    {
+                        for (auto bits = _words[w]; bits != 0; bits &= bits - 1)
+                        {
+                            f(w * 64 + __builtin_ctzll(bits));
+                        }
+                    }
+                }
+    };
+
+    /*!
+     * @class RecordBatch
+     * @brief Lines of the same record, copied next to each other to be evaluated column by column
+     * @details Each line is copied into a row of the record length, blank-padded when it's shorter and truncated
+     * when it's longer, as **Record::setValue()** does. So a field is found at the same offset of each row, a
+     * fixed stride apart, and predicates (see **Filter::select()**) compare a field of all rows in a tight loop.
+     *
+     * **Example**
+     *
+     * @code
+     * RecordBatch batch(*layout["COUN"]);
+     * Selection selection;
+     * reader.for_each_batch(batch, [&](const RecordBatch& b) {
+     *     filter.select(b, selection);
+     *     selection.for_each([&](size_t i) { cout << b.line(i) << endl; });
+     * });
+     * @endcode
+     */
+    class RecordBatch
+    {
+        private:
+            const Record& _record;              // record of all lines
+            size_t _stride;                     // row length, i.e. record length
+            size_t _capacity;                   // maximum number of lines
+            size_t _size {0};                   // number of lines
+            vector<char> _rows;                 // all rows, followed by a few blanks so 8 bytes can be loaded at once
+            vector<size_t> _lengths;            // line lengths, up to the record length
+
+        public:
+            RecordBatch() = delete;
+
+            /*!
+             * @brief RecordBatch constructor
+             * @param[in] rec record of the lines (usually from a **Layout**). It must outlive the batch.
+             * @param[in] capacity maximum number of lines
+             */
+            RecordBatch(const Record& rec, size_t capacity = BATCH_SIZE);
+
+            /*!
+             * @return record of the lines
+             */
+            inline const Record& record() const { return _record; }
+
+            /*!
+             * @return name of the record of the lines
+             */
+            inline string record_name() const { return _record.name(); }
+
+            /*!
+             * @return number of lines
+             */
+            inline size_t size() const { return _size; }
+
+            /*!
+             * @return maximum number of lines
+             */
+            inline size_t capacity() const { return _capacity; }
+
+            /*!
+             * @return row length, i.e. record length
+             */
+            inline size_t stride() const { return _stride; }
+
+            inline bool empty() const { return _size == 0; }
+            inline bool full() const { return _size == _capacity; }
+
+            /*!
+             * @details remove all lines
+             */
+            inline void clear() { _size = 0; }
+
+            /*!
+             * @details copy a line into the next row
+             * @param[in] line raw line of the record
+             * @param[in] len line length
+             * @throw length_error if the batch is full
+             */
+            void push_back(const char *line, size_t len);
+            inline void push_back(const string& line) { push_back(line.data(), line.length()); }
+
+            /*!
+             * @return a row, of the record length
+             */
+            inline const char *row(size_t i) const { return _rows.data() + i * _stride; }
+
+            /*!
+             * @return a line, up to the record length, without the padding added to its row
+             */
+            inline string line(size_t i) const { return string(row(i), _lengths[i]); }
+    };
+
+}
+
+#endif // BATCH_H
@@ -0,0 +1,155 @@
+#ifndef BINDING_H
+#define BINDING_H
+
+#include <functional>
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+#include <record.h>
+
+using namespace std;
+
+/*!
+ * @brief bind a struct member to the record field having the same name
+ */
+#define RBF_BIND(binding, type, member) (binding).bind(#member, &type::member)
+
+namespace rbf
+{
+
+    /*!
+     * @class Binding
+     * @brief Populate user structs straight from the raw bytes of a record
+     * @tparam T user struct type
+     * @details Struct members are registered against field names of a record once. Field positions
+     * and conversions are then resolved, so populating a struct doesn't involve any **Field** value
+     * nor name lookup. Members can be **string**, **int64_t** (or any other integral type, range-checked),
+     * **double**, **Decimal** or **Date**, and are converted according to the field type.
+     *
+     * **Example**
+     *
+     * @code
+     * struct Country { string NAME; int64_t POPULATION; string capital; };
+     *
+     * Binding<Country> binding(*layout["COUN"]);
+     * RBF_BIND(binding, Country, NAME);
+     * RBF_BIND(binding, Country, POPULATION);
+     * binding.bind("CAPITAL", &Country::capital);
+     *
+     * reader.for_each_bound(binding, [](const Country& c) { cout << c.NAME << endl; });
+     * @endcode
+     */
+    template <typename T>
+        class Binding
+        {
+            private:
+                // a bound member: where to find the field, and how to convert it into the member
+                struct Member
+                {
+                    string field_name;
+                    size_t offset;
+                    size_t length;
+                    function<ConvStatus (const char *, size_t, T&)> assign;
+                    function<void (T&)> clear;
+                };
+
+                const Record& _record;          // record whose fields are bound
+                vector<Member> _members;        // bound members, in registration order
+
+                // types decoded by FieldType
+                template <typename M>
+                    static typename enable_if<!is_integral<M>::value || is_same<M, int64_t>::value, ConvStatus>::type
+                    convert(const FieldType& ft, const char *p, size_t len, M& value)
+                    {
+                        return ft.decode(p, len, value);
+                    }
+
+                // other integral types are decoded as int64_t, then range-checked
+                template <typename M>
+                    static typename enable_if<is_integral<M>::value && !is_same<M, int64_t>::value, ConvStatus>::type
+                    convert(const FieldType& ft, const char *p, size_t len, M& value)
+                    {
+                        int64_t i;
+                        auto status = ft.decode(p, len, i);
+                        if (status != ConvStatus::OK)
+                            return status;
+
+                        bool in_range = is_unsigned<M>::value ?
+                            i >= 0 && static_cast<uint64_t>(i) <= static_cast<uint64_t>(numeric_limits<M>::max()) :
+                            i >= static_cast<int64_t>(numeric_limits<M>::min()) && i <= static_cast<int64_t>(numeric_limits<M>::max());
+                        if (!in_range)
+                            return ConvStatus::OUT_OF_RANGE;
+
+                        value = static_cast<M>(i);
+                        return ConvStatus::OK;
+                    }
+
+            public:
+                Binding() = delete;
+
+                /*!
+                 * @brief Binding constructor
+                 * @param[in] rec record whose fields are bound (usually from a **Layout**). It must outlive the binding.
+                 */
+                Binding(const Record& rec): _record{rec} {}
+
+                /*!
+                 * @details bind a struct member to a field
+                 * @param[in] field_name name of the field (the first one if several fields have the same name)
+                 * @param[in] member pointer to the struct member
+                 * @return the binding itself, to chain calls
+                 * @throw runtime_error if the field is not found in the record
+                 */
+                template <typename M>
+                    Binding& bind(const string& field_name, M T::*member)
+                    {
+                        auto& f = *(_record.begin() + _record.handle(field_name));
+                        auto ft = f.type();
+
+                        _members.push_back(Member{field_name, f.lower_bound(), f.length(),
+                            [ft, member](const char *p, size_t len, T& obj) { return convert(ft, p, len, obj.*member); },
+                            [member](T& obj) { obj.*member = M(); }});
+                        return *this;
+                    }
+
+                /*!
+                 * @details populate a struct from a raw line
+                 * @param[in] line raw line of the bound record
+                 * @param[in] len line length. Fields beyond a short line are considered blank.
+                 * @param[out] obj struct to populate. Blank numerical fields are set to a value-initialized member (0).
+                 * @throw runtime_error if a field can't be converted
+                 */
+                void populate(const char *line, size_t len, T& obj) const
+                {
+                    for (auto& m: _members)
+                    {
+                        auto offset = min(m.offset, len);
+                        auto status = m.assign(line + offset, min(m.length, len - offset), obj);
+
+                        if (status == ConvStatus::EMPTY)
+                            m.clear(obj);
+                        else if (status != ConvStatus::OK)
+                            throw runtime_error("field " + m.field_name + ": " + conv_message(status));
+                    }
+                }
+
+                /*!
+                 * @details populate a struct from a raw line
+                 */
+                inline void populate(const string& line, T& obj) const { populate(line.data(), line.length(), obj); }
+
+                /*!
+                 * @return the name of the bound record
+                 */
+                inline string record_name() const { return _record.name(); }
+
+                /*!
+                 * @return the number of bound members
+                 */
+                inline size_t size() const { return _members.size(); }
+        };
+
+}
+
+#endif // BINDING_H
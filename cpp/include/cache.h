@@ -0,0 +1,234 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <fstream>
+#include <stdexcept>
+
+using namespace std;
+
+#include <layout.h>
+#include <reader.h>
+#include <chunk.h>
+
+namespace rbf
+{
+
+    /// default size limit of a parse cache directory
+    constexpr size_t PARSE_CACHE_SIZE = static_cast<size_t>(1) << 30;
+
+    /// extension of parse cache files
+    constexpr const char *PARSE_CACHE_EXTENSION = ".rbpc";
+
+    /// extension of parse cache files being written
+    constexpr const char *PARSE_CACHE_TEMP_EXTENSION = ".tmp";
+
+    /// seconds after which a temporary file not written anymore is left by a crashed writer, and is evicted
+    constexpr time_t PARSE_CACHE_TEMP_AGE = 3600;
+
+    /// magic number found at both ends of a parse cache file
+    constexpr char PARSE_CACHE_MAGIC[] = "RBFPC02";
+
+    /// FNV-1a initial value
+    constexpr uint64_t FNV_OFFSET = 0xCBF29CE484222325ULL;
+
+    /*!
+     * @brief 64-bit FNV-1a hash
+     * @param[in] p bytes to hash
+     * @param[in] len number of bytes
+     * @param[in] hash previous hash, to chain several calls
+     */
+    uint64_t fnv1a(const char *p, size_t len, uint64_t hash = FNV_OFFSET);
+
+    /*!
+     * @return a hash of the compiled layout: record and field names, positions and types. Descriptions are
+     * not hashed.
+     */
+    uint64_t layout_hash(Layout& layout);
+
+    /*!
+     * @class CacheReader
+     * @brief Lines of a parse cache file, with their record name and field ranges, read through a mapping
+     */
+    class CacheReader
+    {
+        private:
+            MappedFile _file;
+            vector<string> _names;      // record names, by index
+            size_t _pos;                // next line
+            size_t _end;                // end of lines
+
+        public:
+            CacheReader() = delete;
+            CacheReader(const CacheReader& other) = delete;
+            CacheReader& operator=(const CacheReader& other) = delete;
+
+            /*!
+             * @brief CacheReader constructor
+             * @param[in] file_name cache file
+             * @param[in] key key the file must have been written with
+             * @throw runtime_error if the file can't be mapped, is not a cache file or has another key
+             */
+            CacheReader(const string& file_name, const string& key);
+
+            /*!
+             * @details get the next line
+             * @param[out] record_name record name of the line
+             * @param[out] line line, in the mapping
+             * @param[out] length line length
+             * @param[out] bounds blank-stripped range of each field, as given to **Record::setValue()**. It's
+             * empty if the record is not in the layout.
+             * @return false at the end of the file
+             */
+            bool next(const string *&record_name, const char *&line, size_t& length, vector<uint32_t>& bounds);
+    };
+
+    /*!
+     * @class CacheWriter
+     * @brief Write a parse cache file, renamed into place once complete
+     * @details Lines are written to a temporary file with a unique name (**<hash>.XXXXXX.tmp** for
+     * **<hash>.rbpc**), which is removed if the writer is
+     * destroyed before **commit()**, e.g. when a reader doesn't read the whole input file. It's also removed as
+     * soon as it outgrows the size limit, the writer then ignoring other lines.
+     */
+    class CacheWriter
+    {
+        private:
+            ofstream _out;
+            string _file_name;
+            string _temp_name;
+            size_t _max_size;
+            map<string, uint32_t> _names;   // record name indexes
+            uint64_t _offset {0};
+            bool _committed {false};
+            bool _dropped {false};          // true once the file outgrew the size limit
+
+            void write(const char *p, size_t len);
+
+            // remove the temporary file
+            void drop();
+
+        public:
+            CacheWriter() = delete;
+            CacheWriter(const CacheWriter& other) = delete;
+            CacheWriter& operator=(const CacheWriter& other) = delete;
+
+            /*!
+             * @brief CacheWriter constructor
+             * @param[in] file_name cache file
+             * @param[in] key key of the cache file, checked when read
+             * @param[in] max_size size limit of the cache file
+             * @throw runtime_error if the temporary file can't be created
+             */
+            CacheWriter(const string& file_name, const string& key, size_t max_size);
+
+            // dtor
+            ~CacheWriter();
+
+            /*!
+             * @details add a line
+             * @param[in] record_name record name of the line
+             * @param[in] line line, as read
+             * @param[in] bounds blank-stripped range of each field, empty if the record is not in the layout
+             */
+            void add(const string& record_name, const string& line, const vector<uint32_t>& bounds);
+
+            /*!
+             * @details write the record names, and rename the file into place unless it outgrew the size limit
+             * @throw runtime_error on any I/O error
+             */
+            void commit();
+    };
+
+    /*!
+     * @class ParseCache
+     * @brief A directory of parse results, shared by readers
+     * @details A cache file holds the lines of an input file, as read by a **Reader** (i.e. split and transcoded),
+     * each one with its record name and the blank-stripped range of its fields. When a reader finds the file of
+     * its input, lines are served from it: the input file is not read, neither transcoded nor mapped, and fields
+     * are set without being scanned. Otherwise, the cache file is written while reading, and committed once the
+     * input file is read to the end.
+     *
+     * Cache files are keyed by:
+     *
+     * * the input file identity: device, inode, size and modification time
+     * * a hash of the layout (see **layout_hash()**)
+     * * the reader settings: record length, delimiter, code page
+     * * a tag identifying the mapper, given to **Reader::setCache()**, as the mapper code itself can't be hashed
+     *
+     * Files are evicted once their total size is above the limit, the least recently used first. Temporary
+     * files count toward the limit: those left by a crashed writer (see **PARSE_CACHE_TEMP_AGE**) are evicted,
+     * those being written are kept.
+     *
+     * **Example**
+     *
+     * @code
+     * ParseCache cache("/var/cache/rbf", 10 << 30);
+     * Reader reader("world_data.txt", layout, [](string s) { return s.substr(0,4); });
+     * reader.setCache(&cache, "substr(0,4)");
+     * for (auto& rec: reader) { ... }
+     * @endcode
+     */
+    class ParseCache
+    {
+        private:
+            string _directory;
+            size_t _max_size;
+
+        public:
+            ParseCache() = delete;
+            ParseCache(const ParseCache& other) = delete;
+            ParseCache& operator=(const ParseCache& other) = delete;
+
+            /*!
+             * @brief ParseCache constructor
+             * @param[in] directory cache directory, created if needed
+             * @param[in] max_size size limit of cache files
+             * @throw runtime_error if the directory can't be created
+             */
+            explicit ParseCache(const string& directory, size_t max_size = PARSE_CACHE_SIZE);
+
+            inline const string& directory() const { return _directory; }
+            inline size_t max_size() const { return _max_size; }
+
+            /*!
+             * @return the key of the input file of a reader, with its settings
+             * @throw runtime_error if the input file is not found
+             */
+            string key(ReaderData& rdata) const;
+
+            /*!
+             * @return the cache file of a key
+             */
+            string file_name(const string& key) const;
+
+            /*!
+             * @details find the cache file of a key, and mark it as recently used
+             * @return a reader on the cache file, or **nullptr** if not found
+             */
+            unique_ptr<CacheReader> lookup(const string& key) const;
+
+            /*!
+             * @return a writer of the cache file of a key, dropping it if it gets larger than the cache size limit
+             */
+            unique_ptr<CacheWriter> populate(const string& key) const;
+
+            /*!
+             * @return the total size of cache files
+             */
+            size_t size() const;
+
+            /*!
+             * @details remove the least recently used cache files, until their total size is within the limit
+             */
+            void evict() const;
+    };
+
+}
+
+#endif // CACHE_H
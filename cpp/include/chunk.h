@@ -0,0 +1,175 @@
+#ifndef CHUNK_H
+#define CHUNK_H
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <exception>
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+namespace rbf
+{
+
+    /// input bytes processed by a thread at once
+    constexpr size_t CHUNK_SIZE = 1 << 22;
+
+    /*!
+     * @class MappedFile
+     * @brief A read-only mapping of a whole file
+     * @details Lines are found and processed directly from the mapping, so input files are read without
+     * any copy into a buffer.
+     */
+    class MappedFile
+    {
+        private:
+            const char *_data {nullptr};
+            size_t _size {0};
+
+        public:
+            MappedFile() = delete;
+            MappedFile(const MappedFile& other) = delete;
+            MappedFile& operator=(const MappedFile& other) = delete;
+
+            /*!
+             * @brief MappedFile constructor
+             * @param[in] file_name file to map
+             * @throw runtime_error if the file can't be opened or mapped
+             */
+            explicit MappedFile(const string& file_name);
+
+            // dtor
+            ~MappedFile();
+
+            /*!
+             * @return a pointer on the first byte of the file, **nullptr** for an empty file
+             */
+            inline const char *data() const { return _data; }
+
+            /*!
+             * @return the file size
+             */
+            inline size_t size() const { return _size; }
+    };
+
+    /*!
+     * @details call **f(line, length, next)** for each line of a buffer, **next** being the number of bytes up to the
+     * next line (i.e. including the delimiter, if any)
+     * @param[in] p buffer
+     * @param[in] size buffer size
+     * @param[in] record_length fixed record length, or 0 for lines ended by **delimiter**
+     * @param[in] delimiter line delimiter
+     * @param[in] f function called with each line
+     */
+    template <typename Function>
+        void for_each_raw_line(const char *p, size_t size, size_t record_length, char delimiter, Function f)
+        {
+            for (size_t pos = 0; pos < size; )
+            {
+                auto line = p + pos;
+                auto left = size - pos;
+                size_t length, next;
+
+                if (record_length != 0)
+                {
+                    length = min(record_length, left);
+                    next = length;
+                }
+                else
+                {
+                    auto end = static_cast<const char *>(memchr(line, delimiter, left));
+                    length = end ? static_cast<size_t>(end - line) : left;
+                    next = end ? length + 1 : length;
+                }
+
+                f(line, length, next);
+                pos += next;
+            }
+        }
+
+    /*!
+     * @details split a buffer into chunks of whole lines, process chunks in parallel and consume their outputs
+     * in order. At most **nb_threads** chunks are processed at once, so memory use is bounded whatever the
+     * buffer size.
+     * @param[in] p buffer, usually a **MappedFile**
+     * @param[in] size buffer size
+     * @param[in] record_length fixed record length, or 0 for lines ended by **delimiter**
+     * @param[in] delimiter line delimiter
+     * @param[in] nb_threads number of threads, 0 for the number of cores
+     * @param[in] process function called as **process(const char *chunk, size_t size, string& out)**, returning the
+     * number of lines processed. It's called by several threads.
+     * @param[in] consume function called with each **const string&** output, in the chunks order
+     * @param[in] chunk_size approximate chunk size
+     * @return number of lines processed
+     * @throw the first exception thrown by **process**, or any exception thrown by **consume**
+     */
+    template <typename Process, typename Consume>
+        size_t process_chunks(const char *p, size_t size, size_t record_length, char delimiter, size_t nb_threads,
+            Process process, Consume consume, size_t chunk_size = CHUNK_SIZE)
+        {
+            if (nb_threads == 0)
+                nb_threads = max(1u, thread::hardware_concurrency());
+
+            // a whole number of fixed-length records
+            if (record_length != 0)
+                chunk_size = max(record_length, chunk_size - chunk_size % record_length);
+
+            vector<string> outputs(nb_threads);
+            vector<size_t> counts(nb_threads);
+            vector<exception_ptr> errors(nb_threads);
+            size_t nb_lines = 0;
+
+            for (size_t pos = 0; pos < size; )
+            {
+                // next chunks of whole lines
+                vector<pair<size_t, size_t>> chunks;
+                while (pos < size && chunks.size() < nb_threads)
+                {
+                    auto end = min(pos + chunk_size, size);
+                    if (record_length == 0 && end < size)
+                    {
+                        auto found = static_cast<const char *>(memchr(p + end, delimiter, size - end));
+                        end = found ? static_cast<size_t>(found - p) + 1 : size;
+                    }
+                    chunks.emplace_back(pos, end - pos);
+                    pos = end;
+                }
+
+                auto work = [&](size_t i) {
+                    try
+                    {
+                        outputs[i].clear();
+                        counts[i] = process(p + chunks[i].first, chunks[i].second, outputs[i]);
+                    }
+                    catch (...)
+                    {
+                        errors[i] = current_exception();
+                    }
+                };
+
+                // current thread takes the first chunk
+                vector<thread> threads;
+                for (size_t i = 1; i < chunks.size(); i++)
+                {
+                    threads.emplace_back(work, i);
+                }
+                work(0);
+                for (auto& th: threads) th.join();
+
+                for (size_t i = 0; i < chunks.size(); i++)
+                {
+                    if (errors[i])
+                        rethrow_exception(errors[i]);
+                    consume(static_cast<const string&>(outputs[i]));
+                    nb_lines += counts[i];
+                }
+            }
+
+            return nb_lines;
+        }
+
+}
+
+#endif // CHUNK_H
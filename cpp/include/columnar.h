@@ -0,0 +1,353 @@
+#ifndef COLUMNAR_H
+#define COLUMNAR_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <stdexcept>
+
+using namespace std;
+
+#include <record.h>
+#include <reader.h>
+#include <chunk.h>
+
+namespace rbf
+{
+
+    /// default number of rows of a columnar block
+    constexpr size_t COLUMNAR_BLOCK_ROWS = 1 << 16;
+
+    /// magic number found at both ends of a columnar file
+    constexpr char COLUMNAR_MAGIC[] = "RBFCOL1";
+
+    /*!
+     * @enum ColumnType
+     * @brief How values of a column are stored, derived from the field **DataType**
+     */
+    enum class ColumnType: uint8_t
+    {
+        BYTES,              ///< STRING and VOID fields: raw values, as a fixed-width slab
+        INT64,              ///< INTEGER fields
+        FIXED,              ///< DECIMAL, PACKED and ZONED fields: int64 mantissas, with a scale per block
+        DAYS,               ///< DATE fields: days since 1970-01-01
+    };
+
+    /*!
+     * @enum ColumnEncoding
+     * @brief Compression of a column block
+     */
+    enum class ColumnEncoding: uint8_t
+    {
+        PLAIN,              ///< values as-is: int64_t values or the byte slab, read in place
+        DICTIONARY,         ///< distinct byte values, followed by a uint8_t or uint16_t code per row
+        RLE,                ///< int64_t run values, followed by uint32_t run lengths
+        DELTA,              ///< first int64_t value, followed by int8_t, int16_t or int32_t differences
+    };
+
+    /*!
+     * @struct ColumnEntry
+     * @brief A column of a columnar file, as stored in its footer
+     */
+    struct ColumnEntry
+    {
+        uint32_t name_offset;           ///< offset of the column name in the name table
+        uint32_t name_length;
+        uint32_t width;                 ///< field length, i.e. bytes per value of a BYTES column
+        ColumnType type;
+        uint8_t padding[3];
+    };
+
+    /*!
+     * @struct ColumnChunk
+     * @brief Values of a column for a block of rows, as indexed in the footer of a columnar file
+     * @details Chunk data is made of a null bitmap when **null_count** is not 0 (a bit set per null value,
+     * padded to 8 bytes), followed by encoded values. Null values are stored as blanks, or repeat the previous
+     * numeric value so that they don't break RLE runs nor DELTA differences.
+     */
+    struct ColumnChunk
+    {
+        uint64_t offset;                ///< data offset in the file, 8-byte aligned
+        uint64_t size;                  ///< data size
+        int64_t min;                    ///< smallest non-null value of numeric columns
+        int64_t max;                    ///< largest non-null value of numeric columns
+        uint32_t rows;
+        uint32_t null_count;
+        uint32_t count;                 ///< number of RLE runs or dictionary values
+        ColumnEncoding encoding;
+        uint8_t width;                  ///< DELTA difference size, or DICTIONARY code size
+        uint16_t scale;                 ///< number of decimals of a FIXED block
+    };
+
+    /*!
+     * @struct ColumnarFooter
+     * @brief Index of a columnar file, found just before its ending magic number
+     */
+    struct ColumnarFooter
+    {
+        uint64_t rows;
+        uint64_t block_rows;            ///< rows per block, the last one excepted
+        uint64_t names_offset;          ///< name table: record name, then column names
+        uint64_t columns_offset;        ///< **ColumnEntry** array
+        uint64_t chunks_offset;         ///< **ColumnChunk** array, block by block
+        uint32_t nb_columns;
+        uint32_t nb_blocks;
+        uint32_t record_name_length;
+        uint32_t padding;
+    };
+
+    /*!
+     * @class ColumnarWriter
+     * @brief Write the lines of a record into a columnar file
+     * @details Rows are gathered into blocks. Each column of a block is stored with the smallest encoding
+     * among **PLAIN** and, for BYTES columns, **DICTIONARY**, or **RLE** and **DELTA** for numeric ones.
+     * Blocks are followed by the footer, indexing all chunks. A file is made of:
+     *
+     * * **COLUMNAR_MAGIC**, on 8 bytes
+     * * chunk data, 8-byte aligned
+     * * the name table, the **ColumnEntry** array and the **ColumnChunk** array
+     * * the **ColumnarFooter**, followed by **COLUMNAR_MAGIC**
+     *
+     * Integers are stored in the host order, which must be little-endian.
+     */
+    class ColumnarWriter
+    {
+        private:
+            // values of a column in the current block
+            struct ColumnBuffer
+            {
+                ColumnType type;
+                string bytes;               // BYTES values
+                vector<int64_t> values;     // numeric values
+                vector<unsigned int> scales;// FIXED values scale
+                string nulls;               // null bitmap
+                size_t null_count {0};
+            };
+
+            ofstream _out;
+            string _file_name;
+            string _record_name;
+            size_t _block_rows;
+            size_t _rows {0};               // rows written
+            size_t _block_size {0};         // rows of the current block
+            uint64_t _offset {0};           // current file offset
+            vector<ColumnEntry> _columns;
+            vector<ColumnChunk> _chunks;
+            string _names;
+            vector<ColumnBuffer> _buffers;
+            bool _closed {false};
+
+            void write(const string& s);
+            void flush();
+            void write_chunk(size_t column);
+
+        public:
+            ColumnarWriter() = delete;
+            ColumnarWriter(const ColumnarWriter& other) = delete;
+            ColumnarWriter& operator=(const ColumnarWriter& other) = delete;
+
+            /*!
+             * @brief ColumnarWriter constructor
+             * @param[in] file_name file created or truncated
+             * @param[in] rec record of the written lines, defining the columns
+             * @param[in] block_rows number of rows of a block
+             * @throw runtime_error if the file can't be created
+             */
+            ColumnarWriter(const string& file_name, const Record& rec, size_t block_rows = COLUMNAR_BLOCK_ROWS);
+
+            // dtor
+            ~ColumnarWriter();
+
+            /*!
+             * @details add a line, from the raw values of a record with the same fields
+             * @throw runtime_error if a numeric value can't be converted. Blank values are null.
+             */
+            void append(const Record& rec);
+
+            /*!
+             * @details write the last block and the footer
+             */
+            void close();
+    };
+
+    /*!
+     * @brief convert all records read by a **Reader** into columnar files, one per record
+     * @param[in] reader any reader, already set up
+     * @param[in] output_prefix prefix of output files, followed by the record name and **.rbc**
+     * @param[in] block_rows number of rows of a block
+     * @return number of lines converted
+     * @throw runtime_error on any I/O or conversion error
+     *
+     * @code
+     * Reader reader("world_data.txt", layout, [](string s) { return s.substr(0,4); });
+     * // writes /tmp/world_CONT.rbc and /tmp/world_COUN.rbc
+     * write_columnar(reader, "/tmp/world_");
+     * @endcode
+     */
+    size_t write_columnar(Reader& reader, const string& output_prefix, size_t block_rows = COLUMNAR_BLOCK_ROWS);
+
+    /*!
+     * @class ColumnarFile
+     * @brief A columnar file, read through a mapping
+     * @details The footer is used in place, without any deserialization: PLAIN blocks are read directly from the
+     * mapping, other blocks are decoded into a buffer given by the caller.
+     *
+     * **Example**
+     *
+     * @code
+     * ColumnarFile countries("/tmp/world_COUN.rbc");
+     * int64_t total = 0;
+     * countries.for_each<int64_t>("POPULATION", [&](size_t row, int64_t population) { total += population; });
+     * @endcode
+     */
+    class ColumnarFile
+    {
+        private:
+            MappedFile _file;
+            const ColumnarFooter *_footer;
+            const ColumnEntry *_columns;
+            const ColumnChunk *_chunks;
+            const char *_names;
+
+            // encoded values of a chunk, after its null bitmap
+            const char *chunk_values(const ColumnChunk& chunk) const;
+
+            // value conversions, according to the column type
+            static void convert(int64_t value, unsigned int scale, int64_t& out) { (void)scale; out = value; }
+            static void convert(int64_t value, unsigned int scale, Decimal& out) { out = Decimal{value, scale}; }
+            static void convert(int64_t value, unsigned int scale, double& out) { out = Decimal{value, scale}.to_double(); }
+            static void convert(int64_t value, unsigned int scale, Date& out) { (void)scale; out.days = static_cast<int32_t>(value); }
+
+            // loop through numeric or BYTES columns
+            template <typename T, typename Function>
+                void each(size_t column, Function f, T *) const;
+            template <typename Function>
+                void each(size_t column, Function f, string *) const;
+
+        public:
+            ColumnarFile() = delete;
+            ColumnarFile(const ColumnarFile& other) = delete;
+            ColumnarFile& operator=(const ColumnarFile& other) = delete;
+
+            /*!
+             * @brief ColumnarFile constructor
+             * @param[in] file_name file written by a **ColumnarWriter**
+             * @throw runtime_error if the file can't be mapped or is not a columnar file
+             */
+            explicit ColumnarFile(const string& file_name);
+
+            /*!
+             * @return the name of the record whose lines are stored
+             */
+            inline string record_name() const { return string(_names, _footer->record_name_length); }
+
+            inline size_t rows() const { return _footer->rows; }
+            inline size_t nb_columns() const { return _footer->nb_columns; }
+            inline size_t nb_blocks() const { return _footer->nb_blocks; }
+
+            /*!
+             * @return the column at index i
+             */
+            inline const ColumnEntry& column(size_t i) const { return _columns[i]; }
+
+            /*!
+             * @return the name of the column at index i
+             */
+            inline string column_name(size_t i) const { return string(_names + _columns[i].name_offset, _columns[i].name_length); }
+
+            /*!
+             * @return the index of the first column with this name
+             * @throw runtime_error if not found
+             */
+            size_t column_index(const string& name) const;
+
+            /*!
+             * @return the index entry of a column block
+             */
+            inline const ColumnChunk& chunk(size_t block, size_t column) const { return _chunks[block * _footer->nb_columns + column]; }
+
+            /*!
+             * @return the null bitmap of a column block (a bit set per null value), **nullptr** without nulls
+             */
+            const unsigned char *nulls(size_t block, size_t column) const;
+
+            /*!
+             * @details values of a numeric column block: mantissas for FIXED columns, days for DATE ones
+             * @param[out] buffer used when the block must be decoded
+             * @return a pointer on the values, in the mapping for PLAIN blocks
+             * @throw runtime_error if the column is a BYTES one
+             */
+            const int64_t *int64_values(size_t block, size_t column, vector<int64_t>& buffer) const;
+
+            /*!
+             * @details values of a BYTES column block, **column(i).width** bytes each
+             * @param[out] buffer used when the block must be decoded
+             * @return a pointer on the values, in the mapping for PLAIN blocks
+             * @throw runtime_error if the column is a numeric one
+             */
+            const char *byte_values(size_t block, size_t column, string& buffer) const;
+
+            /*!
+             * @details call **f(row, value)** for each non-null value of a column
+             * @tparam T **string** (blank-stripped) for BYTES columns; **int64_t** (stored values, i.e. mantissas
+             * of FIXED columns), **Decimal**, **double** or **Date** for numeric ones
+             * @throw runtime_error if the column is not found, or if its type doesn't match **T**
+             */
+            template <typename T, typename Function>
+                void for_each(const string& name, Function f) const { each(column_index(name), f, static_cast<T *>(nullptr)); }
+    };
+
+    template <typename T, typename Function>
+        void ColumnarFile::each(size_t column, Function f, T *) const
+        {
+            vector<int64_t> buffer;
+            size_t row = 0;
+
+            for (size_t block = 0; block < nb_blocks(); block++)
+            {
+                auto& c = chunk(block, column);
+                auto values = int64_values(block, column, buffer);
+                auto nulls = this->nulls(block, column);
+
+                T value;
+                for (size_t j = 0; j < c.rows; j++)
+                {
+                    if (nulls && (nulls[j / 8] >> (j % 8)) & 1)
+                        continue;
+                    convert(values[j], c.scale, value);
+                    f(row + j, static_cast<const T&>(value));
+                }
+                row += c.rows;
+            }
+        }
+
+    template <typename Function>
+        void ColumnarFile::each(size_t column, Function f, string *) const
+        {
+            string buffer, value;
+            size_t width = _columns[column].width;
+            size_t row = 0;
+
+            for (size_t block = 0; block < nb_blocks(); block++)
+            {
+                auto& c = chunk(block, column);
+                auto values = byte_values(block, column, buffer);
+
+                for (size_t j = 0; j < c.rows; j++)
+                {
+                    // blank-stripped, as Field::value()
+                    auto p = values + j * width;
+                    auto len = width;
+                    while (len > 0 && *p == ' ') { p++; len--; }
+                    while (len > 0 && p[len-1] == ' ') len--;
+                    value.assign(p, len);
+                    f(row + j, static_cast<const string&>(value));
+                }
+                row += c.rows;
+            }
+        }
+
+}
+
+#endif // COLUMNAR_H
@@ -0,0 +1,317 @@
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <stdexcept>
+
+using namespace std;
+
+#include <chunk.h>
+
+namespace rbf
+{
+
+    /// default uncompressed size of a block
+    constexpr size_t COMPRESSED_BLOCK_SIZE = 1 << 21;
+
+    /// magic number found at both ends of a block-compressed file
+    constexpr char BLOCK_FILE_MAGIC[] = "RBFBLK1";
+
+    /// size of the buffers of uncompressed bytes read from a gzip or zstd stream
+    constexpr size_t STREAM_BUFFER_SIZE = 1 << 20;
+
+    /// largest zstd frame decompressed at once by a thread: larger frames are streamed
+    constexpr size_t ZSTD_FRAME_LIMIT = 1 << 26;
+
+    /// number of buffers decompressed ahead of the parsing thread
+    constexpr size_t PIPELINE_DEPTH = 4;
+
+    /*!
+     * @enum InputFormat
+     * @brief Format of an input file, found from its first bytes
+     */
+    enum class InputFormat
+    {
+        PLAIN,              ///< uncompressed
+        BLOCKS,             ///< block-compressed file, see **compress_file()**
+        GZIP,               ///< gzip, possibly made of several members
+        ZSTD,               ///< Zstandard, possibly made of several frames
+    };
+
+    /*!
+     * @return the format of a file, **PLAIN** if it can't be read
+     */
+    InputFormat input_format(const string& file_name);
+
+    /*!
+     * @enum Codec
+     * @brief Compression of the blocks of a block-compressed file
+     * @details Codecs depend on the libraries found when building: **DEFLATE** needs zlib (**RBF_HAVE_ZLIB**),
+     * **ZSTD** needs libzstd (**RBF_HAVE_ZSTD**).
+     */
+    enum class Codec: uint8_t
+    {
+        NONE,               ///< stored as-is
+        DEFLATE,            ///< zlib format
+        ZSTD,               ///< Zstandard frames
+    };
+
+    /*!
+     * @return true if a codec is available in this build
+     */
+    bool codec_available(Codec codec);
+
+    /*!
+     * @return the best available codec: ZSTD, then DEFLATE, then NONE
+     */
+    Codec default_codec();
+
+    /*!
+     * @details compress a buffer
+     * @param[in] codec codec
+     * @param[in] p buffer
+     * @param[in] len buffer size
+     * @param[out] out compressed data, replacing its content
+     * @throw runtime_error if the codec is not available or fails
+     */
+    void compress_block(Codec codec, const char *p, size_t len, string& out);
+
+    /*!
+     * @details decompress a buffer
+     * @param[in] codec codec
+     * @param[in] p compressed data
+     * @param[in] len compressed size
+     * @param[in] raw_size uncompressed size
+     * @param[out] out uncompressed data, replacing its content
+     * @throw runtime_error if the codec is not available or the data is corrupted
+     */
+    void decompress_block(Codec codec, const char *p, size_t len, size_t raw_size, string& out);
+
+    /*!
+     * @struct BlockEntry
+     * @brief A block of a block-compressed file, as indexed in its footer
+     */
+    struct BlockEntry
+    {
+        uint64_t offset;                ///< compressed data offset in the file
+        uint64_t first_record;          ///< number of the first record of the block, from 0
+        uint32_t size;                  ///< compressed size
+        uint32_t raw_size;              ///< uncompressed size
+    };
+
+    /*!
+     * @struct BlockFooter
+     * @brief Index of a block-compressed file, found just before its ending magic number
+     */
+    struct BlockFooter
+    {
+        uint64_t index_offset;          ///< **BlockEntry** array
+        uint64_t nb_blocks;
+        uint64_t nb_records;
+        uint64_t record_length;         ///< fixed record length, or 0 for lines
+        Codec codec;
+        char delimiter;                 ///< line delimiter
+        uint8_t padding[6];
+    };
+
+    /*!
+     * @class ByteSource
+     * @brief Successive buffers of uncompressed bytes, read by a **Reader** instead of its input file
+     */
+    class ByteSource
+    {
+        public:
+            virtual ~ByteSource() = default;
+
+            /*!
+             * @details get the next buffer
+             * @param[out] buffer next bytes, replacing its content
+             * @return false at the end of the input
+             */
+            virtual bool next(string& buffer) = 0;
+    };
+
+    /*!
+     * @class BlockFile
+     * @brief A block-compressed file, read through a mapping
+     * @details Such a file is made of whole records grouped into blocks, compressed independently and indexed
+     * by record number, so a block can be read without reading the previous ones:
+     *
+     * * **BLOCK_FILE_MAGIC**, on 8 bytes
+     * * compressed blocks
+     * * the **BlockEntry** array
+     * * the **BlockFooter**, followed by **BLOCK_FILE_MAGIC**
+     *
+     * A **Reader** recognizes such files, and reads them directly.
+     */
+    class BlockFile
+    {
+        private:
+            MappedFile _file;
+            const BlockFooter *_footer;
+            const BlockEntry *_index;
+
+        public:
+            BlockFile() = delete;
+            BlockFile(const BlockFile& other) = delete;
+            BlockFile& operator=(const BlockFile& other) = delete;
+
+            /*!
+             * @brief BlockFile constructor
+             * @param[in] file_name block-compressed file
+             * @throw runtime_error if the file can't be mapped or is not a block-compressed file
+             */
+            explicit BlockFile(const string& file_name);
+
+            /*!
+             * @return true if a file starts like a block-compressed file
+             */
+            static bool is_block_file(const string& file_name);
+
+            inline size_t nb_blocks() const { return _footer->nb_blocks; }
+            inline size_t nb_records() const { return _footer->nb_records; }
+            inline size_t record_length() const { return _footer->record_length; }
+            inline char delimiter() const { return _footer->delimiter; }
+            inline Codec codec() const { return _footer->codec; }
+
+            /*!
+             * @return the index entry of a block
+             */
+            inline const BlockEntry& block(size_t i) const { return _index[i]; }
+
+            /*!
+             * @return the block holding a record
+             * @throw out_of_range if there's no such record
+             */
+            size_t find_block(size_t record_number) const;
+
+            /*!
+             * @details decompress a block. It can be called by several threads at once.
+             * @param[in] i block number
+             * @param[out] out uncompressed block
+             */
+            void read_block(size_t i, string& out) const;
+    };
+
+    /*!
+     * @class BlockSource
+     * @brief Blocks of a block-compressed file, decompressed ahead by several threads
+     * @details While a block is parsed, the next ones are decompressed in parallel, so decompression and
+     * parsing overlap.
+     */
+    class BlockSource: public ByteSource
+    {
+        private:
+            shared_ptr<BlockFile> _file;
+            size_t _next;                           // next block to decompress
+            size_t _nb_threads;
+            deque<future<string>> _pending;         // blocks being decompressed, in order, waited for when destroyed
+
+            // start decompressing the next blocks
+            void prefetch();
+
+        public:
+            /*!
+             * @brief BlockSource constructor
+             * @param[in] file block-compressed file
+             * @param[in] first_block first block to read
+             * @param[in] nb_threads number of blocks decompressed at once, 0 for the number of cores
+             */
+            BlockSource(shared_ptr<BlockFile> file, size_t first_block = 0, size_t nb_threads = 0);
+
+            bool next(string& buffer) override;
+    };
+
+    /*!
+     * @class PipelinedSource
+     * @brief Buffers of another source, read ahead by a thread
+     * @details The other source is read by a thread of its own, up to a few buffers ahead, so that
+     * decompression and parsing run on different cores.
+     */
+    class PipelinedSource: public ByteSource
+    {
+        private:
+            unique_ptr<ByteSource> _source;
+            size_t _depth;
+            mutex _mutex;
+            condition_variable _changed;
+            deque<string> _buffers;                 // buffers read ahead
+            bool _done {false};                     // true once the source is read to the end
+            bool _stopped {false};                  // true once the reading thread must stop
+            exception_ptr _error;                   // thrown by the source
+            thread _thread;
+
+            // reading thread
+            void run();
+
+        public:
+            PipelinedSource() = delete;
+            PipelinedSource(const PipelinedSource& other) = delete;
+            PipelinedSource& operator=(const PipelinedSource& other) = delete;
+
+            /*!
+             * @brief PipelinedSource constructor
+             * @param[in] source source read by the thread
+             * @param[in] depth number of buffers read ahead
+             */
+            explicit PipelinedSource(unique_ptr<ByteSource> source, size_t depth = PIPELINE_DEPTH);
+
+            // stop the reading thread
+            ~PipelinedSource();
+
+            /*!
+             * @throw the exception thrown by the source, if any
+             */
+            bool next(string& buffer) override;
+    };
+
+    /*!
+     * @brief open the source of uncompressed bytes of a compressed file
+     * @details Formats are handled as follows, each one being read by threads of its own:
+     *
+     * * **BLOCKS**: blocks are decompressed in parallel (see **BlockSource**)
+     * * **GZIP**: the stream is decompressed by a single thread, in a pipeline (see **PipelinedSource**).
+     *   Concatenated members are read one after the other.
+     * * **ZSTD**: frames are decompressed in parallel, e.g. for files written by **pzstd** or in the
+     *   seekable format, whose skippable frames are skipped. Files of a single frame, such as those written
+     *   by **zstd -T0**, are decompressed by one thread. From the first frame whose size is unknown or
+     *   above **ZSTD_FRAME_LIMIT**, the rest of the file is streamed by a single thread.
+     *
+     * @param[in] file_name compressed file
+     * @param[in] nb_threads number of blocks or frames decompressed at once, 0 for the number of cores
+     * @return a source, or **nullptr** for a **PLAIN** file
+     * @throw runtime_error if the file can't be read, or if its compression library is not available
+     */
+    shared_ptr<ByteSource> open_source(const string& file_name, size_t nb_threads = 0);
+
+    /*!
+     * @brief convert a record-based file into a block-compressed file. Blocks are compressed by several threads.
+     * @param[in] input_file record-based file
+     * @param[in] output_file file created or truncated
+     * @param[in] record_length fixed record length, or 0 for lines
+     * @param[in] delimiter line delimiter
+     * @param[in] codec block codec
+     * @param[in] block_size approximate uncompressed size of a block
+     * @param[in] nb_threads number of threads, 0 for the number of cores
+     * @return number of records
+     * @throw runtime_error on any I/O error, or if the codec is not available
+     *
+     * @code
+     * compress_file("world_data.txt", "world_data.rbz");
+     * Reader reader("world_data.rbz", layout, [](string s) { return s.substr(0,4); });
+     * @endcode
+     */
+    size_t compress_file(const string& input_file, const string& output_file, size_t record_length = 0, char delimiter = '\n',
+        Codec codec = default_codec(), size_t block_size = COMPRESSED_BLOCK_SIZE, size_t nb_threads = 0);
+
+}
+
+#endif // COMPRESS_H
@@ -0,0 +1,233 @@
+/**
+ * @file Conversion routines from raw field bytes to typed values
+ */
+#ifndef CONVERT_H
+#define CONVERT_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+using namespace std;
+
+namespace rbf
+{
+
+    /*!
+     * @enum ConvStatus
+     * @brief Outcome of a conversion from raw field bytes to a typed value
+     */
+    enum class ConvStatus
+    {
+        OK,                 ///< conversion succeeded
+        EMPTY,              ///< field is only made of blanks
+        BAD_DIGIT,          ///< a non-digit character was found
+        OUT_OF_RANGE,       ///< value doesn't fit into the target type
+    };
+
+    /*!
+     * @struct Decimal
+     * @brief Exact fixed-point value: **mantissa** * 10^-**scale**
+     *
+     * @code
+     * Decimal d;
+     * parse_decimal("  29.50 ", 8, 0, d);
+     * assert(d.mantissa == 2950 && d.scale == 2);
+     * @endcode
+     */
+    struct Decimal
+    {
+        int64_t mantissa {0};           ///< all significant digits, with sign
+        unsigned int scale {0};         ///< number of digits after the decimal point
+
+        /*!
+         * @return the closest double to the exact value (correctly rounded)
+         */
+        double to_double() const;
+    };
+
+    /*!
+     * @brief convert a fixed-width, blank-padded field into a signed 64-bit integer
+     * @details Leading and trailing blanks are skipped, an optional leading sign (**+** or **-**)
+     * is accepted. Digits are consumed 8 at a time (SWAR) directly from the raw bytes, without
+     * any intermediate string.
+     * @param[in] p pointer on the first byte of the field
+     * @param[in] len field length
+     * @param[out] value converted value (only meaningful when **ConvStatus::OK** is returned)
+     * @return conversion status
+     *
+     * @code
+     * int64_t i;
+     * assert(parse_integer("   -1234  ", 10, i) == ConvStatus::OK);
+     * assert(i == -1234);
+     * @endcode
+     */
+    ConvStatus parse_integer(const char *p, size_t len, int64_t& value);
+
+    /*!
+     * @brief convert a run of ASCII digits (no sign, no blanks) into an unsigned integer
+     * @param[in] p pointer on the first digit
+     * @param[in] len number of digits
+     * @param[out] value converted value
+     * @return **ConvStatus::OUT_OF_RANGE** when more than 19 significant digits are found
+     */
+    ConvStatus parse_digits(const char *p, size_t len, uint64_t& value);
+
+    /*!
+     * @brief convert a fixed-width, blank-padded field into an exact fixed-point value
+     * @details The decimal point is always **.** whatever the current locale. When the field holds no
+     * decimal point, the last **implied_decimals** digits are the fractional part (e.g. "12345" is
+     * 123.45 with 2 implied decimals).
+     * @param[in] p pointer on the first byte of the field
+     * @param[in] len field length
+     * @param[in] implied_decimals number of implied decimals when no decimal point is found
+     * @param[out] value converted value
+     * @return conversion status. **ConvStatus::OUT_OF_RANGE** is returned when the mantissa
+     * doesn't fit into an int64_t.
+     */
+    ConvStatus parse_decimal(const char *p, size_t len, unsigned int implied_decimals, Decimal& value);
+
+    /*!
+     * @brief convert a fixed-width, blank-padded field into a correctly rounded double
+     * @details Same syntax as **parse_decimal()**, but mantissas too large for an int64_t are accepted.
+     * @param[in] p pointer on the first byte of the field
+     * @param[in] len field length
+     * @param[in] implied_decimals number of implied decimals when no decimal point is found
+     * @param[out] value converted value
+     * @return conversion status
+     */
+    ConvStatus parse_double(const char *p, size_t len, unsigned int implied_decimals, double& value);
+
+    /*!
+     * @brief convert a packed decimal field (COBOL COMP-3) into a signed 64-bit integer
+     * @details Each byte holds 2 digits, except the last one whose low nibble is the sign
+     * (**C**, **A**, **E**, **F** for positive, **B**, **D** for negative). Conversion is table-driven,
+     * one byte at a time.
+     * @param[in] p pointer on the first byte of the field
+     * @param[in] len field length in bytes (i.e. 2*len-1 digits)
+     * @param[out] value converted value
+     * @return conversion status
+     *
+     * @code
+     * int64_t i;
+     * assert(parse_packed("\x01\x23\x4D", 3, i) == ConvStatus::OK);
+     * assert(i == -1234);
+     * @endcode
+     */
+    ConvStatus parse_packed(const char *p, size_t len, int64_t& value);
+
+    /*!
+     * @brief convert a zoned decimal field into a signed 64-bit integer
+     * @details Each byte holds one digit, either in ASCII (**'0'..'9'**) or EBCDIC (**0xF0..0xF9**). The sign is
+     * overpunched in the last byte: **{**, **A..I** (positive) and **}**, **J..R** (negative) in ASCII,
+     * **0xC0..0xC9** (positive) and **0xD0..0xD9** (negative) in EBCDIC. A regular last digit is positive.
+     * @param[in] p pointer on the first byte of the field
+     * @param[in] len field length
+     * @param[out] value converted value
+     * @return conversion status
+     *
+     * @code
+     * int64_t i;
+     * assert(parse_zoned("0012J", 5, i) == ConvStatus::OK);
+     * assert(i == -121);
+     * @endcode
+     */
+    ConvStatus parse_zoned(const char *p, size_t len, int64_t& value);
+
+    /*!
+     * @brief change the scale of a fixed-point value, rounding half away from zero
+     * @param[in] value value to rescale
+     * @param[in] scale target scale
+     * @param[out] mantissa mantissa of the value with the target scale
+     * @return **ConvStatus::OUT_OF_RANGE** if the mantissa doesn't fit into an int64_t
+     */
+    ConvStatus rescale(const Decimal& value, unsigned int scale, int64_t& mantissa);
+
+    /*!
+     * @brief compare two fixed-point values exactly, whatever their scales
+     * @details Values whose common scale doesn't fit into an int64_t are compared as doubles.
+     * @return a negative number, 0 or a positive number when **a** is lower than, equal to or greater than **b**
+     */
+    int compare(const Decimal& a, const Decimal& b);
+
+    /*!
+     * @brief format a signed integer into a fixed-width field: right-justified and zero-padded, with
+     * a leading **-** for negative values
+     * @details This is the counterpart of **parse_integer()**. Digits are written 2 at a time, without
+     * any intermediate string nor locale.
+     * @param[out] p pointer on the first byte of the field
+     * @param[in] len field length
+     * @param[in] value value to format
+     * @return **ConvStatus::OUT_OF_RANGE** if the value doesn't fit, the field being left unchanged
+     *
+     * @code
+     * char s[6];
+     * assert(format_integer(s, 6, -42) == ConvStatus::OK);
+     * assert(memcmp(s, "-00042", 6) == 0);
+     * @endcode
+     */
+    ConvStatus format_integer(char *p, size_t len, int64_t value);
+
+    /*!
+     * @brief format a fixed-point value into a fixed-width field, right-justified and zero-padded
+     * @details With implied decimals, the value is rounded to **implied_decimals** digits and no decimal
+     * point is written, as expected by **parse_decimal()**. Otherwise a **.** is written when the value scale
+     * is not 0.
+     * @param[out] p pointer on the first byte of the field
+     * @param[in] len field length
+     * @param[in] implied_decimals number of implied decimals
+     * @param[in] value value to format
+     * @return conversion status. **ConvStatus::OUT_OF_RANGE** is returned when the value doesn't fit, or when
+     * its scale is over 19 without implied decimals.
+     */
+    ConvStatus format_decimal(char *p, size_t len, unsigned int implied_decimals, const Decimal& value);
+
+    /*!
+     * @brief format an integer as a packed decimal field (COBOL COMP-3), counterpart of **parse_packed()**
+     * @details The sign nibble is **C** for positive values and **D** for negative ones.
+     * @param[out] p pointer on the first byte of the field
+     * @param[in] len field length in bytes (i.e. 2*len-1 digits)
+     * @param[in] value value to format
+     * @return conversion status
+     */
+    ConvStatus format_packed(char *p, size_t len, int64_t value);
+
+    /*!
+     * @brief format an integer as an ASCII zoned decimal field, counterpart of **parse_zoned()**
+     * @details Negative values have their sign overpunched in the last byte (**}**, **J..R**).
+     * @param[out] p pointer on the first byte of the field
+     * @param[in] len field length
+     * @param[in] value value to format
+     * @return conversion status
+     */
+    ConvStatus format_zoned(char *p, size_t len, int64_t value);
+
+    /// longest text written by **print_decimal()**
+    constexpr size_t DECIMAL_TEXT_LENGTH = 22;
+
+    /*!
+     * @brief write a fixed-point value as plain text, without padding: **-** for negative values, and a **.**
+     * followed by **scale** digits when the scale is not 0
+     * @details This is meant for text exports (CSV, JSON), where values can't have leading zeros.
+     * @param[out] p pointer on at least **DECIMAL_TEXT_LENGTH** bytes
+     * @param[in] value value to write
+     * @return number of bytes written, 0 if the scale is over 19 (nothing being written)
+     *
+     * @code
+     * char s[DECIMAL_TEXT_LENGTH];
+     * Decimal d;
+     * d.mantissa = -5;
+     * d.scale = 2;
+     * assert(string(s, print_decimal(s, d)) == "-0.05");
+     * @endcode
+     */
+    size_t print_decimal(char *p, const Decimal& value);
+
+    /*!
+     * @return a human readable message for a conversion status
+     */
+    string conv_message(ConvStatus status);
+
+}
+
+#endif // CONVERT_H
@@ -0,0 +1,144 @@
+/**
+ * @file Date conversion from raw field bytes
+ */
+#ifndef DATE_H
+#define DATE_H
+
+#include <cstdint>
+#include <string>
+
+#include <convert.h>
+
+using namespace std;
+
+namespace rbf
+{
+
+    /// date format used when a date field type doesn't provide one
+    constexpr const char *DEFAULT_DATE_FORMAT = "YYYYMMDD";
+
+    /// 2-digit years below this pivot are in the 21st century (e.g. 49 is 2049, 50 is 1950)
+    constexpr int DATE_CENTURY_PIVOT = 50;
+
+    /// number of memoized values per thread
+    constexpr size_t DATE_MEMO_SIZE = 8;
+
+    /// longest raw value which can be memoized
+    constexpr size_t DATE_MEMO_KEY_SIZE = 16;
+
+    /*!
+     * @struct Date
+     * @brief A calendar date stored as a number of days since 1970-01-01
+     */
+    struct Date
+    {
+        int32_t days {0};               ///< days since the epoch (negative before 1970)
+
+        /*!
+         * @return the date built from its calendar representation
+         * @param[in] year full year (e.g. 2016)
+         * @param[in] month month 1..12
+         * @param[in] day day of month 1..31
+         */
+        static Date from_civil(int year, unsigned int month, unsigned int day);
+
+        /*!
+         * @details get the calendar representation of the date
+         */
+        void to_civil(int& year, unsigned int& month, unsigned int& day) const;
+
+        inline bool operator==(const Date& d) const { return days == d.days; }
+        inline bool operator!=(const Date& d) const { return days != d.days; }
+    };
+
+    /*!
+     * @class DateFormat
+     * @brief A date format compiled into a dedicated parser
+     * @details The format is given as in the **format** attribute of a **fieldtype** XML tag. It's made
+     * of the following tokens, any other character being a separator which is skipped:
+     *
+     * * **YYYY** 4-digit year, **YY** 2-digit year (see **DATE_CENTURY_PIVOT**)
+     * * **MM** month number, **MMM** English month abbreviation (JAN..DEC, case insensitive)
+     * * **DD** day of month, **DDD** day of year (julian dates like YYDDD)
+     *
+     * The format is analyzed once: **YYYYMMDD** is decoded in one 8-digit step, other formats
+     * are decoded using precomputed token offsets.
+     *
+     * **Example**
+     *
+     * @code
+     * DateFormat fmt("DDMMMYY");
+     * Date d;
+     * assert(fmt.parse("05JAN16", 7, d) == ConvStatus::OK);
+     * assert(d == Date::from_civil(2016, 1, 5));
+     * @endcode
+     */
+    class DateFormat
+    {
+        private:
+            // a token is missing when its length is 0
+            struct Token
+            {
+                size_t offset {0};
+                size_t length {0};
+            };
+
+            enum class Kind { YYYYMMDD, GENERIC };
+
+            string _format;                 // format as found in the layout
+            Kind _kind;                     // which parser to use
+            size_t _length {0};             // length of a formatted date
+
+            Token _year;
+            Token _month;                   // MM or MMM depending on length
+            Token _day;                     // DD or DDD depending on length
+
+            uint64_t _id;                   // identifies the format in the memo of each thread
+
+        public:
+            DateFormat() = delete;
+
+            /*!
+             * @brief DateFormat constructor
+             * @param[in] format date format
+             * @throw runtime_error if the format is not valid
+             */
+            DateFormat(const string& format);
+
+            /*!
+             * @details **format** attribute getter
+             */
+            inline string format() const { return _format; }
+
+            /*!
+             * @return the length of a formatted date
+             */
+            inline size_t length() const { return _length; }
+
+            /*!
+             * @details convert raw bytes into a date
+             * @param[in] p pointer on the first byte of the field
+             * @param[in] len field length. Blanks after the date are ignored.
+             * @param[out] value converted value
+             * @return **ConvStatus::OUT_OF_RANGE** for an impossible date like 20160230
+             */
+            ConvStatus parse(const char *p, size_t len, Date& value) const;
+
+            /*!
+             * @details same as **parse()**, but repeated raw values are served from a small memo. Each thread has
+             * its own memo, so a format can be shared among threads, as **FieldType** does.
+             */
+            ConvStatus cached_parse(const char *p, size_t len, Date& value) const;
+
+            /*!
+             * @details format a date, counterpart of **parse()**. Separators are copied from the format.
+             * @param[in] value date to format
+             * @param[out] p pointer on **length()** bytes
+             * @return **ConvStatus::OUT_OF_RANGE** if the year can't be written with the format
+             */
+            ConvStatus print(const Date& value, char *p) const;
+    };
+
+}
+
+#endif // DATE_H
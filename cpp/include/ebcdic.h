@@ -0,0 +1,56 @@
+/**
+ * @file EBCDIC to ASCII transcoding
+ */
+#ifndef EBCDIC_H
+#define EBCDIC_H
+
+#include <cstddef>
+#include <string>
+
+using namespace std;
+
+namespace rbf
+{
+
+    /*!
+     * @enum CodePage
+     * @brief Input code pages which can be transcoded by the reader
+     */
+    enum class CodePage
+    {
+        ASCII,              ///< no transcoding
+        IBM037,             ///< EBCDIC US/Canada
+        IBM500,             ///< EBCDIC international
+        IBM1047,            ///< EBCDIC Latin-1 (z/OS Unix)
+    };
+
+    /*!
+     * @brief get a code page from its name
+     * @param[in] name code page name, like **IBM-037**, **IBM037**, **CP037** or **037**
+     * @throw runtime_error if the code page is not supported
+     */
+    CodePage code_page(const string& name);
+
+    /*!
+     * @return the 256-byte translation table from the code page to ISO-8859-1 (which is ASCII for
+     * all invariant characters), or **nullptr** for **CodePage::ASCII**
+     */
+    const unsigned char *transcoding_table(CodePage cp);
+
+    /*!
+     * @brief translate a buffer in place through a 256-byte table
+     * @param[in,out] p buffer to translate
+     * @param[in] len buffer length
+     * @param[in] table translation table, as returned by **transcoding_table()**
+     *
+     * @code
+     * char s[] = "\xC1\xC2\xC3";
+     * transcode(s, 3, transcoding_table(CodePage::IBM037));
+     * assert(string(s) == "ABC");
+     * @endcode
+     */
+    void transcode(char *p, size_t len, const unsigned char *table);
+
+}
+
+#endif // EBCDIC_H
@@ -0,0 +1,390 @@
+#ifndef EXPORTER_H
+#define EXPORTER_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <functional>
+#include <stdexcept>
+
+using namespace std;
+
+#include <record.h>
+#include <layout.h>
+#include <ebcdic.h>
+#include <chunk.h>
+
+namespace rbf
+{
+
+    /*!
+     * @struct Column
+     * @brief A field exported by an **Exporter**, located in the raw line
+     */
+    struct Column
+    {
+        string name;                    ///< field name
+        size_t offset;                  ///< field offset in the line
+        size_t length;                  ///< field length
+        const FieldType *type;          ///< field type, owned by the layout
+    };
+
+    /*!
+     * @struct ExportPlan
+     * @brief Columns exported for the lines of a record
+     */
+    struct ExportPlan
+    {
+        string record_name;
+        vector<Column> columns;
+        vector<pair<size_t, size_t>> text_ranges;   ///< (offset, length) of all non-binary fields of the record
+        vector<string> prefixes;                    ///< text written before each column, if needed by the exporter
+    };
+
+    /*!
+     * @brief append a string value escaped for JSON, without quotes
+     * @details Bytes are scanned 8 at a time (SWAR) for quotes, backslashes and control characters, so runs of
+     * bytes without any of them are copied at once.
+     * @param[out] out string the value is appended to
+     * @param[in] p value
+     * @param[in] len value length
+     * @param[in] latin1 when true, bytes above 0x7F are ISO-8859-1 characters and are encoded as UTF-8.
+     * Otherwise, valid UTF-8 sequences are copied as-is, and other bytes above 0x7F are read as ISO-8859-1
+     * characters and escaped (e.g. **\\u00e9**), so the output is always valid UTF-8.
+     *
+     * @code
+     * string out;
+     * append_json_string(out, "a\"b\n", 4);
+     * assert(out == "a\\\"b\\n");
+     * @endcode
+     */
+    void append_json_string(string& out, const char *p, size_t len, bool latin1 = false);
+
+    /*!
+     * @brief append a text value as UTF-8
+     * @details Runs of ASCII bytes are found 8 at a time (SWAR) and copied at once.
+     * @param[out] out string the value is appended to
+     * @param[in] p value
+     * @param[in] len value length
+     * @param[in] latin1 when true, bytes above 0x7F are ISO-8859-1 characters and are encoded as UTF-8.
+     * Otherwise, valid UTF-8 sequences are copied as-is, and other bytes above 0x7F are encoded as ISO-8859-1
+     * characters, so the output is always valid UTF-8.
+     */
+    void append_utf8(string& out, const char *p, size_t len, bool latin1 = false);
+
+    /*!
+     * @class Exporter
+     * @brief Base class of exports, reading columns directly from raw lines
+     * @details Columns are located once per record in an **ExportPlan**, and each line is converted from its raw
+     * bytes by the derived class, without setting any **Field** value.
+     *
+     * By default, all fields of all records are exported.
+     */
+    class Exporter
+    {
+        protected:
+            Layout& _layout;
+
+            map<string, vector<string>> _columns;   // exported fields by record name, when not all of them
+            map<string, ExportPlan> _plans;         // by record name
+            bool _compiled {false};
+
+            size_t _record_length {0};              // 0 for line-based files
+            char _delimiter {'\n'};
+            const unsigned char *_code_table {nullptr};
+
+            // call f(plan, line, length) for each line of a buffer whose record is exported. Text fields of the line
+            // are transcoded if needed.
+            template <typename Function>
+                size_t for_each_line(const char *p, size_t size, const function <string (string)>& mapper, Function f) const;
+
+            // complete the plan of a record, once its columns are located
+            virtual void prepare(ExportPlan&) const {}
+
+            // throw if a field can't be converted
+            static void check(ConvStatus status, const Column& column);
+
+            // text of a field: trimmed raw bytes, or a number decoded from a PACKED or ZONED field into buffer,
+            // which holds DECIMAL_TEXT_LENGTH bytes. Empty numbers have no text.
+            static size_t field_text(const Column& column, const char *p, size_t len, char *buffer, const char *&text);
+
+        public:
+            Exporter() = delete;
+            Exporter(const Exporter& other) = delete;
+            Exporter& operator=(const Exporter& other) = delete;
+
+            /*!
+             * @brief Exporter constructor
+             * @param[in] layout layout of the input file
+             */
+            explicit Exporter(Layout& layout): _layout{layout} {}
+
+            // dtor
+            virtual ~Exporter() = default;
+
+            /*!
+             * @details select the exported fields of a record
+             * @param[in] record_name record name
+             * @param[in] field_names fields to export, in this order. When empty, lines of this record are skipped.
+             */
+            inline void setColumns(const string& record_name, const vector<string>& field_names) {
+                _columns[record_name] = field_names;
+                _compiled = false;
+            }
+
+            /*!
+             * @details read fixed-length records (without any delimiter) instead of lines
+             * @param[in] length record length in bytes, 0 to read lines
+             */
+            inline void setRecordLength(size_t length) { _record_length = length; }
+
+            /*!
+             * @details change the input line delimiter
+             */
+            inline void setDelimiter(char delimiter) { _delimiter = delimiter; }
+
+            /*!
+             * @details set the input code page. Text fields are transcoded, PACKED and ZONED fields are decoded
+             * as numbers. The mapper is given a transcoded copy of the line.
+             */
+            inline void setCodePage(CodePage cp) { _code_table = transcoding_table(cp); }
+
+            /*!
+             * @details locate the exported fields of all records. It's done by **run()** when needed.
+             * @throw runtime_error if a selected record or field is not found
+             */
+            void compile();
+
+            /*!
+             * @return the plan of a record
+             * @throw runtime_error if the record is not found
+             */
+            const ExportPlan& plan(const string& record_name);
+    };
+
+    template <typename Function>
+        size_t Exporter::for_each_line(const char *p, size_t size, const function <string (string)>& mapper, Function f) const
+        {
+            size_t nb_lines = 0;
+            const ExportPlan *plan = nullptr;
+            string record_name, mapped, transcoded;
+
+            for_each_raw_line(p, size, _record_length, _delimiter, [&](const char *line, size_t length, size_t) {
+                // mapper is given a transcoded copy, and only text fields are transcoded for conversion
+                string name;
+                if (_code_table)
+                {
+                    mapped.assign(line, length);
+                    transcode(&mapped[0], length, _code_table);
+                    name = mapper(mapped);
+                }
+                else
+                {
+                    name = mapper(string(line, length));
+                }
+
+                // consecutive lines often belong to the same record
+                if (!plan || name != record_name)
+                {
+                    auto it = _plans.find(name);
+                    if (it == _plans.end())
+                        throw runtime_error("record " + name + " not in layout");
+                    plan = &it->second;
+                    record_name = name;
+                }
+
+                if (plan->columns.empty())
+                    return;
+
+                if (_code_table)
+                {
+                    transcoded.assign(line, length);
+                    for (auto const &range: plan->text_ranges)
+                    {
+                        if (range.first >= length)
+                            break;
+                        transcode(&transcoded[range.first], min(range.second, length - range.first), _code_table);
+                    }
+                    line = transcoded.data();
+                }
+
+                f(*plan, line, length);
+                nb_lines++;
+            });
+
+            return nb_lines;
+        }
+
+    /*!
+     * @class TextExporter
+     * @brief Base class of text exports, formatting raw lines into large output buffers
+     * @details The input file is split into chunks, which are formatted by several threads and written in order.
+     */
+    class TextExporter: public Exporter
+    {
+        protected:
+            // format lines of a chunk
+            size_t format_chunk(const char *p, size_t size, const function <string (string)>& mapper, string& out) const;
+
+            // written before the first line
+            virtual string prologue() { return ""; }
+
+        public:
+            /*!
+             * @brief TextExporter constructor
+             * @param[in] layout layout of the input file
+             */
+            explicit TextExporter(Layout& layout): Exporter(layout) {}
+
+            /*!
+             * @details format a single line, already transcoded if needed
+             * @param[in] plan plan of the line record
+             * @param[in] line raw line. Short lines are blank-padded.
+             * @param[in] length line length
+             * @param[out] out string the formatted line is appended to, with its end of line
+             * @throw runtime_error if a numeric value can't be converted
+             */
+            virtual void format(const ExportPlan& plan, const char *line, size_t length, string& out) const = 0;
+
+            /*!
+             * @details export a whole file
+             * @param[in] input_file file of the layout
+             * @param[in] output_file file created or truncated
+             * @param[in] mapper function returning the record name of a line. It's called by several threads.
+             * @param[in] nb_threads number of threads, 0 for the number of cores
+             * @return number of lines exported, skipped ones excluded
+             * @throw runtime_error on any I/O or conversion error, or if a line record is not found
+             */
+            size_t run(const string& input_file, const string& output_file, function <string (string)> mapper, size_t nb_threads = 0);
+    };
+
+    /*!
+     * @enum Quoting
+     * @brief When CSV values are quoted
+     */
+    enum class Quoting
+    {
+        MINIMAL,            ///< only values holding a separator, a quote or an end of line
+        ALL,                ///< all values
+        NONE,               ///< never: values are written as-is
+    };
+
+    /*!
+     * @class CsvExporter
+     * @brief Export a record-based file as CSV (RFC 4180), one line per record
+     * @details Text values are trimmed, and numbers read from PACKED or ZONED fields are written as plain decimals.
+     * Quoted values have their quotes doubled.
+     *
+     * **Example**
+     *
+     * @code
+     * CsvExporter csv(layout);
+     * csv.setColumns("COUN", {"NAME", "CAPITAL"});
+     * csv.setColumns("CONT", {});
+     * csv.run("world_data.txt", "countries.csv", [](string s) { return s.substr(0,4); });
+     * @endcode
+     */
+    class CsvExporter: public TextExporter
+    {
+        private:
+            char _separator {','};
+            char _quote {'"'};
+            Quoting _quoting {Quoting::MINIMAL};
+            bool _special[256];                 // bytes requiring a value to be quoted
+            string _header_record;              // record whose header line is written first
+
+            string prologue() override { return _header_record.empty() ? "" : header(_header_record); }
+
+            // write a value, quoted if needed
+            void append(string& out, const char *p, size_t len) const;
+
+        public:
+            /*!
+             * @brief CsvExporter constructor
+             * @param[in] layout layout of the input file
+             */
+            explicit CsvExporter(Layout& layout);
+
+            /*!
+             * @details change the value separator, **,** by default
+             */
+            void setSeparator(char separator);
+
+            /*!
+             * @details change the quote character, **"** by default
+             */
+            void setQuote(char quote);
+
+            /*!
+             * @details change when values are quoted, **Quoting::MINIMAL** by default
+             */
+            inline void setQuoting(Quoting quoting) { _quoting = quoting; }
+
+            /*!
+             * @return the header line of a record: its column names, with an end of line
+             */
+            string header(const string& record_name);
+
+            /*!
+             * @details write the header line of a record before all lines, none by default
+             */
+            inline void setHeader(const string& record_name) { _header_record = record_name; }
+
+            // format a line as CSV
+            void format(const ExportPlan& plan, const char *line, size_t length, string& out) const override;
+    };
+
+
+    /*!
+     * @class JsonExporter
+     * @brief Export a record-based file as JSON Lines (NDJSON), one object per record
+     * @details Keys are field names. Values are typed according to the field **DataType**:
+     *
+     * * INTEGER, DECIMAL, PACKED and ZONED fields are numbers, written as plain decimals
+     * * DATE fields are strings in the ISO format (YYYY-MM-DD)
+     * * other fields are trimmed strings
+     *
+     * Blank numbers and dates are **null**. Keys are escaped once per record, and values are escaped with
+     * **append_json_string()**.
+     *
+     * **Example**
+     *
+     * @code
+     * JsonExporter json(layout);
+     * json.setRecordKey("record");
+     * json.run("world_data.txt", "world_data.json", [](string s) { return s.substr(0,4); });
+     *
+     * // {"record":"COUN","ID":"COUN","NAME":"France","POPULATION":63000000,"CAPITAL":"Paris"}
+     * @endcode
+     */
+    class JsonExporter: public TextExporter
+    {
+        private:
+            string _record_key;                 // key of the record name, none when empty
+
+            // escaped keys
+            void prepare(ExportPlan& plan) const override;
+
+        public:
+            /*!
+             * @brief JsonExporter constructor
+             * @param[in] layout layout of the input file
+             */
+            explicit JsonExporter(Layout& layout): TextExporter(layout) {}
+
+            /*!
+             * @details add the record name to each object, as the first member
+             * @param[in] key member name, empty for none (the default)
+             */
+            inline void setRecordKey(const string& key) {
+                _record_key = key;
+                _compiled = false;
+            }
+
+            // format a line as a JSON object
+            void format(const ExportPlan& plan, const char *line, size_t length, string& out) const override;
+    };
+
+}
+
+#endif // EXPORTER_H
@@ -10,6 +10,8 @@ using namespace std;
 
 #include <element.h>
 #include <fieldtype.h>
+#include <convert.h>
+#include <resource.h>
 
 namespace rbf
 {
@@ -22,12 +24,14 @@ namespace rbf
      * be mapped to a line of text within a file, then a field is a substring from
      * that line, with a fixed length.
      *
-     * Each field is holding the substring in the **value** and **raw_value** properties.
+     * Once added into a record, a field doesn't own its value: it refers to a range of the record
+     * buffer, which holds the values of all fields (see **Record**). A field outside any record
+     * keeps its value in its own storage. The blank-stripped **value** is a sub-range of
+     * **raw_value**, found when the value is set.
      * a record can represent numerical, alphumerical, etc type of data. This class holds the type
      * of field.
      *
      * @todo 
-     * * copy at least length-chars when setting the value
      * * type() should return a ref
      *
      * **Example**
@@ -46,15 +50,27 @@ namespace rbf
      *
      *  assert(f1 == f2);
      *  assert(f2 == f3);
+     *
+     *  auto f4 = Field("FIELD_4", "Field4 description", FieldType("INT", "integer"), 10);
+     *  f4.setValue("   -1234  ");
+     *  assert(f4.get<int64_t>() == -1234);
      * @endcode
      */
     class Field : public DataElement
     {
         private:
+            friend class Record;
+
             FieldType _field_type;    // associated FieldType object
 
-            string _str_value;        // when set, store the value of the field (blank stripped)
-            string _raw_value;        // when set, store the raw value of the field
+            MemoryResource *_resource {default_resource()}; // where _storage is allocated
+            char *_storage {nullptr}; // value storage, when the field is not part of a record
+            size_t _capacity {0};     // _storage size
+            char *_data {nullptr};    // raw value of the field, either in _storage or in the record buffer
+            size_t _raw_length {0};   // raw value length
+            size_t _first {0};        // blank-stripped value range within the raw value
+            size_t _last {0};
+            bool _bound {false};      // true when _data refers to a record buffer
 
             unsigned int _index {0};  // index of the field within a record
             unsigned int _offset {0}; // offset of the field among its brothers
@@ -75,42 +91,61 @@ namespace rbf
              * @param[in] description field representation
              * @param[in] type field type object
              * @param[in] length field length
+             * @param[in] resource memory resource for the field value, when the field is not part of a record
              *
              * @code 
              * auto ft1 = FieldType("ALPHA", "string");
              * auto f1 = Field("FIELD1", "This is field #1", ft1, 10);
              * @endcode
              */
-            Field(const string& name, const string& description, const FieldType& type, const size_t& length) : 
-                DataElement(name, description, length), _field_type(type) { 
-                    _raw_value.reserve(length); 
-                    _str_value.reserve(length); 
-                } 
+            Field(const string& name, const string& description, const FieldType& type, const size_t& length, 
+                  MemoryResource *resource = default_resource()) : 
+                DataElement(name, description, length), _field_type(type), _resource{resource} {} 
 
             /*!
              * @brief Field class copy constructor
+             * @details When the field is part of a record, the copy refers to the same record buffer
              */
             //Field(const Field& f): Field(f._name, f._description, f._field_type, f._length) { cout << "Field " << f._name << " is copied!!" << endl;}
-            Field(const Field& f) = default;
+            Field(const Field& f);
+
+            /*!
+             * @brief Field class copy assignment, as the copy constructor
+             */
+            Field& operator=(const Field& f);
+
+            // dtor
+            virtual ~Field();
 
             // accessors & mutators
             /*!
              * @details **value** attribute getter
              * @return the left and right-stripped value of the field
              */
-            inline string value() const { return _str_value; }
+            inline string value() const { return _first == _last ? string() : string(_data + _first, _last - _first); }
 
             /*!
              * @details **raw_value** attribute getter
              * @return the non-modified value of the field (i.e. non-stripped)
              */
-            inline string raw_value() const { return _raw_value; }
+            inline string raw_value() const { return _raw_length == 0 ? string() : string(_data, _raw_length); }
+
+            /*!
+             * @return a pointer on the raw value of the field, without any copy
+             */
+            inline const char *raw_data() const { return _data; }
+
+            /*!
+             * @return the raw value length. It's the field length when the field is part of a record.
+             */
+            inline size_t raw_length() const { return _raw_length; }
 
             /*!
              * @details **type** attribute getter
              * @return the FieldType object
              */
             inline FieldType& type() { return _field_type; }
+            inline const FieldType& type() const { return _field_type; }
 
             /*!
              * @details **index** attribute getter
@@ -139,16 +174,36 @@ namespace rbf
             inline unsigned int upper_bound() const { return _upper_bound; }
 
             /*!
-             * @details set the **value** and **raw_value** attribute from a string
-             * @param[in] s string value to store. Only **lenght** characters are saved, and **value** is blank-stripped
+             * @details convert the raw value of the field, without building any intermediate
+             * string. See **FieldType::decode()** for the conversions available.
+             * @param[out] value converted value
+             * @return conversion status
+             */
+            template <typename T>
+                inline ConvStatus get(T& value) const { return _field_type.decode(_data, _raw_length, value); }
+
+            /*!
+             * @details typed accessor
+             * @tparam T target type (**int64_t**, **Decimal**, **double**, **Date** or **string**)
+             * @return the raw value of the field converted to **T**
+             * @throw runtime_error if the raw value can't be converted
              */
-            void setValue(string s);
+            template <typename T>
+                T get() const
+                {
+                    T value;
+                    auto status = get(value);
+                    if (status != ConvStatus::OK)
+                        throw runtime_error("field " + _name + ": " + conv_message(status));
+                    return value;
+                }
 
             /*!
-             * @details set the **raw_value** attribute (only)
-             * @param[in] s string value
+             * @details set the **value** and **raw_value** attribute from a string
+             * @param[in] s string value to store, **value** is blank-stripped. When the field is part of a record,
+             * only **length** characters are saved, and shorter strings are blank-padded.
              */
-            inline void setRawValue(const string& s) { _raw_value = s; }
+            void setValue(const string& s);
 
             /*!
              * @details **index** attribute setter
@@ -185,6 +240,16 @@ namespace rbf
             // public methods other than standard ones
             friend ostream &operator<<(ostream &output, const Field& f);
 
+        private:
+            // find the blank-stripped value range
+            void trim();
+
+            // refer to a range of a record buffer, copying the current value into it unless it's already there
+            void bind(char *p, bool copy);
+
+            // copy a value into _storage, growing it if needed
+            void store(const char *p, size_t len);
+
     };
 
 }
@@ -4,7 +4,10 @@
 #ifndef FIELDTYPE_H
 #define FIELDTYPE_H
 
+#include <memory>
+
 #include <element.h>
+#include <date.h>
 
 namespace rbf 
 {
@@ -21,6 +24,8 @@ namespace rbf
         INTEGER,            ///< represent integer numbers (positive or negative)
         DATE,               ///< represent data values
         STRING,             ///< represent alphanumerical or alphabetical data
+        PACKED,             ///< represent packed decimal numbers (COBOL COMP-3)
+        ZONED,              ///< represent zoned decimal numbers, with an overpunched sign
         VOID,               ///< no value
     };
 
@@ -44,6 +49,9 @@ namespace rbf
     class FieldType : public DataElement
     {
         DataType _data_type;         ///< field type converted to enum type
+        unsigned int _decimals {0};  ///< number of implied decimals for DECIMAL fields
+        string _format;              ///< format attribute as found in the layout
+        shared_ptr<DateFormat> _date_format; ///< compiled format for DATE fields
 
         public:
         /*!
@@ -80,12 +88,125 @@ namespace rbf
          */
         inline DataType data_type() const { return _data_type; }
 
+        /*!
+         * @details **decimals** attribute getter
+         * @return the number of implied decimals, used when a decimal field value has no decimal point
+         */
+        inline unsigned int decimals() const { return _decimals; }
+
+        /*!
+         * @details **format** attribute getter
+         */
+        inline string format() const { return _format; }
+
+        /*!
+         * @details compiled date format getter
+         * @return the date parser shared among fields of this type, or **nullptr** if not a DATE type
+         */
+        inline const shared_ptr<DateFormat>& date_format() const { return _date_format; }
+
+        // setters
+        /*!
+         * @details **decimals** attribute setter
+         */
+        inline void setDecimals(unsigned int decimals) { _decimals = decimals; }
+
+        /*!
+         * @details **format** attribute setter. For DATE types, the format is compiled
+         * into a dedicated parser. An empty format keeps **DEFAULT_DATE_FORMAT**.
+         * @throw runtime_error for an invalid date format
+         */
+        void setFormat(const string& format);
+
+        // conversions from raw bytes
+        /*!
+         * @details convert raw bytes of a field of this type into an integer. PACKED and ZONED
+         * fields are decoded from their binary representation.
+         * @param[in] p pointer on the first byte of the field
+         * @param[in] len field length
+         * @param[out] value converted value
+         * @return conversion status
+         */
+        ConvStatus decode(const char *p, size_t len, int64_t& value) const;
+
+        /*!
+         * @details convert raw bytes of a field of this type into an exact fixed-point value. **decimals**
+         * are applied when the value has no decimal point, and are the scale of PACKED and ZONED fields.
+         */
+        ConvStatus decode(const char *p, size_t len, Decimal& value) const;
+
+        /*!
+         * @details convert raw bytes of a field of this type into a correctly rounded double,
+         * whatever the current locale
+         */
+        ConvStatus decode(const char *p, size_t len, double& value) const;
+
+        /*!
+         * @details convert raw bytes of a field of this type into a date, using the type format
+         * (**DEFAULT_DATE_FORMAT** if not a DATE type). It can be called by several threads at once.
+         */
+        ConvStatus decode(const char *p, size_t len, Date& value) const;
+
+        /*!
+         * @details copy raw bytes of a field of this type into a blank-stripped string
+         * @return always **ConvStatus::OK**
+         */
+        ConvStatus decode(const char *p, size_t len, string& value) const;
+
+        // conversions to raw bytes
+        /*!
+         * @details format an integer into a field of this type, counterpart of **decode()**. Numbers are
+         * right-justified and zero-padded (INTEGER, DECIMAL), or written in their binary representation
+         * (PACKED, ZONED). Other types get the value left-justified and blank-padded.
+         * @param[out] p pointer on the first byte of the field
+         * @param[in] len field length
+         * @param[in] value value to format
+         * @return conversion status. **ConvStatus::OUT_OF_RANGE** is returned when the value doesn't fit.
+         */
+        ConvStatus encode(char *p, size_t len, int64_t value) const;
+
+        /*!
+         * @details format a fixed-point value into a field of this type. It's rounded to **decimals**
+         * digits when they're implied (and to an integer for INTEGER fields).
+         */
+        ConvStatus encode(char *p, size_t len, const Decimal& value) const;
+
+        /*!
+         * @details format a double into a field of this type. It's first converted into the shortest fixed-point
+         * value giving back the same double (e.g. 12.1), which is then formatted as a **Decimal**. Other types get
+         * the text of this value (e.g. "3.25").
+         * @return **ConvStatus::OUT_OF_RANGE** if the value has more decimals than implied by the type (or any
+         * decimal for an INTEGER field), or if it's not finite
+         */
+        ConvStatus encode(char *p, size_t len, double value) const;
+
+        /*!
+         * @details format a date into a field of this type, using the type format
+         * (**DEFAULT_DATE_FORMAT** if not a DATE type), blank-padded
+         */
+        ConvStatus encode(char *p, size_t len, const Date& value) const;
+
+        /*!
+         * @details format a text value into a field of this type. Numeric types read the text as
+         * **decode()** would read raw bytes (e.g. with implied decimals) before formatting it, so a blank
+         * text gives a blank field. Other types get the blank-stripped text left-justified and blank-padded,
+         * truncated if needed.
+         * @param[out] p pointer on the first byte of the field
+         * @param[in] len field length
+         * @param[in] s text
+         * @param[in] n text length
+         */
+        ConvStatus encode(char *p, size_t len, const char *s, size_t n) const;
+        inline ConvStatus encode(char *p, size_t len, const string& s) const { return encode(p, len, s.data(), s.length()); }
+
         // overloaded ops
         /*!
-         * @details Two FieldType objects are equals if **name**, **description** 
-         * and **DataType** are equal.
+         * @details Two FieldType objects are equals if **name**, **description**, 
+         * **DataType**, **decimals** and **format** are equal.
          */
-        inline bool operator==(const FieldType& e) const { return DataElement::operator==(e) && _data_type == e._data_type; }
+        inline bool operator==(const FieldType& e) const { 
+            return DataElement::operator==(e) && _data_type == e._data_type && _decimals == e._decimals && _format == e._format; 
+        }
 
         /*!
          * @details Negation of equality
@@ -0,0 +1,215 @@
+#ifndef FILTER_H
+#define FILTER_H
+
+#include <string>
+#include <vector>
+#include <initializer_list>
+#include <stdexcept>
+
+#include <record.h>
+#include <batch.h>
+
+using namespace std;
+
+namespace rbf
+{
+
+    /*!
+     * @class Filter
+     * @brief A predicate on the raw bytes of a record, evaluated before its fields are set
+     * @details Terms are added on fields of a record, and they must all be true for a line to match. Each term
+     * is compiled once against the field position and type, so a line is checked straight from its bytes:
+     * fields are never set, and a rejected line only costs the bytes of the terms evaluated up to the first
+     * failing one, in the order they were added.
+     *
+     * How a field is compared depends on its type:
+     *
+     * * STRING and VOID fields: constants are blank-padded to the field length and compared byte for byte,
+     *   leading blanks included (missing bytes of a short line are blanks). They can't be longer than the field.
+     * * INTEGER, DECIMAL, PACKED and ZONED fields: the field is decoded, and compared exactly with the
+     *   constants as numbers. Text constants are numbers as written (e.g. "12.5").
+     * * DATE fields: the field is decoded, and compared with **Date** constants, or text ones in the field format
+     *
+     * Blank numeric and date fields never match. Lines can be checked one at a time (**match()**), or by
+     * batches of the same record (**select()**).
+     *
+     * **Example**
+     *
+     * @code
+     * Filter filter(*layout["COUN"]);
+     * filter.in("CONTINENT", {"Asia", "Europe"}).at_least("POPULATION", 10000000);
+     *
+     * reader.for_each_matching(filter, [](RecordPtr& rec) { cout << rec->get_field_value("NAME") << endl; });
+     * @endcode
+     */
+    class Filter
+    {
+        private:
+            enum class Comparison { BYTES, NUMBER, DATE };
+            enum class Operation { IN, PREFIX, BETWEEN };
+
+            // a compiled term
+            struct Term
+            {
+                string field_name;
+                FieldType type;
+                size_t offset;
+                size_t length;
+                Comparison comparison;
+                Operation operation;
+                bool has_low {false};           // BETWEEN bounds
+                bool has_high {false};
+                vector<string> values;          // padded constants of BYTES terms, sorted for IN
+                vector<Decimal> numbers;        // constants of NUMBER and DATE terms, dates as days
+                bool exact {false};             // true if all numbers are mantissas of the same scale
+                unsigned int scale {0};         // scale of exact numbers
+                vector<int64_t> mantissas;      // exact numbers, in the same order
+
+                // decode a NUMBER or DATE field, dates as days
+                ConvStatus decode(const char *p, size_t available, Decimal& value) const;
+
+                // compare a decoded value with the numbers
+                bool match_number(const Decimal& value) const;
+
+                bool match(const char *line, size_t len) const;
+
+                // unselect the rows of a batch which don't match, whole 64-row groups at a time
+                void select(const RecordBatch& batch, Selection& selection) const;
+                void select_bytes(const RecordBatch& batch, Selection& selection, const string& value) const;
+                void select_numbers(const RecordBatch& batch, Selection& selection) const;
+            };
+
+            const Record& _record;              // record whose fields are compared
+            vector<Term> _terms;                // terms, in evaluation order
+
+            // a term on a field, without constants yet
+            Term term(const string& field_name, Operation operation) const;
+
+            // compile a constant into a term
+            void add_constant(Term& t, const string& value) const;
+            void add_constant(Term& t, const Decimal& value) const;
+            void add_constant(Term& t, const Date& value) const;
+            void add_constant(Term& t, int64_t value) const { add_constant(t, Decimal{value, 0}); }
+
+            // add a term, sorting IN constants and rescaling numbers
+            Filter& add(Term& t);
+
+        public:
+            Filter() = delete;
+
+            /*!
+             * @brief Filter constructor
+             * @param[in] rec record whose fields are compared (usually from a **Layout**). It must outlive the filter.
+             */
+            Filter(const Record& rec): _record{rec} {}
+
+            /*!
+             * @return name of the record whose lines are filtered
+             */
+            inline string record_name() const { return _record.name(); }
+
+            /*!
+             * @return number of terms
+             */
+            inline size_t size() const { return _terms.size(); }
+
+            /*!
+             * @details keep lines whose field is equal to a value
+             * @param[in] field_name name of the field (the first one if several fields have the same name)
+             * @param[in] value **string**, integer, **Decimal** or **Date** constant
+             * @throw runtime_error if the field is not found, or if the value can't be compared with it
+             */
+            template <typename V>
+                Filter& equal(const string& field_name, const V& value)
+                {
+                    auto t = term(field_name, Operation::IN);
+                    add_constant(t, value);
+                    return add(t);
+                }
+
+            /*!
+             * @details keep lines whose field is equal to any of the values
+             */
+            template <typename V>
+                Filter& in(const string& field_name, const vector<V>& values)
+                {
+                    auto t = term(field_name, Operation::IN);
+                    for (auto const &value: values)
+                    {
+                        add_constant(t, value);
+                    }
+                    return add(t);
+                }
+
+            template <typename V>
+                Filter& in(const string& field_name, initializer_list<V> values) { return in(field_name, vector<V>(values)); }
+
+            /*!
+             * @details keep lines whose field is between two values, both included
+             */
+            template <typename L, typename H>
+                Filter& between(const string& field_name, const L& low, const H& high)
+                {
+                    auto t = term(field_name, Operation::BETWEEN);
+                    t.has_low = t.has_high = true;
+                    add_constant(t, low);
+                    add_constant(t, high);
+                    return add(t);
+                }
+
+            /*!
+             * @details keep lines whose field is greater than or equal to a value
+             */
+            template <typename V>
+                Filter& at_least(const string& field_name, const V& low)
+                {
+                    auto t = term(field_name, Operation::BETWEEN);
+                    t.has_low = true;
+                    add_constant(t, low);
+                    return add(t);
+                }
+
+            /*!
+             * @details keep lines whose field is lower than or equal to a value
+             */
+            template <typename V>
+                Filter& at_most(const string& field_name, const V& high)
+                {
+                    auto t = term(field_name, Operation::BETWEEN);
+                    t.has_high = true;
+                    add_constant(t, high);
+                    return add(t);
+                }
+
+            /*!
+             * @details keep lines whose field starts with some bytes
+             * @throw runtime_error if the field is not found or is not a STRING or VOID one, or if the prefix is
+             * longer than the field
+             */
+            Filter& prefix(const string& field_name, const string& prefix);
+
+            /*!
+             * @param[in] line raw line of the record
+             * @param[in] len line length
+             * @return true if all terms are true
+             * @throw runtime_error if a numeric or date field can't be decoded
+             */
+            bool match(const char *line, size_t len) const;
+            inline bool match(const string& line) const { return match(line.data(), line.length()); }
+
+            /*!
+             * @details select the lines of a batch matching all terms. Terms are evaluated one after the other
+             * on all the lines still selected, i.e. column by column, and groups of 64 lines are skipped as soon
+             * as none of them is selected. Short byte comparisons (equality, prefix) load 8 bytes of each line
+             * into a word, and numbers are decoded for the selected lines before being compared all at once.
+             * @param[in] batch lines of the filtered record
+             * @param[out] selection lines matching all terms
+             * @throw runtime_error if the batch is not made of lines of the filtered record, or if a numeric or
+             * date field can't be decoded
+             */
+            void select(const RecordBatch& batch, Selection& selection) const;
+    };
+
+}
+
+#endif // FILTER_H
@@ -6,6 +6,7 @@
 #include <element.h>
 #include <field.h>
 #include <record.h>
+#include <resource.h>
 
 #include <pugixml.hpp>
 
@@ -14,8 +15,8 @@ using namespace std;
 
 namespace rbf
 {
-    /// useful helper
-    using RecordPtr = unique_ptr<Record>;
+    /// useful helper. Records are shared so that snapshots can keep them as descriptors
+    using RecordPtr = shared_ptr<Record>;
 
 
     /// initial record number of fields
@@ -45,6 +46,7 @@ namespace rbf
         private:
             string _xml_file;                       // xml file name for underlying layout
             map<string, RecordPtr> _record_map;     // hold records as a map with key = record name
+            map<string, string> _meta;              // attributes of the <meta> tag
 
         public:
             /*!
@@ -59,8 +61,10 @@ namespace rbf
              * @param[in] xml_file xml layout file name
              * @param[in] initial_record_size pre_allocate every record in the layout with
              * this parameter
+             * @param[in] resource memory resource for records, their fields and buffers. As a layout is
+             * built once, a **MonotonicResource** fits well. It must outlive the layout and its records.
              */
-            Layout(string xml_file, size_t initial_record_size = RECORD_SIZE_INIT);
+            Layout(string xml_file, size_t initial_record_size = RECORD_SIZE_INIT, MemoryResource *resource = default_resource());
 
             /*!
              * @brief Record access
@@ -80,6 +84,25 @@ namespace rbf
              * @return true if found
              */
             bool contains(string record_name) const { return _record_map.find(record_name) != _record_map.end(); }
+
+            /*!
+             * @details get an attribute of the **meta** tag
+             * @param[in] attribute attribute name (e.g. **mapper**)
+             * @return attribute value, or an empty string if not found
+             */
+            string meta(const string& attribute) const { 
+                auto it = _meta.find(attribute);
+                return it == _meta.end() ? "" : it->second; 
+            }
+
+            /*!
+             * @details get the record ID position from the **meta** tag mapper attribute, e.g. **type:1 map:0..4**.
+             * A line is mapped to the record whose name is the record ID.
+             * @param[out] offset record ID offset in a line
+             * @param[out] length record ID length
+             * @return false if the layout has no such mapper
+             */
+            bool id_range(size_t& offset, size_t& length) const;
     };
 
 }
@@ -1,6 +1,24 @@
+#include<resource.h>
 #include<element.h>
 #include<fieldtype.h>
+#include<convert.h>
+#include<date.h>
 #include<field.h>
 #include<record.h>
+#include<binding.h>
 #include<layout.h>
+#include<snapshot.h>
+#include<ring.h>
+#include<ebcdic.h>
 #include<reader.h>
+#include<chunk.h>
+#include<writer.h>
+#include<reformatter.h>
+#include<exporter.h>
+#include<arrow.h>
+#include<columnar.h>
+#include<cache.h>
+#include<compress.h>
+#include<filter.h>
+#include<batch.h>
+#include<aggregate.h>
@@ -4,15 +4,29 @@
 #include <iostream>
 #include <fstream>
 #include <functional>
+#include <memory>
 
 #include <record.h>
 #include <layout.h>
+#include <ebcdic.h>
+#include <binding.h>
+#include <filter.h>
+#include <batch.h>
+#include <ring.h>
 
 using namespace std;
 
 namespace rbf
 {
 
+    /// largest block copied at once by **Reader::copy_if()**
+    constexpr size_t COPY_CHUNK_SIZE = 1 << 24;
+
+    class ParseCache;
+    class CacheReader;
+    class CacheWriter;
+    class ByteSource;
+
     // helper for all reader data
     struct ReaderData
     {
@@ -20,6 +34,22 @@ namespace rbf
         Layout& layout;
         function <string (string)> mapper;
         ifstream rbf;
+        size_t record_length {0};                   // 0 for line-based files
+        char delimiter {'\n'};                      // line delimiter for line-based files
+        const unsigned char *code_table {nullptr};  // transcoding table, nullptr for ASCII input
+        bool text_only {false};                     // only transcode text fields
+        ParseCache *cache {nullptr};                // parse results cache, if any
+        string cache_tag;                           // mapper identity, part of the cache key
+        shared_ptr<CacheReader> cache_reader;       // lines served from the cache, on a hit
+        shared_ptr<CacheWriter> cache_writer;       // lines saved into the cache, on a miss
+        shared_ptr<ByteSource> source;              // uncompressed bytes, for compressed files
+        string source_buffer;                       // source bytes not split into lines yet
+        size_t source_pos {0};                      // next line in the source buffer
+        size_t first_record {0};                    // number of the first record read
+        size_t nb_threads {0};                      // decompression threads, 0 for the number of cores
+
+        ReaderData(const string& rb_file, Layout& layout, function <string (string)> mapper):
+            rb_file{rb_file}, layout{layout}, mapper{mapper} {}
     };
 
 
@@ -28,13 +58,39 @@ namespace rbf
         private:
             ReaderData& _rdata;
             string _current_line;
+            string _mapper_line;        // transcoded copy of the line, when only text fields are transcoded
+            string _record_name;        // record name of the current line, once mapped
+            bool _mapped {false};       // true once the current line is mapped
+            bool _named {false};        // true once the record name is known, e.g. from the cache
+            vector<uint32_t> _bounds;   // blank-stripped field ranges of the current line
+            bool _parsed {false};       // true when the field ranges come from the cache
+            bool _at_end;
+
+            // read next line or record, and transcode it if requested
+            void read();
+
+            // record name of the current line, without transcoding it
+            string record_name();
 
         public:
-            ReaderIterator(ReaderData& rdata): _rdata{rdata} {}
+            ReaderIterator(ReaderData& rdata, bool at_end = false);
 
             bool operator!=(const ReaderIterator& it) const;
             ReaderIterator& operator++();
             RecordPtr& operator*();
+
+            /*!
+             * @details map the current line to its record name, without splitting it into fields. When only
+             * text fields are transcoded, they're transcoded in place at this point.
+             * @return record name
+             */
+            const string& map();
+
+            /*!
+             * @return the current line, not split into fields. It's transcoded if the whole line is, or
+             * if only text fields are and the line has been mapped.
+             */
+            inline const string& line() const { return _current_line; }
     };
 
     class Reader
@@ -44,6 +100,12 @@ namespace rbf
 
         public:
 
+            /*!
+             * @brief Reader constructor
+             * @param[in] rb_file record-based file name
+             * @param[in] layout file layout
+             * @param[in] mapper function returning the record name of a line
+             */
             Reader(const string& rb_file, Layout& layout, function <string (string)> mapper): 
                 _rdata{rb_file, layout, mapper} {}
 
@@ -51,10 +113,203 @@ namespace rbf
             Reader(const Reader& other) = delete;
             Reader& operator=(const Reader& other) = delete;
 
+            /*!
+             * @details read fixed-length records (without any delimiter) instead of lines
+             * @param[in] length record length in bytes, 0 to read lines
+             */
+            inline void setRecordLength(size_t length) { _rdata.record_length = length; }
 
-            // to loop through records within a rb-file
+            /*!
+             * @details change the line delimiter. It's checked before transcoding, so EBCDIC files
+             * usually need **'\x25'** (LF) or **'\x15'** (NL).
+             * @param[in] delimiter line delimiter
+             */
+            inline void setDelimiter(char delimiter) { _rdata.delimiter = delimiter; }
+
+            /*!
+             * @details set the input code page. Each line is transcoded in place into ASCII before
+             * being mapped and split into fields.
+             * @param[in] cp input code page
+             * @param[in] text_only when true, only the fields which are not PACKED or ZONED are transcoded,
+             * so binary data stays untouched. The mapper is then given a transcoded copy of the line.
+             *
+             * @code
+             * Reader reader("mainframe.dat", layout, [](string s) { return s.substr(0,4); });
+             * reader.setRecordLength(80);
+             * reader.setCodePage(code_page("IBM-037"), true);
+             * @endcode
+             */
+            inline void setCodePage(CodePage cp, bool text_only = false) {
+                _rdata.code_table = transcoding_table(cp);
+                _rdata.text_only = text_only;
+            }
+
+            /*!
+             * @details read through a parse cache. When the cache holds the input file, lines are served from
+             * it, already split and mapped. Otherwise, the cache is populated while reading, once the file is read
+             * to the end: lines are then mapped as soon as they're read, so all lines must belong to a record.
+             * @param[in] cache parse cache, **nullptr** to read without any cache
+             * @param[in] tag identity of the mapper, as the cache can't tell two mappers apart. Readers sharing
+             * a cache must use different tags for different mappers.
+             */
+            inline void setCache(ParseCache *cache, const string& tag = "") {
+                _rdata.cache = cache;
+                _rdata.cache_tag = tag;
+            }
+
+            /*!
+             * @details start reading at a record, numbered from 0. Block-compressed files (see **compress_file()**)
+             * are read from the block holding it, others from their first line. A parse cache is not used.
+             * @param[in] record_number number of the first record read
+             */
+            inline void setFirstRecord(size_t record_number) { _rdata.first_record = record_number; }
+
+            /*!
+             * @details set the number of blocks of a block-compressed file, or of frames of a zstd file,
+             * decompressed at once ahead of the one being read
+             * @param[in] nb_threads number of threads, 0 for the number of cores
+             */
+            inline void setThreads(size_t nb_threads) { _rdata.nb_threads = nb_threads; }
+
+            // to loop through records within a rb-file. Compressed files are recognized (see **open_source()**),
+            // and block-compressed ones are read with the record length and delimiter they were written with.
             ReaderIterator begin();
             ReaderIterator end();
+
+            /*!
+             * @details loop through raw lines, without mapping nor splitting them into fields. This is meant
+             * for code which decodes lines by itself, like headers generated by **rbfgen**.
+             * @param[in] f function called with each line as a **const string&**
+             * @warning when only text fields are transcoded (see **setCodePage()**), lines are given untranscoded
+             */
+            template <typename Function>
+                void for_each_line(Function f)
+                {
+                    for (auto it = begin(), last = end(); it != last; ++it)
+                    {
+                        f(it.line());
+                    }
+                }
+
+            /*!
+             * @details loop through lines of the bound record only, populating a user struct from each one.
+             * Other records are skipped, and no **Field** value is set.
+             * @param[in] binding struct binding, for one record of the layout
+             * @param[in] f function called with the populated struct as a **const T&**. The same struct
+             * is reused from one line to the next.
+             */
+            template <typename T, typename Function>
+                void for_each_bound(const Binding<T>& binding, Function f)
+                {
+                    auto record_name = binding.record_name();
+                    T obj{};
+
+                    for (auto it = begin(), last = end(); it != last; ++it)
+                    {
+                        if (it.map() != record_name)
+                            continue;
+
+                        binding.populate(it.line(), obj);
+                        f(static_cast<const T&>(obj));
+                    }
+                }
+
+            /*!
+             * @details loop through lines of the filtered record matching a filter. Lines are only mapped, and
+             * checked from their raw bytes: rejected lines are never split into fields.
+             * @param[in] filter filter on one record of the layout
+             * @param[in] f function called with each matching record as a **RecordPtr&**, its fields being set
+             */
+            template <typename Function>
+                void for_each_matching(const Filter& filter, Function f)
+                {
+                    auto record_name = filter.record_name();
+
+                    for (auto it = begin(), last = end(); it != last; ++it)
+                    {
+                        if (it.map() != record_name || !filter.match(it.line()))
+                            continue;
+
+                        f(*it);
+                    }
+                }
+
+            /*!
+             * @details loop through lines of the batch record, by batches. Lines are only mapped and copied into
+             * the batch, which is given to the function each time it's full, and once more with the last lines.
+             * @param[in] batch batch of the read record, cleared first
+             * @param[in] f function called with each batch as a **const RecordBatch&**
+             */
+            template <typename Function>
+                void for_each_batch(RecordBatch& batch, Function f)
+                {
+                    auto record_name = batch.record_name();
+                    batch.clear();
+
+                    for (auto it = begin(), last = end(); it != last; ++it)
+                    {
+                        if (it.map() != record_name)
+                            continue;
+
+                        batch.push_back(it.line());
+                        if (batch.full())
+                        {
+                            f(static_cast<const RecordBatch&>(batch));
+                            batch.clear();
+                        }
+                    }
+
+                    if (!batch.empty())
+                        f(static_cast<const RecordBatch&>(batch));
+                }
+
+            /*!
+             * @details loop through batches of lines of the filtered record, selecting lines matching a filter
+             * column by column (see **Filter::select()**). Batches without any matching line are skipped.
+             * @param[in] filter filter on one record of the layout
+             * @param[in] f function called with each batch as a **const RecordBatch&**, and its matching lines as a
+             * **const Selection&**
+             * @param[in] capacity number of lines of a batch
+             */
+            template <typename Function>
+                void for_each_selected(const Filter& filter, Function f, size_t capacity = BATCH_SIZE)
+                {
+                    RecordBatch batch(*_rdata.layout[filter.record_name()], capacity);
+                    Selection selection;
+
+                    for_each_batch(batch, [&](const RecordBatch& b) {
+                        filter.select(b, selection);
+                        if (!selection.none())
+                            f(b, static_cast<const Selection&>(selection));
+                    });
+                }
+
+            /*!
+             * @details push all records into a ring, mapping lines without splitting them into fields. The
+             * ring is closed once the whole file is read, or if an exception is thrown. This is meant to be
+             * run by a producer thread, while consumers acquire records from the ring.
+             * @param[in] ring ring built from the reader layout
+             */
+            void fill(RecordRing& ring);
+
+            /*!
+             * @details copy the lines of some records into another file, byte for byte. Lines are only mapped to
+             * their record name, and consecutive kept lines are copied as a single block by the kernel
+             * (**copy_file_range()** or **sendfile()**), without passing through user space. When the
+             * kernel can't copy between both files, blocks are written from a mapping of the input file.
+             * The record length and delimiter of the reader are used to split lines.
+             * @param[in] output_file file created or truncated
+             * @param[in] keep function called with the record name of each line, returning true to copy it
+             * @return number of lines copied
+             * @throw runtime_error on any I/O error, or if the input file is compressed
+             * @warning when a code page is set, the mapper is given a transcoded copy of the line
+             *
+             * @code
+             * Reader reader("world_data.txt", layout, [](string s) { return s.substr(0,4); });
+             * reader.copy_if("countries.txt", [](const string& name) { return name == "COUN"; });
+             * @endcode
+             */
+            size_t copy_if(const string& output_file, function <bool (const string&)> keep);
     };
 
 }
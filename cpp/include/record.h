@@ -12,6 +12,7 @@ using namespace std;
 #include <sstream>
 
 #include <field.h>
+#include <resource.h>
 
 namespace rbf
 {
@@ -112,11 +113,14 @@ namespace rbf
             private:
                 // true if field_name exist
 
-                using FieldList = vector<Field>;
+                using FieldList = vector<Field, PolymorphicAllocator<Field>>;
                 using FieldPtr = unique_ptr<Field>;
 
+                MemoryResource *_resource;                        // where fields and the buffer are allocated
                 FieldList _field_list;                            // hold the list of fields
                 unordered_map<string, vector<size_t>> _field_map; // hold hashmap of field index having the same name
+                char *_buffer {nullptr};                          // values of all fields, record length bytes
+                size_t _capacity {0};                             // buffer size
 
             public:
                 /*!
@@ -131,8 +135,10 @@ namespace rbf
                  * @brief Record default constructor
                  * @param[in] name record name
                  * @param[in] description record representation
+                 * @param[in] resource memory resource for the field list and the record buffer
                  */
-                Record(const string& name, const string& description) : DataElement(name, description, 0) 
+                Record(const string& name, const string& description, MemoryResource *resource = default_resource()) : 
+                    DataElement(name, description, 0), _resource{resource}, _field_list(PolymorphicAllocator<Field>(resource))
                 {
                     _field_list.reserve(RECORD_INITIAL_SIZE);
                 } 
@@ -145,6 +151,11 @@ namespace rbf
                  */
                 Record(const Record& r);
 
+                /*!
+                 * @brief Record copy assignment is not allowed, as fields refer to the record buffer
+                 */
+                Record& operator=(const Record& r) = delete;
+
                 // dtor
                 virtual ~Record();
                 //
@@ -160,15 +171,37 @@ namespace rbf
                 string value(const char separator = ';') const;
 
                 /*!
-                 * @return the string value which is the concatenation of all fields raw_value
+                 * @return the string value which is the concatenation of all fields raw_value. All field
+                 * values are held by this single buffer, fields referring to ranges in it.
+                 */
+                inline string raw_value() const { return _length == 0 ? string() : string(_buffer, _length); }
+
+                /*!
+                 * @return a pointer on the record buffer, without any copy
                  */
-                string raw_value() const;
+                inline const char *raw_data() const { return _buffer; }
 
                 /*!
-                 * @details set record value by setting all included field values individually
-                 * @param[in] string value to set
+                 * @return the memory resource used by the record
                  */
-                void setValue(string s);
+                inline MemoryResource *resource() const { return _resource; }
+
+                /*!
+                 * @details set record value: the string is copied into the record buffer at once, and each
+                 * field value is then blank-stripped
+                 * @param[in] string value to set. It's blank-padded when shorter than the record, and
+                 * truncated when longer.
+                 */
+                void setValue(const string& s);
+
+                /*!
+                 * @details same as above, the blank-stripped value range of each field being already known (e.g.
+                 * from a parse cache), so no field is scanned
+                 * @param[in] s string value to set
+                 * @param[in] bounds first and last offsets of each blank-stripped field value within the field,
+                 * in field order (2 per field)
+                 */
+                void setValue(const string& s, const uint32_t *bounds);
 
                 /*!
                  * @details append a Field object in the record
@@ -198,6 +231,28 @@ namespace rbf
                  * @warning this method returns the value of the first field matching the argument
                  */
                 string get_field_value(const string& field_name);
+
+                /*!
+                 * @details get a handle on a field, to be used with typed accessors. Resolving
+                 * the handle once avoids a name lookup for each record read.
+                 * @param[in] field name to fetch
+                 * @return handle of the first field matching the argument
+                 * @throw runtime_error if the field is not found
+                 */
+                size_t handle(const string& field_name) const;
+
+                /*!
+                 * @details typed access to a field value, converted from its raw value
+                 * @tparam T target type (**int64_t**, **Decimal**, **double**, **Date** or **string**)
+                 * @param[in] handle field handle as returned by **handle()**
+                 *
+                 * @code
+                 * auto h = rec.handle("POPULATION");
+                 * int64_t population = rec.get<int64_t>(h);
+                 * @endcode
+                 */
+                template <typename T>
+                    T get(size_t handle) const { return _field_list[handle].get<T>(); }
                 //string operator()(const string& field_name) const { return operator()(field_name); };
 
                 //string operator()(const char *field_name) { return this->operator()(string(field_name)); }
@@ -205,10 +260,10 @@ namespace rbf
                 /*!
                  * @details iterator to loop through fields
                  */
-                vector<Field>::iterator begin() { return _field_list.begin(); }
-                vector<Field>::iterator end() { return _field_list.end(); }
-                vector<Field>::const_iterator begin() const { return _field_list.begin(); }
-                vector<Field>::const_iterator end() const { return _field_list.end(); }
+                FieldList::iterator begin() { return _field_list.begin(); }
+                FieldList::iterator end() { return _field_list.end(); }
+                FieldList::const_iterator begin() const { return _field_list.begin(); }
+                FieldList::const_iterator end() const { return _field_list.end(); }
                 //vector<Field>::const_iterator cbegin() const { cout << "const_iterator2 called!!" << endl;return _field_list.cbegin(); }
                 //vector<Field>::const_iterator cend() const { return _field_list.cend(); }
 
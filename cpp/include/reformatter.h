@@ -0,0 +1,213 @@
+#ifndef REFORMATTER_H
+#define REFORMATTER_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <functional>
+#include <stdexcept>
+
+using namespace std;
+
+#include <record.h>
+#include <layout.h>
+#include <ebcdic.h>
+
+namespace rbf
+{
+
+    /*!
+     * @enum Justify
+     * @brief Where a value is placed within a resized field
+     */
+    enum class Justify
+    {
+        LEFT,               ///< text and dates: padded on the right
+        RIGHT,              ///< numbers: padded on the left
+    };
+
+    /*!
+     * @struct CopyStep
+     * @brief Copy of one source field into one target field, as compiled by **Reformatter**
+     * @details Fields of the same length are copied as-is, and consecutive ones are merged into a single
+     * step. Resized fields are justified, and padded with the **pad** byte.
+     */
+    struct CopyStep
+    {
+        size_t src_offset;
+        size_t dst_offset;
+        size_t src_length;
+        size_t dst_length;
+        Justify justify;
+        char pad;
+        bool truncate;          ///< when a value is too long: keep its first bytes, or throw
+        bool text_number;       ///< INTEGER or DECIMAL value, padded again when resized
+        string name;            ///< target field name, for error messages
+    };
+
+    /*!
+     * @struct RecordPlan
+     * @brief All copies needed to reformat the lines of a source record
+     */
+    struct RecordPlan
+    {
+        string target_name;         ///< target record name
+        size_t source_length;       ///< source record length
+        string image;               ///< target record with all fields padded: unmapped fields keep this value
+        vector<CopyStep> steps;     ///< sorted by target offset
+        char zero;                  ///< zero digit and signs in the file code page
+        char minus;
+        char plus;
+    };
+
+    /*!
+     * @class Reformatter
+     * @brief Reformat a record-based file from a layout into another one, without splitting lines into fields
+     * @details Each source record is mapped to the target record of the same name, and each target field to the
+     * source field of the same name, unless told otherwise. These mappings are compiled into a plan per record,
+     * made of byte offsets and lengths only, so reformatting a line is a **memcpy()** of the target image
+     * followed by a **memcpy()** per (group of) fields. No **Field** value is ever set.
+     *
+     * Fields are copied byte for byte, so mapped fields must have the same type (and decimals or date format).
+     * When a field is resized, text and dates are left-justified, and numbers right-justified. Text is
+     * truncated when shrunk, numbers can only lose their padding: blanks and leading zeros for INTEGER and
+     * DECIMAL fields, leading zeros for ZONED ones and leading zero bytes for PACKED ones. INTEGER and DECIMAL
+     * values are padded again as they were: with zeros after their sign (as written by **Writer**), or with
+     * blanks before it. One digit is kept before a decimal point.
+     *
+     * The input file is split into chunks, reformatted by several threads, and written in order.
+     *
+     * **Example**
+     *
+     * @code
+     * Layout v1{"partner_v1.xml"}, v2{"partner_v2.xml"};
+     * Reformatter reformatter(v1, v2);
+     * reformatter.setRecordMapping("CUST", "CLNT");
+     * reformatter.setFieldMapping("CLNT", "CLIENT_NAME", "NAME");
+     * reformatter.setFieldValue("CLNT", "ID", "CLNT");
+     * reformatter.run("input.txt", "output.txt", [](string s) { return s.substr(0,4); });
+     * @endcode
+     */
+    class Reformatter
+    {
+        private:
+            Layout& _source;
+            Layout& _target;
+
+            map<string, string> _record_mapping;                // source record -> target record
+            map<string, map<string, string>> _field_mapping;    // target record -> target field -> source field
+            map<string, map<string, string>> _field_values;     // target record -> target field -> constant value
+            map<string, RecordPlan> _plans;                     // by source record name
+            bool _compiled {false};
+
+            size_t _record_length {0};      // 0 for line-based files
+            char _delimiter {'\n'};
+            char _blank {' '};              // blank, zero digit and signs in the file code page
+            char _zero {'0'};
+            char _minus {'-'};
+            char _plus {'+'};
+
+            // plan for one record
+            RecordPlan compile(Record& source, Record& target);
+
+            // reformat a chunk of lines
+            size_t reformat(const char *p, size_t size, const function <string (string)>& mapper, string& out) const;
+
+        public:
+            Reformatter() = delete;
+            Reformatter(const Reformatter& other) = delete;
+            Reformatter& operator=(const Reformatter& other) = delete;
+
+            /*!
+             * @brief Reformatter constructor
+             * @param[in] source layout of the input file
+             * @param[in] target layout of the output file
+             */
+            Reformatter(Layout& source, Layout& target): _source{source}, _target{target} {}
+
+            /*!
+             * @details map a source record to a target record with another name
+             */
+            inline void setRecordMapping(const string& source_record, const string& target_record) {
+                _record_mapping[source_record] = target_record;
+                _compiled = false;
+            }
+
+            /*!
+             * @details map a target field to a source field with another name
+             * @param[in] target_record target record name
+             * @param[in] target_field field of the target record
+             * @param[in] source_field field of the matching source record, empty to leave the target field blank
+             */
+            inline void setFieldMapping(const string& target_record, const string& target_field, const string& source_field) {
+                _field_mapping[target_record][target_field] = source_field;
+                _compiled = false;
+            }
+
+            /*!
+             * @details fill a target field with a constant value, e.g. a record ID
+             * @param[in] target_record target record name
+             * @param[in] target_field field of the target record
+             * @param[in] value raw value, left-justified and truncated to the field length
+             */
+            inline void setFieldValue(const string& target_record, const string& target_field, const string& value) {
+                _field_values[target_record][target_field] = value;
+                _compiled = false;
+            }
+
+            /*!
+             * @details read fixed-length records (without any delimiter) instead of lines. Output records have
+             * no delimiter either.
+             * @param[in] length source record length in bytes, 0 to read lines
+             */
+            inline void setRecordLength(size_t length) { _record_length = length; }
+
+            /*!
+             * @details change the line delimiter, used for both input and output files
+             */
+            inline void setDelimiter(char delimiter) { _delimiter = delimiter; }
+
+            /*!
+             * @details set the code page of both files, used for padding bytes. Lines are not transcoded, so the
+             * mapper is given raw lines.
+             */
+            void setCodePage(CodePage cp);
+
+            /*!
+             * @details build the plans of all source records having a target record. It's done by **run()** when
+             * needed.
+             * @throw runtime_error if a mapped field is not found, or can't be copied byte for byte
+             */
+            void compile();
+
+            /*!
+             * @return the plan of a source record
+             * @throw runtime_error if the record has no target record
+             */
+            const RecordPlan& plan(const string& source_record);
+
+            /*!
+             * @details reformat a single line
+             * @param[in] plan plan of the line record
+             * @param[in] line raw line. Short lines are blank-padded.
+             * @param[in] length line length
+             * @param[out] out pointer on **plan.image.length()** bytes
+             * @throw runtime_error if a numeric value doesn't fit its target field
+             */
+            static void apply(const RecordPlan& plan, const char *line, size_t length, char *out);
+
+            /*!
+             * @details reformat a whole file
+             * @param[in] input_file file of the source layout
+             * @param[in] output_file file created or truncated
+             * @param[in] mapper function returning the record name of a line. It's called by several threads.
+             * @param[in] nb_threads number of threads, 0 for the number of cores
+             * @return number of lines reformatted
+             * @throw runtime_error on any I/O error, or if a line record has no target record
+             */
+            size_t run(const string& input_file, const string& output_file, function <string (string)> mapper, size_t nb_threads = 0);
+    };
+
+}
+
+#endif // REFORMATTER_H
@@ -0,0 +1,160 @@
+/**
+ * @file Memory resources used for record and field storage
+ */
+#ifndef RESOURCE_H
+#define RESOURCE_H
+
+#include <cstddef>
+#include <memory>
+
+using namespace std;
+
+namespace rbf
+{
+
+    /// size of the first chunk of a monotonic resource
+    constexpr size_t MONOTONIC_INITIAL_SIZE = 4096;
+
+    /*!
+     * @class MemoryResource
+     * @brief Abstract memory resource, modelled after C++17 **std::pmr::memory_resource**
+     * @details Records, fields, layouts and record snapshots take an optional memory resource, so their storage
+     * can be allocated from an arena instead of the global heap. When not given, **default_resource()** is used,
+     * which calls **new** and **delete**. Readers don't take any: their buffers live as long as the reader, so
+     * an arena reset after each batch is given to snapshots instead.
+     */
+    class MemoryResource
+    {
+        public:
+            virtual ~MemoryResource() = default;
+
+            /*!
+             * @return a pointer on **bytes** bytes aligned on **alignment**
+             * @throw bad_alloc if memory can't be allocated
+             */
+            inline void *allocate(size_t bytes, size_t alignment = alignof(max_align_t)) { return do_allocate(bytes, alignment); }
+
+            /*!
+             * @details give back memory returned by **allocate()** with the same size and alignment
+             */
+            inline void deallocate(void *p, size_t bytes, size_t alignment = alignof(max_align_t)) { do_deallocate(p, bytes, alignment); }
+
+            /*!
+             * @return true if memory allocated by one resource can be deallocated by the other
+             */
+            inline bool is_equal(const MemoryResource& other) const noexcept { return this == &other || do_is_equal(other); }
+
+        protected:
+            virtual void *do_allocate(size_t bytes, size_t alignment) = 0;
+            virtual void do_deallocate(void *p, size_t bytes, size_t alignment) = 0;
+            virtual bool do_is_equal(const MemoryResource& other) const noexcept { return this == &other; }
+    };
+
+    /*!
+     * @return the resource using **new** and **delete**, used when no resource is given
+     */
+    MemoryResource *default_resource() noexcept;
+
+    /*!
+     * @class MonotonicResource
+     * @brief An arena: memory is allocated by bumping a pointer into chunks, and is only given back at once
+     * @details **deallocate()** does nothing. **reset()** makes the memory available again while keeping the
+     * largest chunk, so a batch of records can be processed without reaching the upstream resource once
+     * the arena is large enough.
+     * @warning not thread safe
+     *
+     * **Example**
+     *
+     * @code
+     * MonotonicResource arena;
+     * Reader reader(rbffile, layout, mapper);
+     *
+     * vector<RecordSnapshot> batch;
+     * for (auto& rec: reader)
+     * {
+     *     batch.emplace_back(rec, &arena);
+     *     if (batch.size() == 1000)
+     *     {
+     *         process(batch);
+     *         batch.clear();
+     *         arena.reset();
+     *     }
+     * }
+     * @endcode
+     */
+    class MonotonicResource : public MemoryResource
+    {
+        private:
+            struct Chunk
+            {
+                Chunk *next;
+                size_t size;            // usable size, after the header
+            };
+
+            MemoryResource *_upstream;
+            size_t _next_size;          // size of the next chunk to allocate
+            Chunk *_chunks {nullptr};   // last allocated chunk first
+            char *_current {nullptr};   // free space in the last chunk
+            size_t _left {0};
+
+        protected:
+            void *do_allocate(size_t bytes, size_t alignment) override;
+            void do_deallocate(void *, size_t, size_t) override {}
+
+        public:
+            MonotonicResource(const MonotonicResource& other) = delete;
+            MonotonicResource& operator=(const MonotonicResource& other) = delete;
+
+            /*!
+             * @brief MonotonicResource constructor
+             * @param[in] initial_size size of the first chunk. Each next chunk is twice as large.
+             * @param[in] upstream resource used to allocate chunks
+             */
+            explicit MonotonicResource(size_t initial_size = MONOTONIC_INITIAL_SIZE, MemoryResource *upstream = default_resource());
+
+            virtual ~MonotonicResource() { release(); }
+
+            /*!
+             * @details give all chunks back to the upstream resource
+             */
+            void release();
+
+            /*!
+             * @details make all memory available again, keeping only the largest chunk
+             * @warning all memory previously allocated is invalidated
+             */
+            void reset();
+    };
+
+    /*!
+     * @class PolymorphicAllocator
+     * @brief Standard allocator using a memory resource, modelled after **std::pmr::polymorphic_allocator**
+     */
+    template <typename T>
+        class PolymorphicAllocator
+        {
+            private:
+                MemoryResource *_resource;
+
+            public:
+                using value_type = T;
+
+                PolymorphicAllocator(MemoryResource *resource = default_resource()) noexcept: _resource{resource} {}
+
+                template <typename U>
+                    PolymorphicAllocator(const PolymorphicAllocator<U>& other) noexcept: _resource{other.resource()} {}
+
+                inline T *allocate(size_t n) { return static_cast<T *>(_resource->allocate(n * sizeof(T), alignof(T))); }
+                inline void deallocate(T *p, size_t n) { _resource->deallocate(p, n * sizeof(T), alignof(T)); }
+
+                inline MemoryResource *resource() const noexcept { return _resource; }
+
+                template <typename U>
+                    inline bool operator==(const PolymorphicAllocator<U>& other) const noexcept { return _resource->is_equal(*other.resource()); }
+                template <typename U>
+                    inline bool operator!=(const PolymorphicAllocator<U>& other) const noexcept { return !(*this == other); }
+        };
+
+}
+
+#endif // RESOURCE_H
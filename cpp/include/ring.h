@@ -0,0 +1,207 @@
+#ifndef RING_H
+#define RING_H
+
+#include <string>
+#include <vector>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <stdexcept>
+
+using namespace std;
+
+#include <record.h>
+#include <layout.h>
+
+namespace rbf
+{
+
+    /*!
+     * @enum RingPolicy
+     * @brief What to do when a record is pushed into a full ring
+     */
+    enum class RingPolicy
+    {
+        BLOCK,              ///< wait for a consumer to release a slot
+        SPILL,              ///< copy the record on the heap, records are still consumed in order
+    };
+
+    class RecordRing;
+
+    /// a record copied on the heap when the ring is full, with its descriptor
+    using SpilledRecord = pair<const Record *, string>;
+
+    /*!
+     * @class RecordSlot
+     * @brief A record value held by a **RecordRing**, until it's released
+     * @details Like **RecordSnapshot**, the record is only used as a descriptor: values are trimmed or
+     * converted on access from the raw bytes held by the ring.
+     */
+    class RecordSlot
+    {
+        private:
+            friend class RecordRing;
+
+            const Record *_record {nullptr};        // record descriptor
+            const char *_data {nullptr};            // raw values of all fields, record length bytes
+            size_t _index {0};                      // slot index in the ring
+            list<SpilledRecord>::iterator _spilled; // heap copy, when _data is not in the ring
+            bool _is_spilled {false};
+
+        public:
+            /*!
+             * @return the record name
+             */
+            inline string name() const { return _record->name(); }
+
+            /*!
+             * @return the record descriptor
+             */
+            inline const Record& record() const { return *_record; }
+
+            /*!
+             * @return the concatenation of all field raw values
+             */
+            inline string raw_value() const { return string(_data, _record->length()); }
+
+            /*!
+             * @return the string value which is the concatenation of all fields values
+             */
+            string value(const char separator = ';') const;
+
+            /*!
+             * @details convert the raw value of a field, without building any intermediate string
+             * @param[in] handle field handle as returned by **Record::handle()**
+             * @param[out] value converted value
+             * @return conversion status
+             */
+            template <typename T>
+                inline ConvStatus get(size_t handle, T& value) const
+                {
+                    auto& f = *(_record->begin() + handle);
+                    return f.type().decode(_data + f.lower_bound(), f.length(), value);
+                }
+
+            /*!
+             * @details typed access to a field value, as **Record::get()**
+             * @throw runtime_error if the raw value can't be converted
+             */
+            template <typename T>
+                T get(size_t handle) const
+                {
+                    T value;
+                    auto status = get(handle, value);
+                    if (status != ConvStatus::OK)
+                        throw runtime_error("field " + (_record->begin() + handle)->name() + ": " + conv_message(status));
+                    return value;
+                }
+    };
+
+    /*!
+     * @class RecordRing
+     * @brief A fixed-size ring of record slots, to pass records from a producer to consumers
+     * @details All slots are allocated once, in a single slab whose slot size is the longest record length
+     * of the layout. The producer (usually **Reader::fill()**) copies each line into the next free slot, and
+     * consumers get slots in order with **acquire()**. A slot is reused only once it's been released, so a
+     * consumer can keep a record as long as needed without any heap allocation.
+     *
+     * When all slots are in use, the producer either waits or spills records on the heap,
+     * depending on the ring policy.
+     *
+     * @warning the layout must outlive the ring and its slots
+     *
+     * **Example**
+     *
+     * @code
+     * RecordRing ring(layout, 64);
+     * thread producer([&]() { reader.fill(ring); });
+     *
+     * RecordSlot slot;
+     * while (ring.acquire(slot))
+     * {
+     *     cout << slot.value(';') << endl;
+     *     ring.release(slot);
+     * }
+     * producer.join();
+     * @endcode
+     */
+    class RecordRing
+    {
+        private:
+            enum class State { FREE, FILLED, ACQUIRED };
+
+            struct Slot
+            {
+                const Record *record {nullptr};
+                State state {State::FREE};
+            };
+
+            RingPolicy _policy;
+            size_t _slot_size {0};                  // longest record length
+            unique_ptr<char[]> _slab;               // all slots values
+            vector<Slot> _slots;
+
+            size_t _head {0};                       // next slot to acquire
+            size_t _tail {0};                       // next slot to fill
+            size_t _filled {0};                     // number of slots filled, not yet acquired
+
+            // spilled records in order. Acquired ones are moved to _acquired until released.
+            list<SpilledRecord> _spill;
+            list<SpilledRecord> _acquired;
+
+            bool _closed {false};
+
+            mutex _mutex;
+            condition_variable _not_full;
+            condition_variable _not_empty;
+
+        public:
+            RecordRing() = delete;
+            RecordRing(const RecordRing& other) = delete;
+            RecordRing& operator=(const RecordRing& other) = delete;
+
+            /*!
+             * @brief RecordRing constructor
+             * @param[in] layout layout of the records pushed into the ring
+             * @param[in] capacity number of slots
+             * @param[in] policy what to do when all slots are in use
+             */
+            RecordRing(Layout& layout, size_t capacity, RingPolicy policy = RingPolicy::BLOCK);
+
+            /*!
+             * @return the number of slots
+             */
+            inline size_t capacity() const { return _slots.size(); }
+
+            /*!
+             * @details copy a record value into the next free slot. Lines shorter than the record are
+             * blank-padded, longer ones are truncated.
+             * @param[in] rec record descriptor, from the ring layout
+             * @param[in] line raw line
+             * @param[in] len line length
+             * @throw runtime_error if the ring is closed, including while waiting for a free slot
+             */
+            void push(const Record& rec, const char *line, size_t len);
+
+            /*!
+             * @details no more records will be pushed: consumers are woken up once all records are acquired
+             */
+            void close();
+
+            /*!
+             * @details get the oldest record not acquired yet, waiting for the producer if needed
+             * @param[out] slot slot holding the record, valid until released
+             * @return false when the ring is closed and all records have been acquired
+             */
+            bool acquire(RecordSlot& slot);
+
+            /*!
+             * @details give back a slot to the producer. Each acquired slot must be released once.
+             */
+            void release(RecordSlot& slot);
+    };
+
+}
+
+#endif // RING_H
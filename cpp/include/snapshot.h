@@ -0,0 +1,163 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <string>
+#include <memory>
+#include <stdexcept>
+
+using namespace std;
+
+#include <record.h>
+#include <layout.h>
+#include <resource.h>
+
+namespace rbf
+{
+
+    /*!
+     * @class RecordSnapshot
+     * @brief An immutable copy of a record value, which outlives iteration
+     * @details The **Reader** always returns the same **Record** object for a given record name, whose
+     * values are overwritten by the next matching line. A snapshot keeps a copy of the record value,
+     * made of:
+     *
+     * * a shared pointer on the record, used as a descriptor only (field names, bounds and types)
+     * * one contiguous buffer holding the raw values of all fields
+     *
+     * So retaining a record costs one allocation and one copy of the record buffer. Field values
+     * are trimmed or converted on access. The buffer is allocated from a memory resource, e.g. an
+     * arena reset after each batch of records.
+     *
+     * @warning fields must not be added to or removed from the record while snapshots of it are alive
+     *
+     * **Example**
+     *
+     * @code
+     * vector<RecordSnapshot> window;
+     * for (auto& rec: reader)
+     * {
+     *     window.emplace_back(rec);
+     * }
+     * auto h = window[0].handle("POPULATION");
+     * int64_t population = window[0].get<int64_t>(h);
+     * @endcode
+     */
+    class RecordSnapshot
+    {
+        private:
+            shared_ptr<const Record> _record;       // record descriptor
+            MemoryResource *_resource {default_resource()};
+            char *_data {nullptr};                  // raw values of all fields, record length bytes
+            size_t _length {0};
+
+            // copy raw values into a new buffer
+            void copy(const char *data, size_t length);
+
+        public:
+            /*!
+             * @brief RecordSnapshot default constructor
+             * @details Create an empty snapshot, not bound to any record
+             */
+            RecordSnapshot() = default;
+
+            /*!
+             * @brief RecordSnapshot constructor
+             * @details Copy the current value of the record
+             * @param[in] rec record as returned by the **Reader** or the **Layout**
+             * @param[in] resource memory resource for the snapshot buffer. It must outlive the snapshot.
+             */
+            explicit RecordSnapshot(const RecordPtr& rec, MemoryResource *resource = default_resource());
+
+            /*!
+             * @brief RecordSnapshot copy constructor
+             * @details The buffer is copied, using the same memory resource
+             */
+            RecordSnapshot(const RecordSnapshot& other);
+            RecordSnapshot(RecordSnapshot&& other) noexcept;
+            RecordSnapshot& operator=(RecordSnapshot other) noexcept;
+
+            // dtor
+            ~RecordSnapshot();
+
+            /*!
+             * @return true if the snapshot is not bound to any record
+             */
+            inline bool empty() const { return !_record; }
+
+            /*!
+             * @return the record name
+             */
+            inline string name() const { return _record->name(); }
+
+            /*!
+             * @return the number of fields in the record
+             */
+            inline size_t size() const { return _record->size(); }
+
+            /*!
+             * @return the record descriptor. Its field values are those of the last line read, not
+             * those of the snapshot.
+             */
+            inline const Record& record() const { return *_record; }
+
+            /*!
+             * @return the concatenation of all field raw values
+             */
+            inline string raw_value() const { return string(_data, _length); }
+
+            /*!
+             * @return a pointer on the snapshot buffer, without any copy
+             */
+            inline const char *raw_data() const { return _data; }
+
+            /*!
+             * @return the string value which is the concatenation of all fields values
+             */
+            string value(const char separator = ';') const;
+
+            /*!
+             * @details same as **Record::handle()**
+             */
+            inline size_t handle(const string& field_name) const { return _record->handle(field_name); }
+
+            /*!
+             * @details access to a Field value
+             * @param[in] field name to fetch
+             * @return field value
+             * @warning this method returns the value of the first field matching the argument
+             */
+            inline string get_field_value(const string& field_name) const { return get<string>(handle(field_name)); }
+
+            /*!
+             * @details convert the raw value of a field, without building any intermediate string
+             * @param[in] handle field handle as returned by **handle()**
+             * @param[out] value converted value
+             * @return conversion status
+             */
+            template <typename T>
+                inline ConvStatus get(size_t handle, T& value) const
+                {
+                    auto& f = *(_record->begin() + handle);
+                    return f.type().decode(_data + f.lower_bound(), f.length(), value);
+                }
+
+            /*!
+             * @details typed access to a field value, as **Record::get()**
+             * @tparam T target type (**int64_t**, **Decimal**, **double**, **Date** or **string**)
+             * @param[in] handle field handle as returned by **handle()**
+             * @throw runtime_error if the raw value can't be converted
+             */
+            template <typename T>
+                T get(size_t handle) const
+                {
+                    T value;
+                    auto status = get(handle, value);
+                    if (status != ConvStatus::OK)
+                        throw runtime_error("field " + (_record->begin() + handle)->name() + ": " + conv_message(status));
+                    return value;
+                }
+    };
+
+}
+
+#endif // SNAPSHOT_H
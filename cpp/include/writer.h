@@ -0,0 +1,398 @@
+#ifndef WRITER_H
+#define WRITER_H
+
+#include <string>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <cstring>
+#include <vector>
+#include <thread>
+#include <exception>
+#include <algorithm>
+
+#include <sys/uio.h>
+
+#include <record.h>
+#include <layout.h>
+
+using namespace std;
+
+namespace rbf
+{
+
+    /// default size of the writer buffer
+    constexpr size_t WRITER_BUFFER_SIZE = 1 << 20;
+
+    /*!
+     * @class RecordEncoder
+     * @brief Format a record into raw bytes, as done by writers
+     */
+    class RecordEncoder
+    {
+        private:
+            // format typed values into consecutive fields
+            static inline void encode_values(const Record&, char *, size_t) {}
+
+            template <typename T, typename... Args>
+                static void encode_values(const Record& rec, char *p, size_t i, const T& value, const Args&... values)
+                {
+                    if (i >= rec.size())
+                        throw runtime_error("too many values for record " + rec.name());
+
+                    auto& f = *(rec.begin() + i);
+                    check(encode_value(f.type(), p + f.lower_bound(), f.length(), value), f);
+                    encode_values(rec, p, i + 1, values...);
+                }
+
+            // all integral types are written as int64_t
+            template <typename T>
+                static typename enable_if<is_integral<T>::value, ConvStatus>::type
+                    encode_value(const FieldType& ft, char *p, size_t len, const T& value) { return ft.encode(p, len, static_cast<int64_t>(value)); }
+
+            template <typename T>
+                static typename enable_if<!is_integral<T>::value, ConvStatus>::type
+                    encode_value(const FieldType& ft, char *p, size_t len, const T& value) { return ft.encode(p, len, value); }
+
+            static inline ConvStatus encode_value(const FieldType& ft, char *p, size_t len, const char *value) { return ft.encode(p, len, value, strlen(value)); }
+
+        public:
+            /*!
+             * @details throw if a field value can't be formatted
+             * @throw runtime_error if **status** is not **ConvStatus::OK**
+             */
+            static void check(ConvStatus status, const Field& f);
+
+            /*!
+             * @details format the current values of a record. Values are formatted again according to the
+             * field types, except PACKED and ZONED fields which are copied as-is.
+             * @param[in] rec record to format
+             * @param[out] p pointer on **rec.length()** bytes
+             * @throw runtime_error if a value can't be formatted
+             */
+            static void encode(const Record& rec, char *p);
+
+            /*!
+             * @details format typed values, given in field order. Fields without a value are blank.
+             * @param[in] rec record descriptor, only used for its fields
+             * @param[out] p pointer on **rec.length()** bytes
+             * @param[in] values values of the first fields: integral types, **Decimal**, **double**, **Date** or text
+             * @throw runtime_error if a value can't be formatted, or if there're more values than fields
+             */
+            template <typename... Args>
+                static void encode(const Record& rec, char *p, const Args&... values)
+                {
+                    memset(p, ' ', rec.length());
+                    encode_values(rec, p, 0, values...);
+                }
+    };
+
+    /*!
+     * @class Writer
+     * @brief Write fixed-width records into a record-based file
+     * @details Each field is formatted according to its **FieldType** (see **FieldType::encode()**): text is
+     * left-justified and blank-padded, numbers are right-justified and zero-padded, PACKED and ZONED fields
+     * are written in their binary representation. Records are formatted directly into a large buffer,
+     * which is written with **writev()** when full, so no allocation occurs per record.
+     *
+     * **Example**
+     *
+     * @code
+     * Layout layout{"world_data.xml"};
+     * Writer writer("countries.txt", layout);
+     *
+     * // typed values, in field order
+     * writer.write("COUN", "COUN", "France", 66000000, "Paris");
+     *
+     * // current values of a record
+     * for (auto& rec: reader)
+     * {
+     *     writer.write(*rec);
+     * }
+     * writer.close();
+     * @endcode
+     */
+    class Writer
+    {
+        private:
+            string _file_name;
+            Layout& _layout;
+            int _fd {-1};
+
+            unique_ptr<char[]> _buffer;
+            size_t _size;                       // buffer size
+            size_t _used {0};                   // bytes waiting to be written
+
+            char _delimiter[8];                 // written after each record
+            size_t _delimiter_length {1};
+
+            // write all iovecs, whatever the number of bytes written by each call
+            void write_all(struct iovec *iov, int count);
+
+            // get room for a record in the buffer, flushing or enlarging it if needed
+            char *reserve(size_t length);
+
+            // end a record formatted into the buffer
+            inline void commit(char *p, size_t length)
+            {
+                memcpy(p + length, _delimiter, _delimiter_length);
+                _used += length + _delimiter_length;
+            }
+
+        public:
+            Writer() = delete;
+            Writer(const Writer& other) = delete;
+            Writer& operator=(const Writer& other) = delete;
+
+            /*!
+             * @brief Writer constructor
+             * @param[in] file_name output file, created or truncated
+             * @param[in] layout layout of the records to write
+             * @param[in] buffer_size output buffer size. It's enlarged to hold at least the longest record.
+             * @throw runtime_error if the file can't be created
+             */
+            Writer(const string& file_name, Layout& layout, size_t buffer_size = WRITER_BUFFER_SIZE);
+
+            /*!
+             * @brief Writer destructor
+             * @details Remaining records are written, errors are ignored: call **close()** to get them
+             */
+            virtual ~Writer();
+
+            /*!
+             * @details change the record delimiter, **"\n"** by default
+             * @param[in] delimiter up to 8 bytes written after each record, empty for fixed-length records
+             */
+            void setDelimiter(const string& delimiter);
+
+            /*!
+             * @details write a record with the current values of its fields. Values are formatted
+             * again according to the field types, except PACKED and ZONED fields which are copied as-is.
+             * @param[in] rec record to write
+             * @throw runtime_error if a value can't be formatted
+             */
+            inline void write(const Record& rec)
+            {
+                auto length = rec.length();
+                auto p = reserve(length);
+                RecordEncoder::encode(rec, p);
+                commit(p, length);
+            }
+
+            /*!
+             * @details write a record from typed values, given in field order. Fields without a value are blank.
+             * @param[in] rec record descriptor, only used for its fields
+             * @param[in] values values of the first fields: integral types, **Decimal**, **double**, **Date** or text
+             * @throw runtime_error if a value can't be formatted, or if there're more values than fields
+             */
+            template <typename... Args>
+                void write(const Record& rec, const Args&... values)
+                {
+                    auto length = rec.length();
+                    auto p = reserve(length);
+                    RecordEncoder::encode(rec, p, values...);
+                    commit(p, length);
+                }
+
+            /*!
+             * @details same as above, the record being looked up by its name in the layout
+             * @throw runtime_error if the record is not found
+             */
+            template <typename... Args>
+                void write(const string& record_name, const Args&... values)
+                {
+                    if (!_layout.contains(record_name))
+                        throw runtime_error("record " + record_name + " not in layout");
+                    write(*_layout[record_name], values...);
+                }
+
+            /*!
+             * @details write bytes as-is. Large blocks are written along with the buffer in a single
+             * **writev()** call, without being copied.
+             * @param[in] p bytes to write
+             * @param[in] len number of bytes
+             */
+            void write_raw(const char *p, size_t len);
+
+            /*!
+             * @details write all buffered records
+             */
+            void flush();
+
+            /*!
+             * @details write all buffered records and close the file
+             * @throw runtime_error on any write error
+             */
+            void close();
+    };
+
+    /*!
+     * @class MappedWriter
+     * @brief Write a known number of fixed-size records into a memory-mapped file, from several threads
+     * @details The output file is sized up front to **nb_records** slots, each one being a record followed by
+     * the delimiter, and mapped into memory. As the position of each record is known, records can be
+     * formatted in any order, and disjoint ranges of records by different threads, without any lock.
+     * Records shorter than the slot are blank-padded.
+     *
+     * @warning every slot must be written: unwritten ones are left as null bytes
+     *
+     * **Example**
+     *
+     * @code
+     * vector<RecordSnapshot> input = ...;
+     * MappedWriter writer("output.txt", layout, input.size());
+     *
+     * writer.parallel_for(4, [&](size_t first, size_t last) {
+     *     for (auto i = first; i < last; i++)
+     *     {
+     *         auto& snap = input[i];
+     *         writer.write(i, snap.record(), snap.get<string>(0), snap.get<int64_t>(2));
+     *     }
+     * });
+     * writer.close();
+     * @endcode
+     */
+    class MappedWriter
+    {
+        private:
+            string _file_name;
+            Layout& _layout;
+            int _fd {-1};
+
+            char *_map {nullptr};
+            size_t _map_size {0};
+            size_t _nb_records;
+            size_t _record_length;              // slot length, without delimiter
+
+            char _delimiter[8];                 // written after each record
+            size_t _delimiter_length {1};
+
+            // get slot i, checking bounds
+            inline char *slot(size_t i, size_t length)
+            {
+                if (i >= _nb_records)
+                    throw runtime_error("record number " + to_string(i) + " out of range");
+                if (length > _record_length)
+                    throw runtime_error("record longer than slots of file " + _file_name);
+                return _map + i * (_record_length + _delimiter_length);
+            }
+
+            // end a record formatted into a slot
+            inline void commit(char *p, size_t length)
+            {
+                memset(p + length, ' ', _record_length - length);
+                memcpy(p + _record_length, _delimiter, _delimiter_length);
+            }
+
+        public:
+            MappedWriter() = delete;
+            MappedWriter(const MappedWriter& other) = delete;
+            MappedWriter& operator=(const MappedWriter& other) = delete;
+
+            /*!
+             * @brief MappedWriter constructor
+             * @param[in] file_name output file, created or truncated, then sized and mapped
+             * @param[in] layout layout of the records to write
+             * @param[in] nb_records number of records of the file
+             * @param[in] delimiter up to 8 bytes written after each record, empty for fixed-length records
+             * @param[in] record_length slot length, 0 for the longest record of the layout
+             * @throw runtime_error if the file can't be created or mapped
+             */
+            MappedWriter(const string& file_name, Layout& layout, size_t nb_records, const string& delimiter = "\n", size_t record_length = 0);
+
+            /*!
+             * @brief MappedWriter destructor
+             * @details The file is unmapped and closed, errors are ignored: call **close()** to get them
+             */
+            virtual ~MappedWriter();
+
+            /*!
+             * @return the number of records of the file
+             */
+            inline size_t size() const { return _nb_records; }
+
+            /*!
+             * @details write record **i** with the current values of its fields, see **RecordEncoder::encode()**
+             */
+            inline void write(size_t i, const Record& rec)
+            {
+                auto p = slot(i, rec.length());
+                RecordEncoder::encode(rec, p);
+                commit(p, rec.length());
+            }
+
+            /*!
+             * @details write record **i** from typed values given in field order, see **RecordEncoder::encode()**
+             */
+            template <typename... Args>
+                void write(size_t i, const Record& rec, const Args&... values)
+                {
+                    auto p = slot(i, rec.length());
+                    RecordEncoder::encode(rec, p, values...);
+                    commit(p, rec.length());
+                }
+
+            /*!
+             * @details same as above, the record being looked up by its name in the layout
+             * @throw runtime_error if the record is not found
+             */
+            template <typename... Args>
+                void write(size_t i, const string& record_name, const Args&... values)
+                {
+                    if (!_layout.contains(record_name))
+                        throw runtime_error("record " + record_name + " not in layout");
+                    write(i, *_layout[record_name], values...);
+                }
+
+            /*!
+             * @details split all records into **nb_threads** contiguous ranges, and call **f(first, last)** for
+             * each range in its own thread
+             * @param[in] nb_threads number of threads, 0 for the number of cores
+             * @param[in] f function writing records first..last-1
+             * @throw the first exception thrown by **f**, once all threads are done
+             */
+            template <typename Function>
+                void parallel_for(size_t nb_threads, Function f)
+                {
+                    if (nb_threads == 0)
+                        nb_threads = max(1u, thread::hardware_concurrency());
+                    nb_threads = max(static_cast<size_t>(1), min(nb_threads, _nb_records));
+
+                    vector<thread> threads;
+                    vector<exception_ptr> errors(nb_threads);
+                    auto chunk = (_nb_records + nb_threads - 1) / nb_threads;
+
+                    for (size_t t = 0; t < nb_threads; t++)
+                    {
+                        auto first = min(t * chunk, _nb_records);
+                        auto last = min(first + chunk, _nb_records);
+                        threads.emplace_back([&f, &errors, t, first, last]() {
+                            try
+                            {
+                                f(first, last);
+                            }
+                            catch (...)
+                            {
+                                errors[t] = current_exception();
+                            }
+                        });
+                    }
+
+                    for (auto& th: threads) th.join();
+                    for (auto& e: errors)
+                    {
+                        if (e)
+                            rethrow_exception(e);
+                    }
+                }
+
+            /*!
+             * @details unmap and close the file
+             * @throw runtime_error on any error
+             */
+            void close();
+    };
+
+}
+
+#endif // WRITER_H
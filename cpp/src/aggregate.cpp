@@ -0,0 +1,415 @@
+#include <cstring>
+#include <algorithm>
+
+#include <aggregate.h>
+
+namespace rbf
+{
+
+    namespace
+    {
+        // spill files are read by blocks of this size, rounded to whole groups
+        constexpr size_t SPILL_BLOCK_SIZE = 64 * 1024;
+
+        // partitions are split until the 32 lower bits of the key hash are used
+        constexpr size_t MAX_SPILL_DEPTH = 8;
+    }
+
+    bool AggregateState::add(const Decimal& value)
+    {
+        // the sum keeps the largest scale, so it stays exact. The state is left unchanged on overflow.
+        auto common = std::max(scale, value.scale);
+        int64_t x, y, total;
+        if (rescale(Decimal{sum, scale}, common, x) != ConvStatus::OK || rescale(value, common, y) != ConvStatus::OK ||
+            __builtin_add_overflow(x, y, &total))
+            return false;
+
+        if (count == 0 || compare(value, min) < 0)
+            min = value;
+        if (count == 0 || compare(value, max) > 0)
+            max = value;
+
+        sum = total;
+        scale = common;
+        count++;
+        return true;
+    }
+
+    bool AggregateState::merge(const AggregateState& other)
+    {
+        if (other.count == 0)
+            return true;
+
+        // lines are counted by a state without any value
+        auto total = count + other.count;
+        auto min_value = count == 0 || compare(other.min, min) < 0 ? other.min : min;
+        auto max_value = count == 0 || compare(other.max, max) > 0 ? other.max : max;
+
+        auto common = std::max(scale, other.scale);
+        int64_t x, y, total_sum;
+        if (rescale(Decimal{sum, scale}, common, x) != ConvStatus::OK || rescale(Decimal{other.sum, other.scale}, common, y) != ConvStatus::OK ||
+            __builtin_add_overflow(x, y, &total_sum))
+            return false;
+
+        sum = total_sum;
+        scale = common;
+        count = total;
+        min = min_value;
+        max = max_value;
+        return true;
+    }
+
+    Decimal AggregateState::result(Aggregate function) const
+    {
+        switch (function)
+        {
+            case Aggregate::COUNT:
+                return Decimal{count, 0};
+            case Aggregate::SUM:
+                return Decimal{sum, scale};
+            case Aggregate::MIN:
+                return count == 0 ? Decimal{} : min;
+            case Aggregate::MAX:
+                return count == 0 ? Decimal{} : max;
+            case Aggregate::AVG:
+                break;
+        }
+
+        if (count == 0)
+            return Decimal{};
+
+        // as many extra decimals as the sum allows, rounded half away from zero
+        for (auto extra = AVERAGE_DECIMALS + 1; extra-- > 0; )
+        {
+            int64_t m;
+            if (rescale(Decimal{sum, scale}, scale + extra, m) != ConvStatus::OK)
+                continue;
+
+            auto quotient = m / count, remainder = m % count;
+            auto r = remainder < 0 ? -remainder : remainder;
+            if (r >= count - r)
+                quotient += m < 0 ? -1 : 1;
+            return Decimal{quotient, scale + extra};
+        }
+
+        return Decimal{}; // not reached: no extra decimal always fits
+    }
+
+    Aggregator::Column Aggregator::column(size_t handle) const
+    {
+        if (handle >= _record.size())
+            throw runtime_error("no field " + to_string(handle) + " in record " + _record.name());
+
+        auto& f = *(_record.begin() + handle);
+        return Column{f.name(), f.lower_bound(), f.length(), &f.type()};
+    }
+
+    Aggregator& Aggregator::group_by(size_t handle)
+    {
+        if (!_table.empty() || spilled())
+            throw runtime_error("key fields of record " + _record.name() + " can't change once lines are aggregated");
+
+        _keys.push_back(column(handle));
+        _key_length += _keys.back().length;
+        return *this;
+    }
+
+    Aggregator& Aggregator::add(Aggregate function, size_t handle)
+    {
+        if (!_table.empty() || spilled())
+            throw runtime_error("aggregates of record " + _record.name() + " can't change once lines are aggregated");
+
+        auto c = column(handle);
+        switch (c.type->data_type())
+        {
+            case DataType::INTEGER:
+            case DataType::DECIMAL:
+            case DataType::PACKED:
+            case DataType::ZONED:
+                break;
+            default:
+                throw runtime_error("field " + c.name + ": not a numeric field");
+        }
+
+        _functions.push_back(function);
+        _columns.push_back(c);
+        return *this;
+    }
+
+    Aggregator& Aggregator::add(Aggregate function)
+    {
+        if (function != Aggregate::COUNT)
+            throw runtime_error("only lines can be counted without a field");
+        if (!_table.empty() || spilled())
+            throw runtime_error("aggregates of record " + _record.name() + " can't change once lines are aggregated");
+
+        _functions.push_back(function);
+        _columns.push_back(Column{"", 0, 0, nullptr});
+        return *this;
+    }
+
+    void Aggregator::setFilter(const Filter& filter)
+    {
+        if (filter.record_name() != _record.name())
+            throw runtime_error("filter on record " + filter.record_name() + " can't select lines of record " + _record.name());
+        _filter = &filter;
+    }
+
+    bool Aggregator::update(Table& table, const char *line, size_t len, string& key) const
+    {
+        if (_filter && !_filter->match(line, len))
+            return false;
+
+        // raw key bytes, missing ones being blanks
+        key.assign(_key_length, ' ');
+        size_t pos = 0;
+        for (auto const &k: _keys)
+        {
+            if (k.offset < len)
+                memcpy(&key[pos], line + k.offset, min(k.length, len - k.offset));
+            pos += k.length;
+        }
+
+        auto it = table.find(key);
+        if (it == table.end())
+            it = table.emplace(key, vector<AggregateState>(_columns.size())).first;
+        auto& states = it->second;
+
+        for (size_t i = 0; i < _columns.size(); i++)
+        {
+            auto& c = _columns[i];
+            if (c.length == 0)
+            {
+                states[i].count++;
+                continue;
+            }
+
+            auto available = c.offset < len ? min(c.length, len - c.offset) : 0;
+            Decimal value;
+            auto status = c.type->decode(line + min(c.offset, len), available, value);
+
+            if (status == ConvStatus::EMPTY)
+                continue;
+            if (status != ConvStatus::OK)
+                throw runtime_error("field " + c.name + ": " + conv_message(status));
+            if (!states[i].add(value))
+                throw runtime_error("field " + c.name + ": sum out of range");
+        }
+
+        return true;
+    }
+
+    void Aggregator::merge(Table& table, const string& key, const AggregateState *states) const
+    {
+        auto it = table.find(key);
+        if (it == table.end())
+        {
+            table.emplace(key, vector<AggregateState>(states, states + _columns.size()));
+            return;
+        }
+
+        for (size_t i = 0; i < _columns.size(); i++)
+        {
+            if (!it->second[i].merge(states[i]))
+                throw runtime_error("field " + _columns[i].name + ": sum out of range");
+        }
+    }
+
+    void Aggregator::append(string& out, const string& key, const vector<AggregateState>& states) const
+    {
+        out.append(key);
+        out.append(reinterpret_cast<const char *>(states.data()), states.size() * sizeof(AggregateState));
+    }
+
+    void Aggregator::load(Table& table, const char *p, size_t size) const
+    {
+        auto group_size = _key_length + _columns.size() * sizeof(AggregateState);
+        vector<AggregateState> states(_columns.size());
+        string key;
+
+        for (size_t pos = 0; pos + group_size <= size; pos += group_size)
+        {
+            key.assign(p + pos, _key_length);
+            memcpy(static_cast<void *>(states.data()), p + pos + _key_length, states.size() * sizeof(AggregateState));
+            merge(table, key, states.data());
+        }
+    }
+
+    bool Aggregator::full(const Table& table) const
+    {
+        auto group_size = _key_length + _columns.size() * sizeof(AggregateState) + GROUP_OVERHEAD;
+        return _memory_limit != 0 && table.size() * group_size > _memory_limit;
+    }
+
+    void Aggregator::check_memory()
+    {
+        if (full(_table))
+            spill(_table, _spills, 0);
+    }
+
+    size_t Aggregator::partition(const string& key, size_t depth) const
+    {
+        auto h = hash<string>()(key);
+        for (size_t i = 0; i < depth; i++)
+            h /= SPILL_PARTITIONS;
+        return h % SPILL_PARTITIONS;
+    }
+
+    void Aggregator::spill(Table& table, vector<SpillFile>& files, size_t depth) const
+    {
+        if (files.empty())
+        {
+            for (size_t i = 0; i < SPILL_PARTITIONS; i++)
+            {
+                SpillFile file(tmpfile(), fclose);
+                if (!file)
+                    throw runtime_error("unable to create a spill file for record " + _record.name());
+                files.push_back(move(file));
+            }
+        }
+
+        // a group always goes to the same partition
+        vector<string> partitions(SPILL_PARTITIONS);
+        for (auto const &group: table)
+        {
+            append(partitions[partition(group.first, depth)], group.first, group.second);
+        }
+
+        for (size_t i = 0; i < SPILL_PARTITIONS; i++)
+        {
+            auto& data = partitions[i];
+            if (fseek(files[i].get(), 0, SEEK_END) != 0 || fwrite(data.data(), 1, data.length(), files[i].get()) != data.length())
+                throw runtime_error("unable to write a spill file for record " + _record.name());
+        }
+
+        table.clear();
+    }
+
+    void Aggregator::read(FILE *fp, size_t depth, function <void (const GroupResult&)>& f) const
+    {
+        auto group_size = _key_length + _columns.size() * sizeof(AggregateState);
+        string block(max(SPILL_BLOCK_SIZE / group_size, size_t{1}) * group_size, '\0');
+
+        // groups are merged as they're read, and spilled into sub-partitions whenever they outgrow the limit
+        Table partition;
+        vector<SpillFile> files;
+        rewind(fp);
+        for (size_t n; (n = fread(&block[0], 1, block.length(), fp)) != 0; )
+        {
+            load(partition, block.data(), n);
+            if (depth + 1 < MAX_SPILL_DEPTH && full(partition))
+                spill(partition, files, depth + 1);
+        }
+        if (ferror(fp))
+            throw runtime_error("unable to read a spill file for record " + _record.name());
+
+        if (files.empty())
+        {
+            for (auto const &group: partition)
+            {
+                f(result(group.first, group.second));
+            }
+            return;
+        }
+
+        spill(partition, files, depth + 1);
+        for (auto const &file: files)
+        {
+            read(file.get(), depth + 1, f);
+        }
+    }
+
+    GroupResult Aggregator::result(const string& key, const vector<AggregateState>& states) const
+    {
+        GroupResult group;
+
+        size_t pos = 0;
+        for (auto const &k: _keys)
+        {
+            auto value = key.substr(pos, k.length);
+            auto first = value.find_first_not_of(' ');
+            group.keys.push_back(first == string::npos ? "" : value.substr(first, value.find_last_not_of(' ') - first + 1));
+            pos += k.length;
+        }
+
+        for (size_t i = 0; i < _functions.size(); i++)
+        {
+            group.values.push_back(states[i].result(_functions[i]));
+            group.nulls.push_back(states[i].is_null(_functions[i]));
+        }
+
+        return group;
+    }
+
+    void Aggregator::update(const char *line, size_t len)
+    {
+        string key;
+        update(_table, line, len, key);
+        check_memory();
+    }
+
+    size_t Aggregator::run(const string& input_file, function <string (string)> mapper, size_t nb_threads)
+    {
+        MappedFile input(input_file);
+        auto record_name = _record.name();
+
+        // each chunk is aggregated into a partial table, merged once serialized
+        return process_chunks(input.data(), input.size(), _record_length, _delimiter, nb_threads,
+            [&](const char *p, size_t size, string& out) {
+                Table partial;
+                string key;
+                size_t nb_lines = 0;
+
+                for_each_raw_line(p, size, _record_length, _delimiter, [&](const char *line, size_t length, size_t) {
+                    if (length != 0 && mapper(string(line, length)) == record_name)
+                        nb_lines += update(partial, line, length, key);
+                });
+
+                for (auto const &group: partial)
+                {
+                    append(out, group.first, group.second);
+                }
+                return nb_lines;
+            },
+            [&](const string& out) {
+                load(_table, out.data(), out.length());
+                check_memory();
+            });
+    }
+
+    void Aggregator::for_each_group(function <void (const GroupResult&)> f)
+    {
+        if (_spills.empty())
+        {
+            for (auto const &group: _table)
+            {
+                f(result(group.first, group.second));
+            }
+            return;
+        }
+
+        // groups left in memory join their partitions
+        spill(_table, _spills, 0);
+
+        for (auto const &file: _spills)
+        {
+            read(file.get(), 0, f);
+        }
+    }
+
+    vector<GroupResult> Aggregator::results()
+    {
+        vector<GroupResult> groups;
+        for_each_group([&](const GroupResult& group) { groups.push_back(group); });
+
+        sort(groups.begin(), groups.end(), [](const GroupResult& a, const GroupResult& b) { return a.keys < b.keys; });
+        return groups;
+    }
+
+    void Aggregator::clear()
+    {
+        _table.clear();
+        _spills.clear();
+    }
+
+}
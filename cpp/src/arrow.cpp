@@ -0,0 +1,513 @@
+#include <cstring>
+#include <memory>
+#include <algorithm>
+
+#include <arrow.h>
+#include <writer.h>
+#include <chunk.h>
+
+namespace rbf
+{
+
+    namespace
+    {
+        // IPC constants, from the Arrow Schema.fbs and Message.fbs files
+        constexpr uint32_t CONTINUATION = 0xFFFFFFFF;
+        constexpr uint16_t METADATA_V5 = 4;
+        constexpr uint8_t HEADER_SCHEMA = 1;
+        constexpr uint8_t HEADER_RECORD_BATCH = 3;
+        constexpr char MAGIC[] = "ARROW1";
+
+        enum TypeId: uint8_t { INT = 2, FLOATING_POINT = 3, UTF8 = 5, DECIMAL = 7, DATE = 8 };
+
+        // a scalar or offset field of a flatbuffers table. Offsets are written as 0, then linked.
+        struct TableField
+        {
+            uint16_t id;
+            uint8_t size;
+            uint64_t value;
+        };
+
+        // a table written by FlatBuilder: its position and the position of its fields
+        struct Table
+        {
+            size_t pos;
+            vector<size_t> fields;
+        };
+
+        // Flatbuffers offsets must point forward, so objects are written front to back: a parent first, then its
+        // children, whose positions are linked to the parent offsets. Scalars are written in the host order, which
+        // must be little-endian.
+        class FlatBuilder
+        {
+            public:
+                string buf;
+
+                void pad(size_t alignment)
+                {
+                    buf.append((alignment - buf.size() % alignment) % alignment, '\0');
+                }
+
+                template <typename T>
+                    size_t append(T value)
+                    {
+                        auto pos = buf.size();
+                        buf.append(reinterpret_cast<const char *>(&value), sizeof(T));
+                        return pos;
+                    }
+
+                template <typename T>
+                    void put(size_t pos, T value) { memcpy(&buf[pos], &value, sizeof(T)); }
+
+                // make the offset at pos point to target
+                void link(size_t pos, size_t target) { put<uint32_t>(pos, static_cast<uint32_t>(target - pos)); }
+
+                // a vtable followed by its table. Fields are sorted by size, so they're aligned with little padding.
+                Table table(const vector<TableField>& fields)
+                {
+                    uint16_t nb_fields = 0;
+                    for (auto const &f: fields) nb_fields = max(nb_fields, static_cast<uint16_t>(f.id + 1));
+
+                    pad(2);
+                    auto vtable = buf.size();
+                    buf.append(2 * (2 + nb_fields), '\0');
+
+                    pad(4);
+                    Table t;
+                    t.pos = append<int32_t>(static_cast<int32_t>(buf.size() - vtable));
+                    t.fields.resize(fields.size());
+
+                    vector<size_t> order(fields.size());
+                    for (size_t i = 0; i < order.size(); i++) order[i] = i;
+                    stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return fields[a].size > fields[b].size; });
+
+                    for (auto i: order)
+                    {
+                        pad(fields[i].size);
+                        t.fields[i] = buf.size();
+                        buf.append(reinterpret_cast<const char *>(&fields[i].value), fields[i].size);
+                        put<uint16_t>(vtable + 4 + 2 * fields[i].id, static_cast<uint16_t>(t.fields[i] - t.pos));
+                    }
+
+                    put<uint16_t>(vtable, static_cast<uint16_t>(2 * (2 + nb_fields)));
+                    put<uint16_t>(vtable + 2, static_cast<uint16_t>(buf.size() - t.pos));
+                    return t;
+                }
+
+                // a vector of offsets, linked later: the offset i is at the returned position + 4 + 4*i
+                size_t offsets(size_t length)
+                {
+                    pad(4);
+                    auto pos = append<uint32_t>(static_cast<uint32_t>(length));
+                    buf.append(4 * length, '\0');
+                    return pos;
+                }
+
+                // a vector of 8-byte aligned structs
+                size_t structs(const string& data, size_t length)
+                {
+                    while (buf.size() % 8 != 4) buf += '\0';
+                    auto pos = append<uint32_t>(static_cast<uint32_t>(length));
+                    buf += data;
+                    return pos;
+                }
+
+                size_t str(const string& s)
+                {
+                    pad(4);
+                    auto pos = append<uint32_t>(static_cast<uint32_t>(s.length()));
+                    buf += s;
+                    buf += '\0';
+                    return pos;
+                }
+        };
+
+        template <typename T>
+            void append_value(string& out, T value) { out.append(reinterpret_cast<const char *>(&value), sizeof(T)); }
+
+        // number of digits of a PACKED or ZONED field, at most 18 as values are read into an int64_t
+        int32_t precision(const Column& column)
+        {
+            auto digits = column.type->data_type() == DataType::PACKED ? 2 * column.length - 1 : column.length;
+            return static_cast<int32_t>(min<size_t>(max<size_t>(digits, 1), 18));
+        }
+
+        // Arrow type of a column: its id and the fields of its table
+        vector<TableField> arrow_type(const Column& column, uint8_t& type_id)
+        {
+            switch (column.type->data_type())
+            {
+                case DataType::INTEGER:
+                    type_id = INT;
+                    return {{0, 4, 64}, {1, 1, 1}};         // bitWidth, is_signed
+                case DataType::DECIMAL:
+                    type_id = FLOATING_POINT;
+                    return {{0, 2, 2}};                     // DOUBLE
+                case DataType::PACKED:
+                case DataType::ZONED:
+                    type_id = DECIMAL;
+                    return {{0, 4, static_cast<uint64_t>(precision(column))}, {1, 4, column.type->decimals()}, {2, 4, 128}};
+                case DataType::DATE:
+                    type_id = DATE;
+                    return {{0, 2, 0}};                     // DAY
+                default:
+                    type_id = UTF8;
+                    return {};
+            }
+        }
+
+        // write the Schema table linked from pos
+        void build_schema(FlatBuilder& fb, size_t pos, const ExportPlan& plan)
+        {
+            auto schema = fb.table({{0, 2, 0}, {1, 4, 0}});     // little endian, fields
+            fb.link(pos, schema.pos);
+
+            auto fields = fb.offsets(plan.columns.size());
+            fb.link(schema.fields[1], fields);
+
+            for (size_t i = 0; i < plan.columns.size(); i++)
+            {
+                auto& column = plan.columns[i];
+
+                uint8_t type_id;
+                auto type_fields = arrow_type(column, type_id);
+
+                // name, nullable, type, children
+                auto field = fb.table({{0, 4, 0}, {1, 1, 1}, {2, 1, type_id}, {3, 4, 0}, {5, 4, 0}});
+                fb.link(fields + 4 + 4 * i, field.pos);
+                fb.link(field.fields[0], fb.str(column.name));
+                fb.link(field.fields[3], fb.table(type_fields).pos);
+                fb.link(field.fields[4], fb.offsets(0));
+            }
+        }
+
+        // an encapsulated message: continuation, metadata length, metadata padded to 8 bytes. The body follows.
+        template <typename Header>
+            string message(uint8_t header_type, size_t body_length, Header header)
+            {
+                FlatBuilder fb;
+                fb.append<uint32_t>(0);
+                auto msg = fb.table({{0, 2, METADATA_V5}, {1, 1, header_type}, {2, 4, 0}, {3, 8, body_length}});
+                fb.link(0, msg.pos);
+                header(fb, msg.fields[2]);
+                fb.pad(8);
+
+                string out;
+                append_value(out, CONTINUATION);
+                append_value(out, static_cast<int32_t>(fb.buf.size()));
+                return out + fb.buf;
+            }
+
+        string schema_message(const ExportPlan& plan)
+        {
+            return message(HEADER_SCHEMA, 0, [&](FlatBuilder& fb, size_t pos) { build_schema(fb, pos, plan); });
+        }
+
+        // values of a column in the current batch
+        struct ColumnBuilder
+        {
+            string validity;                // bitmap, a bit per row
+            string values;                  // fixed-width values, or offsets of utf8 values
+            string data;                    // utf8 values
+            size_t null_count {0};
+        };
+
+        // rows of a record, encoded as a record batch when the batch is full
+        class BatchBuilder
+        {
+            private:
+                const ExportPlan& _plan;
+                bool _latin1;
+                vector<ColumnBuilder> _columns;
+                size_t _rows {0};
+
+                static void check(ConvStatus status, const Column& column)
+                {
+                    if (status != ConvStatus::OK)
+                        throw runtime_error("field " + column.name + ": " + conv_message(status));
+                }
+
+                // add a value to the column bitmap, and a zeroed value if null
+                bool valid(ColumnBuilder& builder, ConvStatus status, size_t width, const Column& column)
+                {
+                    if (_rows % 8 == 0)
+                        builder.validity += '\0';
+                    if (status == ConvStatus::EMPTY)
+                    {
+                        builder.null_count++;
+                        builder.values.append(width, '\0');
+                        return false;
+                    }
+                    check(status, column);
+                    builder.validity.back() |= static_cast<char>(1 << (_rows % 8));
+                    return true;
+                }
+
+            public:
+                BatchBuilder(const ExportPlan& plan, bool latin1): _plan{plan}, _latin1{latin1}, _columns(plan.columns.size())
+                {
+                    clear();
+                }
+
+                inline size_t rows() const { return _rows; }
+
+                void clear()
+                {
+                    for (size_t i = 0; i < _columns.size(); i++)
+                    {
+                        auto& builder = _columns[i];
+                        builder.validity.clear();
+                        builder.values.clear();
+                        builder.data.clear();
+                        builder.null_count = 0;
+
+                        // utf8 offsets start with 0
+                        auto data_type = _plan.columns[i].type->data_type();
+                        if (data_type == DataType::STRING || data_type == DataType::VOID)
+                            append_value<int32_t>(builder.values, 0);
+                    }
+                    _rows = 0;
+                }
+
+                void append(const char *line, size_t length)
+                {
+                    for (size_t i = 0; i < _columns.size(); i++)
+                    {
+                        auto& column = _plan.columns[i];
+                        auto& builder = _columns[i];
+
+                        // short lines are blank-padded
+                        auto p = line + min(column.offset, length);
+                        auto len = column.offset < length ? min(column.length, length - column.offset) : 0;
+
+                        switch (column.type->data_type())
+                        {
+                            case DataType::INTEGER:
+                            {
+                                int64_t value;
+                                auto status = column.type->decode(p, len, value);
+                                if (valid(builder, status, sizeof(value), column))
+                                    append_value(builder.values, value);
+                                break;
+                            }
+
+                            case DataType::DECIMAL:
+                            {
+                                double value;
+                                auto status = column.type->decode(p, len, value);
+                                if (valid(builder, status, sizeof(value), column))
+                                    append_value(builder.values, value);
+                                break;
+                            }
+
+                            case DataType::PACKED:
+                            case DataType::ZONED:
+                            {
+                                // 128-bit two's complement, low word first
+                                Decimal value;
+                                int64_t mantissa;
+                                auto status = column.type->decode(p, len, value);
+                                if (status == ConvStatus::OK)
+                                    status = rescale(value, column.type->decimals(), mantissa);
+                                if (valid(builder, status, 16, column))
+                                {
+                                    append_value(builder.values, mantissa);
+                                    append_value<int64_t>(builder.values, mantissa < 0 ? -1 : 0);
+                                }
+                                break;
+                            }
+
+                            case DataType::DATE:
+                            {
+                                Date value;
+                                auto status = column.type->decode(p, len, value);
+                                if (valid(builder, status, sizeof(value.days), column))
+                                    append_value(builder.values, value.days);
+                                break;
+                            }
+
+                            default:
+                            {
+                                // trimmed slice
+                                while (len > 0 && *p == ' ') { p++; len--; }
+                                while (len > 0 && p[len-1] == ' ') len--;
+
+                                if (_rows % 8 == 0)
+                                    builder.validity += '\0';
+                                builder.validity.back() |= static_cast<char>(1 << (_rows % 8));
+
+                                append_utf8(builder.data, p, len, _latin1);
+
+                                if (builder.data.size() > INT32_MAX)
+                                    throw runtime_error("field " + column.name + ": batch too large for utf8 offsets");
+                                append_value(builder.values, static_cast<int32_t>(builder.data.size()));
+                                break;
+                            }
+                        }
+                    }
+
+                    _rows++;
+                }
+
+                // the encapsulated record batch message, followed by its body
+                string encode() const
+                {
+                    string nodes, buffers, body;
+                    auto add_buffer = [&](const string& buffer) {
+                        append_value<int64_t>(buffers, body.size());
+                        append_value<int64_t>(buffers, buffer.size());
+                        body += buffer;
+                        body.append((8 - body.size() % 8) % 8, '\0');
+                    };
+
+                    for (size_t i = 0; i < _columns.size(); i++)
+                    {
+                        auto& builder = _columns[i];
+                        append_value<int64_t>(nodes, _rows);
+                        append_value<int64_t>(nodes, builder.null_count);
+
+                        // the bitmap can be omitted without nulls
+                        add_buffer(builder.null_count == 0 ? string() : builder.validity);
+                        add_buffer(builder.values);
+
+                        auto data_type = _plan.columns[i].type->data_type();
+                        if (data_type == DataType::STRING || data_type == DataType::VOID)
+                            add_buffer(builder.data);
+                    }
+
+                    auto metadata = message(HEADER_RECORD_BATCH, body.size(), [&](FlatBuilder& fb, size_t pos) {
+                        auto batch = fb.table({{0, 8, _rows}, {1, 4, 0}, {2, 4, 0}});     // length, nodes, buffers
+                        fb.link(pos, batch.pos);
+                        fb.link(batch.fields[1], fb.structs(nodes, _columns.size()));
+                        fb.link(batch.fields[2], fb.structs(buffers, buffers.size() / 16));
+                    });
+                    return metadata + body;
+                }
+        };
+
+        // location of a record batch in an IPC file
+        struct Block
+        {
+            int64_t offset;
+            int32_t metadata_length;
+            int64_t body_length;
+        };
+
+        // output of a record
+        class ArrowStream
+        {
+            private:
+                Writer _writer;
+                const ExportPlan& _plan;
+                bool _file_format;
+                size_t _size {0};
+                vector<Block> _blocks;
+
+                void write(const string& s)
+                {
+                    _writer.write_raw(s.data(), s.length());
+                    _size += s.length();
+                }
+
+            public:
+                BatchBuilder batch;
+
+                ArrowStream(const string& file_name, Layout& layout, const ExportPlan& plan, bool file_format, bool latin1):
+                    _writer(file_name, layout), _plan{plan}, _file_format{file_format}, batch(plan, latin1)
+                {
+                    if (_file_format)
+                        write(string(MAGIC, sizeof(MAGIC)) + '\0');
+                    write(schema_message(_plan));
+                }
+
+                void flush()
+                {
+                    if (batch.rows() == 0)
+                        return;
+
+                    auto s = batch.encode();
+                    int32_t metadata_length;
+                    memcpy(&metadata_length, &s[4], sizeof(metadata_length));
+                    _blocks.push_back(Block{static_cast<int64_t>(_size), metadata_length + 8,
+                        static_cast<int64_t>(s.size()) - metadata_length - 8});
+
+                    write(s);
+                    batch.clear();
+                }
+
+                void close()
+                {
+                    flush();
+
+                    // end-of-stream marker
+                    string eos;
+                    append_value(eos, CONTINUATION);
+                    append_value<int32_t>(eos, 0);
+                    write(eos);
+
+                    if (_file_format)
+                    {
+                        string blocks;
+                        for (auto const &b: _blocks)
+                        {
+                            append_value(blocks, b.offset);
+                            append_value(blocks, b.metadata_length);
+                            append_value<int32_t>(blocks, 0);
+                            append_value(blocks, b.body_length);
+                        }
+
+                        // version, schema, dictionaries, record batches
+                        FlatBuilder fb;
+                        fb.append<uint32_t>(0);
+                        auto footer = fb.table({{0, 2, METADATA_V5}, {1, 4, 0}, {2, 4, 0}, {3, 4, 0}});
+                        fb.link(0, footer.pos);
+                        build_schema(fb, footer.fields[1], _plan);
+                        fb.link(footer.fields[2], fb.structs("", 0));
+                        fb.link(footer.fields[3], fb.structs(blocks, _blocks.size()));
+
+                        write(fb.buf);
+                        string trailer;
+                        append_value(trailer, static_cast<int32_t>(fb.buf.size()));
+                        write(trailer + string(MAGIC, sizeof(MAGIC) - 1));
+                    }
+
+                    _writer.close();
+                }
+        };
+    }
+
+    string ArrowExporter::schema(const string& record_name)
+    {
+        return schema_message(plan(record_name));
+    }
+
+    size_t ArrowExporter::run(const string& input_file, const string& output_prefix, function <string (string)> mapper)
+    {
+        if (!_compiled)
+            compile();
+
+        MappedFile input(input_file);
+        map<const ExportPlan *, unique_ptr<ArrowStream>> streams;
+
+        auto nb_lines = for_each_line(input.data(), input.size(), mapper, [&](const ExportPlan& plan, const char *line, size_t length) {
+            auto& stream = streams[&plan];
+            if (!stream)
+            {
+                auto file_name = output_prefix + plan.record_name + (_file_format ? ".arrow" : ".arrows");
+                stream.reset(new ArrowStream(file_name, _layout, plan, _file_format, _code_table != nullptr));
+            }
+
+            stream->batch.append(line, length);
+            if (stream->batch.rows() == _batch_size)
+                stream->flush();
+        });
+
+        for (auto& kv: streams)
+        {
+            kv.second->close();
+        }
+
+        return nb_lines;
+    }
+
+}
@@ -0,0 +1,57 @@
+#include <cstring>
+#include <stdexcept>
+
+#include <batch.h>
+
+namespace rbf
+{
+
+    void Selection::select_all(size_t size)
+    {
+        _size = size;
+        _words.assign((size + 63) / 64, ~uint64_t{0});
+
+        // lines past the end are never selected
+        if (size % 64 != 0)
+            _words.back() = (uint64_t{1} << (size % 64)) - 1;
+    }
+
+    size_t Selection::count() const
+    {
+        size_t n = 0;
+        for (auto w: _words)
+        {
+            n += __builtin_popcountll(w);
+        }
+        return n;
+    }
+
+    bool Selection::none() const
+    {
+        for (auto w: _words)
+        {
+            if (w != 0)
+                return false;
+        }
+        return true;
+    }
+
+    RecordBatch::RecordBatch(const Record& rec, size_t capacity):
+        _record{rec}, _stride{rec.length()}, _capacity{capacity}, _rows(capacity * rec.length() + 8, ' '), _lengths(capacity)
+    {
+    }
+
+    void RecordBatch::push_back(const char *line, size_t len)
+    {
+        if (full())
+            throw length_error("record batch " + _record.name() + " is full");
+
+        auto p = _rows.data() + _size * _stride;
+        auto n = min(len, _stride);
+        memcpy(p, line, n);
+        memset(p + n, ' ', _stride - n);
+
+        _lengths[_size++] = n;
+    }
+
+}
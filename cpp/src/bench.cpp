@@ -0,0 +1,94 @@
+// compare row-at-a-time and batch evaluation of filters
+//
+// usage: bench [xml layout] [record-based file] [repeat count]
+#include <iostream>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <functional>
+
+#include <rbf.h>
+
+using namespace std;
+using namespace rbf;
+
+namespace
+{
+    // run a function and print its duration, with the number of lines it selected
+    void measure(const string& name, function<size_t ()> f)
+    {
+        auto start = chrono::steady_clock::now();
+        auto n = f();
+        auto elapsed = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+        cout << "  " << name << ": " << elapsed << " ms, " << n << " lines" << endl;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    string xmlfile = argc > 1 ? argv[1] : "./test/world_data.xml";
+    string rbffile = argc > 2 ? argv[2] : "./test/world_data.txt";
+    size_t repeat = argc > 3 ? stoul(argv[3]) : 5000;
+
+    Layout layout{xmlfile};
+    Reader reader(rbffile, layout, [](string s) { return s.substr(0,4); });
+
+    // lines of the country record, repeated in memory so evaluation is measured without any I/O
+    vector<string> countries;
+    for (auto it = reader.begin(), last = reader.end(); it != last; ++it)
+    {
+        if (it.map() == "COUN")
+            countries.push_back(it.line());
+    }
+    vector<string> lines;
+    lines.reserve(countries.size() * repeat);
+    for (size_t i = 0; i < repeat; i++)
+    {
+        lines.insert(lines.end(), countries.begin(), countries.end());
+    }
+
+    // batches are filled once, as a batch reader would
+    vector<RecordBatch> batches;
+    for (auto const &line: lines)
+    {
+        if (batches.empty() || batches.back().full())
+            batches.emplace_back(*layout["COUN"]);
+        batches.back().push_back(line);
+    }
+
+    Filter equal(*layout["COUN"]);
+    equal.equal("CAPITAL", "Tokyo");
+    Filter numbers(*layout["COUN"]);
+    numbers.between("POPULATION", 1000000, 50000000);
+    Filter chained(*layout["COUN"]);
+    chained.prefix("NAME", "C").at_least("POPULATION", 10000000).at_most("CAPITAL", "M");
+
+    cout << lines.size() << " lines of " << layout["COUN"]->length() << " bytes" << endl;
+
+    for (auto test: vector<pair<string, const Filter *>>{ {"equal", &equal}, {"range", &numbers}, {"chained", &chained} })
+    {
+        auto& filter = *test.second;
+        cout << test.first << endl;
+
+        measure("row at a time", [&]() {
+            size_t n = 0;
+            for (auto const &line: lines)
+            {
+                n += filter.match(line);
+            }
+            return n;
+        });
+
+        measure("batches", [&]() {
+            size_t n = 0;
+            Selection selection;
+            for (auto const &batch: batches)
+            {
+                filter.select(batch, selection);
+                n += selection.count();
+            }
+            return n;
+        });
+    }
+}
@@ -0,0 +1,380 @@
+#include <cerrno>
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <cache.h>
+
+namespace rbf
+{
+
+    namespace
+    {
+        constexpr uint64_t FNV_PRIME = 0x100000001B3ULL;
+
+        template <typename T>
+            void append_value(string& out, T value) { out.append(reinterpret_cast<const char *>(&value), sizeof(T)); }
+
+        template <typename T>
+            T read_value(const char *p)
+            {
+                T value;
+                memcpy(&value, p, sizeof(T));
+                return value;
+            }
+
+        // size of the footer: names offset, number of names, magic
+        constexpr size_t FOOTER_SIZE = 2 * sizeof(uint64_t) + sizeof(PARSE_CACHE_MAGIC);
+
+        bool has_extension(const string& name, const char *extension)
+        {
+            auto ext = strlen(extension);
+            return name.size() > ext && name.compare(name.size() - ext, ext, extension) == 0;
+        }
+
+        // cache files of a directory, temporary ones included, with their size and last use
+        struct CacheFile
+        {
+            string path;
+            size_t size;
+            struct timespec used;
+            bool temporary;
+        };
+
+        vector<CacheFile> cache_files(const string& directory)
+        {
+            vector<CacheFile> files;
+            auto dir = ::opendir(directory.c_str());
+            if (!dir)
+                return files;
+
+            while (auto entry = ::readdir(dir))
+            {
+                string name(entry->d_name);
+                CacheFile file;
+                file.temporary = has_extension(name, PARSE_CACHE_TEMP_EXTENSION);
+                if (!file.temporary && !has_extension(name, PARSE_CACHE_EXTENSION))
+                    continue;
+
+                file.path = directory + "/" + name;
+                struct stat st;
+                if (::stat(file.path.c_str(), &st) != 0)
+                    continue;
+                file.size = static_cast<size_t>(st.st_size);
+                file.used = st.st_mtim;
+                files.push_back(file);
+            }
+
+            ::closedir(dir);
+            return files;
+        }
+    }
+
+    uint64_t fnv1a(const char *p, size_t len, uint64_t hash)
+    {
+        for (size_t i = 0; i < len; i++)
+        {
+            hash ^= static_cast<unsigned char>(p[i]);
+            hash *= FNV_PRIME;
+        }
+        return hash;
+    }
+
+    uint64_t layout_hash(Layout& layout)
+    {
+        string s;
+        for (auto const &kv: layout)
+        {
+            s += kv.first;
+            s += '\0';
+            for (auto const &f: *kv.second)
+            {
+                s += f.name();
+                s += '\0';
+                append_value<uint64_t>(s, f.length());
+                append_value<uint64_t>(s, f.lower_bound());
+                append_value(s, static_cast<int>(f.type().data_type()));
+                append_value(s, f.type().decimals());
+                s += f.type().format();
+                s += '\0';
+            }
+            s += '\n';
+        }
+        return fnv1a(s.data(), s.size());
+    }
+
+    CacheReader::CacheReader(const string& file_name, const string& key): _file(file_name)
+    {
+        auto data = _file.data();
+        auto size = _file.size();
+        auto bad = runtime_error("file " + file_name + " is not a parse cache file");
+
+        if (size < 2 * sizeof(PARSE_CACHE_MAGIC) + sizeof(uint32_t) + FOOTER_SIZE ||
+            memcmp(data, PARSE_CACHE_MAGIC, sizeof(PARSE_CACHE_MAGIC)) != 0 ||
+            memcmp(data + size - sizeof(PARSE_CACHE_MAGIC), PARSE_CACHE_MAGIC, sizeof(PARSE_CACHE_MAGIC)) != 0)
+            throw bad;
+
+        // key
+        _pos = sizeof(PARSE_CACHE_MAGIC);
+        auto key_length = read_value<uint32_t>(data + _pos);
+        _pos += sizeof(uint32_t);
+        if (key_length > size - FOOTER_SIZE - _pos || key.compare(0, string::npos, data + _pos, key_length) != 0)
+            throw bad;
+        _pos += key_length;
+
+        // record names
+        auto footer = data + size - FOOTER_SIZE;
+        _end = read_value<uint64_t>(footer);
+        auto nb_names = read_value<uint64_t>(footer + sizeof(uint64_t));
+        if (_end < _pos || _end > size - FOOTER_SIZE)
+            throw bad;
+
+        for (size_t pos = _end; _names.size() < nb_names; )
+        {
+            if (pos + sizeof(uint32_t) > size - FOOTER_SIZE)
+                throw bad;
+            auto length = read_value<uint32_t>(data + pos);
+            pos += sizeof(uint32_t);
+            if (length > size - FOOTER_SIZE - pos)
+                throw bad;
+            _names.emplace_back(data + pos, length);
+            pos += length;
+        }
+    }
+
+    bool CacheReader::next(const string *&record_name, const char *&line, size_t& length, vector<uint32_t>& bounds)
+    {
+        if (_pos + 3 * sizeof(uint32_t) > _end)
+            return false;
+
+        // record name index, line length and number of field bounds, followed by the line and the bounds
+        auto data = _file.data();
+        auto index = read_value<uint32_t>(data + _pos);
+        length = read_value<uint32_t>(data + _pos + sizeof(uint32_t));
+        size_t nb_bounds = read_value<uint32_t>(data + _pos + 2 * sizeof(uint32_t));
+        _pos += 3 * sizeof(uint32_t);
+        if (index >= _names.size() || length > _end - _pos || nb_bounds > (_end - _pos - length) / sizeof(uint32_t))
+            throw runtime_error("parse cache file is corrupted");
+
+        record_name = &_names[index];
+        line = data + _pos;
+        _pos += length;
+
+        bounds.resize(nb_bounds);
+        if (nb_bounds != 0)
+            memcpy(bounds.data(), data + _pos, nb_bounds * sizeof(uint32_t));
+        _pos += nb_bounds * sizeof(uint32_t);
+        return true;
+    }
+
+    CacheWriter::CacheWriter(const string& file_name, const string& key, size_t max_size):
+        _file_name{file_name}, _max_size{max_size}
+    {
+        // a unique name, as several readers can populate the same file at once
+        _temp_name = file_name;
+        if (has_extension(_temp_name, PARSE_CACHE_EXTENSION))
+            _temp_name.resize(_temp_name.size() - strlen(PARSE_CACHE_EXTENSION));
+        _temp_name += string(".XXXXXX") + PARSE_CACHE_TEMP_EXTENSION;
+
+        auto fd = ::mkstemps(&_temp_name[0], static_cast<int>(strlen(PARSE_CACHE_TEMP_EXTENSION)));
+        if (fd < 0)
+            throw runtime_error("unable to create file " + _temp_name + ": " + strerror(errno));
+        ::fchmod(fd, 0644);
+        ::close(fd);
+
+        _out.open(_temp_name, ios::binary | ios::trunc);
+        if (!_out)
+        {
+            ::unlink(_temp_name.c_str());
+            throw runtime_error("unable to create file " + _temp_name + ": " + strerror(errno));
+        }
+
+        string header(PARSE_CACHE_MAGIC, sizeof(PARSE_CACHE_MAGIC));
+        append_value(header, static_cast<uint32_t>(key.size()));
+        header += key;
+        write(header.data(), header.size());
+    }
+
+    CacheWriter::~CacheWriter()
+    {
+        if (!_committed)
+            drop();
+    }
+
+    void CacheWriter::drop()
+    {
+        if (_dropped)
+            return;
+        _out.close();
+        ::unlink(_temp_name.c_str());
+        _dropped = true;
+    }
+
+    void CacheWriter::write(const char *p, size_t len)
+    {
+        _out.write(p, len);
+        if (!_out)
+            throw runtime_error("unable to write file " + _temp_name + ": " + strerror(errno));
+        _offset += len;
+    }
+
+    void CacheWriter::add(const string& record_name, const string& line, const vector<uint32_t>& bounds)
+    {
+        if (_dropped)
+            return;
+
+        auto it = _names.find(record_name);
+        if (it == _names.end())
+            it = _names.emplace(record_name, static_cast<uint32_t>(_names.size())).first;
+
+        uint32_t header[3] = { it->second, static_cast<uint32_t>(line.size()), static_cast<uint32_t>(bounds.size()) };
+        write(reinterpret_cast<const char *>(header), sizeof(header));
+        write(line.data(), line.size());
+        write(reinterpret_cast<const char *>(bounds.data()), bounds.size() * sizeof(uint32_t));
+
+        if (_offset > _max_size)
+            drop();
+    }
+
+    void CacheWriter::commit()
+    {
+        if (_dropped)
+            return;
+
+        // names by index
+        vector<const string *> names(_names.size());
+        for (auto const &kv: _names)
+        {
+            names[kv.second] = &kv.first;
+        }
+
+        string trailer;
+        for (auto name: names)
+        {
+            append_value(trailer, static_cast<uint32_t>(name->size()));
+            trailer += *name;
+        }
+        append_value<uint64_t>(trailer, _offset);
+        append_value<uint64_t>(trailer, names.size());
+        trailer.append(PARSE_CACHE_MAGIC, sizeof(PARSE_CACHE_MAGIC));
+        write(trailer.data(), trailer.size());
+        if (_offset > _max_size)
+        {
+            drop();
+            return;
+        }
+
+        _out.close();
+        if (!_out)
+            throw runtime_error("unable to close file " + _temp_name);
+
+        // readers never see a partial file
+        if (::rename(_temp_name.c_str(), _file_name.c_str()) != 0)
+            throw runtime_error("unable to rename file " + _temp_name + ": " + strerror(errno));
+        _committed = true;
+    }
+
+    ParseCache::ParseCache(const string& directory, size_t max_size): _directory{directory}, _max_size{max_size}
+    {
+        if (::mkdir(_directory.c_str(), 0755) != 0 && errno != EEXIST)
+            throw runtime_error("unable to create directory " + _directory + ": " + strerror(errno));
+    }
+
+    string ParseCache::key(ReaderData& rdata) const
+    {
+        struct stat st;
+        if (::stat(rdata.rb_file.c_str(), &st) != 0)
+            throw runtime_error("Unable to open file");
+
+        auto code_page = rdata.code_table ? fnv1a(reinterpret_cast<const char *>(rdata.code_table), 256) : 0;
+
+        return "file=" + to_string(st.st_dev) + ":" + to_string(st.st_ino) + ":" + to_string(st.st_size) + ":" +
+            to_string(st.st_mtim.tv_sec) + "." + to_string(st.st_mtim.tv_nsec) +
+            " layout=" + to_string(layout_hash(rdata.layout)) +
+            " record_length=" + to_string(rdata.record_length) +
+            " delimiter=" + to_string(static_cast<int>(rdata.delimiter)) +
+            " code_page=" + to_string(code_page) + (rdata.text_only ? ":text" : "") +
+            " mapper=" + rdata.cache_tag;
+    }
+
+    string ParseCache::file_name(const string& key) const
+    {
+        char hex[17];
+        snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(fnv1a(key.data(), key.size())));
+        return _directory + "/" + hex + PARSE_CACHE_EXTENSION;
+    }
+
+    unique_ptr<CacheReader> ParseCache::lookup(const string& key) const
+    {
+        auto name = file_name(key);
+        if (::access(name.c_str(), R_OK) != 0)
+            return nullptr;
+
+        unique_ptr<CacheReader> reader;
+        try
+        {
+            reader.reset(new CacheReader(name, key));
+        }
+        catch (runtime_error&)
+        {
+            // hash collision or damaged file: it's replaced
+            return nullptr;
+        }
+
+        // last use is the modification time
+        ::utimensat(AT_FDCWD, name.c_str(), nullptr, 0);
+        return reader;
+    }
+
+    unique_ptr<CacheWriter> ParseCache::populate(const string& key) const
+    {
+        return unique_ptr<CacheWriter>(new CacheWriter(file_name(key), key, _max_size));
+    }
+
+    size_t ParseCache::size() const
+    {
+        size_t total = 0;
+        for (auto const &file: cache_files(_directory))
+        {
+            total += file.size;
+        }
+        return total;
+    }
+
+    void ParseCache::evict() const
+    {
+        auto files = cache_files(_directory);
+        size_t total = 0;
+        for (auto const &file: files)
+        {
+            total += file.size;
+        }
+
+        sort(files.begin(), files.end(), [](const CacheFile& a, const CacheFile& b) {
+            return a.used.tv_sec != b.used.tv_sec ? a.used.tv_sec < b.used.tv_sec : a.used.tv_nsec < b.used.tv_nsec;
+        });
+
+        // temporary files left by crashed writers
+        auto stale = time(nullptr) - PARSE_CACHE_TEMP_AGE;
+        for (auto const &file: files)
+        {
+            if (file.temporary && file.used.tv_sec < stale && ::unlink(file.path.c_str()) == 0)
+                total -= file.size;
+        }
+
+        // temporary files being written are kept
+        for (auto const &file: files)
+        {
+            if (total <= _max_size)
+                break;
+            if (!file.temporary && ::unlink(file.path.c_str()) == 0)
+                total -= file.size;
+        }
+    }
+
+}
@@ -0,0 +1,52 @@
+#include <cerrno>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <chunk.h>
+
+namespace rbf
+{
+
+    MappedFile::MappedFile(const string& file_name)
+    {
+        auto fd = ::open(file_name.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw runtime_error("Unable to open file");
+
+        struct stat st;
+        if (::fstat(fd, &st) != 0)
+        {
+            auto error = string(strerror(errno));
+            ::close(fd);
+            throw runtime_error("unable to stat file " + file_name + ": " + error);
+        }
+
+        _size = static_cast<size_t>(st.st_size);
+        if (_size != 0)
+        {
+            auto map = ::mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (map == MAP_FAILED)
+            {
+                auto error = string(strerror(errno));
+                ::close(fd);
+                throw runtime_error("unable to map file " + file_name + ": " + error);
+            }
+            _data = static_cast<const char *>(map);
+            ::madvise(map, _size, MADV_SEQUENTIAL);
+        }
+
+        // the mapping stays valid once the file is closed
+        ::close(fd);
+    }
+
+    MappedFile::~MappedFile()
+    {
+        if (_data)
+            ::munmap(const_cast<char *>(_data), _size);
+    }
+
+}
@@ -0,0 +1,573 @@
+#include <cerrno>
+#include <cstring>
+#include <climits>
+#include <memory>
+#include <map>
+#include <unordered_map>
+#include <algorithm>
+
+#include <columnar.h>
+
+namespace rbf
+{
+
+    static_assert(sizeof(ColumnEntry) == 16, "unexpected ColumnEntry size");
+    static_assert(sizeof(ColumnChunk) == 48, "unexpected ColumnChunk size");
+    static_assert(sizeof(ColumnarFooter) == 56, "unexpected ColumnarFooter size");
+    static_assert(sizeof(COLUMNAR_MAGIC) == 8, "unexpected magic size");
+
+    namespace
+    {
+        // dictionaries are indexed by codes of at most 2 bytes
+        constexpr size_t MAX_DICTIONARY_SIZE = 1 << 16;
+
+        inline size_t align8(size_t n) { return (n + 7) & ~static_cast<size_t>(7); }
+
+        inline void pad8(string& s) { s.append(align8(s.size()) - s.size(), '\0'); }
+
+        template <typename T>
+            void append_value(string& out, T value) { out.append(reinterpret_cast<const char *>(&value), sizeof(T)); }
+
+        template <typename T>
+            T read_value(const char *p)
+            {
+                T value;
+                memcpy(&value, p, sizeof(T));
+                return value;
+            }
+
+        // smallest size (1, 2 or 4) of the differences between consecutive values, 0 if they need 8 bytes
+        uint8_t delta_width(const vector<int64_t>& values)
+        {
+            int64_t lowest = 0, highest = 0;
+            for (size_t i = 1; i < values.size(); i++)
+            {
+                int64_t delta;
+                if (__builtin_sub_overflow(values[i], values[i-1], &delta))
+                    return 0;
+                lowest = min(lowest, delta);
+                highest = max(highest, delta);
+            }
+
+            if (lowest >= INT8_MIN && highest <= INT8_MAX) return 1;
+            if (lowest >= INT16_MIN && highest <= INT16_MAX) return 2;
+            if (lowest >= INT32_MIN && highest <= INT32_MAX) return 4;
+            return 0;
+        }
+
+        // encode numeric values with the smallest encoding. PLAIN is preferred on ties, as it's read in place.
+        void encode_int64(const vector<int64_t>& values, ColumnChunk& chunk, string& out)
+        {
+            auto n = values.size();
+
+            size_t runs = n == 0 ? 0 : 1;
+            for (size_t i = 1; i < n; i++)
+            {
+                if (values[i] != values[i-1]) runs++;
+            }
+
+            auto width = delta_width(values);
+            auto plain_size = 8 * n;
+            auto rle_size = 12 * runs;
+            auto delta_size = width == 0 ? SIZE_MAX : 8 + width * (n == 0 ? 0 : n - 1);
+
+            if (plain_size <= rle_size && plain_size <= delta_size)
+            {
+                chunk.encoding = ColumnEncoding::PLAIN;
+                out.append(reinterpret_cast<const char *>(values.data()), plain_size);
+            }
+            else if (rle_size <= delta_size)
+            {
+                chunk.encoding = ColumnEncoding::RLE;
+                chunk.count = static_cast<uint32_t>(runs);
+
+                vector<uint32_t> lengths;
+                for (size_t i = 0; i < n; i++)
+                {
+                    if (i != 0 && values[i] == values[i-1])
+                        lengths.back()++;
+                    else
+                    {
+                        append_value(out, values[i]);
+                        lengths.push_back(1);
+                    }
+                }
+                out.append(reinterpret_cast<const char *>(lengths.data()), 4 * runs);
+            }
+            else
+            {
+                chunk.encoding = ColumnEncoding::DELTA;
+                chunk.width = width;
+
+                append_value(out, values[0]);
+                for (size_t i = 1; i < n; i++)
+                {
+                    auto delta = values[i] - values[i-1];
+                    switch (width)
+                    {
+                        case 1: append_value(out, static_cast<int8_t>(delta)); break;
+                        case 2: append_value(out, static_cast<int16_t>(delta)); break;
+                        default: append_value(out, static_cast<int32_t>(delta)); break;
+                    }
+                }
+            }
+        }
+
+        // encode fixed-width values as a dictionary when it's smaller than the slab
+        void encode_bytes(const string& slab, size_t width, size_t n, ColumnChunk& chunk, string& out)
+        {
+            unordered_map<string, uint16_t> codes;
+            string dictionary;
+            vector<uint16_t> rows(n);
+
+            for (size_t i = 0; i < n && width != 0; i++)
+            {
+                auto value = slab.substr(i * width, width);
+                auto it = codes.find(value);
+                if (it == codes.end())
+                {
+                    if (codes.size() == MAX_DICTIONARY_SIZE)
+                    {
+                        codes.clear();
+                        break;
+                    }
+                    it = codes.emplace(value, static_cast<uint16_t>(codes.size())).first;
+                    dictionary += value;
+                }
+                rows[i] = it->second;
+            }
+
+            uint8_t code_width = codes.size() <= 256 ? 1 : 2;
+            if (codes.empty() || align8(dictionary.size()) + code_width * n >= slab.size())
+            {
+                chunk.encoding = ColumnEncoding::PLAIN;
+                out += slab;
+                return;
+            }
+
+            chunk.encoding = ColumnEncoding::DICTIONARY;
+            chunk.count = static_cast<uint32_t>(codes.size());
+            chunk.width = code_width;
+
+            out += dictionary;
+            pad8(out);
+            for (auto code: rows)
+            {
+                if (code_width == 1)
+                    append_value(out, static_cast<uint8_t>(code));
+                else
+                    append_value(out, code);
+            }
+        }
+
+        ColumnType column_type(DataType data_type)
+        {
+            switch (data_type)
+            {
+                case DataType::INTEGER: return ColumnType::INT64;
+                case DataType::DECIMAL:
+                case DataType::PACKED:
+                case DataType::ZONED: return ColumnType::FIXED;
+                case DataType::DATE: return ColumnType::DAYS;
+                default: return ColumnType::BYTES;
+            }
+        }
+
+        void check(ConvStatus status, const Field& f)
+        {
+            if (status != ConvStatus::OK)
+                throw runtime_error("field " + f.name() + ": " + conv_message(status));
+        }
+    }
+
+    ColumnarWriter::ColumnarWriter(const string& file_name, const Record& rec, size_t block_rows):
+        _out(file_name, ios::binary | ios::trunc), _file_name{file_name}, _record_name{rec.name()}, _block_rows{block_rows}
+    {
+        if (!_out)
+            throw runtime_error("unable to create file " + file_name + ": " + strerror(errno));
+        if (_block_rows == 0)
+            throw invalid_argument("block rows can't be 0");
+
+        _names = _record_name;
+        for (auto const &f: rec)
+        {
+            ColumnEntry entry{};
+            entry.name_offset = static_cast<uint32_t>(_names.size());
+            entry.name_length = static_cast<uint32_t>(f.name().size());
+            entry.width = static_cast<uint32_t>(f.length());
+            entry.type = column_type(f.type().data_type());
+            _columns.push_back(entry);
+            _names += f.name();
+
+            ColumnBuffer buffer;
+            buffer.type = entry.type;
+            _buffers.push_back(buffer);
+        }
+
+        write(string(COLUMNAR_MAGIC, sizeof(COLUMNAR_MAGIC)));
+    }
+
+    ColumnarWriter::~ColumnarWriter()
+    {
+        try
+        {
+            close();
+        }
+        catch (...) {}
+    }
+
+    void ColumnarWriter::write(const string& s)
+    {
+        _out.write(s.data(), s.size());
+        if (!_out)
+            throw runtime_error("unable to write file " + _file_name + ": " + strerror(errno));
+        _offset += s.size();
+    }
+
+    void ColumnarWriter::append(const Record& rec)
+    {
+        if (static_cast<size_t>(rec.end() - rec.begin()) != _buffers.size())
+            throw runtime_error("record " + rec.name() + " doesn't match columnar file " + _file_name);
+
+        auto bit = static_cast<char>(1 << (_block_size % 8));
+        auto f = rec.begin();
+        for (size_t i = 0; i < _buffers.size(); i++, f++)
+        {
+            auto& buffer = _buffers[i];
+            if (_block_size % 8 == 0)
+                buffer.nulls += '\0';
+
+            ConvStatus status = ConvStatus::OK;
+            switch (buffer.type)
+            {
+                case ColumnType::BYTES:
+                {
+                    // short lines are blank-padded
+                    auto len = min<size_t>(f->raw_length(), _columns[i].width);
+                    buffer.bytes.append(f->raw_data(), len);
+                    buffer.bytes.append(_columns[i].width - len, ' ');
+                    break;
+                }
+
+                case ColumnType::FIXED:
+                {
+                    Decimal value;
+                    status = f->get(value);
+                    buffer.values.push_back(status == ConvStatus::OK ? value.mantissa : 0);
+                    buffer.scales.push_back(status == ConvStatus::OK ? value.scale : 0);
+                    break;
+                }
+
+                case ColumnType::DAYS:
+                {
+                    Date value;
+                    status = f->get(value);
+                    buffer.values.push_back(status == ConvStatus::OK ? value.days : 0);
+                    break;
+                }
+
+                default:
+                {
+                    int64_t value;
+                    status = f->get(value);
+                    buffer.values.push_back(status == ConvStatus::OK ? value : 0);
+                    break;
+                }
+            }
+
+            if (status == ConvStatus::EMPTY)
+            {
+                buffer.nulls.back() |= bit;
+                buffer.null_count++;
+            }
+            else
+                check(status, *f);
+        }
+
+        _rows++;
+        if (++_block_size == _block_rows)
+            flush();
+    }
+
+    void ColumnarWriter::write_chunk(size_t column)
+    {
+        auto& buffer = _buffers[column];
+
+        ColumnChunk chunk{};
+        chunk.offset = _offset;
+        chunk.rows = static_cast<uint32_t>(_block_size);
+        chunk.null_count = static_cast<uint32_t>(buffer.null_count);
+
+        string data;
+        if (buffer.null_count != 0)
+        {
+            data = buffer.nulls;
+            pad8(data);
+        }
+
+        if (buffer.type == ColumnType::BYTES)
+            encode_bytes(buffer.bytes, _columns[column].width, _block_size, chunk, data);
+        else
+        {
+            // FIXED values of a block share the largest scale
+            if (buffer.type == ColumnType::FIXED)
+            {
+                auto scale = *max_element(buffer.scales.begin(), buffer.scales.end());
+                for (size_t j = 0; j < _block_size; j++)
+                {
+                    if (buffer.scales[j] == scale)
+                        continue;
+
+                    auto status = rescale(Decimal{buffer.values[j], buffer.scales[j]}, scale, buffer.values[j]);
+                    if (status != ConvStatus::OK)
+                        throw runtime_error("column " + string(_names, _columns[column].name_offset, _columns[column].name_length)
+                            + ": " + conv_message(status));
+                }
+                chunk.scale = static_cast<uint16_t>(scale);
+            }
+
+            // statistics of non-null values. Nulls repeat the previous value (the first one for leading nulls),
+            // so they don't break runs and differences.
+            auto first = true;
+            size_t leading = 0;
+            for (size_t j = 0; j < _block_size; j++)
+            {
+                if ((buffer.nulls[j / 8] >> (j % 8)) & 1)
+                {
+                    if (first)
+                        leading++;
+                    else
+                        buffer.values[j] = buffer.values[j-1];
+                    continue;
+                }
+                chunk.min = first ? buffer.values[j] : min(chunk.min, buffer.values[j]);
+                chunk.max = first ? buffer.values[j] : max(chunk.max, buffer.values[j]);
+                first = false;
+            }
+            if (leading != _block_size)
+                fill(buffer.values.begin(), buffer.values.begin() + leading, buffer.values[leading]);
+
+            encode_int64(buffer.values, chunk, data);
+        }
+
+        pad8(data);
+        chunk.size = data.size();
+        write(data);
+        _chunks.push_back(chunk);
+
+        buffer.bytes.clear();
+        buffer.values.clear();
+        buffer.scales.clear();
+        buffer.nulls.clear();
+        buffer.null_count = 0;
+    }
+
+    void ColumnarWriter::flush()
+    {
+        if (_block_size == 0)
+            return;
+
+        for (size_t i = 0; i < _buffers.size(); i++)
+        {
+            write_chunk(i);
+        }
+        _block_size = 0;
+    }
+
+    void ColumnarWriter::close()
+    {
+        if (_closed)
+            return;
+        _closed = true;
+
+        flush();
+
+        ColumnarFooter footer{};
+        footer.rows = _rows;
+        footer.block_rows = _block_rows;
+        footer.nb_columns = static_cast<uint32_t>(_columns.size());
+        footer.nb_blocks = static_cast<uint32_t>(_columns.empty() ? 0 : _chunks.size() / _columns.size());
+        footer.record_name_length = static_cast<uint32_t>(_record_name.size());
+
+        string index;
+        footer.names_offset = _offset;
+        index += _names;
+        pad8(index);
+
+        footer.columns_offset = _offset + index.size();
+        index.append(reinterpret_cast<const char *>(_columns.data()), _columns.size() * sizeof(ColumnEntry));
+
+        footer.chunks_offset = _offset + index.size();
+        index.append(reinterpret_cast<const char *>(_chunks.data()), _chunks.size() * sizeof(ColumnChunk));
+
+        append_value(index, footer);
+        index.append(COLUMNAR_MAGIC, sizeof(COLUMNAR_MAGIC));
+        write(index);
+
+        _out.close();
+        if (!_out)
+            throw runtime_error("unable to close file " + _file_name);
+    }
+
+    size_t write_columnar(Reader& reader, const string& output_prefix, size_t block_rows)
+    {
+        map<string, unique_ptr<ColumnarWriter>> writers;
+        size_t nb_lines = 0;
+
+        for (auto& rec: reader)
+        {
+            auto& writer = writers[rec->name()];
+            if (!writer)
+                writer.reset(new ColumnarWriter(output_prefix + rec->name() + ".rbc", *rec, block_rows));
+
+            writer->append(*rec);
+            nb_lines++;
+        }
+
+        for (auto& kv: writers)
+        {
+            kv.second->close();
+        }
+
+        return nb_lines;
+    }
+
+    ColumnarFile::ColumnarFile(const string& file_name): _file(file_name)
+    {
+        auto data = _file.data();
+        auto size = _file.size();
+
+        if (size < 2 * sizeof(COLUMNAR_MAGIC) + sizeof(ColumnarFooter) ||
+            memcmp(data, COLUMNAR_MAGIC, sizeof(COLUMNAR_MAGIC)) != 0 ||
+            memcmp(data + size - sizeof(COLUMNAR_MAGIC), COLUMNAR_MAGIC, sizeof(COLUMNAR_MAGIC)) != 0)
+            throw runtime_error("file " + file_name + " is not a columnar file");
+
+        _footer = reinterpret_cast<const ColumnarFooter *>(data + size - sizeof(COLUMNAR_MAGIC) - sizeof(ColumnarFooter));
+
+        auto index_end = size - sizeof(COLUMNAR_MAGIC) - sizeof(ColumnarFooter);
+        auto nb_chunks = static_cast<uint64_t>(_footer->nb_columns) * _footer->nb_blocks;
+        if (_footer->names_offset > _footer->columns_offset ||
+            _footer->columns_offset + _footer->nb_columns * sizeof(ColumnEntry) > _footer->chunks_offset ||
+            _footer->chunks_offset + nb_chunks * sizeof(ColumnChunk) > index_end ||
+            _footer->record_name_length > _footer->columns_offset - _footer->names_offset)
+            throw runtime_error("columnar file " + file_name + " is corrupted");
+
+        _names = data + _footer->names_offset;
+        _columns = reinterpret_cast<const ColumnEntry *>(data + _footer->columns_offset);
+        _chunks = reinterpret_cast<const ColumnChunk *>(data + _footer->chunks_offset);
+
+        for (uint64_t i = 0; i < nb_chunks; i++)
+        {
+            if (_chunks[i].offset + _chunks[i].size > _footer->names_offset)
+                throw runtime_error("columnar file " + file_name + " is corrupted");
+        }
+    }
+
+    size_t ColumnarFile::column_index(const string& name) const
+    {
+        for (size_t i = 0; i < nb_columns(); i++)
+        {
+            if (_columns[i].name_length == name.size() && memcmp(_names + _columns[i].name_offset, name.data(), name.size()) == 0)
+                return i;
+        }
+        throw runtime_error("column " + name + " not found");
+    }
+
+    const char *ColumnarFile::chunk_values(const ColumnChunk& chunk) const
+    {
+        auto p = _file.data() + chunk.offset;
+        return chunk.null_count == 0 ? p : p + align8((chunk.rows + 7) / 8);
+    }
+
+    const unsigned char *ColumnarFile::nulls(size_t block, size_t column) const
+    {
+        auto& c = chunk(block, column);
+        return c.null_count == 0 ? nullptr : reinterpret_cast<const unsigned char *>(_file.data() + c.offset);
+    }
+
+    const int64_t *ColumnarFile::int64_values(size_t block, size_t column, vector<int64_t>& buffer) const
+    {
+        if (_columns[column].type == ColumnType::BYTES)
+            throw runtime_error("column " + column_name(column) + " is not numeric");
+
+        auto& c = chunk(block, column);
+        auto p = chunk_values(c);
+
+        switch (c.encoding)
+        {
+            case ColumnEncoding::PLAIN:
+                return reinterpret_cast<const int64_t *>(p);
+
+            case ColumnEncoding::RLE:
+            {
+                buffer.clear();
+                auto lengths = p + 8 * c.count;
+                for (size_t run = 0; run < c.count; run++)
+                {
+                    buffer.insert(buffer.end(), read_value<uint32_t>(lengths + 4 * run), read_value<int64_t>(p + 8 * run));
+                }
+                break;
+            }
+
+            case ColumnEncoding::DELTA:
+            {
+                buffer.resize(c.rows);
+                auto value = read_value<int64_t>(p);
+                p += 8;
+                for (size_t j = 0; j < c.rows; j++, p += c.width)
+                {
+                    if (j != 0)
+                    {
+                        switch (c.width)
+                        {
+                            case 1: value += read_value<int8_t>(p - c.width); break;
+                            case 2: value += read_value<int16_t>(p - c.width); break;
+                            default: value += read_value<int32_t>(p - c.width); break;
+                        }
+                    }
+                    buffer[j] = value;
+                }
+                break;
+            }
+
+            default:
+                throw runtime_error("column " + column_name(column) + ": bad encoding");
+        }
+
+        return buffer.data();
+    }
+
+    const char *ColumnarFile::byte_values(size_t block, size_t column, string& buffer) const
+    {
+        if (_columns[column].type != ColumnType::BYTES)
+            throw runtime_error("column " + column_name(column) + " is numeric");
+
+        auto& c = chunk(block, column);
+        auto p = chunk_values(c);
+        auto width = _columns[column].width;
+
+        switch (c.encoding)
+        {
+            case ColumnEncoding::PLAIN:
+                return p;
+
+            case ColumnEncoding::DICTIONARY:
+            {
+                buffer.resize(c.rows * width);
+                auto codes = p + align8(c.count * width);
+                for (size_t j = 0; j < c.rows; j++)
+                {
+                    size_t code = c.width == 1 ? read_value<uint8_t>(codes + j) : read_value<uint16_t>(codes + 2 * j);
+                    memcpy(&buffer[j * width], p + code * width, width);
+                }
+                break;
+            }
+
+            default:
+                throw runtime_error("column " + column_name(column) + ": bad encoding");
+        }
+
+        return buffer.data();
+    }
+
+}
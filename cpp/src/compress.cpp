@@ -0,0 +1,608 @@
+#include <cerrno>
+#include <cstring>
+#include <climits>
+#include <fstream>
+
+#ifdef RBF_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef RBF_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include <compress.h>
+
+namespace rbf
+{
+
+    namespace
+    {
+        constexpr int DEFLATE_LEVEL = 6;
+        constexpr int ZSTD_LEVEL = 3;
+
+        // footer and ending magic number
+        constexpr size_t FOOTER_SIZE = sizeof(BlockFooter) + sizeof(BLOCK_FILE_MAGIC);
+
+        // number of records and uncompressed size, before compressed data of a block being written
+        constexpr size_t BLOCK_HEADER_SIZE = 2 * sizeof(uint64_t);
+
+        template <typename T>
+            void append_value(string& out, T value) { out.append(reinterpret_cast<const char *>(&value), sizeof(T)); }
+
+        template <typename T>
+            T read_value(const char *p)
+            {
+                T value;
+                memcpy(&value, p, sizeof(T));
+                return value;
+            }
+
+        runtime_error unavailable(Codec codec)
+        {
+            return runtime_error("codec " + to_string(static_cast<int>(codec)) + " is not available");
+        }
+
+        // first bytes of gzip (with deflate) and zstd files
+        constexpr unsigned char GZIP_MAGIC[] = { 0x1F, 0x8B, 0x08 };
+        constexpr unsigned char ZSTD_MAGIC[] = { 0x28, 0xB5, 0x2F, 0xFD };
+
+#ifdef RBF_HAVE_ZLIB
+        // compressed bytes given to zlib at once, as its sizes are 32-bit
+        constexpr size_t GZIP_INPUT_SIZE = 1 << 20;
+
+        // a gzip file, inflated buffer by buffer
+        class GzipSource: public ByteSource
+        {
+            private:
+                string _file_name;
+                MappedFile _file;
+                size_t _pos {0};                // next compressed bytes given to zlib
+                z_stream _stream;
+                bool _member_end {false};       // true at the end of a member
+                bool _end {false};
+
+            public:
+                explicit GzipSource(const string& file_name): _file_name{file_name}, _file(file_name)
+                {
+                    memset(&_stream, 0, sizeof(_stream));
+
+                    // gzip header only
+                    if (inflateInit2(&_stream, 15 + 16) != Z_OK)
+                        throw runtime_error("unable to read gzip file " + _file_name);
+                }
+
+                ~GzipSource() { inflateEnd(&_stream); }
+
+                bool next(string& buffer) override
+                {
+                    buffer.resize(STREAM_BUFFER_SIZE);
+                    _stream.next_out = reinterpret_cast<Bytef *>(&buffer[0]);
+                    _stream.avail_out = static_cast<uInt>(buffer.size());
+
+                    while (!_end && _stream.avail_out > 0)
+                    {
+                        if (_stream.avail_in == 0)
+                        {
+                            if (_pos == _file.size())
+                            {
+                                if (!_member_end)
+                                    throw runtime_error("gzip file " + _file_name + " is truncated");
+                                _end = true;
+                                break;
+                            }
+
+                            auto len = min(GZIP_INPUT_SIZE, _file.size() - _pos);
+                            _stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(_file.data() + _pos));
+                            _stream.avail_in = static_cast<uInt>(len);
+                            _pos += len;
+                        }
+
+                        // next member, if any
+                        if (_member_end)
+                        {
+                            inflateReset(&_stream);
+                            _member_end = false;
+                        }
+
+                        auto rc = inflate(&_stream, Z_NO_FLUSH);
+                        if (rc == Z_STREAM_END)
+                            _member_end = true;
+                        else if (rc != Z_OK)
+                            throw runtime_error("gzip file " + _file_name + " is corrupted: " + (_stream.msg ? _stream.msg : zError(rc)));
+                    }
+
+                    buffer.resize(buffer.size() - _stream.avail_out);
+                    return !buffer.empty();
+                }
+        };
+#endif
+
+#ifdef RBF_HAVE_ZSTD
+        // frames of a zstd file, decompressed by several threads until a frame has to be streamed
+        class ZstdSource: public ByteSource
+        {
+            private:
+                string _file_name;
+                shared_ptr<MappedFile> _file;
+                size_t _pos {0};                        // next frame
+                size_t _nb_threads;
+                deque<future<string>> _pending;         // frames being decompressed, in order
+                bool _streaming {false};                // true once the rest of the file is streamed
+                ZSTD_DStream *_dstream {nullptr};
+                ZSTD_inBuffer _in;
+                bool _frame_end {true};                 // false while the input runs out in the middle of a frame
+
+                static bool is_skippable(const char *p)
+                {
+                    uint32_t magic;
+                    memcpy(&magic, p, sizeof(magic));
+                    return (magic & 0xFFFFFFF0U) == 0x184D2A50U;
+                }
+
+                void prefetch()
+                {
+                    auto data = _file->data();
+                    while (!_streaming && _pending.size() < _nb_threads && _pos < _file->size())
+                    {
+                        auto p = data + _pos;
+                        auto size = ZSTD_findFrameCompressedSize(p, _file->size() - _pos);
+                        if (ZSTD_isError(size))
+                            throw runtime_error("zstd file " + _file_name + " is corrupted: " + ZSTD_getErrorName(size));
+
+                        if (size >= sizeof(uint32_t) && is_skippable(p))
+                        {
+                            _pos += size;
+                            continue;
+                        }
+
+                        auto raw_size = ZSTD_getFrameContentSize(p, size);
+                        if (raw_size == ZSTD_CONTENTSIZE_UNKNOWN || raw_size == ZSTD_CONTENTSIZE_ERROR || raw_size > ZSTD_FRAME_LIMIT)
+                        {
+                            _streaming = true;
+                            break;
+                        }
+
+                        auto file = _file;
+                        _pending.push_back(async(launch::async, [file, p, size, raw_size]() {
+                            string out;
+                            decompress_block(Codec::ZSTD, p, size, raw_size, out);
+                            return out;
+                        }));
+                        _pos += size;
+                    }
+                }
+
+            public:
+                ZstdSource(const string& file_name, size_t nb_threads):
+                    _file_name{file_name}, _file{make_shared<MappedFile>(file_name)},
+                    _nb_threads{nb_threads ? nb_threads : max(1u, thread::hardware_concurrency())}
+                {
+                }
+
+                ~ZstdSource() { ZSTD_freeDStream(_dstream); }
+
+                bool next(string& buffer) override
+                {
+                    prefetch();
+                    if (!_pending.empty())
+                    {
+                        buffer = _pending.front().get();
+                        _pending.pop_front();
+                        prefetch();
+                        return true;
+                    }
+                    if (!_streaming)
+                        return false;
+
+                    if (!_dstream)
+                    {
+                        _dstream = ZSTD_createDStream();
+                        if (!_dstream || ZSTD_isError(ZSTD_initDStream(_dstream)))
+                            throw runtime_error("unable to read zstd file " + _file_name);
+                        _in.src = _file->data() + _pos;
+                        _in.size = _file->size() - _pos;
+                        _in.pos = 0;
+                    }
+
+                    buffer.resize(STREAM_BUFFER_SIZE);
+                    ZSTD_outBuffer out = { &buffer[0], buffer.size(), 0 };
+                    while (out.pos < out.size)
+                    {
+                        auto in_pos = _in.pos, out_pos = out.pos;
+                        auto hint = ZSTD_decompressStream(_dstream, &out, &_in);
+                        if (ZSTD_isError(hint))
+                            throw runtime_error("zstd file " + _file_name + " is corrupted: " + ZSTD_getErrorName(hint));
+
+                        // input is exhausted: the hint is then the one of a next frame, which doesn't exist
+                        if (_in.pos == in_pos && out.pos == out_pos)
+                            break;
+                        _frame_end = hint == 0;
+                    }
+
+                    buffer.resize(out.pos);
+                    if (buffer.empty() && !_frame_end)
+                        throw runtime_error("zstd file " + _file_name + " is truncated");
+                    return !buffer.empty();
+                }
+        };
+#endif
+    }
+
+    InputFormat input_format(const string& file_name)
+    {
+        unsigned char magic[sizeof(BLOCK_FILE_MAGIC)] = {};
+        ifstream in(file_name, ios::in | ios::binary);
+        in.read(reinterpret_cast<char *>(magic), sizeof(magic));
+        auto size = static_cast<size_t>(in.gcount());
+
+        if (size == sizeof(BLOCK_FILE_MAGIC) && memcmp(magic, BLOCK_FILE_MAGIC, sizeof(BLOCK_FILE_MAGIC)) == 0)
+            return InputFormat::BLOCKS;
+        if (size >= sizeof(GZIP_MAGIC) && memcmp(magic, GZIP_MAGIC, sizeof(GZIP_MAGIC)) == 0)
+            return InputFormat::GZIP;
+        if (size >= sizeof(ZSTD_MAGIC) && memcmp(magic, ZSTD_MAGIC, sizeof(ZSTD_MAGIC)) == 0)
+            return InputFormat::ZSTD;
+        return InputFormat::PLAIN;
+    }
+
+    bool codec_available(Codec codec)
+    {
+        switch (codec)
+        {
+            case Codec::NONE:
+                return true;
+#ifdef RBF_HAVE_ZLIB
+            case Codec::DEFLATE:
+                return true;
+#endif
+#ifdef RBF_HAVE_ZSTD
+            case Codec::ZSTD:
+                return true;
+#endif
+            default:
+                return false;
+        }
+    }
+
+    Codec default_codec()
+    {
+        if (codec_available(Codec::ZSTD))
+            return Codec::ZSTD;
+        if (codec_available(Codec::DEFLATE))
+            return Codec::DEFLATE;
+        return Codec::NONE;
+    }
+
+    void compress_block(Codec codec, const char *p, size_t len, string& out)
+    {
+        switch (codec)
+        {
+            case Codec::NONE:
+                out.assign(p, len);
+                return;
+#ifdef RBF_HAVE_ZLIB
+            case Codec::DEFLATE:
+            {
+                auto size = compressBound(len);
+                out.resize(size);
+                auto rc = compress2(reinterpret_cast<Bytef *>(&out[0]), &size, reinterpret_cast<const Bytef *>(p), len, DEFLATE_LEVEL);
+                if (rc != Z_OK)
+                    throw runtime_error(string("deflate error: ") + zError(rc));
+                out.resize(size);
+                return;
+            }
+#endif
+#ifdef RBF_HAVE_ZSTD
+            case Codec::ZSTD:
+            {
+                out.resize(ZSTD_compressBound(len));
+                auto size = ZSTD_compress(&out[0], out.size(), p, len, ZSTD_LEVEL);
+                if (ZSTD_isError(size))
+                    throw runtime_error(string("zstd error: ") + ZSTD_getErrorName(size));
+                out.resize(size);
+                return;
+            }
+#endif
+            default:
+                throw unavailable(codec);
+        }
+    }
+
+    void decompress_block(Codec codec, const char *p, size_t len, size_t raw_size, string& out)
+    {
+        switch (codec)
+        {
+            case Codec::NONE:
+                if (len != raw_size)
+                    throw runtime_error("corrupted block");
+                out.assign(p, len);
+                return;
+#ifdef RBF_HAVE_ZLIB
+            case Codec::DEFLATE:
+            {
+                out.resize(raw_size);
+                uLongf size = raw_size;
+                auto rc = uncompress(reinterpret_cast<Bytef *>(&out[0]), &size, reinterpret_cast<const Bytef *>(p), len);
+                if (rc != Z_OK || size != raw_size)
+                    throw runtime_error(string("corrupted block: ") + zError(rc));
+                return;
+            }
+#endif
+#ifdef RBF_HAVE_ZSTD
+            case Codec::ZSTD:
+            {
+                out.resize(raw_size);
+                auto size = ZSTD_decompress(&out[0], raw_size, p, len);
+                if (ZSTD_isError(size) || size != raw_size)
+                    throw runtime_error("corrupted block");
+                return;
+            }
+#endif
+            default:
+                throw unavailable(codec);
+        }
+    }
+
+    BlockFile::BlockFile(const string& file_name): _file(file_name)
+    {
+        auto data = _file.data();
+        auto size = _file.size();
+        auto bad = runtime_error("file " + file_name + " is not a block-compressed file");
+
+        if (size < sizeof(BLOCK_FILE_MAGIC) + FOOTER_SIZE ||
+            memcmp(data, BLOCK_FILE_MAGIC, sizeof(BLOCK_FILE_MAGIC)) != 0 ||
+            memcmp(data + size - sizeof(BLOCK_FILE_MAGIC), BLOCK_FILE_MAGIC, sizeof(BLOCK_FILE_MAGIC)) != 0 ||
+            (size - FOOTER_SIZE) % alignof(BlockFooter) != 0)
+            throw bad;
+
+        // footer and index are aligned by the writer, and used in place
+        _footer = reinterpret_cast<const BlockFooter *>(data + size - FOOTER_SIZE);
+        auto index_end = size - FOOTER_SIZE;
+        if (_footer->index_offset % alignof(BlockEntry) != 0 || _footer->index_offset > index_end ||
+            _footer->nb_blocks != (index_end - _footer->index_offset) / sizeof(BlockEntry))
+            throw bad;
+        _index = reinterpret_cast<const BlockEntry *>(data + _footer->index_offset);
+
+        uint64_t first_record = 0;
+        for (size_t i = 0; i < nb_blocks(); i++)
+        {
+            auto& entry = _index[i];
+            if (entry.offset > _footer->index_offset || entry.size > _footer->index_offset - entry.offset ||
+                entry.first_record < first_record)
+                throw bad;
+            first_record = entry.first_record;
+        }
+        if (first_record > nb_records())
+            throw bad;
+    }
+
+    bool BlockFile::is_block_file(const string& file_name)
+    {
+        return input_format(file_name) == InputFormat::BLOCKS;
+    }
+
+    size_t BlockFile::find_block(size_t record_number) const
+    {
+        if (record_number >= nb_records())
+            throw out_of_range("no record " + to_string(record_number));
+
+        // last block starting at or before the record
+        auto it = upper_bound(_index, _index + nb_blocks(), record_number,
+            [](size_t n, const BlockEntry& entry) { return n < entry.first_record; });
+        return static_cast<size_t>(it - _index) - 1;
+    }
+
+    void BlockFile::read_block(size_t i, string& out) const
+    {
+        auto& entry = _index[i];
+        decompress_block(codec(), _file.data() + entry.offset, entry.size, entry.raw_size, out);
+    }
+
+    BlockSource::BlockSource(shared_ptr<BlockFile> file, size_t first_block, size_t nb_threads):
+        _file{file}, _next{first_block}, _nb_threads{nb_threads ? nb_threads : max(1u, thread::hardware_concurrency())}
+    {
+    }
+
+    void BlockSource::prefetch()
+    {
+        while (_pending.size() < _nb_threads && _next < _file->nb_blocks())
+        {
+            auto file = _file;
+            auto i = _next++;
+            _pending.push_back(async(launch::async, [file, i]() {
+                string out;
+                file->read_block(i, out);
+                return out;
+            }));
+        }
+    }
+
+    bool BlockSource::next(string& buffer)
+    {
+        prefetch();
+        if (_pending.empty())
+            return false;
+
+        buffer = _pending.front().get();
+        _pending.pop_front();
+
+        // next blocks are decompressed while this one is parsed
+        prefetch();
+        return true;
+    }
+
+    PipelinedSource::PipelinedSource(unique_ptr<ByteSource> source, size_t depth):
+        _source{move(source)}, _depth{max(depth, static_cast<size_t>(1))}, _thread{&PipelinedSource::run, this}
+    {
+    }
+
+    PipelinedSource::~PipelinedSource()
+    {
+        {
+            lock_guard<mutex> lock(_mutex);
+            _stopped = true;
+        }
+        _changed.notify_all();
+        _thread.join();
+    }
+
+    void PipelinedSource::run()
+    {
+        for (;;)
+        {
+            string buffer;
+            bool more;
+            exception_ptr error;
+
+            try
+            {
+                more = _source->next(buffer);
+            }
+            catch (...)
+            {
+                error = current_exception();
+                more = false;
+            }
+
+            unique_lock<mutex> lock(_mutex);
+            _changed.wait(lock, [this]() { return _stopped || _buffers.size() < _depth; });
+            if (_stopped)
+                return;
+
+            if (more)
+                _buffers.push_back(move(buffer));
+            else
+            {
+                _done = true;
+                _error = error;
+            }
+            _changed.notify_all();
+
+            if (!more)
+                return;
+        }
+    }
+
+    bool PipelinedSource::next(string& buffer)
+    {
+        unique_lock<mutex> lock(_mutex);
+        _changed.wait(lock, [this]() { return _done || !_buffers.empty(); });
+
+        if (_buffers.empty())
+        {
+            if (_error)
+                rethrow_exception(_error);
+            return false;
+        }
+
+        buffer = move(_buffers.front());
+        _buffers.pop_front();
+        _changed.notify_all();
+        return true;
+    }
+
+    shared_ptr<ByteSource> open_source(const string& file_name, size_t nb_threads)
+    {
+        switch (input_format(file_name))
+        {
+            case InputFormat::BLOCKS:
+                return make_shared<BlockSource>(make_shared<BlockFile>(file_name), 0, nb_threads);
+            case InputFormat::GZIP:
+#ifdef RBF_HAVE_ZLIB
+                return make_shared<PipelinedSource>(unique_ptr<ByteSource>(new GzipSource(file_name)));
+#else
+                throw runtime_error("unable to read gzip file " + file_name + ": zlib is not available");
+#endif
+            case InputFormat::ZSTD:
+#ifdef RBF_HAVE_ZSTD
+                return make_shared<PipelinedSource>(unique_ptr<ByteSource>(new ZstdSource(file_name, nb_threads)));
+#else
+                throw runtime_error("unable to read zstd file " + file_name + ": libzstd is not available");
+#endif
+            default:
+                return nullptr;
+        }
+    }
+
+    size_t compress_file(const string& input_file, const string& output_file, size_t record_length, char delimiter,
+        Codec codec, size_t block_size, size_t nb_threads)
+    {
+        if (!codec_available(codec))
+            throw unavailable(codec);
+
+        MappedFile input(input_file);
+
+        ofstream out(output_file, ios::binary | ios::trunc);
+        if (!out)
+            throw runtime_error("unable to create file " + output_file + ": " + strerror(errno));
+
+        uint64_t offset = 0;
+        auto write = [&](const char *p, size_t len) {
+            out.write(p, len);
+            if (!out)
+                throw runtime_error("unable to write file " + output_file + ": " + strerror(errno));
+            offset += len;
+        };
+
+        write(BLOCK_FILE_MAGIC, sizeof(BLOCK_FILE_MAGIC));
+
+        vector<BlockEntry> index;
+        uint64_t nb_records = 0;
+
+        // blocks are compressed in parallel, and written in order
+        process_chunks(input.data(), input.size(), record_length, delimiter, nb_threads,
+            [&](const char *p, size_t size, string& block) {
+                if (size > UINT32_MAX)
+                    throw runtime_error("block too large");
+
+                size_t n = 0;
+                for_each_raw_line(p, size, record_length, delimiter, [&](const char *, size_t, size_t) { n++; });
+
+                string data;
+                compress_block(codec, p, size, data);
+                if (data.size() > UINT32_MAX)
+                    throw runtime_error("block too large");
+
+                append_value<uint64_t>(block, n);
+                append_value<uint64_t>(block, size);
+                block += data;
+                return n;
+            },
+            [&](const string& block) {
+                BlockEntry entry;
+                entry.offset = offset;
+                entry.first_record = nb_records;
+                entry.size = static_cast<uint32_t>(block.size() - BLOCK_HEADER_SIZE);
+                entry.raw_size = static_cast<uint32_t>(read_value<uint64_t>(block.data() + sizeof(uint64_t)));
+                index.push_back(entry);
+
+                write(block.data() + BLOCK_HEADER_SIZE, entry.size);
+                nb_records += read_value<uint64_t>(block.data());
+            },
+            block_size);
+
+        // index and footer are aligned, to be used in place
+        string padding((alignof(BlockEntry) - offset % alignof(BlockEntry)) % alignof(BlockEntry), '\0');
+        write(padding.data(), padding.size());
+
+        BlockFooter footer;
+        memset(&footer, 0, sizeof(footer));
+        footer.index_offset = offset;
+        footer.nb_blocks = index.size();
+        footer.nb_records = nb_records;
+        footer.record_length = record_length;
+        footer.codec = codec;
+        footer.delimiter = delimiter;
+
+        write(reinterpret_cast<const char *>(index.data()), index.size() * sizeof(BlockEntry));
+        write(reinterpret_cast<const char *>(&footer), sizeof(footer));
+        write(BLOCK_FILE_MAGIC, sizeof(BLOCK_FILE_MAGIC));
+
+        out.close();
+        if (!out)
+            throw runtime_error("unable to close file " + output_file);
+
+        return nb_records;
+    }
+
+}
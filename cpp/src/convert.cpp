@@ -0,0 +1,596 @@
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <cinttypes>
+#include <limits>
+#include <algorithm>
+
+#include <convert.h>
+
+namespace rbf
+{
+
+    // SWAR helpers: 8 ASCII digits are loaded into a 64-bit word, first char in the lowest byte
+    namespace
+    {
+        constexpr uint64_t ZEROES = 0x3030303030303030ULL;
+        constexpr uint64_t HIGH_NIBBLES = 0xF0F0F0F0F0F0F0F0ULL;
+        constexpr uint64_t SIXES = 0x0606060606060606ULL;
+        constexpr uint64_t THREES = 0x3333333333333333ULL;
+
+        // more significant digits than this can't fit into a uint64_t safely
+        constexpr size_t MAX_DIGITS = 19;
+
+        // powers of ten which are exact both as uint64_t and double
+        constexpr uint64_t POW10[] = {
+            1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL, 100000000ULL,
+            1000000000ULL, 10000000000ULL, 100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+            100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL, 100000000000000000ULL,
+            1000000000000000000ULL, 10000000000000000000ULL
+        };
+        constexpr double POW10_DOUBLE[] = {
+            1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+            1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+        };
+
+        // integers up to 2^53 are exact doubles
+        constexpr int64_t MAX_EXACT_DOUBLE = 1LL << 53;
+
+        // room for the digits handed to strtod() on the slow path
+        constexpr size_t MAX_DOUBLE_DIGITS = 100;
+
+        inline uint64_t load_8_chars(const char *p)
+        {
+            uint64_t v;
+            memcpy(&v, p, sizeof(v));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+            v = __builtin_bswap64(v);
+#endif
+            return v;
+        }
+
+        // true if all 8 bytes are in the '0'..'9' range
+        inline bool is_8_digits(uint64_t v)
+        {
+            return ((v & HIGH_NIBBLES) | (((v + SIXES) & HIGH_NIBBLES) >> 4)) == THREES;
+        }
+
+        // convert 8 ASCII digits into their value: pairs, then quads, then the whole word
+        inline uint64_t swar_8_digits(uint64_t v)
+        {
+            v -= ZEROES;
+            v = (v * 10) + (v >> 8);
+            v = (((v & 0x000000FF000000FFULL) * (100 + (1000000ULL << 32))) +
+                 (((v >> 16) & 0x000000FF000000FFULL) * (1 + (10000ULL << 32)))) >> 32;
+            return v;
+        }
+
+        // lookup tables for mainframe numeric formats
+        constexpr uint8_t INVALID = 0xFF;
+        constexpr uint8_t NEGATIVE = 0x80;
+        constexpr char EBCDIC_BLANK = '\x40';
+
+        struct PackedTable
+        {
+            uint8_t pair[256];      // 2-digit value of a byte, INVALID if a nibble is not a digit
+            uint8_t last[256];      // digit | NEGATIVE for the last byte, INVALID if bad digit or sign
+
+            constexpr PackedTable(): pair{}, last{}
+            {
+                for (unsigned int b = 0; b < 256; b++)
+                {
+                    auto high = b >> 4, low = b & 0x0F;
+
+                    pair[b] = (high <= 9 && low <= 9) ? high * 10 + low : INVALID;
+
+                    if (high > 9 || low <= 9)
+                        last[b] = INVALID;
+                    else
+                        last[b] = (low == 0x0B || low == 0x0D) ? high | NEGATIVE : high;
+                }
+            }
+        };
+
+        struct ZonedTable
+        {
+            uint8_t digit[256];     // digit value, INVALID if not a digit
+            uint8_t last[256];      // digit | NEGATIVE for the (overpunched) last byte
+
+            constexpr ZonedTable(): digit{}, last{}
+            {
+                for (unsigned int b = 0; b < 256; b++)
+                {
+                    digit[b] = INVALID;
+                    last[b] = INVALID;
+                }
+                for (unsigned int d = 0; d <= 9; d++)
+                {
+                    // ASCII & EBCDIC digits
+                    digit['0' + d] = last['0' + d] = d;
+                    digit[0xF0 + d] = last[0xF0 + d] = d;
+
+                    // EBCDIC overpunch
+                    last[0xC0 + d] = d;
+                    last[0xD0 + d] = d | NEGATIVE;
+                }
+                // ASCII overpunch
+                last['{'] = 0;
+                last['}'] = NEGATIVE;
+                for (unsigned int d = 1; d <= 9; d++)
+                {
+                    last['A' + d - 1] = d;
+                    last['J' + d - 1] = d | NEGATIVE;
+                }
+            }
+        };
+
+        constexpr PackedTable PACKED;
+        constexpr ZonedTable ZONED;
+
+        // true if the field is only made of ASCII or EBCDIC blanks
+        inline bool is_blank(const char *p, size_t len)
+        {
+            if (len == 0)
+                return true;
+            auto blank = p[0];
+            if (blank != ' ' && blank != EBCDIC_BLANK)
+                return false;
+            for (size_t i = 1; i < len; i++)
+            {
+                if (p[i] != blank)
+                    return false;
+            }
+            return true;
+        }
+
+        // strip blanks on both sides, then an optional sign
+        inline ConvStatus strip(const char *&p, const char *&end, bool& negative)
+        {
+            while (p < end && *p == ' ') p++;
+            while (end > p && *(end-1) == ' ') end--;
+
+            if (p == end)
+                return ConvStatus::EMPTY;
+
+            negative = false;
+            if (*p == '-' || *p == '+')
+            {
+                negative = (*p == '-');
+                if (++p == end)
+                    return ConvStatus::BAD_DIGIT;
+            }
+            return ConvStatus::OK;
+        }
+
+        constexpr char DIGIT_PAIRS[] =
+            "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+            "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+            "8081828384858687888990919293949596979899";
+
+        // number of digits of u, 1 for 0
+        inline size_t count_digits(uint64_t u)
+        {
+            size_t digits = 1;
+            while (digits < 20 && u >= POW10[digits]) digits++;
+            return digits;
+        }
+
+        // write the last **digits** digits of u, 2 at a time
+        inline void write_digits(char *p, uint64_t u, size_t digits)
+        {
+            auto end = p + digits;
+            while (end - p >= 2)
+            {
+                end -= 2;
+                memcpy(end, DIGIT_PAIRS + 2 * (u % 100), 2);
+                u /= 100;
+            }
+            if (end > p)
+                *p = static_cast<char>('0' + u % 10);
+        }
+
+        // apply sign to an unsigned magnitude, checking the int64_t range
+        inline ConvStatus to_signed(uint64_t u, bool negative, int64_t& value)
+        {
+            constexpr auto max = static_cast<uint64_t>(numeric_limits<int64_t>::max());
+            if (negative)
+            {
+                if (u > max + 1)
+                    return ConvStatus::OUT_OF_RANGE;
+                value = (u == max + 1) ? numeric_limits<int64_t>::min() : -static_cast<int64_t>(u);
+            }
+            else
+            {
+                if (u > max)
+                    return ConvStatus::OUT_OF_RANGE;
+                value = static_cast<int64_t>(u);
+            }
+            return ConvStatus::OK;
+        }
+    }
+
+    double Decimal::to_double() const
+    {
+        // fast path: both operands are exact, so the division is correctly rounded
+        if (scale <= 22 && mantissa <= MAX_EXACT_DOUBLE && mantissa >= -MAX_EXACT_DOUBLE)
+            return static_cast<double>(mantissa) / POW10_DOUBLE[scale];
+
+        // let strtod() round. No decimal point is used, so the locale doesn't matter.
+        char buffer[48];
+        snprintf(buffer, sizeof(buffer), "%" PRId64 "e-%u", mantissa, scale);
+        return strtod(buffer, nullptr);
+    }
+
+    ConvStatus parse_digits(const char *p, size_t len, uint64_t& value)
+    {
+        // leading zeroes don't count as significant digits
+        while (len > 0 && *p == '0') { p++; len--; }
+
+        uint64_t acc = 0;
+        bool too_long = len > MAX_DIGITS;
+
+        // 8 digits at a time
+        while (len >= 8)
+        {
+            auto v = load_8_chars(p);
+            if (!is_8_digits(v))
+                return ConvStatus::BAD_DIGIT;
+            acc = acc * 100000000ULL + swar_8_digits(v);
+            p += 8;
+            len -= 8;
+        }
+
+        // remaining digits
+        while (len > 0)
+        {
+            auto d = static_cast<unsigned char>(*p - '0');
+            if (d > 9)
+                return ConvStatus::BAD_DIGIT;
+            acc = acc * 10 + d;
+            p++;
+            len--;
+        }
+
+        // all digits have been checked before reporting overflow
+        if (too_long)
+            return ConvStatus::OUT_OF_RANGE;
+
+        value = acc;
+        return ConvStatus::OK;
+    }
+
+    ConvStatus parse_integer(const char *p, size_t len, int64_t& value)
+    {
+        auto end = p + len;
+        bool negative = false;
+
+        auto status = strip(p, end, negative);
+        if (status != ConvStatus::OK)
+            return status;
+
+        uint64_t u;
+        status = parse_digits(p, end - p, u);
+        if (status != ConvStatus::OK)
+            return status;
+
+        return to_signed(u, negative, value);
+    }
+
+    ConvStatus parse_decimal(const char *p, size_t len, unsigned int implied_decimals, Decimal& value)
+    {
+        auto end = p + len;
+        bool negative = false;
+
+        auto status = strip(p, end, negative);
+        if (status != ConvStatus::OK)
+            return status;
+
+        // split integer and fractional parts
+        auto dot = static_cast<const char *>(memchr(p, '.', end - p));
+        auto int_end = dot ? dot : end;
+        auto frac = dot ? dot + 1 : end;
+
+        if (dot && int_end == p && frac == end)
+            return ConvStatus::BAD_DIGIT;
+
+        // leading zeroes are not significant
+        while (p < int_end && *p == '0') p++;
+
+        uint64_t int_part, frac_part = 0;
+        size_t frac_len = end - frac;
+
+        // both parts are checked before reporting overflow
+        auto int_status = parse_digits(p, int_end - p, int_part);
+        auto frac_status = frac_len > 0 ? parse_digits(frac, frac_len, frac_part) : ConvStatus::OK;
+        if (int_status == ConvStatus::BAD_DIGIT || frac_status == ConvStatus::BAD_DIGIT)
+            return ConvStatus::BAD_DIGIT;
+
+        if (int_status != ConvStatus::OK || frac_status != ConvStatus::OK || static_cast<size_t>(int_end - p) + frac_len > MAX_DIGITS)
+            return ConvStatus::OUT_OF_RANGE;
+
+        status = to_signed(int_part * POW10[frac_len] + frac_part, negative, value.mantissa);
+        if (status != ConvStatus::OK)
+            return status;
+
+        value.scale = dot ? frac_len : implied_decimals;
+        return ConvStatus::OK;
+    }
+
+    ConvStatus parse_double(const char *p, size_t len, unsigned int implied_decimals, double& value)
+    {
+        Decimal d;
+        auto status = parse_decimal(p, len, implied_decimals, d);
+
+        if (status == ConvStatus::OK)
+        {
+            value = d.to_double();
+            return status;
+        }
+        if (status != ConvStatus::OUT_OF_RANGE)
+            return status;
+
+        // mantissa is too large for an int64_t: let strtod() round
+        // the digits written without decimal point
+        auto end = p + len;
+        bool negative = false;
+        strip(p, end, negative);
+
+        char buffer[MAX_DOUBLE_DIGITS + 16];
+        size_t n = 0;
+        unsigned int scale = implied_decimals;
+
+        if (negative)
+            buffer[n++] = '-';
+
+        for (auto c = p; c < end; c++)
+        {
+            if (*c == '.')
+            {
+                scale = end - c - 1;
+                continue;
+            }
+            if (static_cast<unsigned char>(*c - '0') > 9)
+                return ConvStatus::BAD_DIGIT;
+            if (n >= MAX_DOUBLE_DIGITS)
+                return ConvStatus::OUT_OF_RANGE;
+            buffer[n++] = *c;
+        }
+        snprintf(buffer + n, sizeof(buffer) - n, "e-%u", scale);
+
+        value = strtod(buffer, nullptr);
+        return ConvStatus::OK;
+    }
+
+    ConvStatus parse_packed(const char *p, size_t len, int64_t& value)
+    {
+        if (is_blank(p, len))
+            return ConvStatus::EMPTY;
+
+        auto data = reinterpret_cast<const unsigned char *>(p);
+        auto last = PACKED.last[data[len-1]];
+        if (last == INVALID)
+            return ConvStatus::BAD_DIGIT;
+
+        // leading zero bytes are not significant
+        size_t i = 0;
+        while (i < len - 1 && data[i] == 0) i++;
+
+        // 2 digits per byte plus the last one
+        bool too_long = 2 * (len - 1 - i) + 1 > MAX_DIGITS;
+
+        uint64_t acc = 0;
+        for (; i < len - 1; i++)
+        {
+            auto pair = PACKED.pair[data[i]];
+            if (pair == INVALID)
+                return ConvStatus::BAD_DIGIT;
+            acc = acc * 100 + pair;
+        }
+        if (too_long)
+            return ConvStatus::OUT_OF_RANGE;
+
+        acc = acc * 10 + (last & ~NEGATIVE);
+        return to_signed(acc, (last & NEGATIVE) != 0, value);
+    }
+
+    ConvStatus parse_zoned(const char *p, size_t len, int64_t& value)
+    {
+        if (is_blank(p, len))
+            return ConvStatus::EMPTY;
+
+        auto data = reinterpret_cast<const unsigned char *>(p);
+        auto last = ZONED.last[data[len-1]];
+        if (last == INVALID)
+            return ConvStatus::BAD_DIGIT;
+
+        // leading zeroes are not significant
+        size_t i = 0;
+        while (i < len - 1 && ZONED.digit[data[i]] == 0) i++;
+
+        bool too_long = len - i > MAX_DIGITS;
+
+        uint64_t acc = 0;
+        for (; i < len - 1; i++)
+        {
+            auto d = ZONED.digit[data[i]];
+            if (d == INVALID)
+                return ConvStatus::BAD_DIGIT;
+            acc = acc * 10 + d;
+        }
+        if (too_long)
+            return ConvStatus::OUT_OF_RANGE;
+
+        acc = acc * 10 + (last & ~NEGATIVE);
+        return to_signed(acc, (last & NEGATIVE) != 0, value);
+    }
+
+    ConvStatus rescale(const Decimal& value, unsigned int scale, int64_t& mantissa)
+    {
+        if (scale == value.scale)
+        {
+            mantissa = value.mantissa;
+            return ConvStatus::OK;
+        }
+
+        bool negative = value.mantissa < 0;
+        uint64_t u = negative ? 0 - static_cast<uint64_t>(value.mantissa) : static_cast<uint64_t>(value.mantissa);
+
+        if (scale > value.scale)
+        {
+            auto shift = scale - value.scale;
+            if (u == 0)
+                return to_signed(0, false, mantissa);
+            if (shift > MAX_DIGITS || u > numeric_limits<uint64_t>::max() / POW10[shift])
+                return ConvStatus::OUT_OF_RANGE;
+            return to_signed(u * POW10[shift], negative, mantissa);
+        }
+
+        // dropped digits are rounded half away from zero
+        auto shift = value.scale - scale;
+        if (shift > MAX_DIGITS)
+            u = 0;
+        else
+        {
+            auto divisor = POW10[shift];
+            auto remainder = u % divisor;
+            u = u / divisor + (remainder >= divisor - remainder);
+        }
+        return to_signed(u, negative, mantissa);
+    }
+
+    int compare(const Decimal& a, const Decimal& b)
+    {
+        auto scale = max(a.scale, b.scale);
+        int64_t x, y;
+        if (rescale(a, scale, x) == ConvStatus::OK && rescale(b, scale, y) == ConvStatus::OK)
+            return (x > y) - (x < y);
+
+        auto u = a.to_double(), v = b.to_double();
+        return (u > v) - (u < v);
+    }
+
+    ConvStatus format_integer(char *p, size_t len, int64_t value)
+    {
+        bool negative = value < 0;
+        uint64_t u = negative ? 0 - static_cast<uint64_t>(value) : static_cast<uint64_t>(value);
+
+        auto digits = count_digits(u);
+        if (digits + negative > len)
+            return ConvStatus::OUT_OF_RANGE;
+
+        write_digits(p + len - digits, u, digits);
+        memset(p, '0', len - digits);
+        if (negative)
+            p[0] = '-';
+        return ConvStatus::OK;
+    }
+
+    ConvStatus format_decimal(char *p, size_t len, unsigned int implied_decimals, const Decimal& value)
+    {
+        if (implied_decimals != 0 || value.scale == 0)
+        {
+            int64_t mantissa;
+            auto status = rescale(value, implied_decimals, mantissa);
+            if (status != ConvStatus::OK)
+                return status;
+            return format_integer(p, len, mantissa);
+        }
+
+        if (value.scale > MAX_DIGITS)
+            return ConvStatus::OUT_OF_RANGE;
+
+        bool negative = value.mantissa < 0;
+        uint64_t u = negative ? 0 - static_cast<uint64_t>(value.mantissa) : static_cast<uint64_t>(value.mantissa);
+
+        // at least one digit before the decimal point
+        auto digits = max(count_digits(u), static_cast<size_t>(value.scale) + 1);
+        if (digits + 1 + negative > len)
+            return ConvStatus::OUT_OF_RANGE;
+
+        auto frac = p + len - value.scale;
+        auto int_digits = digits - value.scale;
+        write_digits(frac, u % POW10[value.scale], value.scale);
+        frac[-1] = '.';
+        write_digits(frac - 1 - int_digits, u / POW10[value.scale], int_digits);
+        memset(p, '0', len - digits - 1);
+        if (negative)
+            p[0] = '-';
+        return ConvStatus::OK;
+    }
+
+    size_t print_decimal(char *p, const Decimal& value)
+    {
+        if (value.scale > MAX_DIGITS)
+            return 0;
+
+        bool negative = value.mantissa < 0;
+        uint64_t u = negative ? 0 - static_cast<uint64_t>(value.mantissa) : static_cast<uint64_t>(value.mantissa);
+
+        auto start = p;
+        if (negative)
+            *p++ = '-';
+
+        if (value.scale == 0)
+        {
+            auto digits = count_digits(u);
+            write_digits(p, u, digits);
+            return p + digits - start;
+        }
+
+        // at least one digit before the decimal point
+        auto digits = max(count_digits(u), static_cast<size_t>(value.scale) + 1);
+        auto int_digits = digits - value.scale;
+        write_digits(p, u / POW10[value.scale], int_digits);
+        p[int_digits] = '.';
+        write_digits(p + int_digits + 1, u % POW10[value.scale], value.scale);
+        return p + digits + 1 - start;
+    }
+
+    ConvStatus format_packed(char *p, size_t len, int64_t value)
+    {
+        bool negative = value < 0;
+        uint64_t u = negative ? 0 - static_cast<uint64_t>(value) : static_cast<uint64_t>(value);
+
+        if (len == 0 || count_digits(u) > 2 * len - 1)
+            return ConvStatus::OUT_OF_RANGE;
+
+        // last byte holds the last digit and the sign
+        p[len - 1] = static_cast<char>(((u % 10) << 4) | (negative ? 0x0D : 0x0C));
+        u /= 10;
+        for (size_t i = len - 1; i > 0; i--)
+        {
+            p[i - 1] = static_cast<char>((((u / 10) % 10) << 4) | (u % 10));
+            u /= 100;
+        }
+        return ConvStatus::OK;
+    }
+
+    ConvStatus format_zoned(char *p, size_t len, int64_t value)
+    {
+        bool negative = value < 0;
+        uint64_t u = negative ? 0 - static_cast<uint64_t>(value) : static_cast<uint64_t>(value);
+
+        auto digits = count_digits(u);
+        if (len == 0 || digits > len)
+            return ConvStatus::OUT_OF_RANGE;
+
+        write_digits(p + len - digits, u, digits);
+        memset(p, '0', len - digits);
+        if (negative)
+            p[len - 1] = "}JKLMNOPQR"[p[len - 1] - '0'];
+        return ConvStatus::OK;
+    }
+
+    string conv_message(ConvStatus status)
+    {
+        switch (status)
+        {
+            case ConvStatus::OK: return "ok";
+            case ConvStatus::EMPTY: return "empty value";
+            case ConvStatus::BAD_DIGIT: return "invalid character";
+            case ConvStatus::OUT_OF_RANGE: return "value out of range";
+        }
+        return "unknown status";
+    }
+
+}
@@ -0,0 +1,273 @@
+#include <cstring>
+#include <stdexcept>
+#include <atomic>
+
+#include <date.h>
+
+namespace rbf
+{
+
+    namespace
+    {
+        const char *MONTH_NAMES[] = {
+            "JAN", "FEB", "MAR", "APR", "MAY", "JUN", "JUL", "AUG", "SEP", "OCT", "NOV", "DEC"
+        };
+
+        constexpr unsigned int DAYS_IN_MONTH[] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+
+        static_assert((DATE_MEMO_SIZE & (DATE_MEMO_SIZE - 1)) == 0, "DATE_MEMO_SIZE must be a power of 2");
+
+        // one memoized raw value and its conversion
+        struct MemoEntry
+        {
+            uint64_t format_id {0};     // 0 for an unused entry
+            char key[DATE_MEMO_KEY_SIZE];
+            size_t length {0};
+            Date date;
+        };
+
+        // formats are told apart by an ID, as a format can be destroyed and another one built at its address
+        atomic<uint64_t> next_format_id {1};
+
+        thread_local MemoEntry memo[DATE_MEMO_SIZE];
+
+        inline bool is_leap(int year)
+        {
+            return (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+        }
+
+        // convert a short run of digits
+        inline bool small_digits(const char *p, size_t len, unsigned int& value)
+        {
+            value = 0;
+            for (size_t i = 0; i < len; i++)
+            {
+                auto d = static_cast<unsigned char>(p[i] - '0');
+                if (d > 9)
+                    return false;
+                value = value * 10 + d;
+            }
+            return true;
+        }
+
+        // write a zero-padded number
+        inline void write_number(char *p, unsigned int value, size_t len)
+        {
+            for (size_t i = len; i > 0; i--)
+            {
+                p[i - 1] = static_cast<char>('0' + value % 10);
+                value /= 10;
+            }
+        }
+
+        // English month abbreviation, case insensitive
+        inline bool month_from_name(const char *p, unsigned int& month)
+        {
+            char name[3];
+            for (size_t i = 0; i < 3; i++)
+            {
+                name[i] = (p[i] >= 'a' && p[i] <= 'z') ? p[i] - 'a' + 'A' : p[i];
+            }
+            for (unsigned int i = 0; i < 12; i++)
+            {
+                if (memcmp(name, MONTH_NAMES[i], 3) == 0)
+                {
+                    month = i + 1;
+                    return true;
+                }
+            }
+            return false;
+        }
+    }
+
+    // see http://howardhinnant.github.io/date_algorithms.html
+    Date Date::from_civil(int year, unsigned int month, unsigned int day)
+    {
+        year -= month <= 2;
+        const int era = (year >= 0 ? year : year - 399) / 400;
+        const unsigned int yoe = static_cast<unsigned int>(year - era * 400);
+        const unsigned int doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+        const unsigned int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+
+        Date d;
+        d.days = era * 146097 + static_cast<int>(doe) - 719468;
+        return d;
+    }
+
+    void Date::to_civil(int& year, unsigned int& month, unsigned int& day) const
+    {
+        const int z = days + 719468;
+        const int era = (z >= 0 ? z : z - 146096) / 146097;
+        const unsigned int doe = static_cast<unsigned int>(z - era * 146097);
+        const unsigned int yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+        const unsigned int doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+        const unsigned int mp = (5 * doy + 2) / 153;
+
+        day = doy - (153 * mp + 2) / 5 + 1;
+        month = mp < 10 ? mp + 3 : mp - 9;
+        year = static_cast<int>(yoe) + era * 400 + (month <= 2);
+    }
+
+    DateFormat::DateFormat(const string& format): _format{format}, _id{next_format_id++}
+    {
+        // split format into runs of the same char
+        size_t i = 0;
+        while (i < format.length())
+        {
+            auto c = format[i];
+            size_t run = 1;
+            while (i + run < format.length() && format[i + run] == c) run++;
+
+            Token *token = nullptr;
+            if (c == 'Y' && (run == 2 || run == 4))
+                token = &_year;
+            else if (c == 'M' && (run == 2 || run == 3))
+                token = &_month;
+            else if (c == 'D' && (run == 2 || run == 3))
+                token = &_day;
+            else if (c == 'Y' || c == 'M' || c == 'D')
+                throw runtime_error("invalid date format " + format);
+
+            if (token)
+            {
+                if (token->length != 0)
+                    throw runtime_error("invalid date format " + format);
+                token->offset = i;
+                token->length = run;
+            }
+            i += run;
+        }
+        _length = format.length();
+
+        // either a day of month with a month, or a day of year without
+        if (_year.length == 0 || _day.length == 0 || (_day.length == 3) != (_month.length == 0))
+            throw runtime_error("invalid date format " + format);
+
+        _kind = (format == "YYYYMMDD") ? Kind::YYYYMMDD : Kind::GENERIC;
+    }
+
+    ConvStatus DateFormat::parse(const char *p, size_t len, Date& value) const
+    {
+        // blanks after the date are ignored
+        auto end = p + len;
+        while (end > p && *(end-1) == ' ') end--;
+
+        if (p == end)
+            return ConvStatus::EMPTY;
+        if (static_cast<size_t>(end - p) != _length)
+            return ConvStatus::BAD_DIGIT;
+
+        int year;
+        unsigned int month = 1, day, n;
+
+        if (_kind == Kind::YYYYMMDD)
+        {
+            // one SWAR step for the whole date
+            uint64_t u;
+            if (parse_digits(p, 8, u) != ConvStatus::OK)
+                return ConvStatus::BAD_DIGIT;
+            year = static_cast<int>(u / 10000);
+            month = (u / 100) % 100;
+            day = u % 100;
+        }
+        else
+        {
+            if (!small_digits(p + _year.offset, _year.length, n))
+                return ConvStatus::BAD_DIGIT;
+            year = static_cast<int>(n);
+            if (_year.length == 2)
+                year += (year < DATE_CENTURY_PIVOT) ? 2000 : 1900;
+
+            if (_month.length == 3)
+            {
+                if (!month_from_name(p + _month.offset, month))
+                    return ConvStatus::BAD_DIGIT;
+            }
+            else if (_month.length == 2)
+            {
+                if (!small_digits(p + _month.offset, 2, month))
+                    return ConvStatus::BAD_DIGIT;
+            }
+
+            if (!small_digits(p + _day.offset, _day.length, day))
+                return ConvStatus::BAD_DIGIT;
+        }
+
+        // julian date
+        if (_day.length == 3)
+        {
+            if (day < 1 || day > (is_leap(year) ? 366u : 365u))
+                return ConvStatus::OUT_OF_RANGE;
+            value.days = Date::from_civil(year, 1, 1).days + static_cast<int32_t>(day) - 1;
+            return ConvStatus::OK;
+        }
+
+        if (month < 1 || month > 12)
+            return ConvStatus::OUT_OF_RANGE;
+        auto last_day = DAYS_IN_MONTH[month - 1] + (month == 2 && is_leap(year));
+        if (day < 1 || day > last_day)
+            return ConvStatus::OUT_OF_RANGE;
+
+        value = Date::from_civil(year, month, day);
+        return ConvStatus::OK;
+    }
+
+    ConvStatus DateFormat::print(const Date& value, char *p) const
+    {
+        int year;
+        unsigned int month, day;
+        value.to_civil(year, month, day);
+
+        if (year < 0 || year > 9999)
+            return ConvStatus::OUT_OF_RANGE;
+
+        // separators first, then tokens
+        memcpy(p, _format.data(), _length);
+        write_number(p + _year.offset, static_cast<unsigned int>(year) % (_year.length == 2 ? 100 : 10000), _year.length);
+
+        if (_day.length == 3)
+        {
+            auto day_of_year = value.days - Date::from_civil(year, 1, 1).days + 1;
+            write_number(p + _day.offset, static_cast<unsigned int>(day_of_year), 3);
+            return ConvStatus::OK;
+        }
+
+        if (_month.length == 3)
+            memcpy(p + _month.offset, MONTH_NAMES[month - 1], 3);
+        else
+            write_number(p + _month.offset, month, 2);
+        write_number(p + _day.offset, day, 2);
+        return ConvStatus::OK;
+    }
+
+    ConvStatus DateFormat::cached_parse(const char *p, size_t len, Date& value) const
+    {
+        if (len == 0 || len > DATE_MEMO_KEY_SIZE)
+            return parse(p, len, value);
+
+        size_t h = static_cast<size_t>(_id);
+        for (size_t i = 0; i < len; i++)
+        {
+            h = h * 31 + static_cast<unsigned char>(p[i]);
+        }
+        auto& entry = memo[h & (DATE_MEMO_SIZE - 1)];
+
+        if (entry.format_id == _id && entry.length == len && memcmp(entry.key, p, len) == 0)
+        {
+            value = entry.date;
+            return ConvStatus::OK;
+        }
+
+        // only successful conversions are memoized
+        auto status = parse(p, len, value);
+        if (status == ConvStatus::OK)
+        {
+            entry.format_id = _id;
+            memcpy(entry.key, p, len);
+            entry.length = len;
+            entry.date = value;
+        }
+        return status;
+    }
+
+}
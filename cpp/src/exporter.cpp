@@ -0,0 +1,456 @@
+#include <cstring>
+#include <algorithm>
+
+#include <exporter.h>
+#include <writer.h>
+
+namespace rbf
+{
+
+    // SWAR helpers: 8 bytes are loaded into a 64-bit word
+    namespace
+    {
+        constexpr uint64_t ONES = 0x0101010101010101ULL;
+        constexpr uint64_t HIGH_BITS = 0x8080808080808080ULL;
+
+        // true if a byte of v is 0
+        inline uint64_t has_zero(uint64_t v) { return (v - ONES) & ~v & HIGH_BITS; }
+
+        // true if a byte of v is lower than n (n <= 128)
+        inline uint64_t has_less(uint64_t v, uint64_t n) { return (v - ONES * n) & ~v & HIGH_BITS; }
+
+        // true if a byte of v needs to be escaped or checked, bytes above 0x7F being flagged too
+        inline bool needs_escape(uint64_t v)
+        {
+            return (has_less(v, 0x20) | has_zero(v ^ (ONES * '"')) | has_zero(v ^ (ONES * '\\')) | (v & HIGH_BITS)) != 0;
+        }
+
+        constexpr char HEX_DIGITS[] = "0123456789abcdef";
+
+        // length of the valid UTF-8 sequence starting with a byte above 0x7F, 0 if it's not one
+        size_t utf8_length(const unsigned char *p, size_t left)
+        {
+            size_t n;
+            uint32_t code_point;
+            if (p[0] >= 0xC2 && p[0] <= 0xDF) { n = 2; code_point = p[0] & 0x1F; }
+            else if ((p[0] & 0xF0) == 0xE0) { n = 3; code_point = p[0] & 0x0F; }
+            else if (p[0] >= 0xF0 && p[0] <= 0xF4) { n = 4; code_point = p[0] & 0x07; }
+            else return 0;
+
+            if (left < n)
+                return 0;
+            for (size_t i = 1; i < n; i++)
+            {
+                if ((p[i] & 0xC0) != 0x80)
+                    return 0;
+                code_point = (code_point << 6) | (p[i] & 0x3F);
+            }
+
+            // overlong forms, surrogates and code points beyond U+10FFFF
+            if (n == 3 && (code_point < 0x800 || (code_point >= 0xD800 && code_point <= 0xDFFF)))
+                return 0;
+            if (n == 4 && (code_point < 0x10000 || code_point > 0x10FFFF))
+                return 0;
+            return n;
+        }
+    }
+
+    void append_json_string(string& out, const char *p, size_t len, bool latin1)
+    {
+        auto end = p + len;
+        while (p < end)
+        {
+            // skip bytes which don't need to be escaped, 8 at a time
+            auto q = p;
+            while (end - q >= 8)
+            {
+                uint64_t v;
+                memcpy(&v, q, sizeof(v));
+                if (needs_escape(v))
+                    break;
+                q += 8;
+            }
+            for (; q < end; q++)
+            {
+                auto c = static_cast<unsigned char>(*q);
+                if (c < 0x20 || c == '"' || c == '\\' || c > 0x7F)
+                    break;
+            }
+
+            out.append(p, q - p);
+            if (q == end)
+                break;
+
+            auto c = static_cast<unsigned char>(*q);
+            size_t n = 1;
+            switch (c)
+            {
+                case '"': out += "\\\""; break;
+                case '\\': out += "\\\\"; break;
+                case '\n': out += "\\n"; break;
+                case '\r': out += "\\r"; break;
+                case '\t': out += "\\t"; break;
+                case '\b': out += "\\b"; break;
+                case '\f': out += "\\f"; break;
+                default:
+                    if (latin1 && c > 0x7F)
+                    {
+                        // ISO-8859-1 code points are encoded as 2 bytes
+                        out += static_cast<char>(0xC0 | (c >> 6));
+                        out += static_cast<char>(0x80 | (c & 0x3F));
+                    }
+                    else if (c > 0x7F && (n = utf8_length(reinterpret_cast<const unsigned char *>(q), end - q)) != 0)
+                    {
+                        out.append(q, n);
+                    }
+                    else
+                    {
+                        // control characters, and bytes which are not UTF-8 read as ISO-8859-1
+                        n = 1;
+                        char escaped[] = {'\\', 'u', '0', '0', HEX_DIGITS[c >> 4], HEX_DIGITS[c & 0x0F]};
+                        out.append(escaped, sizeof(escaped));
+                    }
+                    break;
+            }
+            p = q + n;
+        }
+    }
+
+    void append_utf8(string& out, const char *p, size_t len, bool latin1)
+    {
+        auto end = p + len;
+        while (p < end)
+        {
+            // copy ASCII bytes, 8 at a time
+            auto q = p;
+            while (end - q >= 8)
+            {
+                uint64_t v;
+                memcpy(&v, q, sizeof(v));
+                if (v & HIGH_BITS)
+                    break;
+                q += 8;
+            }
+            while (q < end && static_cast<unsigned char>(*q) <= 0x7F) q++;
+
+            out.append(p, q - p);
+            if (q == end)
+                break;
+
+            auto c = static_cast<unsigned char>(*q);
+            size_t n = latin1 ? 0 : utf8_length(reinterpret_cast<const unsigned char *>(q), end - q);
+            if (n != 0)
+                out.append(q, n);
+            else
+            {
+                // ISO-8859-1 code points are encoded as 2 bytes
+                n = 1;
+                out += static_cast<char>(0xC0 | (c >> 6));
+                out += static_cast<char>(0x80 | (c & 0x3F));
+            }
+            p = q + n;
+        }
+    }
+
+    void Exporter::compile()
+    {
+        _plans.clear();
+
+        for (auto const &kv: _columns)
+        {
+            if (!_layout.contains(kv.first))
+                throw runtime_error("record " + kv.first + " not in layout");
+        }
+
+        for (auto const &kv: _layout)
+        {
+            auto& rec = *kv.second;
+            ExportPlan plan;
+            plan.record_name = kv.first;
+
+            // binary fields are never transcoded
+            for (auto const &f: rec)
+            {
+                auto data_type = f.type().data_type();
+                if (data_type == DataType::PACKED || data_type == DataType::ZONED)
+                    continue;
+
+                if (!plan.text_ranges.empty() && plan.text_ranges.back().first + plan.text_ranges.back().second == f.lower_bound())
+                    plan.text_ranges.back().second += f.length();
+                else
+                    plan.text_ranges.emplace_back(f.lower_bound(), f.length());
+            }
+
+            auto selected = _columns.find(kv.first);
+            if (selected == _columns.end())
+            {
+                for (auto const &f: rec)
+                {
+                    plan.columns.push_back(Column{f.name(), f.lower_bound(), f.length(), &f.type()});
+                }
+            }
+            else
+            {
+                for (auto const &name: selected->second)
+                {
+                    auto& f = *(rec.begin() + rec.handle(name));
+                    plan.columns.push_back(Column{f.name(), f.lower_bound(), f.length(), &f.type()});
+                }
+            }
+
+            prepare(plan);
+            _plans[kv.first] = plan;
+        }
+
+        _compiled = true;
+    }
+
+    const ExportPlan& Exporter::plan(const string& record_name)
+    {
+        if (!_compiled)
+            compile();
+
+        auto it = _plans.find(record_name);
+        if (it == _plans.end())
+            throw runtime_error("record " + record_name + " not in layout");
+        return it->second;
+    }
+
+    void Exporter::check(ConvStatus status, const Column& column)
+    {
+        if (status != ConvStatus::OK)
+            throw runtime_error("field " + column.name + ": " + conv_message(status));
+    }
+
+    size_t Exporter::field_text(const Column& column, const char *p, size_t len, char *buffer, const char *&text)
+    {
+        auto data_type = column.type->data_type();
+        if (data_type == DataType::PACKED || data_type == DataType::ZONED)
+        {
+            Decimal value;
+            auto status = column.type->decode(p, len, value);
+            if (status == ConvStatus::EMPTY)
+                return 0;
+            check(status, column);
+
+            auto n = print_decimal(buffer, value);
+            if (n == 0)
+                check(ConvStatus::OUT_OF_RANGE, column);
+            text = buffer;
+            return n;
+        }
+
+        // strip blanks
+        while (len > 0 && *p == ' ') { p++; len--; }
+        while (len > 0 && p[len-1] == ' ') len--;
+        text = p;
+        return len;
+    }
+
+    size_t TextExporter::format_chunk(const char *p, size_t size, const function <string (string)>& mapper, string& out) const
+    {
+        out.reserve(size);
+        return for_each_line(p, size, mapper, [&](const ExportPlan& plan, const char *line, size_t length) {
+            format(plan, line, length, out);
+        });
+    }
+
+    size_t TextExporter::run(const string& input_file, const string& output_file, function <string (string)> mapper, size_t nb_threads)
+    {
+        if (!_compiled)
+            compile();
+
+        MappedFile input(input_file);
+        Writer writer(output_file, _layout);
+
+        auto first = prologue();
+        writer.write_raw(first.data(), first.length());
+
+        // chunks are written in order
+        auto nb_lines = process_chunks(input.data(), input.size(), _record_length, _delimiter, nb_threads,
+            [&](const char *p, size_t size, string& out) { return format_chunk(p, size, mapper, out); },
+            [&](const string& out) { writer.write_raw(out.data(), out.length()); });
+
+        writer.close();
+        return nb_lines;
+    }
+
+    CsvExporter::CsvExporter(Layout& layout): TextExporter(layout)
+    {
+        setSeparator(_separator);
+    }
+
+    void CsvExporter::setSeparator(char separator)
+    {
+        _separator = separator;
+
+        memset(_special, 0, sizeof(_special));
+        _special[static_cast<unsigned char>(_separator)] = true;
+        _special[static_cast<unsigned char>(_quote)] = true;
+        _special[static_cast<unsigned char>('\r')] = true;
+        _special[static_cast<unsigned char>('\n')] = true;
+    }
+
+    void CsvExporter::setQuote(char quote)
+    {
+        _quote = quote;
+        setSeparator(_separator);
+    }
+
+    void CsvExporter::append(string& out, const char *p, size_t len) const
+    {
+        auto quoted = _quoting == Quoting::ALL;
+        if (_quoting == Quoting::MINIMAL)
+        {
+            for (size_t i = 0; i < len && !quoted; i++)
+            {
+                quoted = _special[static_cast<unsigned char>(p[i])];
+            }
+        }
+
+        if (!quoted)
+        {
+            out.append(p, len);
+            return;
+        }
+
+        // double quotes
+        out += _quote;
+        for (auto end = p + len; p < end; )
+        {
+            auto q = static_cast<const char *>(memchr(p, _quote, end - p));
+            if (!q)
+            {
+                out.append(p, end - p);
+                break;
+            }
+            out.append(p, q + 1 - p);
+            out += _quote;
+            p = q + 1;
+        }
+        out += _quote;
+    }
+
+    string CsvExporter::header(const string& record_name)
+    {
+        string out;
+        for (auto const &column: plan(record_name).columns)
+        {
+            if (!out.empty())
+                out += _separator;
+            append(out, column.name.data(), column.name.length());
+        }
+        out += '\n';
+        return out;
+    }
+
+    void CsvExporter::format(const ExportPlan& plan, const char *line, size_t length, string& out) const
+    {
+        char buffer[DECIMAL_TEXT_LENGTH];
+
+        for (size_t i = 0; i < plan.columns.size(); i++)
+        {
+            auto& column = plan.columns[i];
+            if (i != 0)
+                out += _separator;
+
+            // short lines are blank-padded
+            const char *text = line;
+            size_t n = 0;
+            if (column.offset < length)
+                n = field_text(column, line + column.offset, min(column.length, length - column.offset), buffer, text);
+            append(out, text, n);
+        }
+        out += '\n';
+    }
+
+    void JsonExporter::prepare(ExportPlan& plan) const
+    {
+        plan.prefixes.clear();
+        for (size_t i = 0; i < plan.columns.size(); i++)
+        {
+            string prefix(i == 0 ? "{" : ",");
+            if (i == 0 && !_record_key.empty())
+            {
+                prefix += '"';
+                append_json_string(prefix, _record_key.data(), _record_key.length());
+                prefix += "\":\"";
+                append_json_string(prefix, plan.record_name.data(), plan.record_name.length());
+                prefix += "\",";
+            }
+
+            prefix += '"';
+            append_json_string(prefix, plan.columns[i].name.data(), plan.columns[i].name.length());
+            prefix += "\":";
+            plan.prefixes.push_back(prefix);
+        }
+    }
+
+    void JsonExporter::format(const ExportPlan& plan, const char *line, size_t length, string& out) const
+    {
+        static const DateFormat iso("YYYY-MM-DD");
+        char buffer[DECIMAL_TEXT_LENGTH];
+
+        for (size_t i = 0; i < plan.columns.size(); i++)
+        {
+            auto& column = plan.columns[i];
+            out += plan.prefixes[i];
+
+            // short lines are blank-padded
+            auto p = line + min(column.offset, length);
+            auto len = column.offset < length ? min(column.length, length - column.offset) : 0;
+
+            switch (column.type->data_type())
+            {
+                case DataType::INTEGER:
+                case DataType::DECIMAL:
+                case DataType::PACKED:
+                case DataType::ZONED:
+                {
+                    Decimal value;
+                    auto status = column.type->decode(p, len, value);
+                    if (status == ConvStatus::EMPTY)
+                    {
+                        out += "null";
+                        break;
+                    }
+                    check(status, column);
+                    auto n = print_decimal(buffer, value);
+                    if (n == 0)
+                        check(ConvStatus::OUT_OF_RANGE, column);
+                    out.append(buffer, n);
+                    break;
+                }
+
+                case DataType::DATE:
+                {
+                    Date value;
+                    auto status = column.type->decode(p, len, value);
+                    if (status == ConvStatus::EMPTY)
+                    {
+                        out += "null";
+                        break;
+                    }
+                    check(status, column);
+                    check(iso.print(value, buffer), column);
+                    out += '"';
+                    out.append(buffer, iso.length());
+                    out += '"';
+                    break;
+                }
+
+                default:
+                {
+                    const char *text;
+                    auto n = field_text(column, p, len, buffer, text);
+                    out += '"';
+                    append_json_string(out, text, n, _code_table != nullptr);
+                    out += '"';
+                    break;
+                }
+            }
+        }
+        out += "}\n";
+    }
+
+}
@@ -1,27 +1,108 @@
+#include <cstring>
+#include <algorithm>
+
 #include <field.h>
 
 namespace rbf
 {
 
-    void Field::setValue(string s)
+    Field::Field(const Field& f): DataElement(f), _field_type(f._field_type), _resource(f._resource), _data(f._data),
+        _raw_length(f._raw_length), _first(f._first), _last(f._last), _bound(f._bound),
+        _index(f._index), _offset(f._offset), _lower_bound(f._lower_bound), _upper_bound(f._upper_bound)
+    {
+        // own value is copied, record buffer is shared
+        if (!_bound && f._data)
+            store(f._data, f._raw_length);
+    }
+
+    Field& Field::operator=(const Field& f)
     {
-        // copy s as-is
-        _raw_value = s;
+        if (this == &f)
+            return *this;
+
+        DataElement::operator=(f);
+        _field_type = f._field_type;
+        _data = f._data;
+        _raw_length = f._raw_length;
+        _first = f._first;
+        _last = f._last;
+        _bound = f._bound;
+        _index = f._index;
+        _offset = f._offset;
+        _lower_bound = f._lower_bound;
+        _upper_bound = f._upper_bound;
+
+        if (!_bound && f._data)
+            store(f._data, f._raw_length);
+        return *this;
+    }
 
-        // strip blanks from s
-        size_t first = s.find_first_not_of(' ');
+    Field::~Field()
+    {
+        if (_storage)
+            _resource->deallocate(_storage, _capacity, 1);
+    }
 
-        // check if found a non-blank char
-        if (first == string::npos)
+    void Field::store(const char *p, size_t len)
+    {
+        if (len > _capacity || !_storage)
         {
-            _str_value = "";
+            if (_storage)
+                _resource->deallocate(_storage, _capacity, 1);
+            _capacity = max(max(len, static_cast<size_t>(_length)), static_cast<size_t>(1));
+            _storage = static_cast<char *>(_resource->allocate(_capacity, 1));
+        }
+
+        if (len != 0)
+            memcpy(_storage, p, len);
+        _data = _storage;
+        _raw_length = len;
+    }
+
+    void Field::setValue(const string& s)
+    {
+        if (_bound)
+        {
+            // copy into the record buffer
+            auto n = min(s.length(), _raw_length);
+            memcpy(_data, s.data(), n);
+            memset(_data + n, ' ', _raw_length - n);
         }
         else
         {
-            size_t last = s.find_last_not_of(' ');
-            //cout << first << " " << last << endl;
-            _str_value = s.substr(first, (last-first+1));
+            // copy s as-is
+            store(s.data(), s.length());
         }
+        trim();
+    }
+
+    void Field::trim()
+    {
+        size_t first = 0;
+        size_t last = _raw_length;
+
+        // strip blanks
+        while (first < last && _data[first] == ' ') first++;
+        while (last > first && _data[last-1] == ' ') last--;
+
+        _first = first;
+        _last = last;
+    }
+
+    void Field::bind(char *p, bool copy)
+    {
+        if (copy)
+        {
+            auto n = min(_raw_length, static_cast<size_t>(_length));
+            if (n != 0)
+                memcpy(p, _data, n);
+            memset(p + n, ' ', _length - n);
+        }
+
+        _data = p;
+        _raw_length = _length;
+        _bound = true;
+        trim();
     }
 
     // public methods other than standard ones
@@ -32,8 +113,8 @@ namespace rbf
             << ">, description=<" << f._description
             << ">, length=<" << f._length
             << ">, type=<" << f._field_type.name()
-            << ">, raw_value=<" << f._raw_value
-            << ">, value=<" << f._str_value
+            << ">, raw_value=<" << f.raw_value()
+            << ">, value=<" << f.value()
             << ">, offset=<" << f._offset
             << ">, lower_bound=<" << f._lower_bound
             << ">, upper_bound=<" << f._upper_bound
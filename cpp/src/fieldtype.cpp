@@ -1,4 +1,8 @@
 #include <string>
+#include <cstring>
+#include <cstdio>
+#include <cmath>
+#include <cinttypes>
 using namespace std;
 
 #include <fieldtype.h>
@@ -6,6 +10,54 @@ using namespace std;
 namespace rbf
 {
 
+    namespace
+    {
+        // left-justify blank-stripped text, blank-padded and truncated
+        inline ConvStatus justify_left(char *p, size_t len, const char *s, size_t n)
+        {
+            auto end = s + n;
+            while (s < end && *s == ' ') s++;
+            while (end > s && *(end-1) == ' ') end--;
+
+            n = min(static_cast<size_t>(end - s), len);
+            memcpy(p, s, n);
+            memset(p + n, ' ', len - n);
+            return ConvStatus::OK;
+        }
+
+        // shortest fixed-point value converted back into the same double, e.g. 12.1 for 12.1
+        inline ConvStatus shortest_decimal(double value, Decimal& d)
+        {
+            for (unsigned int scale = 0; scale < 19; scale++)
+            {
+                auto scaled = round(value * pow(10.0, scale));
+                if (!(fabs(scaled) < 9.2e18))
+                    return ConvStatus::OUT_OF_RANGE;
+
+                d.mantissa = static_cast<int64_t>(scaled);
+                d.scale = scale;
+                if (d.to_double() == value)
+                    return ConvStatus::OK;
+            }
+            return ConvStatus::OUT_OF_RANGE;
+        }
+
+        // decimal text of a fixed-point value, e.g. -12.50
+        inline size_t decimal_text(char *buffer, size_t size, const Decimal& value)
+        {
+            auto negative = value.mantissa < 0;
+            uint64_t u = negative ? 0 - static_cast<uint64_t>(value.mantissa) : static_cast<uint64_t>(value.mantissa);
+
+            if (value.scale == 0 || value.scale > 19)
+                return snprintf(buffer, size, "%s%" PRIu64, negative ? "-" : "", u);
+
+            uint64_t divisor = 1;
+            for (unsigned int i = 0; i < value.scale; i++) divisor *= 10;
+            return snprintf(buffer, size, "%s%" PRIu64 ".%0*" PRIu64, negative ? "-" : "", u / divisor,
+                            static_cast<int>(value.scale), u % divisor);
+        }
+    }
+
     FieldType::FieldType(const string& data_type_representation, const string& data_type_description): 
         Element(data_type_representation, data_type_description, 0)
     {
@@ -16,11 +68,187 @@ namespace rbf
         else if (data_type_description == "integer")
             _data_type = DataType::INTEGER;
         else if (data_type_description == "date")
+        {
             _data_type = DataType::DATE;
+            _date_format = make_shared<DateFormat>(DEFAULT_DATE_FORMAT);
+        }
         else if (data_type_description == "string")
             _data_type = DataType::STRING;
+        else if (data_type_description == "packed")
+            _data_type = DataType::PACKED;
+        else if (data_type_description == "zoned")
+            _data_type = DataType::ZONED;
         else if (data_type_description.empty())
             _data_type = DataType::VOID;
     }
 
+    void FieldType::setFormat(const string& format)
+    {
+        if (format.empty())
+            return;
+
+        _format = format;
+        if (_data_type == DataType::DATE)
+            _date_format = make_shared<DateFormat>(format);
+    }
+
+    ConvStatus FieldType::decode(const char *p, size_t len, int64_t& value) const
+    {
+        switch (_data_type)
+        {
+            case DataType::PACKED: return parse_packed(p, len, value);
+            case DataType::ZONED: return parse_zoned(p, len, value);
+            default: return parse_integer(p, len, value);
+        }
+    }
+
+    ConvStatus FieldType::decode(const char *p, size_t len, Decimal& value) const
+    {
+        if (_data_type != DataType::PACKED && _data_type != DataType::ZONED)
+            return parse_decimal(p, len, _decimals, value);
+
+        // mainframe numbers have an implied scale only
+        auto status = decode(p, len, value.mantissa);
+        value.scale = _decimals;
+        return status;
+    }
+
+    ConvStatus FieldType::decode(const char *p, size_t len, double& value) const
+    {
+        if (_data_type != DataType::PACKED && _data_type != DataType::ZONED)
+            return parse_double(p, len, _decimals, value);
+
+        Decimal d;
+        auto status = decode(p, len, d);
+        if (status == ConvStatus::OK)
+            value = d.to_double();
+        return status;
+    }
+
+    ConvStatus FieldType::decode(const char *p, size_t len, Date& value) const
+    {
+        // the format is shared by all copies of the type, possibly among threads: each thread has its own memo
+        if (_date_format)
+            return _date_format->cached_parse(p, len, value);
+
+        static const DateFormat default_format(DEFAULT_DATE_FORMAT);
+        return default_format.cached_parse(p, len, value);
+    }
+
+    ConvStatus FieldType::decode(const char *p, size_t len, string& value) const
+    {
+        auto end = p + len;
+        while (p < end && *p == ' ') p++;
+        while (end > p && *(end-1) == ' ') end--;
+
+        value.assign(p, end - p);
+        return ConvStatus::OK;
+    }
+
+    ConvStatus FieldType::encode(char *p, size_t len, int64_t value) const
+    {
+        Decimal d;
+        d.mantissa = value;
+
+        switch (_data_type)
+        {
+            case DataType::INTEGER: return format_integer(p, len, value);
+            case DataType::DECIMAL:
+            case DataType::PACKED:
+            case DataType::ZONED: return encode(p, len, d);
+            default: break;
+        }
+
+        char buffer[32];
+        auto n = decimal_text(buffer, sizeof(buffer), d);
+        return n > len ? ConvStatus::OUT_OF_RANGE : justify_left(p, len, buffer, n);
+    }
+
+    ConvStatus FieldType::encode(char *p, size_t len, const Decimal& value) const
+    {
+        int64_t mantissa;
+        ConvStatus status;
+
+        switch (_data_type)
+        {
+            case DataType::INTEGER:
+                status = rescale(value, 0, mantissa);
+                return status == ConvStatus::OK ? format_integer(p, len, mantissa) : status;
+
+            case DataType::DECIMAL:
+                return format_decimal(p, len, _decimals, value);
+
+            case DataType::PACKED:
+            case DataType::ZONED:
+                // mainframe numbers have an implied scale only
+                status = rescale(value, _decimals, mantissa);
+                if (status != ConvStatus::OK)
+                    return status;
+                return _data_type == DataType::PACKED ? format_packed(p, len, mantissa) : format_zoned(p, len, mantissa);
+
+            default:
+                break;
+        }
+
+        char buffer[48];
+        auto n = decimal_text(buffer, sizeof(buffer), value);
+        return n > len ? ConvStatus::OUT_OF_RANGE : justify_left(p, len, buffer, n);
+    }
+
+    ConvStatus FieldType::encode(char *p, size_t len, double value) const
+    {
+        Decimal d;
+        auto status = shortest_decimal(value, d);
+        if (status != ConvStatus::OK)
+            return status;
+
+        // implied decimals can't hold more digits
+        auto implied = _data_type == DataType::INTEGER ? 0 : _decimals;
+        auto has_implied = _data_type == DataType::INTEGER || _data_type == DataType::PACKED || _data_type == DataType::ZONED ||
+            (_data_type == DataType::DECIMAL && _decimals != 0);
+        if (has_implied && d.scale > implied)
+            return ConvStatus::OUT_OF_RANGE;
+
+        return encode(p, len, d);
+    }
+
+    ConvStatus FieldType::encode(char *p, size_t len, const Date& value) const
+    {
+        static const DateFormat default_format(DEFAULT_DATE_FORMAT);
+        auto& format = _date_format ? *_date_format : default_format;
+
+        if (format.length() > len)
+            return ConvStatus::OUT_OF_RANGE;
+
+        auto status = format.print(value, p);
+        if (status == ConvStatus::OK)
+            memset(p + format.length(), ' ', len - format.length());
+        return status;
+    }
+
+    ConvStatus FieldType::encode(char *p, size_t len, const char *s, size_t n) const
+    {
+        ConvStatus status;
+        Decimal d;
+
+        switch (_data_type)
+        {
+            case DataType::INTEGER:
+            case DataType::DECIMAL:
+            case DataType::PACKED:
+            case DataType::ZONED:
+                // read as a raw value would be, then formatted
+                status = parse_decimal(s, n, _decimals, d);
+                if (status == ConvStatus::EMPTY)
+                {
+                    memset(p, ' ', len);
+                    return ConvStatus::OK;
+                }
+                return status == ConvStatus::OK ? encode(p, len, d) : status;
+
+            default:
+                return justify_left(p, len, s, n);
+        }
+    }
+
 }
@@ -0,0 +1,372 @@
+#include <cstring>
+#include <algorithm>
+#include <limits>
+
+#include <filter.h>
+
+namespace rbf
+{
+
+    namespace
+    {
+        // compare a field slice with a constant of the field length, missing bytes being blanks
+        int compare_padded(const char *p, size_t available, const string& value)
+        {
+            auto n = min(available, value.length());
+            auto c = memcmp(p, value.data(), n);
+            if (c != 0)
+                return c;
+
+            for (size_t i = n; i < value.length(); i++)
+            {
+                if (value[i] != ' ')
+                    return static_cast<unsigned char>(' ') < static_cast<unsigned char>(value[i]) ? -1 : 1;
+            }
+            return 0;
+        }
+    }
+
+    ConvStatus Filter::Term::decode(const char *p, size_t available, Decimal& value) const
+    {
+        if (comparison == Comparison::NUMBER)
+            return type.decode(p, available, value);
+
+        Date date;
+        auto status = type.decode(p, available, date);
+        value = Decimal{date.days, 0};
+        return status;
+    }
+
+    bool Filter::Term::match_number(const Decimal& value) const
+    {
+        if (operation == Operation::IN)
+        {
+            for (auto const &n: numbers)
+            {
+                if (compare(value, n) == 0)
+                    return true;
+            }
+            return false;
+        }
+
+        return (!has_low || compare(value, numbers[0]) >= 0) && (!has_high || compare(value, numbers.back()) <= 0);
+    }
+
+    bool Filter::Term::match(const char *line, size_t len) const
+    {
+        auto available = offset < len ? min(length, len - offset) : 0;
+        auto p = line + min(offset, len);
+
+        if (comparison == Comparison::BYTES)
+        {
+            switch (operation)
+            {
+                case Operation::IN:
+                {
+                    // sorted constants
+                    size_t low = 0, high = values.size();
+                    while (low < high)
+                    {
+                        auto middle = low + (high - low) / 2;
+                        auto c = compare_padded(p, available, values[middle]);
+                        if (c == 0)
+                            return true;
+                        if (c > 0)
+                            low = middle + 1;
+                        else
+                            high = middle;
+                    }
+                    return false;
+                }
+                case Operation::PREFIX:
+                    return compare_padded(p, available, values[0]) == 0;
+                case Operation::BETWEEN:
+                    return (!has_low || compare_padded(p, available, values[0]) >= 0) &&
+                        (!has_high || compare_padded(p, available, values.back()) <= 0);
+            }
+        }
+
+        // decoded from the field bytes only
+        Decimal value;
+        auto status = decode(p, available, value);
+
+        if (status == ConvStatus::EMPTY)
+            return false;
+        if (status != ConvStatus::OK)
+            throw runtime_error("field " + field_name + ": " + conv_message(status));
+
+        return match_number(value);
+    }
+
+    void Filter::Term::select(const RecordBatch& batch, Selection& selection) const
+    {
+        if (comparison == Comparison::BYTES && (operation == Operation::PREFIX || (operation == Operation::IN && values.size() == 1)))
+            select_bytes(batch, selection, values[0]);
+        else if (comparison != Comparison::BYTES && exact)
+            select_numbers(batch, selection);
+        else
+        {
+            // one line at a time
+            for (size_t w = 0; w < selection.nb_words(); w++)
+            {
+                auto bits = selection.word(w);
+                for (auto b = bits; b != 0; b &= b - 1)
+                {
+                    auto i = w * 64 + __builtin_ctzll(b);
+                    if (!match(batch.row(i), batch.stride()))
+                        bits &= ~(uint64_t{1} << (i % 64));
+                }
+                selection.word(w) = bits;
+            }
+        }
+    }
+
+    void Filter::Term::select_bytes(const RecordBatch& batch, Selection& selection, const string& value) const
+    {
+        // first 8 bytes of the value, and a mask of those to compare
+        char head_bytes[8] = {}, mask_bytes[8] = {};
+        auto head_length = min(value.length(), size_t{8});
+        memcpy(head_bytes, value.data(), head_length);
+        memset(mask_bytes, 0xFF, head_length);
+
+        uint64_t head, mask;
+        memcpy(&head, head_bytes, 8);
+        memcpy(&mask, mask_bytes, 8);
+
+        auto stride = batch.stride();
+        for (size_t w = 0; w < selection.nb_words(); w++)
+        {
+            if (selection.word(w) == 0)
+                continue;
+
+            // all lines of the group, without any branch. Rows are followed by blanks, so 8 bytes can
+            // be loaded from the last one.
+            auto first = w * 64;
+            auto n = min(size_t{64}, batch.size() - first);
+            auto p = batch.row(first) + offset;
+            uint64_t hits = 0;
+            for (size_t j = 0; j < n; j++)
+            {
+                uint64_t v;
+                memcpy(&v, p + j * stride, 8);
+                hits |= static_cast<uint64_t>((v & mask) == head) << j;
+            }
+            hits &= selection.word(w);
+
+            // remaining bytes of longer values, for the lines left only
+            if (value.length() > 8)
+            {
+                for (auto b = hits; b != 0; b &= b - 1)
+                {
+                    auto j = __builtin_ctzll(b);
+                    if (memcmp(p + j * stride + 8, value.data() + 8, value.length() - 8) != 0)
+                        hits &= ~(uint64_t{1} << j);
+                }
+            }
+
+            selection.word(w) = hits;
+        }
+    }
+
+    void Filter::Term::select_numbers(const RecordBatch& batch, Selection& selection) const
+    {
+        auto low = has_low ? mantissas[0] : numeric_limits<int64_t>::min();
+        auto high = has_high ? mantissas.back() : numeric_limits<int64_t>::max();
+
+        for (size_t w = 0; w < selection.nb_words(); w++)
+        {
+            auto bits = selection.word(w);
+            if (bits == 0)
+                continue;
+
+            // decode the selected lines. Values with more decimals than the constants are compared exactly
+            // one at a time.
+            int64_t decoded[64] = {};
+            uint64_t valid = 0, kept = 0;
+            for (auto b = bits; b != 0; b &= b - 1)
+            {
+                auto j = __builtin_ctzll(b);
+                Decimal value;
+                auto status = decode(batch.row(w * 64 + j) + offset, length, value);
+
+                if (status == ConvStatus::EMPTY)
+                    continue;
+                if (status != ConvStatus::OK)
+                    throw runtime_error("field " + field_name + ": " + conv_message(status));
+
+                if (value.scale <= scale && rescale(value, scale, decoded[j]) == ConvStatus::OK)
+                    valid |= uint64_t{1} << j;
+                else if (match_number(value))
+                    kept |= uint64_t{1} << j;
+            }
+
+            // compare all decoded values at once
+            uint64_t hits = 0;
+            if (operation == Operation::IN)
+            {
+                for (auto m: mantissas)
+                {
+                    for (size_t j = 0; j < 64; j++)
+                    {
+                        hits |= static_cast<uint64_t>(decoded[j] == m) << j;
+                    }
+                }
+            }
+            else
+            {
+                for (size_t j = 0; j < 64; j++)
+                {
+                    hits |= static_cast<uint64_t>((decoded[j] >= low) & (decoded[j] <= high)) << j;
+                }
+            }
+
+            selection.word(w) = (hits & valid) | kept;
+        }
+    }
+
+    Filter::Term Filter::term(const string& field_name, Operation operation) const
+    {
+        auto& f = *(_record.begin() + _record.handle(field_name));
+
+        Term t;
+        t.field_name = field_name;
+        t.type = f.type();
+        t.offset = f.lower_bound();
+        t.length = f.length();
+        t.operation = operation;
+
+        switch (f.type().data_type())
+        {
+            case DataType::INTEGER:
+            case DataType::DECIMAL:
+            case DataType::PACKED:
+            case DataType::ZONED:
+                t.comparison = Comparison::NUMBER;
+                break;
+            case DataType::DATE:
+                t.comparison = Comparison::DATE;
+                break;
+            default:
+                t.comparison = Comparison::BYTES;
+                break;
+        }
+
+        return t;
+    }
+
+    void Filter::add_constant(Term& t, const string& value) const
+    {
+        auto status = ConvStatus::OK;
+
+        switch (t.comparison)
+        {
+            case Comparison::BYTES:
+            {
+                // blank-padded, leading blanks being significant
+                if (value.length() > t.length)
+                    throw runtime_error("field " + t.field_name + ": constant longer than the field");
+                string padded(t.length, ' ');
+                memcpy(&padded[0], value.data(), value.length());
+                t.values.push_back(padded);
+                return;
+            }
+            case Comparison::NUMBER:
+            {
+                Decimal d;
+                status = parse_decimal(value.data(), value.length(), 0, d);
+                if (status == ConvStatus::OK)
+                    t.numbers.push_back(d);
+                break;
+            }
+            case Comparison::DATE:
+            {
+                Date d;
+                status = t.type.decode(value.data(), value.length(), d);
+                if (status == ConvStatus::OK)
+                    t.numbers.push_back(Decimal{d.days, 0});
+                break;
+            }
+        }
+
+        if (status != ConvStatus::OK)
+            throw runtime_error("field " + t.field_name + ": " + conv_message(status));
+    }
+
+    void Filter::add_constant(Term& t, const Decimal& value) const
+    {
+        if (t.comparison != Comparison::NUMBER)
+            throw runtime_error("field " + t.field_name + ": not a numeric field");
+        t.numbers.push_back(value);
+    }
+
+    void Filter::add_constant(Term& t, const Date& value) const
+    {
+        if (t.comparison != Comparison::DATE)
+            throw runtime_error("field " + t.field_name + ": not a date field");
+        t.numbers.push_back(Decimal{value.days, 0});
+    }
+
+    Filter& Filter::add(Term& t)
+    {
+        if (t.operation == Operation::IN)
+            sort(t.values.begin(), t.values.end());
+
+        // numbers as mantissas of the largest scale, when they fit into an int64_t
+        if (t.comparison != Comparison::BYTES)
+        {
+            t.scale = 0;
+            for (auto const &n: t.numbers)
+            {
+                t.scale = max(t.scale, n.scale);
+            }
+
+            t.exact = true;
+            for (auto const &n: t.numbers)
+            {
+                int64_t m = 0;
+                t.exact = t.exact && rescale(n, t.scale, m) == ConvStatus::OK;
+                t.mantissas.push_back(m);
+            }
+        }
+
+        _terms.push_back(move(t));
+        return *this;
+    }
+
+    Filter& Filter::prefix(const string& field_name, const string& prefix)
+    {
+        auto t = term(field_name, Operation::PREFIX);
+        if (t.comparison != Comparison::BYTES)
+            throw runtime_error("field " + field_name + ": not a text field");
+
+        if (prefix.length() > t.length)
+            throw runtime_error("field " + field_name + ": prefix longer than the field");
+        t.values.push_back(prefix);
+        return add(t);
+    }
+
+    bool Filter::match(const char *line, size_t len) const
+    {
+        for (auto const &t: _terms)
+        {
+            if (!t.match(line, len))
+                return false;
+        }
+        return true;
+    }
+
+    void Filter::select(const RecordBatch& batch, Selection& selection) const
+    {
+        if (batch.record_name() != _record.name())
+            throw runtime_error("batch of record " + batch.record_name() + " filtered on record " + _record.name());
+
+        selection.select_all(batch.size());
+        for (auto const &t: _terms)
+        {
+            if (selection.none())
+                break;
+            t.select(batch, selection);
+        }
+    }
+
+}
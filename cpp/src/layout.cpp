@@ -4,7 +4,7 @@
 namespace rbf
 {
 
-    Layout::Layout(string xml_file, size_t initial_size)
+    Layout::Layout(string xml_file, size_t initial_size, MemoryResource *resource)
     {
         // save file name for future use
         _xml_file = xml_file;
@@ -22,6 +22,12 @@ namespace rbf
         // root node is rbfile
         auto root = doc.child("rbfile");
 
+        // keep meta attributes
+        for (auto attr: root.child("meta").attributes())
+        {
+            _meta[attr.name()] = attr.value();
+        }
+
         // lookup for field types
         unordered_map<string, FieldType> ftype_map;
 
@@ -30,8 +36,15 @@ namespace rbf
             string data_representation(node.attribute("name").value());
             string data_description(node.attribute("type").value());
 
+            // implied decimals & format are optional
+            auto ft = FieldType(data_representation, data_description);
+            ft.setDecimals(node.attribute("decimals").as_uint());
+
+            // date parsers are chosen once here, from the format attribute
+            ft.setFormat(node.attribute("format").value());
+
             // add field type in our map to later refer to them
-            ftype_map.insert(pair<string, FieldType>(data_representation, FieldType(data_representation, data_description)));
+            ftype_map.insert(pair<string, FieldType>(data_representation, ft));
         }
 
         // now look up records
@@ -41,7 +54,7 @@ namespace rbf
             string rec_desc(node.attribute("description").value());
 
             // create record and add it to our map
-            auto p_rec = make_unique<Record>(rec_name, rec_desc);
+            auto p_rec = allocate_shared<Record>(PolymorphicAllocator<Record>(resource), rec_name, rec_desc, resource);
             _record_map.insert(pair<string, RecordPtr>(rec_name, move(p_rec)));
 
             // pre-allocate record size
@@ -59,10 +72,37 @@ namespace rbf
                 auto ft = ftype_map[field_type];
 
                 // add Field to last record created
-                auto f = Field(field_name, field_desc, ftype_map[field_type], stoul(field_length));
+                auto f = Field(field_name, field_desc, ftype_map[field_type], stoul(field_length), resource);
                 _record_map[rec_name]->push_back(f);
             }
         }
 
     }
+
+    bool Layout::id_range(size_t& offset, size_t& length) const
+    {
+        auto mapper = meta("mapper");
+        auto map = mapper.find("map:");
+        if (map == string::npos)
+            return false;
+
+        auto range = mapper.substr(map + 4);
+        auto dots = range.find("..");
+        if (dots == string::npos)
+            return false;
+
+        try
+        {
+            offset = stoul(range.substr(0, dots));
+            auto upper = stoul(range.substr(dots + 2));
+            if (upper <= offset)
+                return false;
+            length = upper - offset;
+        }
+        catch (logic_error& e)
+        {
+            return false;
+        }
+        return true;
+    }
 }
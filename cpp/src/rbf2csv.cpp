@@ -0,0 +1,131 @@
+/*
+ * rbf2csv: export a record-based file as CSV
+ *
+ * Usage: rbf2csv [options] layout_file input_file
+ *
+ *   -o file        output file (default: standard output)
+ *   -s char        value separator (default: ,)
+ *   -q mode        quoting: minimal, all or none (default: minimal)
+ *   -r REC:F1,F2   export only these fields of record REC, in this order. REC: alone skips the record.
+ *                  Can be repeated.
+ *   -H REC         write the header line of record REC first
+ *   -l length      fixed-length records, without any delimiter
+ *   -c code_page   input code page, e.g. IBM-037
+ *   -j threads     number of threads (default: number of cores)
+ *
+ * A line is mapped to the record whose name is the record ID, found from the layout meta mapper
+ * attribute (e.g. mapper="type:1 map:0..4").
+ */
+#include <iostream>
+#include <sstream>
+
+#include <unistd.h>
+
+#include <rbf.h>
+
+using namespace rbf;
+
+namespace
+{
+
+    void usage(const char *program)
+    {
+        cerr << "Usage: " << program << " [-o output_file] [-s separator] [-q minimal|all|none] [-r REC:F1,F2,...]..."
+             << " [-H REC] [-l record_length] [-c code_page] [-j threads] layout_file input_file" << endl;
+        exit(1);
+    }
+
+    // split a comma-separated list of field names
+    vector<string> split(const string& s)
+    {
+        vector<string> names;
+        stringstream ss(s);
+        string name;
+        while (getline(ss, name, ','))
+        {
+            if (!name.empty())
+                names.push_back(name);
+        }
+        return names;
+    }
+
+}
+
+int main(int argc, char **argv)
+{
+    string output_file = "/dev/stdout";
+    string header_record;
+    char separator = ',';
+    auto quoting = Quoting::MINIMAL;
+    vector<string> columns;
+    size_t record_length = 0;
+    string cp;
+    size_t nb_threads = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "o:s:q:r:H:l:c:j:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'o': output_file = optarg; break;
+            case 's': separator = optarg[0] == '\\' && optarg[1] == 't' ? '\t' : optarg[0]; break;
+            case 'r': columns.push_back(optarg); break;
+            case 'H': header_record = optarg; break;
+            case 'l': record_length = stoul(optarg); break;
+            case 'c': cp = optarg; break;
+            case 'j': nb_threads = stoul(optarg); break;
+            case 'q':
+            {
+                string mode(optarg);
+                if (mode == "minimal") quoting = Quoting::MINIMAL;
+                else if (mode == "all") quoting = Quoting::ALL;
+                else if (mode == "none") quoting = Quoting::NONE;
+                else usage(argv[0]);
+                break;
+            }
+            default:
+                usage(argv[0]);
+        }
+    }
+
+    if (argc - optind != 2 || separator == '\0')
+        usage(argv[0]);
+
+    try
+    {
+        Layout layout{argv[optind]};
+        string input_file(argv[optind + 1]);
+
+        size_t id_offset, id_length;
+        if (!layout.id_range(id_offset, id_length))
+        {
+            cerr << "no record ID range found in layout meta mapper" << endl;
+            exit(1);
+        }
+
+        CsvExporter csv(layout);
+        csv.setSeparator(separator);
+        csv.setQuoting(quoting);
+        csv.setRecordLength(record_length);
+        if (!cp.empty())
+            csv.setCodePage(code_page(cp));
+
+        for (auto const &column: columns)
+        {
+            auto colon = column.find(':');
+            if (colon == string::npos)
+                usage(argv[0]);
+            csv.setColumns(column.substr(0, colon), split(column.substr(colon + 1)));
+        }
+
+        if (!header_record.empty())
+            csv.setHeader(header_record);
+
+        csv.run(input_file, output_file, [id_offset, id_length](string s) { return s.substr(id_offset, id_length); }, nb_threads);
+    }
+    catch (std::exception& e)
+    {
+        cerr << e.what() << endl;
+        exit(1);
+    }
+}
@@ -0,0 +1,355 @@
+/*
+ * rbfgen: generate a C++ header from a layout XML file
+ *
+ * Each record of the layout is turned into a struct holding constexpr offsets and lengths, and
+ * typed accessors reading the raw line. A dispatch function calls a visitor with the struct matching
+ * the record ID of a line. A field whose name collides with a C++ keyword, a struct member or another
+ * field accessor gets a numeric suffix, with a warning.
+ *
+ * Usage: rbfgen layout_file [namespace [id_offset id_length]] > header.h
+ *
+ * When not given, the record ID position is taken from the layout meta mapper attribute (e.g.
+ * mapper="type:1 map:0..4"). A line is mapped to the record whose name is the record ID.
+ */
+#include <iostream>
+#include <sstream>
+#include <map>
+#include <set>
+
+#include <rbf.h>
+
+using namespace rbf;
+
+namespace
+{
+
+    // make a valid C++ identifier from a layout name
+    string identifier(const string& name)
+    {
+        string id;
+        for (auto c: name)
+        {
+            id += isalnum(static_cast<unsigned char>(c)) ? c : '_';
+        }
+        if (id.empty() || isdigit(static_cast<unsigned char>(id[0])))
+            id = "_" + id;
+        return id;
+    }
+
+    // names a field accessor can't take: C++ keywords, and type names used in record structs
+    const set<string> RESERVED_NAMES = {
+        "alignas", "alignof", "and", "and_eq", "asm", "auto", "bitand", "bitor", "bool", "break", "case", "catch",
+        "char", "char16_t", "char32_t", "class", "compl", "const", "const_cast", "constexpr", "continue", "decltype",
+        "default", "delete", "do", "double", "dynamic_cast", "else", "enum", "explicit", "export", "extern", "false",
+        "float", "for", "friend", "goto", "if", "inline", "int", "long", "mutable", "namespace", "new", "noexcept",
+        "not", "not_eq", "nullptr", "operator", "or", "or_eq", "private", "protected", "public", "register",
+        "reinterpret_cast", "return", "short", "signed", "sizeof", "static", "static_assert", "static_cast", "struct",
+        "switch", "template", "this", "thread_local", "throw", "true", "try", "typedef", "typeid", "typename", "union",
+        "unsigned", "using", "virtual", "void", "volatile", "wchar_t", "while", "xor", "xor_eq",
+        "size_t", "int64_t", "string",
+    };
+
+    // identifiers of the fields of a record: each one declares <id>, <id>_offset and <id>_length, which must not
+    // collide with the struct members nor with those of other fields. Fields keep their name when possible,
+    // others get the first free suffix.
+    vector<string> field_identifiers(Record& rec, const string& rec_id)
+    {
+        set<string> used = { rec_id, "data", "record_name", "record_length" };
+        auto claim = [&used](const string& id) {
+            for (auto const &name: { id, id + "_offset", id + "_length" })
+            {
+                if (RESERVED_NAMES.count(name) != 0 || used.count(name) != 0)
+                    return false;
+            }
+            used.insert(id);
+            used.insert(id + "_offset");
+            used.insert(id + "_length");
+            return true;
+        };
+
+        vector<string> ids;
+        for (auto& f: rec)
+        {
+            auto id = identifier(f.name());
+            ids.push_back(claim(id) ? id : "");
+        }
+
+        size_t i = 0;
+        for (auto& f: rec)
+        {
+            auto& id = ids[i++];
+            if (!id.empty())
+                continue;
+
+            auto base = identifier(f.name());
+            size_t n = 2;
+            while (!claim(base + "_" + to_string(n)))
+                n++;
+            id = base + "_" + to_string(n);
+        }
+        return ids;
+    }
+
+    // keep a description on a single comment line
+    string comment(const string& text)
+    {
+        string s;
+        for (auto c: text)
+        {
+            s += (c == '\n' || c == '\r') ? ' ' : c;
+        }
+        return s;
+    }
+
+    // record ID packed into an integer, first char in the highest byte
+    string id_key(const string& id)
+    {
+        stringstream ss;
+        ss << "0x" << hex << uppercase;
+        uint64_t key = 0;
+        for (auto c: id)
+        {
+            key = (key << 8) | static_cast<unsigned char>(c);
+        }
+        ss << key << "ULL";
+        return ss.str();
+    }
+
+    // C++ type and accessor body for a field
+    void accessor(ostream& out, Field& f, const string& id)
+    {
+        auto& ft = f.type();
+        auto decimals = ft.decimals();
+        auto args = "data + " + id + "_offset, " + id + "_length";
+
+        out << "        /// " << comment(f.description()) << endl;
+
+        switch (ft.data_type())
+        {
+            case DataType::INTEGER:
+                out << "        inline int64_t " << id << "() const { int64_t v; detail::check(rbf::parse_integer("
+                    << args << ", v), \"" << id << "\"); return v; }" << endl;
+                break;
+
+            case DataType::DECIMAL:
+                out << "        inline rbf::Decimal " << id << "() const { rbf::Decimal v; detail::check(rbf::parse_decimal("
+                    << args << ", " << decimals << ", v), \"" << id << "\"); return v; }" << endl;
+                break;
+
+            case DataType::PACKED:
+            case DataType::ZONED:
+            {
+                auto parser = ft.data_type() == DataType::PACKED ? "rbf::parse_packed" : "rbf::parse_zoned";
+                if (decimals == 0)
+                {
+                    out << "        inline int64_t " << id << "() const { int64_t v; detail::check(" << parser << "("
+                        << args << ", v), \"" << id << "\"); return v; }" << endl;
+                }
+                else
+                {
+                    out << "        inline rbf::Decimal " << id << "() const { rbf::Decimal v; detail::check(" << parser << "("
+                        << args << ", v.mantissa), \"" << id << "\"); v.scale = " << decimals << "; return v; }" << endl;
+                }
+                break;
+            }
+
+            case DataType::DATE:
+            {
+                auto format = ft.date_format() ? ft.date_format()->format() : DEFAULT_DATE_FORMAT;
+                out << "        inline rbf::Date " << id << "() const { static const rbf::DateFormat fmt(\"" << format
+                    << "\"); rbf::Date v; detail::check(fmt.parse(" << args << ", v), \"" << id << "\"); return v; }" << endl;
+                break;
+            }
+
+            default:
+                out << "        inline string " << id << "() const { return detail::trim(" << args << "); }" << endl;
+                break;
+        }
+    }
+
+    void generate(ostream& out, Layout& layout, const string& xml_file, const string& ns, size_t id_offset, size_t id_length)
+    {
+        auto guard = "RBFGEN_" + identifier(ns) + "_H";
+        for (auto& c: guard) c = toupper(static_cast<unsigned char>(c));
+
+        out << "// generated by rbfgen from " << xml_file << ": do not edit" << endl
+            << "#ifndef " << guard << endl
+            << "#define " << guard << endl << endl
+            << "#include <cstring>" << endl
+            << "#include <stdexcept>" << endl << endl
+            << "#include <rbf.h>" << endl << endl
+            << "namespace " << ns << endl
+            << "{" << endl << endl;
+
+        // helpers
+        out << "    namespace detail" << endl
+            << "    {" << endl
+            << "        inline string trim(const char *p, size_t len)" << endl
+            << "        {" << endl
+            << "            while (len > 0 && *p == ' ') { p++; len--; }" << endl
+            << "            while (len > 0 && p[len-1] == ' ') len--;" << endl
+            << "            return string(p, len);" << endl
+            << "        }" << endl << endl
+            << "        inline void check(rbf::ConvStatus status, const char *field_name)" << endl
+            << "        {" << endl
+            << "            if (status != rbf::ConvStatus::OK)" << endl
+            << "                throw runtime_error(string(\"field \") + field_name + \": \" + rbf::conv_message(status));" << endl
+            << "        }" << endl << endl
+            << "        // record ID packed into an integer, first char in the highest byte" << endl
+            << "        inline uint64_t key(const char *p, size_t len)" << endl
+            << "        {" << endl
+            << "            uint64_t k = 0;" << endl
+            << "            for (size_t i = 0; i < len; i++) k = (k << 8) | static_cast<unsigned char>(p[i]);" << endl
+            << "            return k;" << endl
+            << "        }" << endl << endl
+            << "        // short lines are blank-padded to the record length" << endl
+            << "        template <typename R, typename Visitor>" << endl
+            << "            inline bool call(const char *line, size_t len, Visitor& visitor)" << endl
+            << "            {" << endl
+            << "                if (len >= R::record_length)" << endl
+            << "                {" << endl
+            << "                    visitor(R(line));" << endl
+            << "                    return true;" << endl
+            << "                }" << endl
+            << "                char padded[R::record_length];" << endl
+            << "                memcpy(padded, line, len);" << endl
+            << "                memset(padded + len, ' ', R::record_length - len);" << endl
+            << "                visitor(R(padded));" << endl
+            << "                return true;" << endl
+            << "            }" << endl
+            << "    }" << endl << endl;
+
+        // one struct per record
+        for (auto& kv: layout)
+        {
+            auto& rec = kv.second;
+            auto rec_id = identifier(rec->name());
+
+            out << "    /// " << comment(rec->description()) << endl
+                << "    struct " << rec_id << endl
+                << "    {" << endl
+                << "        static constexpr const char *record_name = \"" << rec->name() << "\";" << endl
+                << "        static constexpr size_t record_length = " << rec->length() << ";" << endl << endl;
+
+            auto ids = field_identifiers(*rec, rec_id);
+            size_t i = 0;
+            for (auto& f: *rec)
+            {
+                auto& id = ids[i++];
+                if (id != identifier(f.name()))
+                    cerr << "warning: field " << f.name() << " of record " << rec->name() << " is named " << id << endl;
+
+                out << "        static constexpr size_t " << id << "_offset = " << f.lower_bound() << ";" << endl
+                    << "        static constexpr size_t " << id << "_length = " << f.length() << ";" << endl;
+            }
+
+            out << endl
+                << "        const char *data;       ///< raw line, at least record_length bytes" << endl << endl
+                << "        explicit " << rec_id << "(const char *line): data{line} {}" << endl << endl;
+
+            i = 0;
+            for (auto& f: *rec)
+            {
+                accessor(out, f, ids[i++]);
+            }
+            out << "    };" << endl << endl;
+        }
+
+        // dispatch on record ID
+        out << "    constexpr size_t id_offset = " << id_offset << ";" << endl
+            << "    constexpr size_t id_length = " << id_length << ";" << endl << endl
+            << "    /*!" << endl
+            << "     * @details call **visitor** with the record struct matching the ID of the line" << endl
+            << "     * @return false if the ID doesn't match any record" << endl
+            << "     */" << endl
+            << "    template <typename Visitor>" << endl
+            << "        inline bool dispatch(const char *line, size_t len, Visitor&& visitor)" << endl
+            << "        {" << endl
+            << "            if (len < id_offset + id_length)" << endl
+            << "                return false;" << endl << endl;
+
+        if (id_length <= sizeof(uint64_t))
+        {
+            out << "            switch (detail::key(line + id_offset, id_length))" << endl
+                << "            {" << endl;
+            for (auto& kv: layout)
+            {
+                if (kv.first.length() != id_length)
+                {
+                    cerr << "warning: record " << kv.first << " can't be matched by a " << id_length << "-char ID" << endl;
+                    continue;
+                }
+                out << "                case " << id_key(kv.first) << ": return detail::call<" << identifier(kv.first)
+                    << ">(line, len, visitor);" << endl;
+            }
+            out << "                default: return false;" << endl
+                << "            }" << endl;
+        }
+        else
+        {
+            for (auto& kv: layout)
+            {
+                if (kv.first.length() != id_length)
+                {
+                    cerr << "warning: record " << kv.first << " can't be matched by a " << id_length << "-char ID" << endl;
+                    continue;
+                }
+                out << "            if (memcmp(line + id_offset, \"" << kv.first << "\", id_length) == 0)" << endl
+                    << "                return detail::call<" << identifier(kv.first) << ">(line, len, visitor);" << endl;
+            }
+            out << "            return false;" << endl;
+        }
+
+        out << "        }" << endl << endl
+            << "    template <typename Visitor>" << endl
+            << "        inline bool dispatch(const string& line, Visitor&& visitor) { return dispatch(line.data(), line.length(), visitor); }" << endl << endl
+            << "}" << endl << endl
+            << "#endif" << endl;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 2 && argc != 3 && argc != 5)
+    {
+        cerr << "Usage: " << argv[0] << " layout_file [namespace [id_offset id_length]]" << endl;
+        exit(1);
+    }
+
+    try
+    {
+        string xml_file(argv[1]);
+        Layout layout{xml_file};
+
+        // namespace defaults to the layout file base name
+        string ns;
+        if (argc >= 3)
+        {
+            ns = argv[2];
+        }
+        else
+        {
+            auto base = xml_file.substr(xml_file.find_last_of('/') + 1);
+            ns = identifier(base.substr(0, base.find('.')));
+        }
+
+        size_t id_offset, id_length;
+        if (argc == 5)
+        {
+            id_offset = stoul(argv[3]);
+            id_length = stoul(argv[4]);
+        }
+        else if (!layout.id_range(id_offset, id_length))
+        {
+            cerr << "no record ID range found in layout meta mapper, please provide id_offset & id_length" << endl;
+            exit(1);
+        }
+
+        generate(cout, layout, xml_file, ns, id_offset, id_length);
+    }
+    catch (std::exception& e)
+    {
+        cerr << e.what() << endl;
+        exit(1);
+    }
+}
@@ -1,42 +1,451 @@
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+
+// copy_file_range() wrapper appeared in glibc 2.27
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 27))
+#define RBF_HAVE_COPY_FILE_RANGE
+#endif
+
 #include <reader.h>
+#include <chunk.h>
+#include <cache.h>
+#include <compress.h>
+
+namespace
+{
+
+    // file descriptor closed on scope exit
+    struct FileDescriptor
+    {
+        int fd;
+        explicit FileDescriptor(int fd): fd{fd} {}
+        ~FileDescriptor() { if (fd >= 0) ::close(fd); }
+    };
+
+    // how blocks are copied, from the fastest to the slowest
+    enum class CopyMethod { COPY_FILE_RANGE, SENDFILE, WRITE };
+
+    // copy len bytes of the input file at offset off to the current position of the output file
+    void copy_block(int in, int out, const char *map, off_t off, size_t len, CopyMethod& method)
+    {
+        while (len > 0)
+        {
+            auto chunk = min(len, rbf::COPY_CHUNK_SIZE);
+            ssize_t n = -1;
+
+            switch (method)
+            {
+#ifdef RBF_HAVE_COPY_FILE_RANGE
+                case CopyMethod::COPY_FILE_RANGE:
+                {
+                    loff_t in_off = off;
+                    n = ::copy_file_range(in, &in_off, out, nullptr, chunk, 0);
+                    break;
+                }
+#endif
+#ifdef __linux__
+                case CopyMethod::SENDFILE:
+                {
+                    auto in_off = off;
+                    n = ::sendfile(out, in, &in_off, chunk);
+                    break;
+                }
+#endif
+                default:
+                    method = CopyMethod::WRITE;
+                    n = ::write(out, map + off, chunk);
+                    break;
+            }
+
+            if (n < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+
+                // not supported between these files: try the next method
+                if (method != CopyMethod::WRITE && (errno == EXDEV || errno == EINVAL || errno == ENOSYS ||
+                    errno == EOPNOTSUPP || errno == EBADF))
+                {
+                    method = method == CopyMethod::COPY_FILE_RANGE ? CopyMethod::SENDFILE : CopyMethod::WRITE;
+                    continue;
+                }
+                throw runtime_error(string("unable to copy records: ") + strerror(errno));
+            }
+            if (n == 0)
+                throw runtime_error("unable to copy records: unexpected end of file");
+
+            off += n;
+            len -= n;
+        }
+    }
+
+    // read the next line or record from the source of a reader, the last one might be shorter
+    bool source_line(rbf::ReaderData& rdata, string& line)
+    {
+        auto& buffer = rdata.source_buffer;
+        auto& pos = rdata.source_pos;
+        string next;
+
+        for (;;)
+        {
+            auto left = buffer.size() - pos;
+            if (rdata.record_length != 0)
+            {
+                if (left >= rdata.record_length)
+                {
+                    line.assign(buffer, pos, rdata.record_length);
+                    pos += rdata.record_length;
+                    return true;
+                }
+            }
+            else if (auto end = static_cast<const char *>(memchr(buffer.data() + pos, rdata.delimiter, left)))
+            {
+                auto length = static_cast<size_t>(end - buffer.data()) - pos;
+                line.assign(buffer, pos, length);
+                pos += length + 1;
+                return true;
+            }
+
+            // line continued in the next buffer, if any
+            if (!rdata.source->next(next))
+            {
+                if (left == 0)
+                    return false;
+                line.assign(buffer, pos, left);
+                pos = buffer.size();
+                return true;
+            }
+
+            if (left == 0)
+                buffer.swap(next);
+            else
+                buffer.erase(0, pos).append(next);
+            pos = 0;
+        }
+    }
+
+    // blank-stripped range of each field of a line, as Record::setValue() would find once the line is mapped.
+    // Text fields not transcoded yet are checked through the code table.
+    void field_bounds(rbf::Record& rec, const string& line, const unsigned char *text_table, vector<uint32_t>& bounds)
+    {
+        for (auto const &f: rec)
+        {
+            auto data_type = f.type().data_type();
+            auto table = data_type == rbf::DataType::PACKED || data_type == rbf::DataType::ZONED ? nullptr : text_table;
+
+            // missing bytes are blanks
+            auto blank = [&](size_t i) {
+                auto pos = f.lower_bound() + i;
+                if (pos >= line.length())
+                    return true;
+                auto c = static_cast<unsigned char>(line[pos]);
+                return (table ? table[c] : c) == ' ';
+            };
+
+            size_t first = 0, last = f.length();
+            while (first < last && blank(first)) first++;
+            while (last > first && blank(last - 1)) last--;
+            bounds.push_back(static_cast<uint32_t>(first));
+            bounds.push_back(static_cast<uint32_t>(last));
+        }
+    }
+
+}
 
 namespace rbf
 {
 
+    ReaderIterator::ReaderIterator(ReaderData& rdata, bool at_end): _rdata{rdata}, _at_end{at_end}
+    {
+        // first line is read as soon as iteration starts
+        if (!_at_end)
+            read();
+    }
+
+    void ReaderIterator::read()
+    {
+        _mapped = false;
+        _named = false;
+        _parsed = false;
+
+        // cache hit: lines are served as read and mapped the first time
+        if (_rdata.cache_reader)
+        {
+            const string *name;
+            const char *line;
+            size_t length;
+
+            _at_end = !_rdata.cache_reader->next(name, line, length, _bounds);
+            if (_at_end)
+            {
+                _rdata.cache_reader.reset();
+                return;
+            }
+
+            _current_line.assign(line, length);
+            _record_name = *name;
+            _named = true;
+            _parsed = true;
+            return;
+        }
+
+        if (_rdata.source)
+        {
+            _at_end = !source_line(_rdata, _current_line);
+        }
+        else if (_rdata.record_length != 0)
+        {
+            // fixed-length records: the last one might be shorter
+            _current_line.resize(_rdata.record_length);
+            _rdata.rbf.read(&_current_line[0], _rdata.record_length);
+            _current_line.resize(_rdata.rbf.gcount());
+
+            _at_end = _current_line.empty();
+        }
+        else
+        {
+            _at_end = !getline(_rdata.rbf, _current_line, _rdata.delimiter);
+        }
+
+        // whole line is transcoded unless only text fields are requested
+        if (!_at_end && _rdata.code_table && !_rdata.text_only)
+            transcode(&_current_line[0], _current_line.length(), _rdata.code_table);
+
+        // cache miss: lines are saved with their record name, and the cache file is committed at the end
+        if (_rdata.cache_writer)
+        {
+            if (_at_end)
+            {
+                _rdata.cache_writer->commit();
+                _rdata.cache_writer.reset();
+                _rdata.cache->evict();
+                return;
+            }
+
+            _record_name = record_name();
+            _named = true;
+
+            _bounds.clear();
+            if (_rdata.layout.contains(_record_name))
+                field_bounds(*_rdata.layout[_record_name], _current_line, _rdata.text_only ? _rdata.code_table : nullptr, _bounds);
+            _rdata.cache_writer->add(_record_name, _current_line, _bounds);
+        }
+    }
+
+    string ReaderIterator::record_name()
+    {
+        // only text fields are transcoded: mapper is given a transcoded copy
+        if (_rdata.code_table && _rdata.text_only)
+        {
+            _mapper_line = _current_line;
+            transcode(&_mapper_line[0], _mapper_line.length(), _rdata.code_table);
+            return _rdata.mapper(_mapper_line);
+        }
+
+        return _rdata.mapper(_current_line);
+    }
+
+    const string& ReaderIterator::map()
+    {
+        if (_mapped)
+            return _record_name;
+        _mapped = true;
+
+        if (!_named)
+        {
+            _record_name = record_name();
+            _named = true;
+        }
+
+        // only text fields are transcoded: they're transcoded in place
+        if (_rdata.code_table && _rdata.text_only)
+        {
+            for (auto& f: *_rdata.layout[_record_name])
+            {
+                auto data_type = f.type().data_type();
+                if (data_type == DataType::PACKED || data_type == DataType::ZONED || f.lower_bound() >= _current_line.length())
+                    continue;
+
+                auto len = min(static_cast<size_t>(f.length()), _current_line.length() - f.lower_bound());
+                transcode(&_current_line[f.lower_bound()], len, _rdata.code_table);
+            }
+        }
+
+        return _record_name;
+    }
+
     RecordPtr& ReaderIterator::operator*()
     {
-        // try to match the record from line read from input file
-        getline(_rdata.rbf, _current_line); 
-        auto recname = _rdata.mapper(_current_line);
-        _rdata.layout[recname]->setValue(_current_line);
+        auto& rec = _rdata.layout[map()];
+        if (_parsed && _bounds.size() == 2 * rec->size())
+            rec->setValue(_current_line, _bounds.data());
+        else
+            rec->setValue(_current_line);
 
-        return _rdata.layout[recname];
+        return rec;
     }
 
     ReaderIterator& ReaderIterator::operator++()
     {
-        getline(_rdata.rbf, _current_line); 
+        read();
         return *this;
     }
 
     bool ReaderIterator::operator!=(const ReaderIterator& it) const 
     { 
-        return !_rdata.rbf.eof(); 
+        return _at_end != it._at_end; 
     }
 
     ReaderIterator Reader::begin()  
     {
-        _rdata.rbf.open(_rdata.rb_file); 
-        if (!_rdata.rbf.is_open())
+        _rdata.cache_reader.reset();
+        _rdata.cache_writer.reset();
+        _rdata.source.reset();
+        _rdata.source_buffer.clear();
+        _rdata.source_pos = 0;
+
+        // block-compressed files are split as they were written
+        auto format = input_format(_rdata.rb_file);
+        shared_ptr<BlockFile> blocks;
+        if (format == InputFormat::BLOCKS)
         {
-            throw runtime_error("Unable to open file");
+            blocks = make_shared<BlockFile>(_rdata.rb_file);
+            _rdata.record_length = blocks->record_length();
+            _rdata.delimiter = blocks->delimiter();
+        }
+
+        if (_rdata.cache && _rdata.first_record == 0)
+        {
+            auto key = _rdata.cache->key(_rdata);
+            _rdata.cache_reader = _rdata.cache->lookup(key);
+            if (_rdata.cache_reader)
+                return ReaderIterator(_rdata);
+            _rdata.cache_writer = _rdata.cache->populate(key);
+        }
+
+        // records before the first one are skipped, from the block holding it if any
+        auto skip = _rdata.first_record;
+        if (blocks)
+        {
+            auto first_block = blocks->nb_blocks();
+            if (skip < blocks->nb_records())
+            {
+                first_block = blocks->find_block(skip);
+                skip -= blocks->block(first_block).first_record;
+            }
+            _rdata.source = make_shared<BlockSource>(blocks, first_block, _rdata.nb_threads);
         }
-        return ReaderIterator(_rdata); 
+        else if (format != InputFormat::PLAIN)
+        {
+            _rdata.source = open_source(_rdata.rb_file, _rdata.nb_threads);
+        }
+        else
+        {
+            // read again from the start
+            if (_rdata.rbf.is_open())
+                _rdata.rbf.close();
+
+            _rdata.rbf.open(_rdata.rb_file, ios::in | ios::binary); 
+            if (!_rdata.rbf.is_open())
+            {
+                throw runtime_error("Unable to open file");
+            }
+        }
+
+        ReaderIterator it(_rdata);
+        for (auto last = end(); skip > 0 && it != last; skip--)
+        {
+            ++it;
+        }
+        return it; 
     }
 
     ReaderIterator Reader::end()  
     {
-        return ReaderIterator(_rdata);
+        return ReaderIterator(_rdata, true);
+    }
+
+    void Reader::fill(RecordRing& ring)
+    {
+        try
+        {
+            for (auto it = begin(), last = end(); it != last; ++it)
+            {
+                auto& rec = _rdata.layout[it.map()];
+                ring.push(*rec, it.line().data(), it.line().length());
+            }
+        }
+        catch (...)
+        {
+            ring.close();
+            throw;
+        }
+        ring.close();
+    }
+
+    size_t Reader::copy_if(const string& output_file, function <bool (const string&)> keep)
+    {
+        if (input_format(_rdata.rb_file) != InputFormat::PLAIN)
+            throw runtime_error("unable to copy records of compressed file " + _rdata.rb_file);
+
+        FileDescriptor in(::open(_rdata.rb_file.c_str(), O_RDONLY));
+        if (in.fd < 0)
+            throw runtime_error("Unable to open file");
+
+        // lines are found from a mapping of the input file: no read buffer is needed
+        MappedFile input(_rdata.rb_file);
+
+        FileDescriptor out(::open(output_file.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644));
+        if (out.fd < 0)
+            throw runtime_error("unable to create file " + output_file + ": " + strerror(errno));
+
+#if defined(RBF_HAVE_COPY_FILE_RANGE)
+        auto method = CopyMethod::COPY_FILE_RANGE;
+#elif defined(__linux__)
+        auto method = CopyMethod::SENDFILE;
+#else
+        auto method = CopyMethod::WRITE;
+#endif
+        size_t run_start = 0, run_length = 0;   // consecutive lines to copy
+        size_t nb_lines = 0;
+        string line;
+
+        for_each_raw_line(input.data(), input.size(), _rdata.record_length, _rdata.delimiter,
+            [&](const char *p, size_t length, size_t next) {
+                line.assign(p, length);
+                if (_rdata.code_table)
+                    transcode(&line[0], line.length(), _rdata.code_table);
+
+                if (keep(_rdata.mapper(line)))
+                {
+                    if (run_length == 0)
+                        run_start = p - input.data();
+                    run_length += next;
+                    nb_lines++;
+                }
+                else if (run_length != 0)
+                {
+                    copy_block(in.fd, out.fd, input.data(), run_start, run_length, method);
+                    run_length = 0;
+                }
+            });
+
+        if (run_length != 0)
+            copy_block(in.fd, out.fd, input.data(), run_start, run_length, method);
+
+        auto fd = out.fd;
+        out.fd = -1;
+        if (::close(fd) != 0)
+            throw runtime_error("unable to close file " + output_file + ": " + strerror(errno));
+
+        return nb_lines;
     }
 
 }
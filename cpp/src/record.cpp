@@ -1,4 +1,6 @@
 #include <iostream>
+#include <cstring>
+#include <algorithm>
 
 #include <record.h>
 
@@ -10,9 +12,12 @@ namespace rbf
         // clear data structures
         _field_list.clear();
         _field_map.clear();
+
+        if (_buffer)
+            _resource->deallocate(_buffer, _capacity, 1);
     }
 
-    Record::Record(const Record& rec)
+    Record::Record(const Record& rec): DataElement(), _resource{rec._resource}, _field_list(PolymorphicAllocator<Field>(rec._resource))
     {
         for (auto f: rec)
         {
@@ -43,41 +48,70 @@ namespace rbf
 
         // autopopulate map is not present
         _field_map[last.name()].push_back(last.index());
-    }
 
-    string Record::value(const char separator) const
-    {
-        stringstream ss;
-        for (auto const &f: _field_list) { ss << f.value() << separator; }
-        return ss.str();
+        // grow the buffer, fields already added follow it
+        if (_length > _capacity)
+        {
+            auto capacity = max(static_cast<size_t>(_length), 2 * _capacity);
+            auto buffer = static_cast<char *>(_resource->allocate(capacity, 1));
+            if (_buffer)
+            {
+                memcpy(buffer, _buffer, last.lower_bound());
+                _resource->deallocate(_buffer, _capacity, 1);
+            }
+            _buffer = buffer;
+            _capacity = capacity;
+
+            for (size_t i = 0; i < _field_list.size() - 1; i++)
+            {
+                auto &previous = _field_list[i];
+                previous.bind(_buffer + previous.lower_bound(), false);
+            }
+        }
+
+        // the new field value is copied into the buffer
+        last.bind(_buffer + last.lower_bound(), true);
     }
 
-    string Record::raw_value() const
+    string Record::value(const char separator) const
     {
-        /*
         string s;
-        for (auto const &f: _field_list) { s += f.raw_value(); }
+        s.reserve(_length + _field_list.size());
+        for (auto const &f: _field_list) 
+        { 
+            s.append(f._data + f._first, f._last - f._first);
+            s += separator;
+        }
         return s;
-        */
-        stringstream ss;
-        for (auto const &f: _field_list) { ss << f.raw_value(); }
-        return ss.str();
     }
 
-    void Record::setValue(string s)
+    void Record::setValue(const string& s)
     {
-        // check s length to match record length
-        auto len = s.length();
+        // one copy for all fields, blank-padded when s is shorter than the record
+        auto len = min(s.length(), static_cast<size_t>(_length));
+        if (len != 0)
+            memcpy(_buffer, s.data(), len);
         if (len < _length)
-        {
-            // left-pad with blanks
-            s += string(_length-len, ' ');
-        }
+            memset(_buffer + len, ' ', _length - len);
 
-        // get the slice of the input string
         for (auto &f: _field_list) 
         { 
-            f.setValue(s.substr(f.lower_bound(), f.length())); 
+            f.trim();
+        }
+    }
+
+    void Record::setValue(const string& s, const uint32_t *bounds)
+    {
+        auto len = min(s.length(), static_cast<size_t>(_length));
+        if (len != 0)
+            memcpy(_buffer, s.data(), len);
+        if (len < _length)
+            memset(_buffer + len, ' ', _length - len);
+
+        for (auto &f: _field_list)
+        {
+            f._first = min(static_cast<size_t>(*bounds++), f._raw_length);
+            f._last = max(min(static_cast<size_t>(*bounds++), f._raw_length), f._first);
         }
     }
 
@@ -109,6 +143,14 @@ namespace rbf
         return _field_list[index_of_first].value(); 
     }
 
+    size_t Record::handle(const string& field_name) const
+    {
+        auto it = _field_map.find(field_name);
+        if (it == _field_map.end())
+            throw runtime_error("field " + field_name + " not in record " + _name);
+        return it->second[0];
+    }
+
     Field& Record::operator[](size_t i) 
     {
         if (i < _field_list.size()) 
@@ -0,0 +1,329 @@
+#include <cstring>
+#include <algorithm>
+
+#include <reformatter.h>
+#include <writer.h>
+#include <chunk.h>
+
+namespace rbf
+{
+
+    void Reformatter::setCodePage(CodePage cp)
+    {
+        _blank = ' ';
+        _zero = '0';
+        _minus = '-';
+        _plus = '+';
+
+        auto table = transcoding_table(cp);
+        if (!table)
+            return;
+
+        // find blank and zero bytes of the code page
+        for (int b = 0; b < 256; b++)
+        {
+            if (table[b] == ' ') _blank = static_cast<char>(b);
+            if (table[b] == '0') _zero = static_cast<char>(b);
+            if (table[b] == '-') _minus = static_cast<char>(b);
+            if (table[b] == '+') _plus = static_cast<char>(b);
+        }
+    }
+
+    RecordPlan Reformatter::compile(Record& source, Record& target)
+    {
+        RecordPlan plan;
+        plan.target_name = target.name();
+        plan.source_length = source.length();
+        plan.image.assign(target.length(), _blank);
+        plan.zero = _zero;
+        plan.minus = _minus;
+        plan.plus = _plus;
+
+        auto mapping = _field_mapping.find(target.name());
+        auto values = _field_values.find(target.name());
+
+        for (auto const &tf: target)
+        {
+            auto& tt = tf.type();
+
+            CopyStep step;
+            step.dst_offset = tf.lower_bound();
+            step.dst_length = tf.length();
+            step.justify = Justify::LEFT;
+            step.pad = _blank;
+            step.truncate = true;
+            step.text_number = false;
+            step.name = tf.name();
+
+            switch (tt.data_type())
+            {
+                case DataType::INTEGER:
+                case DataType::DECIMAL:
+                    step.justify = Justify::RIGHT;
+                    step.truncate = false;
+                    step.text_number = true;
+                    break;
+
+                case DataType::PACKED:
+                    step.justify = Justify::RIGHT;
+                    step.pad = '\0';
+                    step.truncate = false;
+                    break;
+
+                case DataType::ZONED:
+                    step.justify = Justify::RIGHT;
+                    step.pad = _zero;
+                    step.truncate = false;
+                    break;
+
+                default:
+                    break;
+            }
+
+            // unmapped fields keep a padded value, zero for binary numbers
+            memset(&plan.image[step.dst_offset], step.pad, step.dst_length);
+            if (tt.data_type() == DataType::PACKED && step.dst_length != 0)
+                plan.image[step.dst_offset + step.dst_length - 1] = '\x0C';
+
+            // constant value
+            if (values != _field_values.end())
+            {
+                auto it = values->second.find(tf.name());
+                if (it != values->second.end())
+                {
+                    memcpy(&plan.image[step.dst_offset], it->second.data(), min(it->second.length(), step.dst_length));
+                    continue;
+                }
+            }
+
+            // source field, same name by default
+            auto source_name = tf.name();
+            bool is_explicit = false;
+            if (mapping != _field_mapping.end())
+            {
+                auto it = mapping->second.find(tf.name());
+                if (it != mapping->second.end())
+                {
+                    source_name = it->second;
+                    is_explicit = true;
+                }
+            }
+
+            if (source_name.empty())
+                continue;
+            if (!source.contains(source_name))
+            {
+                if (is_explicit)
+                    throw runtime_error("field " + source_name + " not in record " + source.name());
+                continue;
+            }
+
+            auto const &sf = *(source.begin() + source.handle(source_name));
+            auto& st = sf.type();
+
+            // only values of the same representation can be copied
+            auto same_format = st.data_type() == tt.data_type() && st.decimals() == tt.decimals();
+            if (same_format && tt.data_type() == DataType::DATE)
+            {
+                auto sfmt = st.date_format() ? st.date_format()->format() : DEFAULT_DATE_FORMAT;
+                auto tfmt = tt.date_format() ? tt.date_format()->format() : DEFAULT_DATE_FORMAT;
+                same_format = sfmt == tfmt;
+            }
+            if (!same_format)
+                throw runtime_error("field " + tf.name() + " of record " + target.name() + ": can't be copied from field " +
+                    sf.name() + " of another type");
+
+            step.src_offset = sf.lower_bound();
+            step.src_length = sf.length();
+            plan.steps.push_back(step);
+        }
+
+        sort(plan.steps.begin(), plan.steps.end(), [](const CopyStep& a, const CopyStep& b) { return a.dst_offset < b.dst_offset; });
+
+        // merge consecutive copies of unresized fields
+        vector<CopyStep> steps;
+        for (auto const &step: plan.steps)
+        {
+            if (!steps.empty())
+            {
+                auto& last = steps.back();
+                if (last.src_length == last.dst_length && step.src_length == step.dst_length &&
+                    last.src_offset + last.src_length == step.src_offset && last.dst_offset + last.dst_length == step.dst_offset)
+                {
+                    last.src_length += step.src_length;
+                    last.dst_length += step.dst_length;
+                    continue;
+                }
+            }
+            steps.push_back(step);
+        }
+        plan.steps.swap(steps);
+
+        return plan;
+    }
+
+    void Reformatter::compile()
+    {
+        _plans.clear();
+
+        for (auto const &kv: _record_mapping)
+        {
+            if (!_source.contains(kv.first))
+                throw runtime_error("record " + kv.first + " not in source layout");
+            if (!_target.contains(kv.second))
+                throw runtime_error("record " + kv.second + " not in target layout");
+        }
+
+        for (auto const &kv: _source)
+        {
+            auto it = _record_mapping.find(kv.first);
+            auto target_name = it == _record_mapping.end() ? kv.first : it->second;
+            if (!_target.contains(target_name))
+                continue;
+
+            _plans[kv.first] = compile(*kv.second, *_target[target_name]);
+        }
+
+        _compiled = true;
+    }
+
+    const RecordPlan& Reformatter::plan(const string& source_record)
+    {
+        if (!_compiled)
+            compile();
+
+        auto it = _plans.find(source_record);
+        if (it == _plans.end())
+            throw runtime_error("record " + source_record + " has no target record");
+        return it->second;
+    }
+
+    void Reformatter::apply(const RecordPlan& plan, const char *line, size_t length, char *out)
+    {
+        memcpy(out, plan.image.data(), plan.image.length());
+
+        for (auto const &step: plan.steps)
+        {
+            // short lines are blank-padded
+            if (step.src_offset >= length)
+                continue;
+
+            auto p = line + step.src_offset;
+            auto available = min(step.src_length, length - step.src_offset);
+
+            // fast path: field not resized
+            if (step.src_length == step.dst_length)
+            {
+                memcpy(out + step.dst_offset, p, available);
+                continue;
+            }
+
+            size_t first = 0, last = available;
+
+            // INTEGER and DECIMAL values lose their blanks, sign and leading zeros, and are padded again alike
+            if (step.text_number)
+            {
+                while (first < last && p[first] == step.pad) first++;
+                while (last > first && p[last-1] == step.pad) last--;
+
+                char sign = 0;
+                if (first < last && (p[first] == plan.minus || p[first] == plan.plus))
+                    sign = p[first++];
+                auto zero_padded = first == (sign ? 1u : 0u) && first < last && p[first] == plan.zero;
+
+                // one digit is kept before a decimal point
+                while (last - first > 1 && p[first] == plan.zero && static_cast<unsigned char>(p[first+1] - plan.zero) <= 9)
+                    first++;
+
+                auto n = last - first, width = n + (sign ? 1 : 0);
+                if (width > step.dst_length)
+                    throw runtime_error("field " + step.name + ": value too long");
+
+                auto q = out + step.dst_offset;
+                if (zero_padded)
+                {
+                    memset(q, plan.zero, step.dst_length - n);
+                    if (sign) q[0] = sign;
+                }
+                else if (sign)
+                {
+                    q[step.dst_length - width] = sign;
+                }
+                memcpy(q + step.dst_length - n, p + first, n);
+                continue;
+            }
+
+            if (step.dst_length < step.src_length && step.justify == Justify::RIGHT)
+            {
+                // binary numbers only lose their padding
+                while (first < last && p[first] == step.pad) first++;
+            }
+
+            auto n = last - first;
+            if (n > step.dst_length)
+            {
+                if (!step.truncate)
+                    throw runtime_error("field " + step.name + ": value too long");
+                n = step.dst_length;
+            }
+
+            if (step.justify == Justify::LEFT)
+            {
+                memcpy(out + step.dst_offset, p + first, n);
+            }
+            else
+            {
+                auto shift = step.dst_length < step.src_length ? step.dst_length - n : step.dst_length - step.src_length;
+                memcpy(out + step.dst_offset + shift, p + first, n);
+            }
+        }
+    }
+
+    size_t Reformatter::reformat(const char *p, size_t size, const function <string (string)>& mapper, string& out) const
+    {
+        size_t nb_lines = 0;
+        const RecordPlan *plan = nullptr;
+        string record_name;
+
+        for_each_raw_line(p, size, _record_length, _delimiter, [&](const char *line, size_t length, size_t) {
+            // consecutive lines often belong to the same record
+            auto name = mapper(string(line, length));
+            if (!plan || name != record_name)
+            {
+                auto it = _plans.find(name);
+                if (it == _plans.end())
+                    throw runtime_error("record " + name + " has no target record");
+                plan = &it->second;
+                record_name = name;
+            }
+
+            auto offset = out.length();
+            auto target_length = plan->image.length();
+            out.resize(offset + target_length + (_record_length == 0 ? 1 : 0));
+            apply(*plan, line, length, &out[offset]);
+            if (_record_length == 0)
+                out[offset + target_length] = _delimiter;
+            nb_lines++;
+        });
+
+        return nb_lines;
+    }
+
+    size_t Reformatter::run(const string& input_file, const string& output_file, function <string (string)> mapper, size_t nb_threads)
+    {
+        if (!_compiled)
+            compile();
+
+        MappedFile input(input_file);
+        Writer writer(output_file, _target);
+
+        // chunks are written in order
+        auto nb_lines = process_chunks(input.data(), input.size(), _record_length, _delimiter, nb_threads,
+            [&](const char *p, size_t size, string& out) { return reformat(p, size, mapper, out); },
+            [&](const string& out) { writer.write_raw(out.data(), out.length()); });
+
+        writer.close();
+        return nb_lines;
+    }
+
+}
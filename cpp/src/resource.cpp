@@ -0,0 +1,86 @@
+#include <new>
+#include <cstdint>
+
+#include <resource.h>
+
+namespace rbf
+{
+
+    namespace
+    {
+        class NewDeleteResource : public MemoryResource
+        {
+            protected:
+                void *do_allocate(size_t bytes, size_t) override { return ::operator new(bytes); }
+                void do_deallocate(void *p, size_t, size_t) override { ::operator delete(p); }
+        };
+    }
+
+    MemoryResource *default_resource() noexcept
+    {
+        static NewDeleteResource resource;
+        return &resource;
+    }
+
+    MonotonicResource::MonotonicResource(size_t initial_size, MemoryResource *upstream): 
+        _upstream{upstream}, _next_size{initial_size == 0 ? MONOTONIC_INITIAL_SIZE : initial_size}
+    {
+    }
+
+    void *MonotonicResource::do_allocate(size_t bytes, size_t alignment)
+    {
+        auto padding = (alignment - reinterpret_cast<uintptr_t>(_current) % alignment) % alignment;
+
+        if (!_current || padding + bytes > _left)
+        {
+            // new chunk, large enough whatever the alignment
+            auto size = _next_size;
+            while (size < bytes + alignment) size *= 2;
+
+            auto chunk = static_cast<Chunk *>(_upstream->allocate(sizeof(Chunk) + size));
+            chunk->next = _chunks;
+            chunk->size = size;
+            _chunks = chunk;
+
+            _current = reinterpret_cast<char *>(chunk + 1);
+            _left = size;
+            _next_size = size * 2;
+
+            padding = (alignment - reinterpret_cast<uintptr_t>(_current) % alignment) % alignment;
+        }
+
+        auto p = _current + padding;
+        _current += padding + bytes;
+        _left -= padding + bytes;
+        return p;
+    }
+
+    void MonotonicResource::release()
+    {
+        while (_chunks)
+        {
+            auto next = _chunks->next;
+            _upstream->deallocate(_chunks, sizeof(Chunk) + _chunks->size);
+            _chunks = next;
+        }
+        _current = nullptr;
+        _left = 0;
+    }
+
+    void MonotonicResource::reset()
+    {
+        if (!_chunks)
+            return;
+
+        // the last chunk is the largest one
+        auto last = _chunks;
+        _chunks = last->next;
+        release();
+
+        last->next = nullptr;
+        _chunks = last;
+        _current = reinterpret_cast<char *>(last + 1);
+        _left = last->size;
+    }
+
+}
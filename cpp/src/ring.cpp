@@ -0,0 +1,135 @@
+#include <cstring>
+#include <algorithm>
+
+#include <ring.h>
+
+namespace rbf
+{
+
+    string RecordSlot::value(const char separator) const
+    {
+        string s;
+        string v;
+        for (size_t i = 0; i < _record->size(); i++)
+        {
+            get(i, v);
+            s += v;
+            s += separator;
+        }
+        return s;
+    }
+
+    RecordRing::RecordRing(Layout& layout, size_t capacity, RingPolicy policy): _policy{policy}, _slots(capacity)
+    {
+        if (capacity == 0)
+            throw runtime_error("ring capacity must not be 0");
+
+        for (auto const &kv: layout)
+        {
+            _slot_size = max(_slot_size, kv.second->length());
+        }
+        _slab.reset(new char[capacity * _slot_size]);
+    }
+
+    void RecordRing::push(const Record& rec, const char *line, size_t len)
+    {
+        auto length = rec.length();
+        if (length > _slot_size)
+            throw runtime_error("record " + rec.name() + " is not part of the ring layout");
+
+        unique_lock<mutex> lock(_mutex);
+        if (_closed)
+            throw runtime_error("record pushed into a closed ring");
+
+        // once records are spilled, the next ones are spilled too to keep them in order
+        auto full = [this]() { return !_spill.empty() || _slots[_tail].state != State::FREE; };
+
+        if (_policy == RingPolicy::SPILL && full())
+        {
+            string data(line, min(len, length));
+            data.resize(length, ' ');
+            _spill.emplace_back(&rec, move(data));
+        }
+        else
+        {
+            // a producer waiting on a full ring gives up once it's closed
+            _not_full.wait(lock, [this]() { return _slots[_tail].state == State::FREE || _closed; });
+            if (_closed)
+                throw runtime_error("record pushed into a closed ring");
+
+            auto p = _slab.get() + _tail * _slot_size;
+            auto n = min(len, length);
+            memcpy(p, line, n);
+            memset(p + n, ' ', length - n);
+
+            _slots[_tail].record = &rec;
+            _slots[_tail].state = State::FILLED;
+            _tail = (_tail + 1) % _slots.size();
+            _filled++;
+        }
+
+        lock.unlock();
+        _not_empty.notify_one();
+    }
+
+    void RecordRing::close()
+    {
+        {
+            lock_guard<mutex> lock(_mutex);
+            _closed = true;
+        }
+        _not_empty.notify_all();
+        _not_full.notify_all();
+    }
+
+    bool RecordRing::acquire(RecordSlot& slot)
+    {
+        unique_lock<mutex> lock(_mutex);
+        _not_empty.wait(lock, [this]() { return _filled != 0 || !_spill.empty() || _closed; });
+
+        // slots are always older than spilled records
+        if (_filled != 0)
+        {
+            auto& s = _slots[_head];
+            s.state = State::ACQUIRED;
+
+            slot._record = s.record;
+            slot._data = _slab.get() + _head * _slot_size;
+            slot._index = _head;
+            slot._is_spilled = false;
+
+            _head = (_head + 1) % _slots.size();
+            _filled--;
+            return true;
+        }
+
+        if (!_spill.empty())
+        {
+            _acquired.splice(_acquired.end(), _spill, _spill.begin());
+            auto it = prev(_acquired.end());
+
+            slot._record = it->first;
+            slot._data = it->second.data();
+            slot._spilled = it;
+            slot._is_spilled = true;
+            return true;
+        }
+
+        return false;
+    }
+
+    void RecordRing::release(RecordSlot& slot)
+    {
+        {
+            lock_guard<mutex> lock(_mutex);
+            if (slot._is_spilled)
+                _acquired.erase(slot._spilled);
+            else
+                _slots[slot._index].state = State::FREE;
+        }
+        slot._record = nullptr;
+        slot._data = nullptr;
+        _not_full.notify_all();
+    }
+
+}
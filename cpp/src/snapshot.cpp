@@ -0,0 +1,62 @@
+#include <cstring>
+
+#include <snapshot.h>
+
+namespace rbf
+{
+
+    RecordSnapshot::RecordSnapshot(const RecordPtr& rec, MemoryResource *resource): _record{rec}, _resource{resource}
+    {
+        copy(rec->raw_data(), rec->length());
+    }
+
+    RecordSnapshot::RecordSnapshot(const RecordSnapshot& other): _record{other._record}, _resource{other._resource}
+    {
+        if (other._data)
+            copy(other._data, other._length);
+    }
+
+    RecordSnapshot::RecordSnapshot(RecordSnapshot&& other) noexcept: 
+        _record{move(other._record)}, _resource{other._resource}, _data{other._data}, _length{other._length}
+    {
+        other._data = nullptr;
+        other._length = 0;
+    }
+
+    RecordSnapshot& RecordSnapshot::operator=(RecordSnapshot other) noexcept
+    {
+        swap(_record, other._record);
+        swap(_resource, other._resource);
+        swap(_data, other._data);
+        swap(_length, other._length);
+        return *this;
+    }
+
+    RecordSnapshot::~RecordSnapshot()
+    {
+        if (_data)
+            _resource->deallocate(_data, _length == 0 ? 1 : _length, 1);
+    }
+
+    void RecordSnapshot::copy(const char *data, size_t length)
+    {
+        _data = static_cast<char *>(_resource->allocate(length == 0 ? 1 : length, 1));
+        _length = length;
+        if (length != 0)
+            memcpy(_data, data, length);
+    }
+
+    string RecordSnapshot::value(const char separator) const
+    {
+        string s;
+        string v;
+        for (size_t i = 0; i < _record->size(); i++)
+        {
+            get(i, v);
+            s += v;
+            s += separator;
+        }
+        return s;
+    }
+
+}
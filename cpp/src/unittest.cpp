@@ -1,5 +1,12 @@
 #include <iostream>
 #include <cassert>
+#include <limits>
+#include <cstring>
+#include <fstream>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/stat.h>
 //#include <cppunit/extensions/HelperMacros.h>
 
 
@@ -11,12 +18,38 @@ using namespace pugi;
 #include <rbf.h>
 using namespace rbf;
 
+// generated by rbfgen from the test layouts
+#include <world_data.h>
+#include <rbfgen_names.h>
+
 void test_element();
 void test_field_type();
+void test_convert();
+void test_date();
 void test_field();
 void test_record1();
 void test_layout();
 void test_reader();
+void test_ebcdic();
+void test_rbfgen();
+void test_binding();
+void test_snapshot();
+void test_ring();
+void test_resource();
+void test_writer();
+void test_mappedwriter();
+void test_copy_if();
+void test_reformatter();
+void test_csv();
+void test_json();
+void test_arrow();
+void test_columnar();
+void test_cache();
+void test_compress();
+void test_decompress();
+void test_filter();
+void test_batch();
+void test_aggregate();
 
 string xmlfile;
 string rbffile;
@@ -37,10 +70,11 @@ int main(int argc, char**argv)
         Layout layout{xmlfile, 200};
         //auto reader = Reader(rbffile, layout, [](string s) { return s.substr(0,2); });
         //auto reader = Reader(rbffile, layout, [](string s) { return "JAF20A"; });
-        Reader reader(rbffile, layout, [](string s) { return "JAF20A"; });
+        Reader reader(rbffile, layout, [](string) { return "JAF20A"; });
 
         for (auto &rec: reader)
         {
+            (void)rec;
             //cerr << rec->value(';') << endl;
         }
         exit(1);
@@ -58,6 +92,16 @@ int main(int argc, char**argv)
         cout << "Testing test_field_type" << endl;
         test_field_type();
 
+        // test conversions
+        cout << "------------------------------------------------------------------" << endl;
+        cout << "Testing test_convert" << endl;
+        test_convert();
+
+        // test dates
+        cout << "------------------------------------------------------------------" << endl;
+        cout << "Testing test_date" << endl;
+        test_date();
+
         // test field class
         cout << "------------------------------------------------------------------" << endl;
         cout << "Testing test_field" << endl;
@@ -77,6 +121,98 @@ int main(int argc, char**argv)
         cout << "------------------------------------------------------------------" << endl;
         cout << "Testing test_reader" << endl;
         test_reader();
+
+        // test EBCDIC input
+        cout << "------------------------------------------------------------------" << endl;
+        cout << "Testing test_ebcdic" << endl;
+        test_ebcdic();
+
+        // test generated code
+        cout << "------------------------------------------------------------------" << endl;
+        cout << "Testing test_rbfgen" << endl;
+        test_rbfgen();
+
+        // test struct binding
+        cout << "------------------------------------------------------------------" << endl;
+        cout << "Testing test_binding" << endl;
+        test_binding();
+
+        // test record snapshots
+        cout << "------------------------------------------------------------------" << endl;
+        cout << "Testing test_snapshot" << endl;
+        test_snapshot();
+
+        // test record ring
+        cout << "------------------------------------------------------------------" << endl;
+        cout << "Testing test_ring" << endl;
+        test_ring();
+
+        // test memory resources
+        cout << "------------------------------------------------------------------" << endl;
+        cout << "Testing test_resource" << endl;
+        test_resource();
+
+        // test writer
+        cout << "------------------------------------------------------------------" << endl;
+        cout << "Testing test_writer" << endl;
+        test_writer();
+
+        cout << "------------------------------------------------------------" << endl;
+        cout << "Testing test_mappedwriter" << endl;
+        test_mappedwriter();
+
+        cout << "------------------------------------------------------------" << endl;
+        cout << "Testing test_copy_if" << endl;
+        test_copy_if();
+
+        cout << "------------------------------------------------------------" << endl;
+        cout << "Testing test_reformatter" << endl;
+        test_reformatter();
+
+        cout << "------------------------------------------------------------" << endl;
+        cout << "Testing test_csv" << endl;
+        test_csv();
+
+        cout << "------------------------------------------------------------" << endl;
+        cout << "Testing test_json" << endl;
+        test_json();
+
+        cout << "------------------------------------------------------------" << endl;
+        cout << "Testing test_arrow" << endl;
+        test_arrow();
+
+        cout << "------------------------------------------------------------" << endl;
+        cout << "Testing test_columnar" << endl;
+        test_columnar();
+
+        cout << "------------------------------------------------------------" << endl;
+        cout << "Testing test_cache" << endl;
+        test_cache();
+
+        // test block-compressed files
+        cout << "------------------------------------------------------------------" << endl;
+        cout << "Testing test_compress" << endl;
+        test_compress();
+
+        // test compressed inputs
+        cout << "------------------------------------------------------------------" << endl;
+        cout << "Testing test_decompress" << endl;
+        test_decompress();
+
+        // test predicates on raw bytes
+        cout << "------------------------------------------------------------------" << endl;
+        cout << "Testing test_filter" << endl;
+        test_filter();
+
+        // test predicates on batches of records
+        cout << "------------------------------------------------------------------" << endl;
+        cout << "Testing test_batch" << endl;
+        test_batch();
+
+        // test group-by aggregation
+        cout << "------------------------------------------------------------------" << endl;
+        cout << "Testing test_aggregate" << endl;
+        test_aggregate();
     }
     catch (std::exception& e) 
     {
@@ -147,6 +283,234 @@ void test_field_type()
     assert(ft2 == ft3);
 }
 
+void test_convert()
+{
+    int64_t i;
+    uint64_t u;
+
+    assert(parse_integer("1234", 4, i) == ConvStatus::OK && i == 1234);
+    assert(parse_integer("   -1234  ", 10, i) == ConvStatus::OK && i == -1234);
+    assert(parse_integer("+0000000000000000000000042", 26, i) == ConvStatus::OK && i == 42);
+    assert(parse_integer("1338100000          ", 20, i) == ConvStatus::OK && i == 1338100000);
+    assert(parse_integer("12345678901234567", 17, i) == ConvStatus::OK && i == 12345678901234567);
+    assert(parse_integer("9223372036854775807", 19, i) == ConvStatus::OK && i == numeric_limits<int64_t>::max());
+    assert(parse_integer("-9223372036854775808", 20, i) == ConvStatus::OK && i == numeric_limits<int64_t>::min());
+
+    assert(parse_integer("          ", 10, i) == ConvStatus::EMPTY);
+    assert(parse_integer("  -  ", 5, i) == ConvStatus::BAD_DIGIT);
+    assert(parse_integer("12 34", 5, i) == ConvStatus::BAD_DIGIT);
+    assert(parse_integer("1234567X9012", 12, i) == ConvStatus::BAD_DIGIT);
+    assert(parse_integer("12345678901:", 12, i) == ConvStatus::BAD_DIGIT);
+    assert(parse_integer("9223372036854775808", 19, i) == ConvStatus::OUT_OF_RANGE);
+    assert(parse_integer("-9223372036854775809", 20, i) == ConvStatus::OUT_OF_RANGE);
+    assert(parse_integer("123456789012345678901", 21, i) == ConvStatus::OUT_OF_RANGE);
+
+    assert(parse_digits("18446744073709551", 17, u) == ConvStatus::OK && u == 18446744073709551ULL);
+
+    Decimal d;
+    double x;
+
+    assert(parse_decimal("  29.5   ", 9, 0, d) == ConvStatus::OK && d.mantissa == 295 && d.scale == 1);
+    assert(parse_decimal("-0012.340", 9, 0, d) == ConvStatus::OK && d.mantissa == -12340 && d.scale == 3);
+    assert(parse_decimal("   12345", 8, 2, d) == ConvStatus::OK && d.mantissa == 12345 && d.scale == 2);
+    assert(parse_decimal("  123.45", 8, 4, d) == ConvStatus::OK && d.mantissa == 12345 && d.scale == 2);
+    assert(parse_decimal(".5", 2, 0, d) == ConvStatus::OK && d.mantissa == 5 && d.scale == 1);
+    assert(parse_decimal("5.", 2, 0, d) == ConvStatus::OK && d.mantissa == 5 && d.scale == 0);
+    assert(parse_decimal("123456789.0123456789", 20, 0, d) == ConvStatus::OK && d.mantissa == 1234567890123456789);
+    assert(parse_decimal("     ", 5, 0, d) == ConvStatus::EMPTY);
+    assert(parse_decimal(" . ", 3, 0, d) == ConvStatus::BAD_DIGIT);
+    assert(parse_decimal("1.2.3", 5, 0, d) == ConvStatus::BAD_DIGIT);
+    assert(parse_decimal("1,5", 3, 0, d) == ConvStatus::BAD_DIGIT);
+    assert(parse_decimal("12345678901.234567890", 21, 0, d) == ConvStatus::OUT_OF_RANGE);
+    assert(parse_decimal("123456789012345678901234.4x5", 28, 0, d) == ConvStatus::BAD_DIGIT);
+    assert(parse_decimal("123456789012345678901234.4.5", 28, 0, d) == ConvStatus::BAD_DIGIT);
+
+    assert(parse_double("  29.5   ", 9, 0, x) == ConvStatus::OK && x == 29.5);
+    assert(parse_double("0.1", 3, 0, x) == ConvStatus::OK && x == 0.1);
+    assert(parse_double("-12345", 6, 3, x) == ConvStatus::OK && x == -12.345);
+    assert(parse_double("123456789012345678901234.5", 26, 0, x) == ConvStatus::OK && x == 123456789012345678901234.5);
+    assert(parse_double("123456789012345678901234.4x5", 28, 0, x) == ConvStatus::BAD_DIGIT);
+    assert(parse_double("1234567890123x45678901234", 25, 0, x) == ConvStatus::BAD_DIGIT);
+    assert(parse_double("9007199254740993", 16, 0, x) == ConvStatus::OK && x == 9007199254740992.0);
+    assert(parse_double("1.7976931348623157", 18, 0, x) == ConvStatus::OK && x == 1.7976931348623157);
+
+    auto amount = FieldType("AMOUNT", "decimal");
+    amount.setDecimals(2);
+    auto fd = Field("FIELD_2", "Field2 description", amount, 10);
+    fd.setValue("  -1234567");
+    d = fd.get<Decimal>();
+    assert(d.mantissa == -1234567 && d.scale == 2);
+    assert(fd.get<double>() == -12345.67);
+
+    // packed decimal
+    assert(parse_packed("\x01\x23\x4D", 3, i) == ConvStatus::OK && i == -1234);
+    assert(parse_packed("\x01\x23\x4C", 3, i) == ConvStatus::OK && i == 1234);
+    assert(parse_packed("\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x9F", 13, i) == ConvStatus::OK && i == 9);
+    assert(parse_packed("\x92\x23\x37\x20\x36\x85\x47\x75\x80\x7F", 10, i) == ConvStatus::OK && i == numeric_limits<int64_t>::max());
+    assert(parse_packed("\x92\x23\x37\x20\x36\x85\x47\x75\x80\x8F", 10, i) == ConvStatus::OUT_OF_RANGE);
+    assert(parse_packed("\x01\x23\x45", 3, i) == ConvStatus::BAD_DIGIT);
+    assert(parse_packed("\x01\xA3\x4C", 3, i) == ConvStatus::BAD_DIGIT);
+    assert(parse_packed("   ", 3, i) == ConvStatus::EMPTY);
+
+    // zoned decimal
+    assert(parse_zoned("0012J", 5, i) == ConvStatus::OK && i == -121);
+    assert(parse_zoned("0012{", 5, i) == ConvStatus::OK && i == 120);
+    assert(parse_zoned("0012}", 5, i) == ConvStatus::OK && i == -120);
+    assert(parse_zoned("00123", 5, i) == ConvStatus::OK && i == 123);
+    assert(parse_zoned("\xF0\xF1\xF2\xD3", 4, i) == ConvStatus::OK && i == -123);
+    assert(parse_zoned("\xF0\xF1\xF2\xC3", 4, i) == ConvStatus::OK && i == 123);
+    assert(parse_zoned("0A12J", 5, i) == ConvStatus::BAD_DIGIT);
+    assert(parse_zoned("0012Z", 5, i) == ConvStatus::BAD_DIGIT);
+    assert(parse_zoned("\x40\x40\x40", 3, i) == ConvStatus::EMPTY);
+    assert(parse_zoned("12345678901234567890", 20, i) == ConvStatus::OUT_OF_RANGE);
+
+    auto packed = FieldType("COMP3", "packed");
+    packed.setDecimals(2);
+    auto fp = Field("FIELD_3", "Field3 description", packed, 4);
+    fp.setValue(string("\x01\x23\x45\x6D", 4));
+    assert(fp.get<int64_t>() == -123456);
+    d = fp.get<Decimal>();
+    assert(d.mantissa == -123456 && d.scale == 2);
+    assert(fp.get<double>() == -1234.56);
+
+    auto zoned = FieldType("ZONED", "zoned");
+    zoned.setDecimals(1);
+    auto fz = Field("FIELD_4", "Field4 description", zoned, 4);
+    fz.setValue("123R");
+    assert(fz.get<Decimal>().mantissa == -1239);
+    assert(fz.get<double>() == -123.9);
+
+    auto f = Field("FIELD_1", "Field1 description", FieldType("INT", "integer"), 10);
+    f.setValue("  -98765  ");
+    assert(f.get<int64_t>() == -98765);
+
+    f.setValue("  98x65   ");
+    assert(f.get(i) == ConvStatus::BAD_DIGIT);
+    try
+    {
+        f.get<int64_t>();
+        assert(false);
+    }
+    catch (runtime_error& e) {}
+
+    // plain text of decimals
+    char text[DECIMAL_TEXT_LENGTH];
+    d.mantissa = -5;
+    d.scale = 2;
+    assert(string(text, print_decimal(text, d)) == "-0.05");
+    d.mantissa = 123456;
+    d.scale = 3;
+    assert(string(text, print_decimal(text, d)) == "123.456");
+    d.mantissa = numeric_limits<int64_t>::min();
+    d.scale = 0;
+    assert(string(text, print_decimal(text, d)) == "-9223372036854775808");
+    d.scale = 19;
+    assert(string(text, print_decimal(text, d)) == "-0.9223372036854775808");
+    d.mantissa = 0;
+    d.scale = 0;
+    assert(string(text, print_decimal(text, d)) == "0");
+
+    // scales beyond 19 digits
+    d.mantissa = 5;
+    d.scale = 20;
+    assert(print_decimal(text, d) == 0);
+    char field[32];
+    assert(format_decimal(field, sizeof(field), 0, d) == ConvStatus::OUT_OF_RANGE);
+    assert(format_decimal(field, 4, 2, d) == ConvStatus::OK && memcmp(field, "0000", 4) == 0);
+    int64_t m;
+    d.mantissa = 0;
+    assert(rescale(d, 40, m) == ConvStatus::OK && m == 0);
+}
+
+void test_date()
+{
+    Date d;
+    int y;
+    unsigned int m, day;
+
+    assert(Date::from_civil(1970, 1, 1).days == 0);
+    assert(Date::from_civil(2000, 3, 1).days == 11017);
+    assert(Date::from_civil(1969, 12, 31).days == -1);
+
+    Date::from_civil(2016, 2, 29).to_civil(y, m, day);
+    assert(y == 2016 && m == 2 && day == 29);
+
+    DateFormat iso("YYYYMMDD");
+    assert(iso.parse("20160229", 8, d) == ConvStatus::OK && d == Date::from_civil(2016, 2, 29));
+    assert(iso.parse("20160229  ", 10, d) == ConvStatus::OK && d == Date::from_civil(2016, 2, 29));
+    assert(iso.parse("20150229", 8, d) == ConvStatus::OUT_OF_RANGE);
+    assert(iso.parse("20151301", 8, d) == ConvStatus::OUT_OF_RANGE);
+    assert(iso.parse("2015-301", 8, d) == ConvStatus::BAD_DIGIT);
+    assert(iso.parse("2015301", 7, d) == ConvStatus::BAD_DIGIT);
+    assert(iso.parse("        ", 8, d) == ConvStatus::EMPTY);
+
+    DateFormat dmy("DDMMMYY");
+    assert(dmy.parse("05JAN16", 7, d) == ConvStatus::OK && d == Date::from_civil(2016, 1, 5));
+    assert(dmy.parse("31dec99", 7, d) == ConvStatus::OK && d == Date::from_civil(1999, 12, 31));
+    assert(dmy.parse("05JUX16", 7, d) == ConvStatus::BAD_DIGIT);
+
+    DateFormat julian("YYDDD");
+    assert(julian.parse("16060", 5, d) == ConvStatus::OK && d == Date::from_civil(2016, 2, 29));
+    assert(julian.parse("15366", 5, d) == ConvStatus::OUT_OF_RANGE);
+
+    DateFormat dashes("YYYY-MM-DD");
+    assert(dashes.parse("2016-07-14", 10, d) == ConvStatus::OK && d == Date::from_civil(2016, 7, 14));
+
+    // memoized values
+    DateFormat memo("DD/MM/YYYY");
+    for (int i = 0; i < 3; i++)
+    {
+        assert(memo.cached_parse("14/07/2016", 10, d) == ConvStatus::OK && d == Date::from_civil(2016, 7, 14));
+        assert(memo.cached_parse("15/07/2016", 10, d) == ConvStatus::OK && d == Date::from_civil(2016, 7, 15));
+        assert(memo.cached_parse("32/07/2016", 10, d) == ConvStatus::OUT_OF_RANGE);
+    }
+
+    // formats don't share memoized values
+    DateFormat mdy("MM/DD/YYYY");
+    assert(mdy.cached_parse("14/07/2016", 10, d) == ConvStatus::OUT_OF_RANGE);
+    assert(mdy.cached_parse("07/14/2016", 10, d) == ConvStatus::OK && d == Date::from_civil(2016, 7, 14));
+    assert(memo.cached_parse("07/14/2016", 10, d) == ConvStatus::OUT_OF_RANGE);
+
+    for (auto format: { "", "YYYYMM", "YYYYMMDDD", "YYYYYMMDD", "YYYYMMDDYY" })
+    {
+        try
+        {
+            DateFormat bad(format);
+            assert(false);
+        }
+        catch (runtime_error& e) {}
+    }
+
+    auto ft = FieldType("DATE", "date");
+    ft.setFormat("DDMMMYY");
+    auto f = Field("FIELD_1", "Field1 description", ft, 7);
+    f.setValue("14JUL16");
+    assert(f.get<Date>() == Date::from_civil(2016, 7, 14));
+
+    // copies of a type share its format: dates are decoded by several threads at once
+    auto iso_type = FieldType("DATE", "date");
+    iso_type.setFormat("YYYYMMDD");
+    vector<int> decoded(8);
+    vector<thread> threads;
+    for (size_t t = 0; t < decoded.size(); t++)
+    {
+        threads.emplace_back([&decoded, t, iso_type]() {
+            auto ok = true;
+            char text[9];
+            Date date;
+            for (int i = 0; i < 20000; i++)
+            {
+                auto expected = Date{static_cast<int32_t>((i * 7 + t * 131) % 30000)};
+                iso_type.encode(text, 8, expected);
+                ok = ok && iso_type.decode(text, 8, date) == ConvStatus::OK && date == expected;
+            }
+            decoded[t] = ok;
+        });
+    }
+    for (auto& th: threads) th.join();
+    assert(count(decoded.begin(), decoded.end(), 1) == static_cast<long>(decoded.size()));
+}
+
 void test_field()
 {
     Field f0;
@@ -194,7 +558,7 @@ void test_record1()
 
     assert(rec.get_field_value("FIELD_0") == "AAAAAAAAAA");
 
-    for (int i=0; i<=4; i++)
+    for (unsigned int i=0; i<=4; i++)
     {
         assert(rec[i].name() == "FIELD_"+to_string(i));
         assert(rec[i].description() == "Field desc "+to_string(i));
@@ -206,9 +570,10 @@ void test_record1()
     assert(!rec.contains("FOO"));
 
     // const & non-const iterator
-    int i=0;
+    unsigned int i=0;
     for (auto &f: rec) 
     {
+        (void)f;
         assert(rec[i].name() == "FIELD_"+to_string(i));
         assert(rec[i].description() == "Field desc "+to_string(i));
         assert(rec[i].type().name() == to_string(i));
@@ -222,6 +587,7 @@ void test_record1()
     i=0;
     for (const auto &f: rec) 
     {
+        (void)f;
         assert(rec[i].name() == "FIELD_"+to_string(i));
         assert(rec[i].description() == "Field desc "+to_string(i));
         assert(rec[i].type().name() == to_string(i));
@@ -231,6 +597,29 @@ void test_record1()
 
         i++;
     }
+
+    // all field values live in the record buffer
+    assert(rec.raw_value() == "AAAAAAAAAABBBBBBBBBBCCCCCCCCCCDDDDDDDDDDEEEEEEEEEE");
+    assert(rec[1].raw_data() == rec.raw_data() + 10);
+
+    rec.setValue("  XX      YY");
+    assert(rec[0].value() == "XX");
+    assert(rec[0].raw_value() == "  XX      ");
+    assert(rec[1].value() == "YY");
+    assert(rec[4].value() == "");
+    assert(rec[4].raw_length() == 10);
+    assert(rec.value(';') == "XX;YY;;;;");
+
+    rec[2].setValue("ZZZZZZZZZZZZZZZ");
+    assert(rec[2].value() == "ZZZZZZZZZZ");
+    assert(rec.raw_value().substr(20, 10) == "ZZZZZZZZZZ");
+
+    // a copied record has its own buffer
+    Record copy(rec);
+    rec.setValue("");
+    assert(copy[0].value() == "XX");
+    assert(copy[2].value() == "ZZZZZZZZZZ");
+    assert(rec[0].value() == "");
 }
 
 void test_layout()
@@ -250,6 +639,8 @@ void test_layout()
     assert((*cont)[0].description() == "Record ID");
     assert((*cont)[1].description() == "Name of the continent");
 
+    assert(coun->handle("POPULATION") == 2);
+
 }
 
 void test_reader()
@@ -258,8 +649,2067 @@ void test_reader()
     Layout layout{xmlfile};
     Reader reader(rbffile, layout, [](string s) { return s.substr(0,4); });
 
+    auto population = layout["COUN"]->handle("POPULATION");
+    int64_t total = 0;
+    size_t nb_records = 0;
+
     for (auto &rec: reader)
     {
         cerr << rec->value(';') << endl;
+        nb_records++;
+
+        if (rec->name() == "COUN")
+        {
+            auto n = rec->get<int64_t>(population);
+            assert(n == stoll(rec->get_field_value("POPULATION")));
+            total += n;
+        }
+        else if (rec->name() == "CONT")
+        {
+            auto density = rec->get<double>(rec->handle("DENSITY"));
+            assert(density == stod(rec->get_field_value("DENSITY")));
+        }
+    }
+    assert(total > 0);
+
+    // each line is a record
+    ifstream rbf(rbffile);
+    string line;
+    size_t nb_lines = 0;
+    while (getline(rbf, line)) nb_lines++;
+    assert(nb_records == nb_lines);
+}
+
+void test_ebcdic()
+{
+    char s[] = "\xC1\xC2\xC3\x40\xF1\xF2\xF3\x4B\xF4\xF5";
+    transcode(s, strlen(s), transcoding_table(CodePage::IBM037));
+    assert(string(s) == "ABC 123.45");
+
+    assert(code_page("IBM-037") == CodePage::IBM037);
+    assert(code_page("cp500") == CodePage::IBM500);
+    assert(code_page("1047") == CodePage::IBM1047);
+    assert(transcoding_table(CodePage::ASCII) == nullptr);
+    assert(transcoding_table(CodePage::IBM1047)[0xAD] == '[');
+    assert(transcoding_table(CodePage::IBM037)[0xBA] == '[');
+
+    // fixed-length EBCDIC records with packed, zoned and date fields
+    Layout layout{"./test/payment.xml"};
+    const char *accounts[] = { "SMITH", "DOE", "O'HARA" };
+    const int64_t amounts[] = { 123456, -1010, 250 };
+    const int64_t counts[] = { 3, -2, 10 };
+    const Date dates[] = { Date::from_civil(2016, 7, 14), Date::from_civil(2015, 12, 31), Date::from_civil(1999, 12, 1) };
+
+    Reader reader("./test/payment.dat", layout, [](string s) { return s.substr(0,4); });
+    reader.setRecordLength(31);
+    reader.setCodePage(CodePage::IBM037, true);
+
+    size_t i = 0;
+    for (auto &rec: reader)
+    {
+        assert(rec->name() == "PAYM");
+        assert(rec->get_field_value("ACCOUNT") == accounts[i]);
+
+        auto amount = rec->get<Decimal>(rec->handle("AMOUNT"));
+        assert(amount.mantissa == amounts[i] && amount.scale == 2);
+        assert(rec->get<int64_t>(rec->handle("COUNT")) == counts[i]);
+        assert(rec->get<Date>(rec->handle("DATE")) == dates[i]);
+        i++;
+    }
+    assert(i == 3);
+
+    // whole records transcoded: zoned sign becomes an ASCII overpunch
+    Reader full_reader("./test/payment.dat", layout, [](string s) { return s.substr(0,4); });
+    full_reader.setRecordLength(31);
+    full_reader.setCodePage(code_page("IBM-037"));
+
+    i = 0;
+    for (auto &rec: full_reader)
+    {
+        assert(rec->get_field_value("ACCOUNT") == accounts[i]);
+        assert(rec->get<int64_t>(rec->handle("COUNT")) == counts[i]);
+        i++;
+    }
+    assert(i == 3);
+}
+
+// check generated structs against the runtime Record
+struct WorldVisitor
+{
+    Layout& layout;
+    size_t nb_cont;
+    size_t nb_coun;
+
+    void operator()(const world_data::CONT& cont)
+    {
+        auto& rec = layout["CONT"];
+        rec->setValue(string(cont.data, world_data::CONT::record_length));
+
+        assert(cont.NAME() == rec->get_field_value("NAME"));
+        assert(cont.CITY() == rec->get_field_value("CITY"));
+        assert(cont.DENSITY().to_double() == rec->get<double>(rec->handle("DENSITY")));
+        nb_cont++;
+    }
+
+    void operator()(const world_data::COUN& coun)
+    {
+        auto& rec = layout["COUN"];
+        rec->setValue(string(coun.data, world_data::COUN::record_length));
+
+        assert(coun.NAME() == rec->get_field_value("NAME"));
+        assert(coun.CAPITAL() == rec->get_field_value("CAPITAL"));
+        assert(coun.POPULATION() == rec->get<int64_t>(rec->handle("POPULATION")));
+        nb_coun++;
+    }
+};
+
+// generic visitor
+struct NameVisitor
+{
+    string name;
+
+    template <typename R>
+        void operator()(const R& rec) { name = rec.NAME(); }
+};
+
+void test_rbfgen()
+{
+    static_assert(world_data::COUN::record_length == 74, "bad generated record length");
+    static_assert(world_data::COUN::POPULATION_offset == 34, "bad generated offset");
+    static_assert(world_data::CONT::DENSITY_length == 9, "bad generated length");
+
+    // fields named like generated members, keywords or suffixed duplicates get a free name
+    static_assert(rbfgen_names::NAME::data_2_offset == 4 && rbfgen_names::NAME::record_length == 23, "bad generated member");
+    static_assert(rbfgen_names::NAME::VALUE_offset == 15 && rbfgen_names::NAME::VALUE_3_offset == 17, "bad duplicate");
+    static_assert(rbfgen_names::NAME::VALUE_2_offset == 19 && rbfgen_names::NAME::VALUE_offset_2_offset == 21, "bad suffix");
+    int64_t values[3] = {};
+    string names[3];
+    assert(rbfgen_names::dispatch("NAMEabc12xyzint010203", [&](const rbfgen_names::NAME& rec) {
+        values[0] = rec.VALUE(); values[1] = rec.VALUE_3(); values[2] = rec.VALUE_2();
+        names[0] = rec.data_2(); names[1] = rec.NAME_2(); names[2] = rec.class_2();
+    }));
+    assert(values[0] == 1 && values[1] == 2 && values[2] == 3);
+    assert(names[0] == "abc" && names[1] == "xyz" && names[2] == "int");
+
+    Layout layout{xmlfile};
+    Reader reader(rbffile, layout, [](string s) { return s.substr(0,4); });
+    WorldVisitor visitor{layout, 0, 0};
+
+    reader.for_each_line([&](const string& line) {
+        assert(world_data::dispatch(line, visitor));
+    });
+    assert(visitor.nb_cont > 0 && visitor.nb_coun > 0);
+
+    assert(!world_data::dispatch("FOO", visitor));
+    assert(!world_data::dispatch("XXXXYYYY", visitor));
+
+    // short line is padded
+    NameVisitor name_visitor;
+    assert(world_data::dispatch("COUNFoo", name_visitor));
+    assert(name_visitor.name == "Foo");
+}
+
+// user struct populated from COUN records
+struct Country
+{
+    string NAME;
+    int64_t POPULATION;
+    string capital;
+    double population;
+};
+
+// user struct populated from PAYM records
+struct Payment
+{
+    string ACCOUNT;
+    Decimal AMOUNT;
+    int COUNT;
+    Date DATE;
+};
+
+void test_binding()
+{
+    Layout layout{xmlfile};
+
+    Binding<Country> binding(*layout["COUN"]);
+    RBF_BIND(binding, Country, NAME);
+    RBF_BIND(binding, Country, POPULATION);
+    binding.bind("CAPITAL", &Country::capital).bind("POPULATION", &Country::population);
+    assert(binding.size() == 4);
+    assert(binding.record_name() == "COUN");
+
+    try
+    {
+        binding.bind("FOO", &Country::capital);
+        assert(false);
+    }
+    catch (runtime_error& e) {}
+
+    Country c;
+    binding.populate("COUNChina                         1338100000          Beijing             ", c);
+    assert(c.NAME == "China" && c.POPULATION == 1338100000 && c.capital == "Beijing" && c.population == 1338100000.0);
+
+    // short line: missing fields are blank
+    binding.populate("COUNNowhere", c);
+    assert(c.NAME == "Nowhere" && c.POPULATION == 0 && c.capital == "");
+
+    // compare with records read the usual way
+    vector<string> names;
+    Reader reader(rbffile, layout, [](string s) { return s.substr(0,4); });
+    reader.for_each_bound(binding, [&](const Country& c) { names.push_back(c.NAME); });
+
+    size_t i = 0;
+    Reader runtime_reader(rbffile, layout, [](string s) { return s.substr(0,4); });
+    for (auto &rec: runtime_reader)
+    {
+        if (rec->name() == "COUN")
+            assert(rec->get_field_value("NAME") == names[i++]);
+    }
+    assert(i == names.size() && i > 0);
+
+    // mainframe types
+    Layout payment_layout{"./test/payment.xml"};
+    Binding<Payment> payment_binding(*payment_layout["PAYM"]);
+    RBF_BIND(payment_binding, Payment, ACCOUNT);
+    RBF_BIND(payment_binding, Payment, AMOUNT);
+    RBF_BIND(payment_binding, Payment, COUNT);
+    RBF_BIND(payment_binding, Payment, DATE);
+
+    vector<Payment> payments;
+    Reader payment_reader("./test/payment.dat", payment_layout, [](string s) { return s.substr(0,4); });
+    payment_reader.setRecordLength(31);
+    payment_reader.setCodePage(CodePage::IBM037, true);
+    payment_reader.for_each_bound(payment_binding, [&](const Payment& p) { payments.push_back(p); });
+
+    assert(payments.size() == 3);
+    assert(payments[0].ACCOUNT == "SMITH" && payments[0].COUNT == 3 && payments[0].DATE == Date::from_civil(2016, 7, 14));
+    assert(payments[1].ACCOUNT == "DOE" && payments[1].COUNT == -2);
+    assert(payments[2].AMOUNT.mantissa == 250 && payments[2].AMOUNT.scale == 2);
+}
+
+void test_snapshot()
+{
+    Layout layout{xmlfile};
+    Reader reader(rbffile, layout, [](string s) { return s.substr(0,4); });
+
+    // keep all records and their values as read
+    vector<RecordSnapshot> snapshots;
+    vector<string> values;
+    for (auto &rec: reader)
+    {
+        snapshots.emplace_back(rec);
+        values.push_back(rec->value(';'));
+        assert(snapshots.back().raw_value() == rec->raw_value());
+    }
+    assert(snapshots.size() > 1);
+
+    // snapshots are not overwritten by the next lines
+    for (size_t i = 0; i < snapshots.size(); i++)
+    {
+        assert(snapshots[i].value(';') == values[i]);
+    }
+
+    for (auto const &snap: snapshots)
+    {
+        if (snap.name() == "COUN")
+        {
+            auto population = snap.handle("POPULATION");
+            assert(snap.get<int64_t>(population) == stoll(snap.get_field_value("POPULATION")));
+        }
+    }
+
+    // copies are independent
+    auto copy = snapshots[0];
+    snapshots.clear();
+    assert(!copy.empty());
+    assert(copy.value(';') == values[0]);
+
+    assert(RecordSnapshot().empty());
+
+    // snapshots outlive the layout
+    RecordSnapshot last;
+    {
+        Layout other{xmlfile};
+        Reader other_reader(rbffile, other, [](string s) { return s.substr(0,4); });
+        for (auto &rec: other_reader) last = RecordSnapshot(rec);
+    }
+    assert(last.value(';') == values.back());
+}
+
+void test_ring()
+{
+    Layout layout{xmlfile};
+    auto mapper = [](string s) { return s.substr(0,4); };
+
+    // expected values
+    vector<string> values;
+    {
+        Reader reader(rbffile, layout, mapper);
+        for (auto &rec: reader) values.push_back(rec->value(';'));
+    }
+
+    // producer thread blocks when the ring is full
+    {
+        Reader reader(rbffile, layout, mapper);
+        RecordRing ring(layout, 4);
+        thread producer([&]() { reader.fill(ring); });
+
+        // keep 2 slots at a time, as a lookbehind window
+        vector<string> read;
+        RecordSlot previous, slot;
+        bool has_previous = false;
+        while (ring.acquire(slot))
+        {
+            read.push_back(slot.value(';'));
+            if (has_previous)
+            {
+                assert(previous.value(';') == read[read.size()-2]);
+                ring.release(previous);
+            }
+            previous = slot;
+            has_previous = true;
+        }
+        if (has_previous) ring.release(previous);
+        producer.join();
+
+        assert(read == values);
+    }
+
+    // records are spilled when the ring is full, and still consumed in order
+    {
+        Reader reader(rbffile, layout, mapper);
+        RecordRing ring(layout, 2, RingPolicy::SPILL);
+        reader.fill(ring);
+
+        size_t i = 0;
+        RecordSlot slot;
+        while (ring.acquire(slot))
+        {
+            assert(slot.value(';') == values[i++]);
+            if (slot.name() == "COUN")
+            {
+                int64_t population;
+                auto status = slot.get(layout["COUN"]->handle("POPULATION"), population);
+                assert(status == ConvStatus::OK || status == ConvStatus::EMPTY);
+            }
+            ring.release(slot);
+        }
+        assert(i == values.size());
+    }
+
+    // a producer blocked on a full ring gives up when it's closed
+    {
+        RecordRing ring(layout, 2);
+        auto& cont = *layout["CONT"];
+        string line = "CONTEurope";
+        size_t pushed = 0;
+        bool closed = false;
+        thread producer([&]() {
+            try
+            {
+                for (int k = 0; k < 3; k++, pushed++)
+                    ring.push(cont, line.data(), line.length());
+            }
+            catch (runtime_error&)
+            {
+                closed = true;
+            }
+        });
+        this_thread::sleep_for(chrono::milliseconds(50));
+        ring.close();
+        producer.join();
+        assert(closed && pushed <= 2);
+    }
+}
+
+// counts allocations made through it
+class CountingResource : public MemoryResource
+{
+    public:
+        size_t allocated {0};
+        size_t deallocated {0};
+
+    protected:
+        void *do_allocate(size_t bytes, size_t alignment) override { allocated++; return default_resource()->allocate(bytes, alignment); }
+        void do_deallocate(void *p, size_t bytes, size_t alignment) override { deallocated++; default_resource()->deallocate(p, bytes, alignment); }
+};
+
+void test_resource()
+{
+    // arena
+    CountingResource upstream;
+    {
+        MonotonicResource arena(64, &upstream);
+        auto p1 = arena.allocate(10, 1);
+        auto p2 = arena.allocate(8, 8);
+        assert(reinterpret_cast<uintptr_t>(p2) % 8 == 0);
+        assert(static_cast<char *>(p2) >= static_cast<char *>(p1) + 10);
+        assert(upstream.allocated == 1);
+
+        // larger than a chunk
+        arena.allocate(1000);
+        assert(upstream.allocated == 2);
+
+        // the largest chunk is kept
+        arena.reset();
+        assert(upstream.deallocated == 1);
+        arena.allocate(500);
+        assert(upstream.allocated == 2);
+
+        // standard containers
+        vector<int, PolymorphicAllocator<int>> v{PolymorphicAllocator<int>(&arena)};
+        for (int i = 0; i < 100; i++) v.push_back(i);
+        assert(v[99] == 99);
+    }
+    assert(upstream.allocated == upstream.deallocated);
+
+    // layout built in an arena
+    CountingResource counter;
+    MonotonicResource layout_arena(MONOTONIC_INITIAL_SIZE, &counter);
+    Layout layout{xmlfile, RECORD_SIZE_INIT, &layout_arena};
+    assert(counter.allocated > 0);
+    assert(layout["COUN"]->resource() == &layout_arena);
+
+    // per-batch arena for snapshots
+    MonotonicResource batch_arena(MONOTONIC_INITIAL_SIZE, &counter);
+    Reader reader(rbffile, layout, [](string s) { return s.substr(0,4); });
+
+    size_t nb_records = 0;
+    vector<RecordSnapshot> batch;
+    for (auto &rec: reader)
+    {
+        nb_records++;
+        batch.emplace_back(rec, &batch_arena);
+        assert(batch.back().value(';') == rec->value(';'));
+
+        if (batch.size() == 2)
+        {
+            auto copy = batch[0];
+            assert(copy.raw_value() == batch[0].raw_value());
+            batch.clear();
+            batch_arena.reset();
+        }
+    }
+    assert(nb_records > 2);
+
+    // setting record values doesn't allocate anything from the layout arena
+    auto allocated = counter.allocated;
+    Reader other_reader(rbffile, layout, [](string s) { return s.substr(0,4); });
+    for (auto &rec: other_reader)
+    {
+        rec->value(';');
+    }
+    assert(counter.allocated == allocated);
+}
+
+void test_writer()
+{
+    // number formatting
+    char s[16];
+    assert(format_integer(s, 6, -42) == ConvStatus::OK && memcmp(s, "-00042", 6) == 0);
+    assert(format_integer(s, 6, 123456) == ConvStatus::OK && memcmp(s, "123456", 6) == 0);
+    assert(format_integer(s, 6, -123456) == ConvStatus::OUT_OF_RANGE);
+    assert(format_integer(s, 15, numeric_limits<int64_t>::min()) == ConvStatus::OUT_OF_RANGE);
+
+    Decimal d;
+    d.mantissa = -2950;
+    d.scale = 2;
+    assert(format_decimal(s, 8, 0, d) == ConvStatus::OK && memcmp(s, "-0029.50", 8) == 0);
+    assert(format_decimal(s, 6, 3, d) == ConvStatus::OK && memcmp(s, "-29500", 6) == 0);
+    assert(format_decimal(s, 4, 1, d) == ConvStatus::OK && memcmp(s, "-295", 4) == 0);
+    d.mantissa = 5;
+    assert(format_decimal(s, 5, 0, d) == ConvStatus::OK && memcmp(s, "00.05", 5) == 0);
+
+    int64_t m;
+    d.mantissa = 12345;
+    d.scale = 3;
+    assert(rescale(d, 1, m) == ConvStatus::OK && m == 123);
+    assert(rescale(d, 2, m) == ConvStatus::OK && m == 1235);
+    d.mantissa = -12345;
+    assert(rescale(d, 2, m) == ConvStatus::OK && m == -1235);
+
+    int64_t i;
+    assert(format_packed(s, 3, -1234) == ConvStatus::OK && memcmp(s, "\x01\x23\x4D", 3) == 0);
+    assert(parse_packed(s, 3, i) == ConvStatus::OK && i == -1234);
+    assert(format_packed(s, 3, 123456) == ConvStatus::OUT_OF_RANGE);
+    assert(format_zoned(s, 5, -121) == ConvStatus::OK && memcmp(s, "0012J", 5) == 0);
+    assert(parse_zoned(s, 5, i) == ConvStatus::OK && i == -121);
+
+    // date formatting
+    DateFormat fmt("DD-MMM-YY");
+    assert(fmt.print(Date::from_civil(2016, 7, 5), s) == ConvStatus::OK && memcmp(s, "05-JUL-16", 9) == 0);
+    DateFormat julian("YYYYDDD");
+    assert(julian.print(Date::from_civil(2016, 12, 31), s) == ConvStatus::OK && memcmp(s, "2016366", 7) == 0);
+
+    // doubles are formatted exactly, or not at all
+    auto decimal = FieldType("N", "decimal");
+    assert(decimal.encode(s, 9, 12.5) == ConvStatus::OK && memcmp(s, "0000012.5", 9) == 0);
+    assert(decimal.encode(s, 9, 12.1) == ConvStatus::OK && memcmp(s, "0000012.1", 9) == 0);
+    decimal.setDecimals(2);
+    assert(decimal.encode(s, 6, 12.5) == ConvStatus::OK && memcmp(s, "001250", 6) == 0);
+    assert(decimal.encode(s, 6, 12.125) == ConvStatus::OUT_OF_RANGE);
+    auto integer = FieldType("I", "integer");
+    assert(integer.encode(s, 4, 12.0) == ConvStatus::OK && memcmp(s, "0012", 4) == 0);
+    assert(integer.encode(s, 4, 12.5) == ConvStatus::OUT_OF_RANGE);
+    assert(integer.encode(s, 4, numeric_limits<double>::quiet_NaN()) == ConvStatus::OUT_OF_RANGE);
+    auto text = FieldType("A", "string");
+    assert(text.encode(s, 6, 3.25) == ConvStatus::OK && memcmp(s, "3.25  ", 6) == 0);
+    assert(text.encode(s, 3, 3.25) == ConvStatus::OUT_OF_RANGE);
+    assert(text.encode(s, 3, int64_t{-1234}) == ConvStatus::OUT_OF_RANGE);
+
+    // copy of the world data file
+    string output = "/tmp/rbf_test_writer.txt";
+    Layout layout{xmlfile};
+    {
+        Reader reader(rbffile, layout, [](string s) { return s.substr(0,4); });
+        Writer writer(output, layout, 256);
+        for (auto &rec: reader)
+        {
+            writer.write(*rec);
+        }
+        writer.write("COUN", "COUN", "Utopia", -1, string("  Nowhere "));
+        writer.close();
+    }
+
+    // values are the same once read back
+    {
+        Reader reader(rbffile, layout, [](string s) { return s.substr(0,4); });
+        vector<RecordSnapshot> expected;
+        for (auto &rec: reader) expected.emplace_back(rec);
+
+        Reader copy(output, layout, [](string s) { return s.substr(0,4); });
+        size_t n = 0;
+        for (auto &rec: copy)
+        {
+            assert(rec->raw_value().length() == rec->length());
+            if (n == expected.size())
+            {
+                assert(rec->value(';') == "COUN;Utopia;-0000000000000000001;Nowhere;");
+                assert(rec->get<int64_t>(rec->handle("POPULATION")) == -1);
+                n++;
+                continue;
+            }
+
+            auto& snap = expected[n++];
+            for (auto const &f: *rec)
+            {
+                auto data_type = f.type().data_type();
+                if (data_type == DataType::STRING)
+                {
+                    assert(f.value() == snap.get<string>(f.index()));
+                    continue;
+                }
+
+                Decimal d1, d2;
+                auto status = f.get(d1);
+                assert(status == snap.get(f.index(), d2));
+                assert(status != ConvStatus::OK || (d1.mantissa == d2.mantissa && d1.scale == d2.scale));
+            }
+        }
+        assert(n == expected.size() + 1);
+    }
+
+    // binary fields, fixed-length records
+    Layout payments{"./test/payment.xml"};
+    {
+        Writer writer(output, payments);
+        writer.setDelimiter("");
+
+        Decimal amount;
+        amount.mantissa = -101050;
+        amount.scale = 3;
+        writer.write("PAYM", "PAYM", "DOE", amount, -2, Date::from_civil(2015, 12, 31));
+        writer.write("PAYM", "PAYM", "SMITH", 1234.56, 3, "20160714");
+
+        try
+        {
+            writer.write("PAYM", "PAYM", "SMITH", 12345678.0);
+            assert(false);
+        }
+        catch (runtime_error& e) {}
     }
+    {
+        Reader reader(output, payments, [](string s) { return s.substr(0,4); });
+        reader.setRecordLength(31);
+
+        vector<string> accounts;
+        for (auto &rec: reader)
+        {
+            accounts.push_back(rec->get_field_value("ACCOUNT"));
+            auto amount = rec->get<Decimal>(rec->handle("AMOUNT"));
+            if (accounts.size() == 1)
+            {
+                assert(amount.mantissa == -10105 && amount.scale == 2);
+                assert(rec->get<int64_t>(rec->handle("COUNT")) == -2);
+                assert(rec->get<Date>(rec->handle("DATE")) == Date::from_civil(2015, 12, 31));
+            }
+            else
+            {
+                assert(amount.mantissa == 123456);
+                assert(rec->get<Date>(rec->handle("DATE")) == Date::from_civil(2016, 7, 14));
+            }
+        }
+        assert(accounts == vector<string>({"DOE", "SMITH"}));
+    }
+
+    // a record longer than the buffer, not in the layout
+    {
+        auto wide = Record("WIDE", "Wide record");
+        wide.push_back(Field("TEXT", "Wide text", FieldType("A", "string"), 300));
+        wide.setValue(string(300, 'x'));
+
+        Writer writer(output, payments, 16);
+        writer.write("PAYM", "PAYM", "DOE");
+        writer.write(wide);
+        writer.write(wide, "y");
+        writer.close();
+
+        ifstream in(output);
+        string line;
+        assert(getline(in, line) && line.length() == 31 && line.substr(0, 7) == "PAYMDOE");
+        assert(getline(in, line) && line == string(300, 'x'));
+        assert(getline(in, line) && line == "y" + string(299, ' '));
+        assert(!getline(in, line));
+    }
+
+    remove(output.c_str());
+}
+
+void test_mappedwriter()
+{
+    string output = "/tmp/rbf_test_mappedwriter.txt";
+    Layout payments{"./test/payment.xml"};
+    size_t nb_records = 1000;
+
+    {
+        MappedWriter writer(output, payments, nb_records, "");
+        assert(writer.size() == nb_records);
+
+        writer.parallel_for(4, [&](size_t first, size_t last) {
+            for (auto i = first; i < last; i++)
+            {
+                writer.write(i, "PAYM", "PAYM", "ACC" + to_string(i), 1.5, static_cast<int>(i % 100));
+            }
+        });
+
+        try
+        {
+            writer.write(nb_records, "PAYM", "PAYM");
+            assert(false);
+        }
+        catch (runtime_error& e) {}
+
+        // first exception of a thread is rethrown
+        try
+        {
+            writer.parallel_for(2, [&](size_t first, size_t) {
+                if (first != 0) writer.write(first, "PAYM", "PAYM", "X", 12345678.0);
+            });
+            assert(false);
+        }
+        catch (runtime_error& e) {}
+        writer.write(nb_records / 2, "PAYM", "PAYM", "ACC" + to_string(nb_records / 2), 1.5, 0);
+
+        writer.close();
+    }
+    {
+        Reader reader(output, payments, [](string s) { return s.substr(0,4); });
+        reader.setRecordLength(31);
+
+        size_t n = 0;
+        for (auto &rec: reader)
+        {
+            assert(rec->get_field_value("ACCOUNT") == "ACC" + to_string(n));
+            assert(rec->get<int64_t>(rec->handle("COUNT")) == static_cast<int64_t>(n % 100));
+            n++;
+        }
+        assert(n == nb_records);
+    }
+
+    // variable-length records are blank-padded to the longest one
+    Layout layout{xmlfile};
+    {
+        MappedWriter writer(output, layout, 2);
+        writer.write(0, "CONT", "CONT", "Europe");
+        writer.write(1, "COUN", "COUN", "France", 66000000, "Paris");
+    }
+    {
+        size_t longest = 0;
+        for (auto const &kv: layout) longest = max(longest, kv.second->length());
+
+        ifstream in(output);
+        string line;
+        size_t n = 0;
+        while (getline(in, line))
+        {
+            assert(line.length() == longest);
+            assert(line.substr(0, 4) == (n == 0 ? "CONT" : "COUN"));
+            n++;
+        }
+        assert(n == 2);
+    }
+
+    remove(output.c_str());
+}
+
+void test_copy_if()
+{
+    string output = "/tmp/rbf_test_copy_if.txt";
+    Layout layout{xmlfile};
+
+    auto content = [](const string& file) {
+        ifstream in(file, ios::binary);
+        return string((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+    };
+
+    // runs of lines separated by dropped ones
+    {
+        Reader reader(rbffile, layout, [](string s) { return s.substr(0,4); });
+        auto n = reader.copy_if(output, [](const string& name) { return name == "COUN"; });
+
+        // expected lines, read the usual way
+        ifstream in(rbffile, ios::binary);
+        string line, kept;
+        size_t nb_lines = 0;
+        while (getline(in, line))
+        {
+            if (line.substr(0, 4) == "COUN")
+            {
+                kept += line + "\n";
+                nb_lines++;
+            }
+        }
+        assert(n == nb_lines);
+        assert(content(output) == kept);
+    }
+    {
+        Reader reader(rbffile, layout, [](string s) { return s.substr(0,4); });
+        assert(reader.copy_if(output, [](const string&) { return false; }) == 0);
+        assert(content(output).empty());
+
+        Reader all(rbffile, layout, [](string s) { return s.substr(0,4); });
+        all.copy_if(output, [](const string&) { return true; });
+        assert(content(output) == content(rbffile));
+    }
+
+    // fixed-length EBCDIC records, mapped once transcoded
+    {
+        Layout payments{"./test/payment.xml"};
+        Reader reader("./test/payment.dat", payments, [](string s) { return s.substr(0,4); });
+        reader.setRecordLength(31);
+        reader.setCodePage(code_page("IBM-037"), true);
+
+        size_t i = 0;
+        auto n = reader.copy_if(output, [&i](const string& name) { assert(name == "PAYM"); return i++ != 1; });
+        assert(n == 2);
+
+        auto input = content("./test/payment.dat");
+        assert(content(output) == input.substr(0, 31) + input.substr(62));
+    }
+
+    remove(output.c_str());
+}
+
+void test_reformatter()
+{
+    Layout v1{xmlfile};
+    Layout v2{"./test/world_data_v2.xml"};
+
+    Reformatter reformatter(v1, v2);
+    reformatter.setRecordMapping("COUN", "CTRY");
+    reformatter.setFieldMapping("CTRY", "COUNTRY", "NAME");
+    reformatter.setFieldValue("CTRY", "ID", "CTRY");
+
+    // resized fields
+    auto& plan = reformatter.plan("COUN");
+    assert(plan.target_name == "CTRY");
+    assert(plan.image.length() == v2["CTRY"]->length());
+    assert(plan.steps.size() == 3);
+    assert(plan.steps[0].justify == Justify::LEFT && plan.steps[0].truncate);
+    assert(plan.steps[2].name == "POPULATION" && plan.steps[2].justify == Justify::RIGHT && !plan.steps[2].truncate);
+
+    // unchanged fields are copied at once
+    auto& cont = reformatter.plan("CONT");
+    assert(cont.steps.size() == 2);
+    assert(cont.steps[0].src_length == 19 && cont.steps[0].dst_length == 19);
+
+    char out[100];
+    string line = "COUNFrance                        66000000            Paris";
+    Reformatter::apply(plan, line.data(), line.length(), out);
+    assert(string(out, plan.image.length()) == "CTRY   Paris     France                                      66000000");
+
+    line = "COUNFrance                        66000000000000000000Paris";
+    try
+    {
+        Reformatter::apply(plan, line.data(), line.length(), out);
+        assert(false);
+    }
+    catch (runtime_error& e) {}
+
+    // numbers lose their leading zeros, and keep their sign and padding
+    line = "COUNFrance                        -0000000000066000000Paris";
+    Reformatter::apply(plan, line.data(), line.length(), out);
+    assert(string(out, plan.image.length()) == "CTRY   Paris     France                                  -00066000000");
+    line = "COUNFrance                                -00066000000Paris";
+    Reformatter::apply(plan, line.data(), line.length(), out);
+    assert(string(out, plan.image.length()) == "CTRY   Paris     France                                     -66000000");
+
+    // zero-padded numbers written by Writer
+    {
+        string written = "/tmp/rbf_test_reformatter_written.txt", reformatted = "/tmp/rbf_test_reformatter_reformatted.txt";
+        Writer writer(written, v1);
+        writer.write("COUN", "COUN", "France", 66000000, string("Paris"));
+        writer.write("COUN", "COUN", "Utopia", -1, string("Nowhere"));
+        writer.write("COUN", "COUN", "Atlantis", 0, string("Poseidonia"));
+        writer.close();
+
+        assert(reformatter.run(written, reformatted, [](string s) { return s.substr(0,4); }) == 3);
+        ifstream in(reformatted);
+        string s;
+        assert(getline(in, s) && s == "CTRY   Paris     France                                  000066000000");
+        assert(getline(in, s) && s == "CTRY   Nowhere   Utopia                                  -00000000001");
+        assert(getline(in, s) && s == "CTRY   PoseidoniaAtlantis                                000000000000");
+        assert(!getline(in, s));
+
+        remove(written.c_str());
+        remove(reformatted.c_str());
+    }
+
+    // several chunks, reformatted in parallel
+    string input = "/tmp/rbf_test_reformatter_in.txt";
+    string output = "/tmp/rbf_test_reformatter_out.txt";
+    string expected;
+    size_t nb_lines = 0;
+    {
+        ifstream in(rbffile, ios::binary);
+        string content((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+
+        Reader reader(rbffile, v1, [](string s) { return s.substr(0,4); });
+        string lines;
+        size_t n = 0;
+        for (auto &rec: reader)
+        {
+            // raw values: text is copied byte for byte
+            auto raw = [&rec](const string& name, size_t len) {
+                auto s = (*rec)[rec->handle(name)].raw_value().substr(0, len);
+                s.resize(len, ' ');
+                return s;
+            };
+            if (rec->name() == "CONT")
+            {
+                lines += raw("ID", 4) + raw("NAME", 15) + raw("CITY", 20) + "\n";
+            }
+            else
+            {
+                auto population = rec->get_field_value("POPULATION");
+                lines += "CTRY   " + raw("CAPITAL", 10) + raw("NAME", 40) + string(12 - population.length(), ' ') + population + "\n";
+            }
+            n++;
+        }
+
+        ofstream out(input, ios::binary);
+        for (size_t i = 0; i < (CHUNK_SIZE * 2) / content.length() + 1; i++)
+        {
+            out << content;
+            expected += lines;
+            nb_lines += n;
+        }
+    }
+
+    auto n = reformatter.run(input, output, [](string s) { return s.substr(0,4); }, 3);
+    assert(n == nb_lines);
+    {
+        ifstream in(output, ios::binary);
+        string content((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+        assert(content == expected);
+    }
+
+    // records without target record
+    Reformatter partial(v1, v2);
+    try
+    {
+        partial.run(input, output, [](string s) { return s.substr(0,4); });
+        assert(false);
+    }
+    catch (runtime_error& e) {}
+
+    remove(input.c_str());
+    remove(output.c_str());
+}
+
+
+void test_csv()
+{
+    Layout layout{xmlfile};
+    string output = "/tmp/rbf_test_csv.csv";
+
+    auto content = [](const string& file) {
+        ifstream in(file, ios::binary);
+        return string((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+    };
+
+    // column selection, skipped records
+    CsvExporter csv(layout);
+    csv.setColumns("COUN", {"NAME", "POPULATION", "CAPITAL"});
+    csv.setColumns("CONT", {});
+    csv.setHeader("COUN");
+    auto n = csv.run(rbffile, output, [](string s) { return s.substr(0,4); }, 2);
+
+    string expected = "NAME,POPULATION,CAPITAL\n";
+    size_t nb_lines = 0;
+    Reader reader(rbffile, layout, [](string s) { return s.substr(0,4); });
+    for (auto &rec: reader)
+    {
+        if (rec->name() != "COUN")
+            continue;
+
+        // values holding a separator are quoted
+        auto name = rec->get_field_value("NAME");
+        if (name.find(',') != string::npos)
+            name = "\"" + name + "\"";
+        expected += name + "," + rec->get_field_value("POPULATION") + "," + rec->get_field_value("CAPITAL") + "\n";
+        nb_lines++;
+    }
+    assert(n == nb_lines);
+    assert(content(output) == expected);
+
+    try
+    {
+        csv.setColumns("COUN", {"FOO"});
+        csv.compile();
+        assert(false);
+    }
+    catch (runtime_error& e) {}
+
+    // quoting rules
+    CsvExporter quoted(layout);
+    quoted.setSeparator(';');
+    string line = "COUN";
+    auto field = [&line](string value, size_t length) { value.resize(length, ' '); line += value; };
+    field("  Hello \"World\"; !", 30);
+    field("000042", 20);
+    field("Paris", 20);
+
+    string out;
+    quoted.format(quoted.plan("COUN"), line.data(), line.length(), out);
+    assert(out == "COUN;\"Hello \"\"World\"\"; !\";000042;Paris\n");
+
+    quoted.setQuoting(Quoting::ALL);
+    out.clear();
+    quoted.format(quoted.plan("COUN"), line.data(), 8, out);
+    assert(out == "\"COUN\";\"He\";\"\";\"\"\n");
+
+    // binary numbers are decoded, text is transcoded
+    Layout payments{"./test/payment.xml"};
+    CsvExporter ebcdic(payments);
+    ebcdic.setRecordLength(31);
+    ebcdic.setCodePage(CodePage::IBM037);
+    assert(ebcdic.run("./test/payment.dat", output, [](string s) { return s.substr(0,4); }) == 3);
+
+    string lines;
+    Reader binary("./test/payment.dat", payments, [](string s) { return s.substr(0,4); });
+    binary.setRecordLength(31);
+    binary.setCodePage(code_page("IBM-037"), true);
+    for (auto &rec: binary)
+    {
+        char text[DECIMAL_TEXT_LENGTH];
+        auto amount = rec->get<Decimal>(rec->handle("AMOUNT"));
+        auto count = rec->get<Decimal>(rec->handle("COUNT"));
+        lines += rec->get_field_value("ID") + "," + rec->get_field_value("ACCOUNT") + "," + string(text, print_decimal(text, amount)) + "," +
+            string(text, print_decimal(text, count)) + "," + rec->get_field_value("DATE") + "\n";
+    }
+    assert(content(output) == lines);
+
+    remove(output.c_str());
+}
+
+void test_json()
+{
+    // escaping, 8 bytes at a time or not
+    string out;
+    append_json_string(out, "plain text without escapes", 26);
+    assert(out == "plain text without escapes");
+
+    out.clear();
+    string special = string("0123456789\"abc\\def\n\t\x01", 21);
+    append_json_string(out, special.data(), special.length());
+    assert(out == "0123456789\\\"abc\\\\def\\n\\t\\u0001");
+
+    out.clear();
+    append_json_string(out, "caf\xE9 cr\xE8" "me br\xFB" "l\xE9" "e", 17, true);
+    assert(out == "caf\xC3\xA9 cr\xC3\xA8" "me br\xC3\xBB" "l\xC3\xA9" "e");
+
+    out.clear();
+    append_json_string(out, "R\xC3\xA9union", 8);
+    assert(out == "R\xC3\xA9union");
+
+    // bytes which are not UTF-8, without any code page
+    out.clear();
+    append_json_string(out, "caf\xE9 na\xEFve \xC0\xAF \xED\xA0\x80 \xE2\x82\xAC \xF0\x9F\x98\x80 \xC3", 28);
+    assert(out == "caf\\u00e9 na\\u00efve \\u00c0\\u00af \\u00ed\\u00a0\\u0080 \xE2\x82\xAC \xF0\x9F\x98\x80 \\u00c3");
+
+    // typed values
+    Layout layout{xmlfile};
+    JsonExporter json(layout);
+    json.setRecordKey("record");
+    json.setColumns("CONT", {"NAME", "AREA", "DENSITY"});
+
+    string output = "/tmp/rbf_test_json.json";
+    auto n = json.run(rbffile, output, [](string s) { return s.substr(0,4); }, 2);
+
+    ifstream in(output);
+    string line;
+    vector<string> lines;
+    while (getline(in, line)) lines.push_back(line);
+    assert(n == lines.size());
+    assert(lines[0] == "{\"record\":\"CONT\",\"NAME\":\"Asia\",\"AREA\":43820000,\"DENSITY\":29.5}");
+    assert(lines[1] == "{\"record\":\"COUN\",\"ID\":\"COUN\",\"NAME\":\"China\",\"POPULATION\":1338100000,\"CAPITAL\":\"Beijing\"}");
+
+    // blank numbers are null, bad ones throw
+    out.clear();
+    string coun = "COUNNowhere";
+    coun.resize(layout["COUN"]->length(), ' ');
+    JsonExporter plain(layout);
+    plain.format(plain.plan("COUN"), coun.data(), coun.length(), out);
+    assert(out == "{\"ID\":\"COUN\",\"NAME\":\"Nowhere\",\"POPULATION\":null,\"CAPITAL\":\"\"}\n");
+
+    coun.replace(34, 3, "1x2");
+    try
+    {
+        plain.format(plain.plan("COUN"), coun.data(), coun.length(), out);
+        assert(false);
+    }
+    catch (runtime_error& e) {}
+
+    // binary numbers and dates
+    Layout payments{"./test/payment.xml"};
+    JsonExporter ebcdic(payments);
+    ebcdic.setRecordLength(31);
+    ebcdic.setCodePage(CodePage::IBM037);
+    ebcdic.setColumns("PAYM", {"ACCOUNT", "AMOUNT", "COUNT", "DATE"});
+    assert(ebcdic.run("./test/payment.dat", output, [](string s) { return s.substr(0,4); }) == 3);
+
+    ifstream pin(output);
+    getline(pin, line);
+    assert(line == "{\"ACCOUNT\":\"SMITH\",\"AMOUNT\":1234.56,\"COUNT\":3,\"DATE\":\"2016-07-14\"}");
+    getline(pin, line);
+    assert(line == "{\"ACCOUNT\":\"DOE\",\"AMOUNT\":-10.10,\"COUNT\":-2,\"DATE\":\"2015-12-31\"}");
+
+    remove(output.c_str());
+}
+
+void test_arrow()
+{
+    auto mapper = [](string s) { return s.substr(0,4); };
+    string prefix = "/tmp/rbf_test_arrow_";
+
+    // utf8 values: without any code page, bytes which are not UTF-8 are read as ISO-8859-1
+    string text, mixed = "R\xC3\xA9union caf\xE9 \xED\xA0\x80 \xF0\x9F\x98\x80 and more ascii \xC3";
+    append_utf8(text, mixed.data(), mixed.length());
+    assert(text == "R\xC3\xA9union caf\xC3\xA9 \xC3\xAD\xC2\xA0\xC2\x80 \xF0\x9F\x98\x80 and more ascii \xC3\x83");
+    text.clear();
+    append_utf8(text, "caf\xC3\xA9", 5, true);
+    assert(text == "caf\xC3\x83\xC2\xA9");
+
+    Layout payments{"./test/payment.xml"};
+    ArrowExporter arrow(payments);
+    arrow.setRecordLength(31);
+    arrow.setCodePage(CodePage::IBM037);
+    arrow.setBatchSize(2);
+    arrow.setColumns("PAYM", {"ACCOUNT", "AMOUNT", "DATE"});
+    assert(arrow.run("./test/payment.dat", prefix, mapper) == 3);
+
+    ifstream in(prefix + "PAYM.arrows", ios::binary);
+    string s((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+
+    // the stream starts with the schema
+    auto schema = arrow.schema("PAYM");
+    assert(s.compare(0, schema.size(), schema) == 0);
+    assert(schema.find("ACCOUNT") != string::npos);
+
+    // flatbuffers reading
+    auto u32 = [&](size_t pos) { uint32_t v; memcpy(&v, &s[pos], sizeof(v)); return v; };
+    auto i64 = [&](size_t pos) { int64_t v; memcpy(&v, &s[pos], sizeof(v)); return v; };
+    auto deref = [&](size_t pos) { return pos + u32(pos); };
+    auto field = [&](size_t table, size_t id) -> size_t {
+        auto vtable = table - static_cast<int32_t>(u32(table));
+        uint16_t size, offset;
+        memcpy(&size, &s[vtable], sizeof(size));
+        if (4 + 2 * id >= size)
+            return 0;
+        memcpy(&offset, &s[vtable + 4 + 2 * id], sizeof(offset));
+        return offset == 0 ? 0 : table + offset;
+    };
+
+    // record batches of 2 lines, then the end-of-stream marker
+    vector<string> accounts;
+    vector<int64_t> amounts;
+    vector<int32_t> dates;
+    size_t nb_batches = 0;
+    size_t pos = schema.size();
+    while (u32(pos + 4) != 0)
+    {
+        assert(u32(pos) == 0xFFFFFFFF);
+        auto message = deref(pos + 8);
+        auto body = pos + 8 + u32(pos + 4);
+        assert(s[field(message, 1)] == 3);
+
+        // buffers: ACCOUNT validity, offsets and data, AMOUNT validity and values, DATE validity and values
+        auto batch = deref(field(message, 2));
+        auto buffers = deref(field(batch, 2));
+        auto buffer = [&](size_t i) { return body + i64(buffers + 4 + 16 * i); };
+        for (int64_t row = 0; row < i64(field(batch, 0)); row++)
+        {
+            auto offset = buffer(1) + 4 * row;
+            accounts.push_back(s.substr(buffer(2) + u32(offset), u32(offset + 4) - u32(offset)));
+            amounts.push_back(i64(buffer(4) + 16 * row));
+            dates.push_back(static_cast<int32_t>(u32(buffer(6) + 4 * row)));
+        }
+
+        pos = body + i64(field(message, 3));
+        nb_batches++;
+    }
+    assert(pos + 8 == s.size());
+    assert(nb_batches == 2);
+    assert(accounts == vector<string>({"SMITH", "DOE", "O'HARA"}));
+    assert(amounts == vector<int64_t>({123456, -1010, 250}));
+    assert(dates[1] == Date::from_civil(2015, 12, 31).days);
+
+    // file format: the footer locates the batches
+    Layout layout{xmlfile};
+    ArrowExporter file(layout);
+    file.setFileFormat(true);
+    file.setColumns("CONT", {});
+    file.run(rbffile, prefix, mapper);
+    assert(!ifstream(prefix + "CONT.arrow"));
+
+    ifstream fin(prefix + "COUN.arrow", ios::binary);
+    s.assign(istreambuf_iterator<char>(fin), istreambuf_iterator<char>());
+    assert(s.compare(0, 8, string("ARROW1\0\0", 8)) == 0);
+    assert(s.compare(s.size() - 6, 6, "ARROW1") == 0);
+
+    auto footer = deref(s.size() - 10 - u32(s.size() - 10));
+    auto blocks = deref(field(footer, 3));
+    assert(u32(blocks) == 1);
+    assert(i64(blocks + 4) > 8 && u32(i64(blocks + 4)) == 0xFFFFFFFF);
+
+    remove((prefix + "PAYM.arrows").c_str());
+    remove((prefix + "COUN.arrow").c_str());
+}
+
+void test_columnar()
+{
+    auto mapper = [](string s) { return s.substr(0,4); };
+    string prefix = "/tmp/rbf_test_columnar_";
+
+    // conversion from a reader, in several blocks
+    Layout layout{xmlfile};
+    vector<string> names;
+    int64_t total = 0;
+    Reader reader(rbffile, layout, mapper);
+    for (auto& rec: reader)
+    {
+        if (rec->name() != "COUN")
+            continue;
+        names.push_back(rec->get_field_value("NAME"));
+        total += rec->get<int64_t>(rec->handle("POPULATION"));
+    }
+
+    Reader source(rbffile, layout, mapper);
+    write_columnar(source, prefix, 50);
+
+    ColumnarFile countries(prefix + "COUN.rbc");
+    assert(countries.record_name() == "COUN");
+    assert(countries.rows() == names.size());
+    assert(countries.nb_blocks() == (names.size() + 49) / 50);
+    assert(countries.column_name(2) == "POPULATION" && countries.column(2).type == ColumnType::INT64);
+
+    vector<string> columnar_names;
+    countries.for_each<string>("NAME", [&](size_t row, const string& name) {
+        assert(row == columnar_names.size());
+        columnar_names.push_back(name);
+    });
+    assert(columnar_names == names);
+
+    int64_t columnar_total = 0, highest = 0;
+    countries.for_each<int64_t>("POPULATION", [&](size_t, int64_t population) { columnar_total += population; });
+    for (size_t block = 0; block < countries.nb_blocks(); block++)
+    {
+        highest = max(highest, countries.chunk(block, 2).max);
+    }
+    assert(columnar_total == total);
+    assert(highest == 1338100000);
+
+    // the same ID everywhere
+    assert(countries.chunk(0, 0).encoding == ColumnEncoding::DICTIONARY && countries.chunk(0, 0).count == 1);
+    string buffer;
+    assert(string(countries.byte_values(0, 0, buffer), 8) == "COUNCOUN");
+
+    // RLE, DELTA and nulls
+    auto& rec = *layout["COUN"];
+    {
+        ColumnarWriter writer(prefix + "encodings.rbc", rec, 100);
+        for (int i = 0; i < 150; i++)
+        {
+            rec[0].setValue("COUN");
+            rec[1].setValue(i < 100 ? "Same" : "Other");
+            rec[2].setValue(i % 10 == 0 ? "" : to_string(i < 100 ? 1000000 + 3 * i : 42));
+            rec[3].setValue(to_string(i % 7));
+            writer.append(rec);
+        }
+    }
+
+    ColumnarFile encodings(prefix + "encodings.rbc");
+    assert(encodings.rows() == 150 && encodings.nb_blocks() == 2);
+    assert(encodings.chunk(0, 2).encoding == ColumnEncoding::DELTA && encodings.chunk(0, 2).width == 1);
+    assert(encodings.chunk(0, 2).null_count == 10 && encodings.chunk(1, 2).rows == 50);
+    assert(encodings.chunk(1, 2).encoding == ColumnEncoding::RLE && encodings.chunk(1, 2).count == 1);
+    assert(encodings.chunk(0, 1).encoding == ColumnEncoding::DICTIONARY);
+
+    vector<int64_t> values;
+    auto populations = encodings.int64_values(0, 2, values);
+    assert(populations[1] == 1000003 && populations[99] == 1000297);
+    assert(encodings.nulls(0, 2)[0] == 1 && encodings.nulls(0, 3) == nullptr);
+
+    size_t nb_values = 0;
+    encodings.for_each<int64_t>("POPULATION", [&](size_t row, int64_t population) {
+        assert(row % 10 != 0 && population == (row < 100 ? 1000000 + 3 * static_cast<int64_t>(row) : 42));
+        nb_values++;
+    });
+    assert(nb_values == 135);
+
+    try
+    {
+        encodings.int64_values(0, 1, values);
+        assert(false);
+    }
+    catch (runtime_error& e) {}
+
+    // binary fields: fixed-point values and dates
+    Layout payments{"./test/payment.xml"};
+    Reader binary("./test/payment.dat", payments, mapper);
+    binary.setRecordLength(31);
+    binary.setCodePage(CodePage::IBM037, true);
+    assert(write_columnar(binary, prefix) == 3);
+
+    ColumnarFile paym(prefix + "PAYM.rbc");
+    assert(paym.chunk(0, paym.column_index("AMOUNT")).scale == 2);
+
+    vector<Decimal> amounts;
+    paym.for_each<Decimal>("AMOUNT", [&](size_t, const Decimal& amount) { amounts.push_back(amount); });
+    assert(amounts.size() == 3 && amounts[1].mantissa == -1010 && amounts[1].scale == 2);
+
+    vector<Date> dates;
+    paym.for_each<Date>("DATE", [&](size_t, const Date& date) { dates.push_back(date); });
+    assert(dates[2] == Date::from_civil(1999, 12, 1));
+
+    vector<string> accounts;
+    paym.for_each<string>("ACCOUNT", [&](size_t, const string& account) { accounts.push_back(account); });
+    assert(accounts[2] == "O'HARA");
+
+    try
+    {
+        ColumnarFile bad(rbffile);
+        assert(false);
+    }
+    catch (runtime_error& e) {}
+
+    for (auto name: {"COUN", "CONT", "encodings", "PAYM"})
+    {
+        remove((prefix + name + ".rbc").c_str());
+    }
+}
+
+void test_cache()
+{
+    string directory = "/tmp/rbf_test_cache";
+    ParseCache(directory, 0).evict();
+
+    Layout layout{xmlfile};
+    size_t calls = 0;
+    auto mapper = [&](string s) { calls++; return s.substr(0,4); };
+
+    auto read_world = [&](ParseCache& cache, const string& tag) {
+        Reader reader(rbffile, layout, mapper);
+        reader.setCache(&cache, tag);
+        vector<string> lines;
+        for (auto& rec: reader)
+        {
+            lines.push_back(rec->name() + ":" + rec->value(';'));
+        }
+        return lines;
+    };
+
+    Layout payments{"./test/payment.xml"};
+    auto read_payments = [&](ParseCache& cache) {
+        Reader reader("./test/payment.dat", payments, mapper);
+        reader.setRecordLength(31);
+        reader.setCodePage(CodePage::IBM037, true);
+        reader.setCache(&cache, "t1");
+        vector<int64_t> amounts;
+        for (auto& rec: reader)
+        {
+            assert(rec->get_field_value("ID") == "PAYM" && !rec->get_field_value("ACCOUNT").empty());
+            assert(rec->get_field_value("ACCOUNT").back() != ' ');
+            amounts.push_back(rec->get<Decimal>(rec->handle("AMOUNT")).mantissa);
+        }
+        return amounts;
+    };
+
+    // a miss populates the cache, a hit doesn't map lines
+    ParseCache cache(directory);
+    auto lines = read_world(cache, "t1");
+    auto world_size = cache.size();
+    assert(calls == lines.size() && world_size > 0);
+
+    calls = 0;
+    assert(read_world(cache, "t1") == lines);
+    assert(calls == 0);
+
+    // with only text fields transcoded
+    assert(read_payments(cache) == vector<int64_t>({123456, -1010, 250}));
+    auto payments_size = cache.size() - world_size;
+    calls = 0;
+    assert(read_payments(cache) == vector<int64_t>({123456, -1010, 250}));
+    assert(calls == 0);
+
+    // an incomplete read doesn't populate the cache
+    {
+        Reader reader(rbffile, layout, mapper);
+        reader.setCache(&cache, "t2");
+        auto it = reader.begin();
+        assert((*it)->name() == "CONT");
+    }
+    assert(cache.size() == world_size + payments_size);
+
+    // files are written under unique names, so writers of the same file don't collide
+    {
+        auto first = cache.populate("same key");
+        auto second = cache.populate("same key");
+        first->add("CONT", "CONTAsia", vector<uint32_t>());
+        second->add("CONT", "CONTEurope", vector<uint32_t>({0, 4}));
+
+        // files being written aren't evicted
+        ParseCache(directory, 0).evict();
+        first->commit();
+        second->commit();
+
+        auto reader = cache.lookup("same key");
+        const string *name;
+        const char *line;
+        size_t length;
+        vector<uint32_t> bounds;
+        assert(reader->next(name, line, length, bounds) && string(line, length) == "CONTEurope");
+        assert(bounds == vector<uint32_t>({0, 4}) && !reader->next(name, line, length, bounds));
+        remove(cache.file_name("same key").c_str());
+    }
+
+    // a file larger than the limit is dropped while written
+    {
+        ParseCache small(directory + "_small", world_size - 1);
+        calls = 0;
+        assert(read_world(small, "t1") == lines && calls == lines.size());
+        assert(small.size() == 0 && remove(small.directory().c_str()) == 0);
+    }
+
+    // the least recently used file is evicted first
+    ParseCache(directory, 0).evict();
+    ParseCache lru(directory, 2 * world_size + payments_size - 1);
+    read_world(lru, "t1");
+    this_thread::sleep_for(chrono::milliseconds(10));
+    read_payments(lru);
+    this_thread::sleep_for(chrono::milliseconds(10));
+    read_world(lru, "t1");
+    this_thread::sleep_for(chrono::milliseconds(10));
+    read_world(lru, "t2");
+    assert(lru.size() == 2 * world_size);
+
+    calls = 0;
+    read_world(lru, "t1");
+    assert(calls == 0);
+    read_payments(lru);
+    assert(calls == 3);
+
+    // temporary files left by a crashed writer are evicted
+    string stale = directory + "/0123456789abcdef.Ab12Cd" + PARSE_CACHE_TEMP_EXTENSION;
+    string fresh = directory + "/0123456789abcdef.Ef34Gh" + PARSE_CACHE_TEMP_EXTENSION;
+    ofstream(stale) << "partial";
+    ofstream(fresh) << "partial";
+    struct timespec old_times[2] = { {time(nullptr) - PARSE_CACHE_TEMP_AGE - 60, 0}, {time(nullptr) - PARSE_CACHE_TEMP_AGE - 60, 0} };
+    assert(::utimensat(AT_FDCWD, stale.c_str(), old_times, 0) == 0);
+    ParseCache(directory, 0).evict();
+    assert(!ifstream(stale) && ifstream(fresh) && lru.size() == 7);
+
+    remove(fresh.c_str());
+    remove(directory.c_str());
+}
+
+void test_compress()
+{
+    Layout layout{xmlfile};
+    auto mapper = [](string s) { return s.substr(0,4); };
+
+    auto read_lines = [&](const string& file_name, size_t first_record) {
+        Reader reader(file_name, layout, mapper);
+        reader.setFirstRecord(first_record);
+        reader.setThreads(2);
+        vector<string> lines;
+        for (auto& rec: reader)
+        {
+            lines.push_back(rec->name() + ":" + rec->get_field_value("NAME"));
+        }
+        return lines;
+    };
+    auto lines = read_lines(rbffile, 0);
+
+    // small blocks, to get many of them
+    string compressed = "/tmp/rbf_test_world.rbz";
+    for (auto codec: {Codec::NONE, default_codec()})
+    {
+        assert(compress_file(rbffile, compressed, 0, '\n', codec, 100, 2) == lines.size());
+
+        BlockFile blocks(compressed);
+        assert(blocks.nb_records() == lines.size() && blocks.nb_blocks() > 2 && blocks.codec() == codec);
+        assert(blocks.find_block(0) == 0 && blocks.find_block(lines.size() - 1) == blocks.nb_blocks() - 1);
+
+        // whole file, then from any record
+        assert(read_lines(compressed, 0) == lines);
+        for (size_t first: {size_t(1), blocks.block(1).first_record, blocks.block(2).first_record + 1, lines.size() - 1, lines.size()})
+        {
+            assert(read_lines(compressed, first) == vector<string>(lines.begin() + first, lines.end()));
+        }
+    }
+
+    // same when seeking into a plain file
+    assert(read_lines(rbffile, 5) == vector<string>(lines.begin() + 5, lines.end()));
+
+    // fixed-length EBCDIC records
+    compress_file("./test/payment.dat", compressed, 31, '\n', default_codec(), 62);
+    assert(BlockFile(compressed).nb_blocks() == 2);
+
+    Layout payments{"./test/payment.xml"};
+    Reader reader(compressed, payments, mapper);
+    reader.setCodePage(CodePage::IBM037, true);
+    reader.setFirstRecord(1);
+    vector<int64_t> amounts;
+    for (auto& rec: reader)
+    {
+        amounts.push_back(rec->get<Decimal>(rec->handle("AMOUNT")).mantissa);
+    }
+    assert(amounts == vector<int64_t>({-1010, 250}));
+
+    try
+    {
+        BlockFile("./test/payment.dat");
+        assert(false);
+    }
+    catch (runtime_error&)
+    {
+    }
+
+    remove(compressed.c_str());
+}
+
+// a gzip member, from the raw deflate data of a zlib stream
+string gzip_member(const string& data)
+{
+    uint32_t crc = 0xFFFFFFFF;
+    for (unsigned char c: data)
+    {
+        crc ^= c;
+        for (int k = 0; k < 8; k++)
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+    }
+    crc = ~crc;
+    uint32_t size = static_cast<uint32_t>(data.size());
+
+    string zlib;
+    compress_block(Codec::DEFLATE, data.data(), data.size(), zlib);
+
+    string member("\x1f\x8b\x08\0\0\0\0\0\0\xff", 10);
+    member.append(zlib, 2, zlib.size() - 6);
+    member.append(reinterpret_cast<const char *>(&crc), 4);
+    member.append(reinterpret_cast<const char *>(&size), 4);
+    return member;
+}
+
+// a zstd frame without content size, as written by a streaming compressor, made of raw blocks
+string zstd_stream_frame(const string& data)
+{
+    const size_t block_size = 1 << 17;
+
+    // no content size nor checksum, a 128 KiB window
+    string frame("\x28\xb5\x2f\xfd\x00\x38", 6);
+    for (size_t pos = 0; pos < data.size() || pos == 0; pos += block_size)
+    {
+        auto size = min(block_size, data.size() - pos);
+        uint32_t header = static_cast<uint32_t>(size << 3) | (pos + size == data.size() ? 1 : 0);
+        frame.append(reinterpret_cast<const char *>(&header), 3);
+        frame.append(data, pos, size);
+    }
+    return frame;
+}
+
+// a zstd frame with its content size
+string zstd_frame(const string& data)
+{
+    string frame;
+    compress_block(Codec::ZSTD, data.data(), data.size(), frame);
+    return frame;
+}
+
+void test_decompress()
+{
+    // buffers fail in the middle of lines
+    class Pieces: public ByteSource
+    {
+        private:
+            string _data;
+            size_t _pos {0};
+        public:
+            explicit Pieces(const string& data): _data{data} {}
+            bool next(string& buffer) override
+            {
+                if (_pos == _data.size())
+                    throw runtime_error("no more pieces");
+                buffer = _data.substr(_pos, 7);
+                _pos += buffer.size();
+                return true;
+            }
+    };
+
+    PipelinedSource pipeline(unique_ptr<ByteSource>(new Pieces("abcdefghijklmnopqrstuvwxyz")), 2);
+    string buffer, all;
+    try
+    {
+        while (pipeline.next(buffer))
+            all += buffer;
+        assert(false);
+    }
+    catch (runtime_error& e)
+    {
+        assert(string(e.what()) == "no more pieces");
+    }
+    assert(all == "abcdefghijklmnopqrstuvwxyz");
+
+    assert(input_format(rbffile) == InputFormat::PLAIN);
+    assert(input_format("/tmp/rbf_no_such_file") == InputFormat::PLAIN);
+    assert(open_source(rbffile) == nullptr);
+
+    if (!codec_available(Codec::DEFLATE) && !codec_available(Codec::ZSTD))
+        return;
+
+    // larger than a stream buffer
+    ifstream in(rbffile, ios::binary);
+    string world((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+    string data;
+    while (data.size() < 2 * STREAM_BUFFER_SIZE)
+        data += world;
+
+    Layout layout{xmlfile};
+    auto read_lines = [&](const string& file_name, size_t first_record) {
+        Reader reader(file_name, layout, [](string s) { return s.substr(0,4); });
+        reader.setFirstRecord(first_record);
+        vector<string> lines;
+        for (auto& rec: reader)
+        {
+            lines.push_back(rec->name() + ":" + rec->get_field_value("NAME"));
+        }
+        return lines;
+    };
+
+    string plain = "/tmp/rbf_test_world.txt", compressed = "/tmp/rbf_test_world.txt.gz";
+    ofstream(plain, ios::binary) << data;
+    auto lines = read_lines(plain, 0);
+    auto half = data.size() / 2 + 3;
+
+    if (codec_available(Codec::DEFLATE))
+    {
+        // two members, split within a line
+        ofstream(compressed, ios::binary) << gzip_member(data.substr(0, half)) + gzip_member(data.substr(half));
+        assert(input_format(compressed) == InputFormat::GZIP);
+        assert(read_lines(compressed, 0) == lines);
+        assert(read_lines(compressed, 1000) == vector<string>(lines.begin() + 1000, lines.end()));
+
+        // truncated and corrupted files
+        auto member = gzip_member(world);
+        for (auto bad: {member.substr(0, member.size() / 2), member.substr(0, 20) + string(100, 'x')})
+        {
+            ofstream(compressed, ios::binary) << bad;
+            try
+            {
+                read_lines(compressed, 0);
+                assert(false);
+            }
+            catch (runtime_error&)
+            {
+            }
+        }
+    }
+
+    if (codec_available(Codec::ZSTD))
+    {
+        string skippable("\x50\x2a\x4d\x18\x04\0\0\0abcd", 12);
+        auto third = data.size() / 3 + 5;
+
+        // frames decompressed in parallel, a skippable frame between them, split within lines
+        ofstream(compressed, ios::binary) << zstd_frame(data.substr(0, third)) + skippable +
+            zstd_frame(data.substr(third, third)) + zstd_frame(data.substr(2 * third));
+        assert(input_format(compressed) == InputFormat::ZSTD);
+        assert(read_lines(compressed, 0) == lines);
+        assert(read_lines(compressed, 1000) == vector<string>(lines.begin() + 1000, lines.end()));
+
+        // frames of unknown size are streamed, up to the end of the file
+        ofstream(compressed, ios::binary) << zstd_stream_frame(data);
+        assert(read_lines(compressed, 0) == lines);
+        ofstream(compressed, ios::binary) << zstd_frame(data.substr(0, half)) + zstd_stream_frame(data.substr(half, 1000)) +
+            zstd_stream_frame("") + zstd_frame(data.substr(half + 1000));
+        assert(read_lines(compressed, 0) == lines);
+
+        // truncated frames, found before or while streaming
+        auto frame = zstd_frame(world), stream = zstd_stream_frame(world);
+        for (auto bad: {frame.substr(0, frame.size() / 2), stream.substr(0, stream.size() / 2),
+                        stream + stream.substr(0, stream.size() / 2), stream + stream.substr(0, 3)})
+        {
+            ofstream(compressed, ios::binary) << bad;
+            try
+            {
+                read_lines(compressed, 0);
+                assert(false);
+            }
+            catch (runtime_error&)
+            {
+            }
+        }
+    }
+
+    remove(plain.c_str());
+    remove(compressed.c_str());
+}
+
+void test_filter()
+{
+    Layout layout{xmlfile};
+    Reader reader(rbffile, layout, [](string s) { return s.substr(0,4); });
+
+    // names of countries matching a filter, and of those selected from their field values
+    auto filtered = [&](const Filter& filter) {
+        vector<string> names;
+        reader.for_each_matching(filter, [&](RecordPtr& rec) { names.push_back(rec->get_field_value("NAME")); });
+        return names;
+    };
+    auto selected = [&](function<bool (RecordPtr&)> keep) {
+        vector<string> names;
+        for (auto& rec: reader)
+        {
+            if (rec->name() == "COUN" && keep(rec))
+                names.push_back(rec->get_field_value("NAME"));
+        }
+        return names;
+    };
+    auto population = [](RecordPtr& rec) { return rec->get<int64_t>(rec->handle("POPULATION")); };
+
+    Filter china(*layout["COUN"]);
+    china.equal("NAME", "China");
+    assert(filtered(china) == vector<string>({"China"}));
+
+    Filter prefix(*layout["COUN"]);
+    prefix.prefix("NAME", "China");
+    assert(filtered(prefix) == selected([](RecordPtr& rec) { return rec->get_field_value("NAME").compare(0, 5, "China") == 0; }));
+    assert(filtered(prefix).size() == 4);
+
+    Filter capitals(*layout["COUN"]);
+    capitals.in("CAPITAL", {"Paris", "Rome", "Tokyo", "Nowhere"});
+    assert(filtered(capitals) == selected([](RecordPtr& rec) {
+        auto capital = rec->get_field_value("CAPITAL");
+        return capital == "Paris" || capital == "Rome" || capital == "Tokyo";
+    }));
+    assert(filtered(capitals).size() == 3);
+
+    // numbers and ranges, chained
+    Filter large(*layout["COUN"]);
+    large.at_least("POPULATION", 100000000).at_most("NAME", "M");
+    assert(filtered(large) == selected([&](RecordPtr& rec) {
+        return population(rec) >= 100000000 && rec->get_field_value("NAME") <= "M";
+    }));
+    assert(!filtered(large).empty() && large.size() == 2);
+
+    Filter range(*layout["COUN"]);
+    range.between("POPULATION", string("1000000"), string("2000000.5")).between("NAME", "A", "Czz");
+    assert(filtered(range) == selected([&](RecordPtr& rec) {
+        auto name = rec->get_field_value("NAME");
+        return population(rec) >= 1000000 && population(rec) <= 2000000 && name >= "A" && name <= "Czz";
+    }));
+
+    // decimal field with a decimal point
+    Filter dense(*layout["CONT"]);
+    dense.between("DENSITY", Decimal{295, 1}, Decimal{30, 0});
+    vector<string> continents;
+    reader.for_each_matching(dense, [&](RecordPtr& rec) { continents.push_back(rec->get_field_value("NAME")); });
+    assert(continents == vector<string>({"Asia"}));
+
+    // short lines: missing bytes are blanks
+    string line = "COUNFrance";
+    Filter france(*layout["COUN"]);
+    france.equal("NAME", "France");
+    assert(france.match(line) && !france.match(line.substr(0, 8)));
+    Filter blank(*layout["COUN"]);
+    blank.equal("CAPITAL", "");
+    assert(blank.match(line));
+    Filter indented(*layout["COUN"]);
+    indented.equal("NAME", "  France");
+    assert(!indented.match(line) && indented.match("COUN  France"));
+    Filter number(*layout["COUN"]);
+    number.at_least("POPULATION", 0);
+    assert(!number.match(line));
+
+    // packed, zoned and date fields of EBCDIC records
+    Layout payments{"./test/payment.xml"};
+    Reader payment_reader("./test/payment.dat", payments, [](string s) { return s.substr(0,4); });
+    payment_reader.setRecordLength(31);
+    payment_reader.setCodePage(CodePage::IBM037, true);
+
+    auto accounts = [&](const Filter& filter) {
+        vector<string> names;
+        payment_reader.for_each_matching(filter, [&](RecordPtr& rec) { names.push_back(rec->get_field_value("ACCOUNT")); });
+        return names;
+    };
+
+    Filter paid(*payments["PAYM"]);
+    paid.at_least("AMOUNT", string("0")).in("COUNT", {3, 10});
+    assert(accounts(paid) == vector<string>({"SMITH", "O'HARA"}));
+
+    Filter recent(*payments["PAYM"]);
+    recent.between("DATE", Date::from_civil(2015, 1, 1), Date::from_civil(2015, 12, 31));
+    assert(accounts(recent) == vector<string>({"DOE"}));
+
+    Filter old(*payments["PAYM"]);
+    old.at_most("DATE", "19991231").prefix("ACCOUNT", "O'");
+    assert(accounts(old) == vector<string>({"O'HARA"}));
+
+    // constants which can't be compared
+    Filter bad(*layout["COUN"]);
+    for (auto add: vector<function<void ()>>{
+        [&]() { bad.equal("NAME", 12); },
+        [&]() { bad.prefix("POPULATION", "1"); },
+        [&]() { bad.equal("POPULATION", "12x"); },
+        [&]() { bad.equal("NAME", string(1000, 'x')); },
+        [&]() { bad.prefix("NAME", string(1000, 'x')); },
+        [&]() { bad.equal("NO_SUCH_FIELD", "x"); } })
+    {
+        try
+        {
+            add();
+            assert(false);
+        }
+        catch (runtime_error&)
+        {
+        }
+    }
+    assert(bad.size() == 0);
+}
+
+void test_batch()
+{
+    // selection bitmap
+    Selection selection(130);
+    assert(selection.size() == 130 && selection.nb_words() == 3 && selection.count() == 130);
+    assert(selection.word(2) == 3);
+    selection.clear(0);
+    selection.clear(129);
+    assert(!selection.test(0) && selection.test(1) && selection.count() == 128);
+    vector<size_t> selected;
+    selection.for_each([&](size_t i) { selected.push_back(i); });
+    assert(selected.size() == 128 && selected.front() == 1 && selected.back() == 128);
+    selection.select_all(0);
+    assert(selection.none() && selection.count() == 0);
+
+    Layout layout{xmlfile};
+    Reader reader(rbffile, layout, [](string s) { return s.substr(0,4); });
+
+    // lines are blank-padded, or truncated, to the record length
+    RecordBatch batch(*layout["COUN"], 2);
+    auto length = layout["COUN"]->length();
+    batch.push_back("COUNFrance");
+    batch.push_back(string(length + 5, 'x'));
+    assert(batch.full() && batch.stride() == length);
+    assert(batch.line(0) == "COUNFrance" && string(batch.row(0), length) == "COUNFrance" + string(length - 10, ' '));
+    assert(batch.line(1) == string(length, 'x'));
+    try
+    {
+        batch.push_back("COUN");
+        assert(false);
+    }
+    catch (length_error&)
+    {
+    }
+
+    // same lines selected one at a time and by batches, with groups of 64 lines partially filled
+    auto same = [&](const Filter& filter) {
+        vector<string> lines, batched;
+        auto record_length = layout[filter.record_name()]->length();
+        for (auto it = reader.begin(), last = reader.end(); it != last; ++it)
+        {
+            if (it.map() == filter.record_name() && filter.match(it.line()))
+                lines.push_back(it.line().substr(0, record_length));
+        }
+        for (auto capacity: {BATCH_SIZE, size_t{70}, size_t{1}})
+        {
+            batched.clear();
+            reader.for_each_selected(filter, [&](const RecordBatch& b, const Selection& s) {
+                s.for_each([&](size_t i) { batched.push_back(b.line(i)); });
+            }, capacity);
+            if (batched != lines)
+                return false;
+        }
+        return !lines.empty();
+    };
+
+    Filter china(*layout["COUN"]);
+    china.equal("NAME", "China");
+    assert(same(china));
+
+    Filter prefix(*layout["COUN"]);
+    prefix.prefix("NAME", "China");
+    assert(same(prefix));
+
+    Filter capitals(*layout["COUN"]);
+    capitals.in("CAPITAL", {"Paris", "Rome", "Tokyo", "Nowhere"});
+    assert(same(capitals));
+
+    Filter large(*layout["COUN"]);
+    large.at_least("POPULATION", 100000000).at_most("NAME", "M");
+    assert(same(large));
+
+    Filter range(*layout["COUN"]);
+    range.between("POPULATION", string("1000000"), string("2000000.5")).between("NAME", "A", "Czz");
+    assert(same(range));
+
+    Filter populations(*layout["COUN"]);
+    populations.in("POPULATION", {Decimal{1, 0}, Decimal{1338100000, 0}, Decimal{1274000000, 1}, Decimal{314, 2}});
+    assert(same(populations));
+
+    Filter dense(*layout["CONT"]);
+    dense.between("DENSITY", Decimal{295, 1}, Decimal{30, 0});
+    assert(same(dense));
+
+    // batches without any matching line are skipped
+    Filter none(*layout["COUN"]);
+    none.equal("NAME", "Atlantis").at_least("POPULATION", 0);
+    vector<string> lines;
+    reader.for_each_selected(none, [&](const RecordBatch& b, const Selection&) { lines.push_back(b.line(0)); });
+    assert(lines.empty());
+
+    // batches of another record
+    RecordBatch continents(*layout["CONT"]);
+    try
+    {
+        china.select(continents, selection);
+        assert(false);
+    }
+    catch (runtime_error&)
+    {
+    }
+
+    // EBCDIC records, with packed, zoned and date fields
+    Layout payments{"./test/payment.xml"};
+    Reader payment_reader("./test/payment.dat", payments, [](string s) { return s.substr(0,4); });
+    payment_reader.setRecordLength(31);
+    payment_reader.setCodePage(CodePage::IBM037, true);
+
+    Filter paid(*payments["PAYM"]);
+    paid.at_least("AMOUNT", string("0")).in("COUNT", {3, 10});
+    Filter recent(*payments["PAYM"]);
+    recent.between("DATE", Date::from_civil(2015, 1, 1), Date::from_civil(2015, 12, 31));
+
+    for (auto filter: {&paid, &recent})
+    {
+        size_t matching = 0, selected_lines = 0;
+        for (auto it = payment_reader.begin(), last = payment_reader.end(); it != last; ++it)
+        {
+            if (it.map() == "PAYM" && filter->match(it.line()))
+                matching++;
+        }
+        payment_reader.for_each_selected(*filter, [&](const RecordBatch&, const Selection& s) { selected_lines += s.count(); });
+        assert(matching > 0 && selected_lines == matching);
+    }
+}
+
+void test_aggregate()
+{
+    // states
+    AggregateState state;
+    state.add(Decimal{125, 1});
+    state.add(Decimal{-3, 0});
+    state.add(Decimal{1, 2});
+    assert(state.count == 3 && state.sum == 951 && state.scale == 2);
+    assert(state.result(Aggregate::MIN).mantissa == -3 && state.result(Aggregate::MAX).mantissa == 125);
+    auto avg = state.result(Aggregate::AVG);
+    assert(avg.mantissa == 3170000 && avg.scale == 6);
+    AggregateState other;
+    other.add(Decimal{numeric_limits<int64_t>::max(), 0});
+    assert(!other.merge(other) && !other.add(Decimal{1, 0}));
+    assert(AggregateState{}.result(Aggregate::AVG).mantissa == 0);
+    assert(AggregateState{}.is_null(Aggregate::MIN) && !AggregateState{}.is_null(Aggregate::COUNT) && !state.is_null(Aggregate::MIN));
+
+    Layout layout{xmlfile};
+    Reader reader(rbffile, layout, [](string s) { return s.substr(0,4); });
+    auto mapper = [](string s) { return s.substr(0,4); };
+
+    // continents: a single group
+    Aggregator continents(*layout["CONT"]);
+    continents.group_by("ID").add(Aggregate::COUNT).add(Aggregate::SUM, "DENSITY").add(Aggregate::AVG, "DENSITY")
+        .add(Aggregate::MIN, "DENSITY").add(Aggregate::MAX, "DENSITY");
+    assert(continents.run(rbffile, mapper) == 7);
+    auto groups = continents.results();
+    assert(groups.size() == 1 && groups[0].keys == vector<string>({"CONT"}));
+    assert(groups[0].values[0].mantissa == 7);
+    assert(groups[0].values[1].mantissa == 1003 && groups[0].values[1].scale == 1);
+    assert(groups[0].values[2].mantissa == 1432857 && groups[0].values[2].scale == 5);
+    assert(groups[0].values[3].mantissa == 59 && groups[0].values[4].mantissa == 295);
+
+    // countries by capital, compared with sums computed from the reader
+    map<string, pair<int64_t, int64_t>> expected;
+    for (auto& rec: reader)
+    {
+        if (rec->name() != "COUN")
+            continue;
+        auto& e = expected[rec->get_field_value("CAPITAL")];
+        e.first++;
+        e.second += rec->get<int64_t>(rec->handle("POPULATION"));
+    }
+
+    auto check = [&](Aggregator& capitals, size_t repeat) {
+        auto results = capitals.results();
+        assert(results.size() == expected.size());
+        for (auto const &group: results)
+        {
+            auto& e = expected.at(group.keys[0]);
+            assert(group.values[0].mantissa == e.first * static_cast<int64_t>(repeat));
+            assert(group.values[1].mantissa == e.second * static_cast<int64_t>(repeat));
+        }
+    };
+
+    Aggregator capitals(*layout["COUN"]);
+    auto population = layout["COUN"]->handle("POPULATION");
+    capitals.group_by(layout["COUN"]->handle("CAPITAL")).add(Aggregate::COUNT).add(Aggregate::SUM, population);
+    capitals.run(rbffile, mapper);
+    assert(!capitals.spilled() && capitals.size() == expected.size());
+    check(capitals, 1);
+
+    // several chunks, aggregated by several threads, and spilled
+    string big = "/tmp/rbf_test_world_big.txt";
+    {
+        ifstream in(rbffile, ios::binary);
+        string data((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+        ofstream out(big, ios::binary);
+        for (size_t i = 0; i < 600; i++)
+            out << data;
+    }
+    assert(capitals.run(big, mapper, 4) == 600 * 198);
+    check(capitals, 601);
+
+    Aggregator spilled(*layout["COUN"]);
+    spilled.group_by("CAPITAL").add(Aggregate::COUNT).add(Aggregate::SUM, "POPULATION");
+    spilled.setMemoryLimit(2000);
+    spilled.run(big, mapper, 4);
+    assert(spilled.spilled() && spilled.size() == 0);
+    check(spilled, 600);
+    check(spilled, 600);
+
+    // partitions holding more groups than the limit, split again
+    Aggregator split(*layout["COUN"]);
+    split.group_by("CAPITAL").add(Aggregate::COUNT).add(Aggregate::SUM, "POPULATION");
+    split.setMemoryLimit(400);
+    split.run(big, mapper, 4);
+    assert(split.spilled());
+    check(split, 600);
+
+    // dates filtered by several threads at once
+    Layout payments{"./test/payment.xml"};
+    string dated = "/tmp/rbf_test_aggregate_dates.dat";
+    map<string, pair<int64_t, int64_t>> paid;
+    {
+        Writer writer(dated, payments);
+        writer.setDelimiter("");
+        auto first = Date::from_civil(2015, 1, 1);
+        for (int64_t i = 0; i < 20000; i++)
+        {
+            Date date;
+            date.days = first.days + i % 365;
+            auto account = "ACC" + to_string(i % 7);
+            writer.write("PAYM", "PAYM", account, Decimal{i, 2}, 1, date);
+            if (date.days >= Date::from_civil(2015, 3, 1).days && date.days <= Date::from_civil(2015, 6, 30).days)
+            {
+                paid[account].first++;
+                paid[account].second += i;
+            }
+        }
+    }
+
+    Filter spring(*payments["PAYM"]);
+    spring.between("DATE", Date::from_civil(2015, 3, 1), Date::from_civil(2015, 6, 30));
+    Aggregator by_account(*payments["PAYM"]);
+    by_account.group_by("ACCOUNT").add(Aggregate::COUNT).add(Aggregate::SUM, "AMOUNT");
+    by_account.setFilter(spring);
+    by_account.setRecordLength(31);
+    auto nb_lines = by_account.run(dated, [](string s) { return s.substr(0,4); }, 4);
+    auto accounts = by_account.results();
+    assert(accounts.size() == paid.size());
+    for (auto const &group: accounts)
+    {
+        auto& e = paid.at(group.keys[0]);
+        nb_lines -= e.first;
+        assert(group.values[0].mantissa == e.first && group.values[1].mantissa == e.second);
+    }
+    assert(nb_lines == 0);
+    remove(dated.c_str());
+
+    // lines aggregated one at a time, filtered
+    Filter large(*layout["COUN"]);
+    large.at_least("POPULATION", 100000000);
+    Aggregator streaming(*layout["COUN"]);
+    streaming.group_by("ID").add(Aggregate::COUNT);
+    streaming.setFilter(large);
+    reader.for_each_line([&](const string& line) {
+        if (line.compare(0, 4, "COUN") == 0)
+            streaming.update(line);
+    });
+    assert(streaming.results()[0].values[0].mantissa == 12);
+    streaming.clear();
+    assert(streaming.size() == 0 && streaming.results().empty());
+
+    // groups whose values are all blank have null aggregates, unlike zeros
+    Aggregator blanks(*layout["COUN"]);
+    blanks.group_by("CAPITAL").add(Aggregate::COUNT).add(Aggregate::COUNT, "POPULATION").add(Aggregate::SUM, "POPULATION")
+        .add(Aggregate::MIN, "POPULATION").add(Aggregate::MAX, "POPULATION").add(Aggregate::AVG, "POPULATION");
+    blanks.update("COUN" + string(30, ' ') + string(20, ' ') + "Nowhere" + string(13, ' '));
+    blanks.update("COUN" + string(30, ' ') + string(19, ' ') + "0" + "Zero" + string(16, ' '));
+    auto blank_groups = blanks.results();
+    sort(blank_groups.begin(), blank_groups.end(), [](const GroupResult& a, const GroupResult& b) { return a.keys < b.keys; });
+    assert(blank_groups.size() == 2 && blank_groups[0].keys[0] == "Nowhere" && blank_groups[1].keys[0] == "Zero");
+    assert(blank_groups[0].nulls == vector<bool>({false, false, true, true, true, true}));
+    assert(blank_groups[0].values[0].mantissa == 1 && blank_groups[0].values[1].mantissa == 0);
+    assert(blank_groups[1].nulls == vector<bool>(6, false));
+    assert(blank_groups[1].values[3].mantissa == 0 && blank_groups[1].values[4].mantissa == 0);
+
+    // fields which can't be aggregated
+    for (auto add: vector<function<void ()>>{
+        [&]() { streaming.add(Aggregate::SUM, "NAME"); },
+        [&]() { streaming.add(Aggregate::SUM); },
+        [&]() { streaming.group_by(99); },
+        [&]() { streaming.setFilter(Filter(*layout["CONT"])); },
+        [&]() { capitals.group_by("NAME"); } })
+    {
+        try
+        {
+            add();
+            assert(false);
+        }
+        catch (runtime_error&)
+        {
+        }
+    }
+
+    remove(big.c_str());
 }
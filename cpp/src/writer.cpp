@@ -0,0 +1,232 @@
+#include <cerrno>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include <writer.h>
+
+namespace rbf
+{
+
+    Writer::Writer(const string& file_name, Layout& layout, size_t buffer_size): 
+        _file_name{file_name}, _layout{layout}, _size{buffer_size}
+    {
+        _delimiter[0] = '\n';
+
+        // a buffer holds at least one record
+        for (auto const &kv: _layout)
+        {
+            _size = max(_size, kv.second->length() + sizeof(_delimiter));
+        }
+        _buffer.reset(new char[_size]);
+
+        _fd = ::open(_file_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (_fd < 0)
+            throw runtime_error("unable to create file " + _file_name + ": " + strerror(errno));
+    }
+
+    Writer::~Writer()
+    {
+        try
+        {
+            close();
+        }
+        catch (...)
+        {
+        }
+    }
+
+    void Writer::setDelimiter(const string& delimiter)
+    {
+        if (delimiter.length() > sizeof(_delimiter))
+            throw runtime_error("record delimiter too long");
+
+        memcpy(_delimiter, delimiter.data(), delimiter.length());
+        _delimiter_length = delimiter.length();
+    }
+
+    void Writer::write_all(struct iovec *iov, int count)
+    {
+        while (count > 0)
+        {
+            auto n = ::writev(_fd, iov, count);
+            if (n < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                throw runtime_error("unable to write file " + _file_name + ": " + strerror(errno));
+            }
+
+            // skip what's been written
+            auto written = static_cast<size_t>(n);
+            while (count > 0 && written >= iov->iov_len)
+            {
+                written -= iov->iov_len;
+                iov++;
+                count--;
+            }
+            if (count > 0)
+            {
+                iov->iov_base = static_cast<char *>(iov->iov_base) + written;
+                iov->iov_len -= written;
+            }
+        }
+    }
+
+    char *Writer::reserve(size_t length)
+    {
+        if (_used + length + _delimiter_length > _size)
+            flush();
+
+        // a record not in the layout (or grown since) may not fit in the empty buffer
+        if (length + _delimiter_length > _size)
+        {
+            _size = length + _delimiter_length;
+            _buffer.reset(new char[_size]);
+        }
+        return _buffer.get() + _used;
+    }
+
+    void RecordEncoder::check(ConvStatus status, const Field& f)
+    {
+        if (status != ConvStatus::OK)
+            throw runtime_error("field " + f.name() + ": " + conv_message(status));
+    }
+
+    void RecordEncoder::encode(const Record& rec, char *p)
+    {
+        for (auto const &f: rec)
+        {
+            auto data_type = f.type().data_type();
+            if (data_type == DataType::PACKED || data_type == DataType::ZONED)
+                memcpy(p + f.lower_bound(), f.raw_data(), f.length());
+            else
+                check(f.type().encode(p + f.lower_bound(), f.length(), f.raw_data(), f.raw_length()), f);
+        }
+    }
+
+    void Writer::write_raw(const char *p, size_t len)
+    {
+        if (_fd < 0)
+            throw runtime_error("file " + _file_name + " is closed");
+
+        if (_used + len <= _size)
+        {
+            memcpy(_buffer.get() + _used, p, len);
+            _used += len;
+            return;
+        }
+
+        // buffer and block at once
+        struct iovec iov[2];
+        iov[0].iov_base = _buffer.get();
+        iov[0].iov_len = _used;
+        iov[1].iov_base = const_cast<char *>(p);
+        iov[1].iov_len = len;
+
+        _used = 0;
+        write_all(iov, 2);
+    }
+
+    void Writer::flush()
+    {
+        if (_used == 0)
+            return;
+        if (_fd < 0)
+            throw runtime_error("file " + _file_name + " is closed");
+
+        struct iovec iov;
+        iov.iov_base = _buffer.get();
+        iov.iov_len = _used;
+
+        _used = 0;
+        write_all(&iov, 1);
+    }
+
+    void Writer::close()
+    {
+        if (_fd < 0)
+            return;
+
+        flush();
+        auto fd = _fd;
+        _fd = -1;
+        if (::close(fd) != 0)
+            throw runtime_error("unable to close file " + _file_name + ": " + strerror(errno));
+    }
+
+    MappedWriter::MappedWriter(const string& file_name, Layout& layout, size_t nb_records, const string& delimiter, size_t record_length):
+        _file_name{file_name}, _layout{layout}, _nb_records{nb_records}, _record_length{record_length}
+    {
+        if (delimiter.length() > sizeof(_delimiter))
+            throw runtime_error("record delimiter too long");
+        memcpy(_delimiter, delimiter.data(), delimiter.length());
+        _delimiter_length = delimiter.length();
+
+        // slots hold the longest record by default
+        if (_record_length == 0)
+        {
+            for (auto const &kv: _layout)
+            {
+                _record_length = max(_record_length, kv.second->length());
+            }
+        }
+
+        _fd = ::open(_file_name.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (_fd < 0)
+            throw runtime_error("unable to create file " + _file_name + ": " + strerror(errno));
+
+        _map_size = _nb_records * (_record_length + _delimiter_length);
+        if (_map_size == 0)
+            return;
+
+        if (::ftruncate(_fd, static_cast<off_t>(_map_size)) != 0)
+        {
+            auto error = string(strerror(errno));
+            ::close(_fd);
+            throw runtime_error("unable to size file " + _file_name + ": " + error);
+        }
+
+        auto map = ::mmap(nullptr, _map_size, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+        if (map == MAP_FAILED)
+        {
+            auto error = string(strerror(errno));
+            ::close(_fd);
+            throw runtime_error("unable to map file " + _file_name + ": " + error);
+        }
+        _map = static_cast<char *>(map);
+    }
+
+    MappedWriter::~MappedWriter()
+    {
+        try
+        {
+            close();
+        }
+        catch (...)
+        {
+        }
+    }
+
+    void MappedWriter::close()
+    {
+        if (_fd < 0)
+            return;
+
+        string error;
+        if (_map && ::munmap(_map, _map_size) != 0)
+            error = strerror(errno);
+        _map = nullptr;
+
+        auto fd = _fd;
+        _fd = -1;
+        if (::close(fd) != 0 && error.empty())
+            error = strerror(errno);
+
+        if (!error.empty())
+            throw runtime_error("unable to close file " + _file_name + ": " + error);
+    }
+
+}